@@ -0,0 +1,184 @@
+// Frustum culling of a large object field: BVH vs. testing every object.
+//
+// Scatters 100000 boxes with random rotations and scales through a cube of
+// space and culls them against cameras looking from inside and outside the
+// field, once with ObjectBvh (four boxes per SIMD plane test, whole subtrees
+// accepted or rejected at once) and once by testing every box with
+// Frustum::intersects. Both must find the same objects. It then moves a share
+// of the objects and compares refitting the BVH with building it again,
+// checking the refit tree still culls exactly. Exits with 1 if a check fails.
+// Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -Isrc bench/cull_bench.cpp src/Frustum.cpp src/ObjectBvh.cpp -o cull_bench
+//   ./cull_bench [--objects N] [--repeat N]
+
+#include "Frustum.h"
+#include "ObjectBvh.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const float fieldSize = 200.0f;
+
+struct View
+{
+	const char* name;
+	glm::vec3 eye;
+	glm::vec3 target;
+	float fov;
+};
+
+// average milliseconds of one call
+static double timeMs(int repeat, const std::function<void()>& work)
+{
+	work();
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < repeat; i++) {
+		work();
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / repeat;
+}
+
+static glm::mat4 randomTransform(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	glm::vec3 position = (glm::vec3(unit(random), unit(random), unit(random)) - 0.5f) * fieldSize;
+	glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) - 0.5f + 1e-4f);
+	float angle = unit(random) * 6.2831853f;
+	glm::vec3 scale = glm::vec3(0.5f) + 1.5f * glm::vec3(unit(random), unit(random), unit(random));
+	return glm::translate(position) * glm::rotate(angle, axis) * glm::scale(scale);
+}
+
+static void cullLinear(const Frustum& frustum, const std::vector<Aabb>& boxes, std::vector<uint32_t>& visible)
+{
+	visible.clear();
+	for (uint32_t i = 0; i < boxes.size(); i++) {
+		if (frustum.intersects(boxes[i])) {
+			visible.push_back(i);
+		}
+	}
+}
+
+// the BVH returns objects in tree order
+static bool sameObjects(std::vector<uint32_t> bvhVisible, const std::vector<uint32_t>& linearVisible)
+{
+	std::sort(bvhVisible.begin(), bvhVisible.end());
+	return bvhVisible == linearVisible;
+}
+
+int main(int argc, char** argv)
+{
+	int objectCount = 100000;
+	int repeat = 20;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--objects" && i + 1 < argc) {
+			objectCount = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--repeat" && i + 1 < argc) {
+			repeat = std::max(atoi(argv[++i]), 1);
+		}
+		else {
+			printf("Unknown argument %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	// a unit cube, like a mesh's bounds in its own space
+	Aabb meshBounds;
+	meshBounds.min = glm::vec3(-0.5f);
+	meshBounds.max = glm::vec3(0.5f);
+
+	std::mt19937 random(1);
+	std::vector<glm::mat4> transforms(objectCount);
+	std::vector<Aabb> boxes(objectCount);
+	for (int i = 0; i < objectCount; i++) {
+		transforms[i] = randomTransform(random);
+		boxes[i] = TransformAabb(meshBounds, transforms[i]);
+	}
+
+	ObjectBvh bvh;
+	double buildMs = timeMs(std::max(repeat / 4, 1), [&]() { bvh.build(boxes); });
+	printf("%d objects, BVH of %zu nodes built in %.3f ms\n", objectCount, bvh.nodeCount(), buildMs);
+
+	const float half = 0.5f * fieldSize;
+	const View views[] = {
+		{ "inside +z", glm::vec3(0.0f), glm::vec3(0, 0, 1), 60.0f },
+		{ "inside -x", glm::vec3(0.0f), glm::vec3(-1, 0, 0), 60.0f },
+		{ "inside narrow", glm::vec3(0.0f), glm::vec3(1, 1, 1), 20.0f },
+		{ "corner", glm::vec3(half), glm::vec3(0.0f), 60.0f },
+		{ "outside all", glm::vec3(0, 0, 3.0f * fieldSize), glm::vec3(0.0f), 60.0f },
+		{ "looking away", glm::vec3(0, 0, 2.0f * fieldSize), glm::vec3(0, 0, 3.0f * fieldSize), 60.0f },
+	};
+
+	bool ok = true;
+	std::vector<uint32_t> bvhVisible;
+	std::vector<uint32_t> linearVisible;
+	printf("%-14s %9s %12s %10s %9s\n", "view", "visible", "linear ms", "bvh ms", "speedup");
+	for (const View& view : views) {
+		glm::vec3 up = std::abs(glm::normalize(view.target - view.eye).y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+		glm::mat4 clip = glm::perspective(glm::radians(view.fov), 16.0f / 9.0f, 0.1f, 4.0f * fieldSize)
+			* glm::lookAt(view.eye, view.target, up);
+		Frustum frustum(clip);
+
+		double linearMs = timeMs(repeat, [&]() { cullLinear(frustum, boxes, linearVisible); });
+		double bvhMs = timeMs(repeat, [&]() { bvh.cull(frustum, bvhVisible); });
+		printf("%-14s %9zu %12.3f %10.3f %8.2fx\n", view.name, linearVisible.size(), linearMs, bvhMs,
+			linearMs / std::max(bvhMs, 1e-6));
+		if (!sameObjects(bvhVisible, linearVisible)) {
+			printf("FAIL: the BVH found %zu objects, testing each %zu\n", bvhVisible.size(), linearVisible.size());
+			ok = false;
+		}
+	}
+
+	// move some objects a little, as an animated scene would
+	glm::mat4 clip = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 4.0f * fieldSize)
+		* glm::lookAt(glm::vec3(0.0f), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0));
+	Frustum frustum(clip);
+	std::uniform_real_distribution<float> step(-2.0f, 2.0f);
+	printf("%-14s %12s %12s\n", "moved", "refit ms", "rebuild ms");
+	for (double share : { 0.001, 0.01, 0.1, 1.0 }) {
+		int moved = std::max((int)(objectCount * share), 1);
+		std::vector<uint32_t> movedObjects(moved);
+		for (int i = 0; i < moved; i++) {
+			movedObjects[i] = (uint32_t)(random() % objectCount);
+			glm::vec3 offset(step(random), step(random), step(random));
+			transforms[movedObjects[i]] = glm::translate(offset) * transforms[movedObjects[i]];
+			boxes[movedObjects[i]] = TransformAabb(meshBounds, transforms[movedObjects[i]]);
+		}
+
+		Clock::time_point start = Clock::now();
+		for (uint32_t object : movedObjects) {
+			bvh.refit(object, boxes[object]);
+		}
+		double refitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		bvh.cull(frustum, bvhVisible);
+		cullLinear(frustum, boxes, linearVisible);
+		if (!sameObjects(bvhVisible, linearVisible)) {
+			printf("FAIL: the refit BVH found %zu objects, testing each %zu\n", bvhVisible.size(),
+				linearVisible.size());
+			ok = false;
+		}
+
+		ObjectBvh rebuilt;
+		start = Clock::now();
+		rebuilt.build(boxes);
+		double rebuildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		printf("%-14d %12.3f %12.3f\n", moved, refitMs, rebuildMs);
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
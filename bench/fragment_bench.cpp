@@ -0,0 +1,236 @@
+// Fragment shading cost at high resolution.
+//
+// Draws the sphere mesh scaled to cover the whole target, `layers` times per
+// frame with the depth test off so every layer is shaded, into an offscreen
+// width x height framebuffer. Compares the original shaders (kept in
+// bench/shaders/legacy.*: inverse(model) per fragment, material if-chain,
+// uniforms looked up on every draw) with the specialized variants of
+// shaders/shader.* for both render modes, using GL_TIME_ELAPSED queries.
+// The images of both are compared first. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc bench/fragment_bench.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/VertexWeld.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lglfw -lGLEW -lGL -o fragment_bench
+//   ./fragment_bench [width height layers]     (defaults to 3840 2160 8)
+
+#include "ShaderProgram.h"
+#include "Material.h"
+#include "Mesh.h"
+
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+static const int warmupFrames = 20;
+static const int timedFrames = 100;
+
+// GPU milliseconds per frame of drawFrame
+static double timeFrames(const std::function<void()>& drawFrame)
+{
+	for (int i = 0; i < warmupFrames; i++) {
+		drawFrame();
+	}
+	glFinish();
+
+	std::vector<GLuint> queries(timedFrames);
+	glGenQueries(timedFrames, queries.data());
+	for (int i = 0; i < timedFrames; i++) {
+		glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+		drawFrame();
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+	glFinish();
+
+	GLuint64 total = 0;
+	for (GLuint query : queries) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		total += elapsed;
+	}
+	glDeleteQueries(timedFrames, queries.data());
+	return total / 1e6 / timedFrames;
+}
+
+static std::vector<unsigned char> readPixels(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+// everything that needs the context; GL objects are gone when it returns
+static bool runBench(int width, int height, int layers)
+{
+	// offscreen target
+	GLuint framebuffer, color, depth;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Framebuffer incomplete\n");
+		return false;
+	}
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+
+	// the sphere in the app's float layout
+	MeshData mesh;
+	if (!LoadMesh("sphere.obj", mesh)) {
+		return false;
+	}
+	GLuint vao, buffers[3];
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(3, buffers);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.points.size(), mesh.points.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh.normals.size(), mesh.normals.data(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::ivec3) * mesh.faces.size(), mesh.faces.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	GLsizei indexCount = (GLsizei)mesh.faces.size() * 3;
+
+	// app camera; at twice its size the sphere covers the whole target
+	glm::vec3 eyePos(0, 0, 20);
+	glm::vec3 lightPos(-8.0f, 8.0f, 0.0f);
+	glm::mat4 view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+	glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(2.0f));
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+
+	GLuint legacy = LoadShaders("bench/shaders/legacy.vert", "bench/shaders/legacy.frag");
+	ShaderVariants variants;
+	if (!legacy || !variants.load("shaders/shader.vert", "shaders/shader.frag")) {
+		return false;
+	}
+	FrameUniformBuffer frameUniforms;
+	MaterialBuffer materials;
+
+	// one frame the way Geometry::draw did it before
+	auto legacyFrame = [&](int drawLayers, int switchRender) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		for (int i = 0; i < drawLayers; i++) {
+			glUseProgram(legacy);
+			glUniformMatrix4fv(glGetUniformLocation(legacy, "view"), 1, false, glm::value_ptr(view));
+			glUniformMatrix4fv(glGetUniformLocation(legacy, "projection"), 1, false, glm::value_ptr(projection));
+			glUniformMatrix4fv(glGetUniformLocation(legacy, "model"), 1, GL_FALSE, glm::value_ptr(model));
+			glUniform1i(glGetUniformLocation(legacy, "switchRender"), switchRender);
+			glUniform1i(glGetUniformLocation(legacy, "rabbit"), 1);
+			glUniform1i(glGetUniformLocation(legacy, "sandal"), 0);
+			glUniform1i(glGetUniformLocation(legacy, "bear"), 0);
+			glUniform1i(glGetUniformLocation(legacy, "sphere"), 0);
+			glUniform3fv(glGetUniformLocation(legacy, "lightPos"), 1, glm::value_ptr(lightPos));
+			glBindVertexArray(vao);
+			glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+			glBindVertexArray(0);
+			glUseProgram(0);
+		}
+	};
+
+	// one frame the way Geometry::draw does it now
+	auto variantFrame = [&](int drawLayers, int flags) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		FrameUniforms frame;
+		frame.view = view;
+		frame.projection = projection;
+		frame.cameraPos = glm::vec4(eyePos, 1.0f);
+		frame.lightPos = glm::vec4(lightPos, 1.0f);
+		frameUniforms.update(frame);
+
+		const ShaderProgram& shader = variants.get(flags);
+		for (int i = 0; i < drawLayers; i++) {
+			shader.use();
+			glUniformMatrix4fv(shader.location(uniformModel), 1, GL_FALSE, glm::value_ptr(model));
+			glUniformMatrix3fv(shader.location(uniformNormalMatrix), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+			glUniform1i(shader.location(uniformMaterial), materialChrome);
+			glBindVertexArray(vao);
+			glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+			glBindVertexArray(0);
+		}
+	};
+
+	printf("%dx%d, %d layers of %d triangles per frame\n", width, height, layers, indexCount / 3);
+	printf("%-8s %12s %12s %12s %12s %12s\n", "mode", "image diff", "legacy ms", "variant ms",
+		"variant Gpix/s", "speedup");
+
+	bool ok = true;
+	const char* modeNames[2] = { "lit", "normals" };
+	for (int mode = 0; mode < 2; mode++) {
+		int flags = mode ? shaderNormalColoring : 0;
+
+		// both should render the same image, up to rounding
+		legacyFrame(1, mode);
+		std::vector<unsigned char> legacyImage = readPixels(width, height);
+		variantFrame(1, flags);
+		std::vector<unsigned char> variantImage = readPixels(width, height);
+		int difference = 0;
+		for (size_t i = 0; i < legacyImage.size(); i++) {
+			difference = std::max(difference, std::abs((int)legacyImage[i] - (int)variantImage[i]));
+		}
+		ok = ok && difference <= 2;
+
+		double legacyMs = timeFrames([&]() { legacyFrame(layers, mode); });
+		double variantMs = timeFrames([&]() { variantFrame(layers, flags); });
+		double pixels = (double)width * height * layers;
+		printf("%-8s %12d %12.3f %12.3f %12.2f %11.2fx\n", modeNames[mode], difference, legacyMs, variantMs,
+			pixels / (variantMs / 1000.0) / 1e9, legacyMs / variantMs);
+	}
+	if (!ok) {
+		printf("images differ by more than rounding\n");
+	}
+
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(3, buffers);
+	glDeleteProgram(legacy);
+	glDeleteRenderbuffers(1, &color);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteFramebuffers(1, &framebuffer);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	int width = (argc > 2) ? atoi(argv[1]) : 3840;
+	int height = (argc > 2) ? atoi(argv[2]) : 2160;
+	int layers = (argc > 3) ? atoi(argv[3]) : 8;
+
+	// hidden window for the context, same version as the app
+	if (!glfwInit()) {
+		fprintf(stderr, "Failed to initialize GLFW\n");
+		return 1;
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "fragment_bench", NULL, NULL);
+	if (window == NULL) {
+		fprintf(stderr, "Failed to open a GLFW window\n");
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent(window);
+	glewExperimental = GL_TRUE;
+	bool ok = glewInit() == GLEW_OK && runBench(width, height, layers);
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return ok ? 0 : 1;
+}
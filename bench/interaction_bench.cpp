@@ -0,0 +1,303 @@
+// Input handling: drags and scrolls applied one by one to the model matrices
+// against coalesced into one quaternion and scale per frame.
+//
+// Replays a seeded script of mouse input as fast as it can be handled: drags
+// across an 800x600 window, restarted now and then at another point, with
+// scroll steps among them and the interaction mode switched every few
+// thousand events, as keys 4 and 5 do. The script is handled three ways from
+// the cursor positions on: the way the app did, building a rotation or scale
+// matrix per event and multiplying it into the model's and the light's
+// matrices (Geometry::rotated, scaled and movedCloserToModel); folding each
+// event into an InteractionDelta and applying it at once; and applying the
+// delta once per --per-frame events, as the app does once per published
+// frame. A mode switch applies what is pending first, as a key press does.
+// Checks that all three end with the same matrices and light position, up to
+// the rounding the matrices pick up over the script, and reports how far the
+// multiplied matrices drifted from a rotation times a scale, which the
+// quaternions do not. Exits with 1 if a check fails. Run from the repository
+// root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc bench/interaction_bench.cpp src/Interaction.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lGLEW -lGL -o interaction_bench
+//   ./interaction_bench [--events N] [--per-frame N] [--seed N]
+
+#include "Interaction.h"
+#include "SceneState.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int windowWidth = 800;
+static const int windowHeight = 600;
+
+// one input event: a cursor move, a new drag starting at the cursor, a
+// scroll step or a switch to another mode
+struct InputEvent
+{
+	enum Kind { move, press, scroll, modeSwitch };
+	Kind kind;
+	glm::vec2 cursor;
+	int offset;
+	InteractionMode mode;
+};
+
+// Scroll steps do not cancel (1.25 * 0.75 < 1), so each goes the way that
+// brings the sizes it changes back towards where they started.
+static std::vector<InputEvent> makeScript(size_t count, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<InputEvent> script;
+	script.reserve(count);
+	glm::vec2 cursor(windowWidth / 2, windowHeight / 2);
+	InteractionMode mode = interactModel;
+	float objectLog = 0.0f;
+	float lightLog = 0.0f;
+	for (size_t i = 0; i < count; i++) {
+		InputEvent event = { InputEvent::move, cursor, 0, mode };
+		if (i % 5000 == 0) {
+			InteractionMode modes[] = { interactModel, interactLight, interactBoth };
+			mode = modes[(i / 5000) % 3];
+			event.kind = InputEvent::modeSwitch;
+			event.mode = mode;
+		}
+		else if (i % 400 == 1) {
+			cursor = glm::vec2(unit(random) * windowWidth, unit(random) * windowHeight);
+			event.kind = InputEvent::press;
+			event.cursor = cursor;
+		}
+		else if (unit(random) < 0.02f) {
+			float level = mode == interactModel ? objectLog : mode == interactLight ? lightLog : objectLog + lightLog;
+			event.kind = InputEvent::scroll;
+			event.offset = level < 0.0f ? 1 : -1;
+			if (mode != interactLight) {
+				objectLog += std::log(event.offset > 0 ? 1.25f : 0.75f);
+			}
+			if (mode != interactModel) {
+				lightLog += std::log(event.offset > 0 ? 1.2f : 0.8f);
+			}
+		}
+		else {
+			cursor += glm::vec2(unit(random) - 0.5f, unit(random) - 0.5f) * 12.0f;
+			cursor = glm::clamp(cursor, glm::vec2(0.0f), glm::vec2(windowWidth, windowHeight));
+			event.cursor = cursor;
+		}
+		script.push_back(event);
+	}
+	return script;
+}
+
+// the start of the drag under way, and the axis and angle a cursor move
+// turns by as in Window::cursor_position_callback; false if it is too small
+// to count
+static bool dragStep(glm::vec3& lastPoint, const glm::vec2& cursor, glm::vec3& axis, float& angle)
+{
+	glm::vec3 point = TrackballPoint(cursor, windowWidth, windowHeight);
+	float velocity = glm::length(point - lastPoint);
+	if (velocity <= 0.0001) {
+		return false;
+	}
+	axis = glm::cross(lastPoint, point);
+	angle = velocity * 1.5f;
+	lastPoint = point;
+	return true;
+}
+
+// the old way: every event multiplied into the matrices
+static SceneState replayMatrices(const std::vector<InputEvent>& script, SceneState scene)
+{
+	glm::vec3 lastPoint;
+	InteractionMode mode = interactModel;
+	glm::mat4& object = scene.models[scene.current].model;
+	glm::mat4& light = scene.models[sceneLight].model;
+	for (const InputEvent& event : script) {
+		glm::vec3 axis;
+		float angle;
+		switch (event.kind) {
+		case InputEvent::modeSwitch:
+			mode = event.mode;
+			break;
+		case InputEvent::press:
+			lastPoint = TrackballPoint(event.cursor, windowWidth, windowHeight);
+			break;
+		case InputEvent::scroll:
+			if (mode != interactLight) {
+				object = Geometry::scaled(object, event.offset);
+			}
+			if (mode != interactModel) {
+				light = Geometry::movedCloserToModel(light, event.offset);
+				scene.lightPos = glm::vec3(light[3]);
+			}
+			break;
+		case InputEvent::move:
+			if (dragStep(lastPoint, event.cursor, axis, angle)) {
+				if (mode != interactLight) {
+					object = Geometry::rotated(object, axis, angle);
+				}
+				if (mode != interactModel) {
+					light = Geometry::rotated(light, axis, angle);
+					scene.lightPos = glm::vec3(light[3]);
+				}
+			}
+			break;
+		}
+	}
+	return scene;
+}
+
+// events folded into a delta, applied after every perFrame of them
+static SceneState replayDeltas(const std::vector<InputEvent>& script, SceneState scene, int perFrame)
+{
+	glm::vec3 lastPoint;
+	InteractionMode mode = interactModel;
+	InteractionDelta delta;
+	int sinceFrame = 0;
+	for (const InputEvent& event : script) {
+		glm::vec3 axis;
+		float angle;
+		switch (event.kind) {
+		case InputEvent::modeSwitch:
+			ApplyInteraction(delta, scene);
+			mode = event.mode;
+			break;
+		case InputEvent::press:
+			lastPoint = TrackballPoint(event.cursor, windowWidth, windowHeight);
+			break;
+		case InputEvent::scroll:
+			ScrollInteraction(mode, delta, event.offset);
+			break;
+		case InputEvent::move:
+			if (dragStep(lastPoint, event.cursor, axis, angle)) {
+				RotateInteraction(mode, delta, axis, angle);
+			}
+			break;
+		}
+		if (++sinceFrame == perFrame) {
+			ApplyInteraction(delta, scene);
+			sinceFrame = 0;
+		}
+	}
+	ApplyInteraction(delta, scene);
+	return scene;
+}
+
+// largest difference between two matrices, relative to the larger of them
+static float matrixError(const glm::mat4& a, const glm::mat4& b)
+{
+	float difference = 0.0f;
+	float size = 1e-20f;
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) {
+			difference = std::max(difference, std::abs(a[c][r] - b[c][r]));
+			size = std::max(size, std::max(std::abs(a[c][r]), std::abs(b[c][r])));
+		}
+	}
+	return difference / size;
+}
+
+// how far the upper 3x3 of a matrix is from a rotation times a uniform scale
+static float skew(const glm::mat4& matrix)
+{
+	glm::mat3 m(matrix);
+	glm::mat3 gram = glm::transpose(m) * m;
+	float scale = (gram[0][0] + gram[1][1] + gram[2][2]) / 3.0f;
+	float worst = 0.0f;
+	for (int c = 0; c < 3; c++) {
+		for (int r = 0; r < 3; r++) {
+			worst = std::max(worst, std::abs(gram[c][r] / scale - (c == r ? 1.0f : 0.0f)));
+		}
+	}
+	return worst;
+}
+
+int main(int argc, char** argv)
+{
+	size_t eventCount = 1000000;
+	int perFrame = 8;
+	unsigned seed = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--events" && i + 1 < argc) {
+			eventCount = (size_t)std::max(atol(argv[++i]), 1L);
+		}
+		else if (arg == "--per-frame" && i + 1 < argc) {
+			perFrame = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--seed" && i + 1 < argc) {
+			seed = (unsigned)atoi(argv[++i]);
+		}
+		else {
+			printf("Unknown argument %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	std::vector<InputEvent> script = makeScript(eventCount, seed);
+
+	// the sandal turned and scaled off center, the light sphere up and away
+	SceneState initial;
+	initial.current = sceneSandal;
+	initial.models[sceneSandal].model = glm::translate(glm::vec3(0.0f, -2.0f, 0.0f)) *
+		glm::rotate(0.7f, glm::normalize(glm::vec3(1.0f, 2.0f, 0.5f))) * glm::scale(glm::vec3(1.5f));
+	initial.models[sceneLight].model = glm::translate(glm::vec3(10.0f, 10.0f, 10.0f)) * glm::scale(glm::vec3(0.2f));
+	initial.lightPos = glm::vec3(10.0f, 10.0f, 10.0f);
+	for (ModelState& model : initial.models) {
+		model.transform = Transform::fromMatrix(model.model);
+	}
+
+	struct Run
+	{
+		const char* name;
+		int perFrame;
+		SceneState scene;
+		double seconds;
+	};
+	Run runs[] = {
+		{ "matrix per event", 0, SceneState(), 0.0 },
+		{ "delta per event", 1, SceneState(), 0.0 },
+		{ "delta per frame", perFrame, SceneState(), 0.0 },
+	};
+	for (Run& run : runs) {
+		Clock::time_point start = Clock::now();
+		run.scene = run.perFrame == 0 ? replayMatrices(script, initial) : replayDeltas(script, initial, run.perFrame);
+		run.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	printf("%zu events, applied every %d for the last\n\n", eventCount, perFrame);
+	printf("%-18s %16s %12s %12s\n", "handling", "events/s", "model skew", "light skew");
+	for (const Run& run : runs) {
+		printf("%-18s %16.0f %12.2e %12.2e\n", run.name, eventCount / run.seconds,
+			skew(run.scene.models[sceneSandal].model), skew(run.scene.models[sceneLight].model));
+	}
+
+	// the matrices round a little with every product, so how close the
+	// others can be to them shrinks with the number of events
+	float tolerance = std::max(1e-4f, 2e-9f * eventCount);
+	bool ok = true;
+	const SceneState& reference = runs[0].scene;
+	for (int i = 1; i < 3; i++) {
+		const SceneState& scene = runs[i].scene;
+		float modelError = matrixError(scene.models[sceneSandal].model, reference.models[sceneSandal].model);
+		float lightError = matrixError(scene.models[sceneLight].model, reference.models[sceneLight].model);
+		float positionError = glm::length(scene.lightPos - reference.lightPos) / glm::length(reference.lightPos);
+		printf("%s: model %.2e, light %.2e, light position %.2e off the matrices\n", runs[i].name, modelError,
+			lightError, positionError);
+		if (modelError > tolerance || lightError > tolerance || positionError > tolerance) {
+			printf("FAIL: %s does not end where the matrices do\n", runs[i].name);
+			ok = false;
+		}
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+// LOD chain build time and selection check.
+//
+// Builds the LOD chain of each OBJ file the way Geometry does and reports the
+// triangles, error and build time per level. It then shrinks the model with
+// the app's scroll step under the app's camera and checks that the selected
+// level, and with it the triangle count drawn, drops as the model gets smaller,
+// and that a size jittering around a switch point does not flip the level.
+// Exits with 1 if a check fails. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc bench/lod_bench.cpp src/MeshLod.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/VertexWeld.cpp src/MeshOptimizer.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -o lod_bench
+//   ./lod_bench [file.obj ...]     (defaults to sphere.obj and SandalF20.obj)
+
+#include "Mesh.h"
+#include "MeshLod.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static bool checkLevels(const MeshData& mesh)
+{
+	bool ok = true;
+	for (size_t l = 0; l < mesh.lods.size(); l++) {
+		const MeshLod& lod = mesh.lods[l];
+		if (l > 0 && lod.faceCount > 0.8f * mesh.lods[l - 1].faceCount) {
+			printf("  FAIL: level %zu has %u triangles, not fewer than level %zu\n", l, lod.faceCount, l - 1);
+			ok = false;
+		}
+		for (uint32_t f = lod.firstFace; f < lod.firstFace + lod.faceCount; f++) {
+			const glm::ivec3& face = mesh.faces[f];
+			bool inRange = face.x >= 0 && face.y >= 0 && face.z >= 0 && (size_t)face.x < mesh.points.size()
+				&& (size_t)face.y < mesh.points.size() && (size_t)face.z < mesh.points.size();
+			if (!inRange || mesh.points[face.x] == mesh.points[face.y] || mesh.points[face.y] == mesh.points[face.z]
+				|| mesh.points[face.x] == mesh.points[face.z]) {
+				printf("  FAIL: level %zu has a bad triangle\n", l);
+				return false;
+			}
+		}
+	}
+	return ok;
+}
+
+// scroll the model smaller like Geometry::scale under the app's camera
+static bool checkSelection(const MeshData& mesh)
+{
+	glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 20), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 640.0f / 480.0f, 1.0f, 1000.0f);
+	float radius = 0.0f;
+	for (const glm::vec3& point : mesh.points) {
+		radius = std::max(radius, glm::length(point));
+	}
+	int lodCount = (int)mesh.lods.size();
+
+	bool ok = true;
+	glm::mat4 model(1.0f);
+	int lod = 0;
+	uint32_t previousDrawn = mesh.lods[0].faceCount;
+	printf("  %6s %10s %5s %10s\n", "scale", "size", "lod", "triangles");
+	for (int step = 0; step <= 20; step++) {
+		float size = ProjectedSize(view * model, projection, radius);
+		lod = SelectMeshLod(lodCount, lod, size);
+		uint32_t drawn = mesh.lods[lod].faceCount;
+		printf("  %6.3f %10.4f %5d %10u\n", std::pow(0.75f, step), size, lod, drawn);
+
+		// shrinking may lag a level behind the ideal one, never more
+		float level = 2.0f * std::log2(lodFullDetailSize / size);
+		int lowest = std::min(std::max((int)std::floor(level - lodHysteresis), 0), lodCount - 1);
+		if (drawn > previousDrawn || lod < lowest) {
+			printf("  FAIL: level %d at size %.4f, expected at least %d\n", lod, size, lowest);
+			ok = false;
+		}
+		previousDrawn = drawn;
+		model = glm::scale(model, glm::vec3(0.75f));
+	}
+	if (lod != lodCount - 1) {
+		printf("  FAIL: a model a few pixels tall still draws level %d of %d\n", lod, lodCount - 1);
+		ok = false;
+	}
+
+	// sizes within 0.2 levels of the switch between level 0 and 1, coming
+	// from either side
+	for (int held = 0; held < std::min(lodCount, 2); held++) {
+		for (int i = 0; i < 100; i++) {
+			float level = (i % 2) ? 0.8f : 1.2f;
+			int selected = SelectMeshLod(lodCount, held, lodFullDetailSize / std::pow(2.0f, 0.5f * level));
+			if (selected != held) {
+				printf("  FAIL: level flips between %d and %d around a switch point\n", held, selected);
+				ok = false;
+				break;
+			}
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		files.push_back(argv[i]);
+	}
+	if (files.empty()) {
+		files.push_back("sphere.obj");
+		files.push_back("SandalF20.obj");
+	}
+
+	ThreadPool pool;
+	bool ok = true;
+	for (const std::string& file : files) {
+		MeshData mesh;
+		if (!LoadMesh(file, mesh, &pool)) {
+			continue;
+		}
+		OptimizeMesh(mesh, glm::vec3(0.0f, 0.0f, 1.0f));
+
+		Clock::time_point start = Clock::now();
+		BuildMeshLods(mesh, &pool);
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		printf("%s: %zu levels built in %.1f ms on %u threads\n", file.c_str(), mesh.lods.size(),
+			seconds * 1000.0, pool.size());
+		for (size_t l = 0; l < mesh.lods.size(); l++) {
+			printf("  level %zu: %8u triangles (%5.1f%%), error %.4f\n", l, mesh.lods[l].faceCount,
+				100.0 * mesh.lods[l].faceCount / mesh.lods[0].faceCount, mesh.lods[l].error);
+		}
+
+		if (mesh.lods.size() < 2 && mesh.lods[0].faceCount >= 256) {
+			printf("  FAIL: no simplified levels\n");
+			ok = false;
+		}
+		ok = checkLevels(mesh) && ok;
+		ok = checkSelection(mesh) && ok;
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
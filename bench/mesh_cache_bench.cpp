@@ -0,0 +1,97 @@
+// Cold vs. cached mesh loading.
+//
+// Cold: parse the OBJ and normalize it, as on a first launch. Cached: map the
+// .meshbin and read every byte the GPU upload would read. The OBJ's cache is
+// rebuilt first, so the bench never touches a stale file. Run from the
+// repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc bench/mesh_cache_bench.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/VertexWeld.cpp src/MeshOptimizer.cpp src/MeshCache.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -o mesh_cache_bench
+//   ./mesh_cache_bench [file.obj ...]     (defaults to sphere.obj and SandalF20.obj)
+
+#include "Mesh.h"
+#include "MeshCache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// run fn until at least minSeconds have passed, return seconds per run
+template <typename Fn>
+static double timeRuns(Fn fn, double minSeconds)
+{
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed = 0.0;
+	do {
+		fn();
+		runs++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < minSeconds);
+	return elapsed / runs;
+}
+
+// stand-in for glBufferData: read every word of an array
+static uint32_t touch(const void* data, size_t bytes)
+{
+	const uint32_t* words = (const uint32_t*)data;
+	uint32_t sum = 0;
+	for (size_t i = 0; i < bytes / sizeof(uint32_t); i++) {
+		sum += words[i];
+	}
+	return sum;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		files.push_back(argv[i]);
+	}
+	if (files.empty()) {
+		files.push_back("sphere.obj");
+		files.push_back("SandalF20.obj");
+	}
+
+	printf("%-20s %12s %12s %9s\n", "file", "cold ms", "cached ms", "speedup");
+
+	volatile uint32_t sink = 0;
+	for (const std::string& file : files) {
+		std::string cacheFilename = MeshCachePath(file);
+		MeshData built;
+		if (!LoadMesh(file, built) || !WriteMeshCache(cacheFilename, file, built)) {
+			fprintf(stderr, "%s: skipped\n", file.c_str());
+			continue;
+		}
+
+		double coldSeconds = timeRuns([&]() {
+			MeshData mesh;
+			LoadMesh(file, mesh);
+			sink = sink + touch(mesh.points.data(), mesh.points.size() * sizeof(glm::vec3));
+		}, 1.0);
+
+		bool cacheValid = true;
+		double cachedSeconds = timeRuns([&]() {
+			MeshCacheView cache;
+			if (!cache.open(cacheFilename, file)) {
+				cacheValid = false;
+				return;
+			}
+			sink = sink + touch(cache.points(), cache.pointCount() * sizeof(glm::vec3))
+				+ touch(cache.normals(), cache.normalCount() * sizeof(glm::vec3))
+				+ touch(cache.faces(), cache.faceCount() * sizeof(glm::ivec3));
+		}, 1.0);
+
+		if (!cacheValid) {
+			fprintf(stderr, "%s: freshly written cache was rejected\n", file.c_str());
+			return 1;
+		}
+		printf("%-20s %12.3f %12.3f %8.1fx\n", file.c_str(), coldSeconds * 1000.0,
+			cachedSeconds * 1000.0, coldSeconds / cachedSeconds);
+	}
+
+	return 0;
+}
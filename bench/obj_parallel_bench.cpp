@@ -0,0 +1,154 @@
+// Parallel OBJ parsing: correctness check and thread scaling.
+//
+// For every file the serial parse is compared bit for bit with parallel
+// parses (tiny chunks, to force many chunk boundaries, and default chunks);
+// the program exits with status 1 on any mismatch. It then reports load time
+// and speedup for 1, 2, 4, ... threads. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc bench/obj_parallel_bench.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -o obj_parallel_bench
+//   ./obj_parallel_bench [file.obj ...]              (defaults to sphere.obj and SandalF20.obj)
+//   ./obj_parallel_bench --generate big.obj 512      (write a ~512 MB test mesh first)
+
+#include "ObjReader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+template <typename T>
+static bool sameBits(const std::vector<T>& a, const std::vector<T>& b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), sizeof(T) * a.size()) == 0);
+}
+
+static bool sameBits(const ObjData& a, const ObjData& b)
+{
+	return sameBits(a.points, b.points) && sameBits(a.texcoords, b.texcoords)
+		&& sameBits(a.normals, b.normals) && sameBits(a.faces, b.faces)
+		&& sameBits(a.texcoordFaces, b.texcoordFaces) && sameBits(a.normalFaces, b.normalFaces);
+}
+
+// write a wavy grid of quads with normals; every other row uses relative
+// indices so chunk-boundary handling of negative indices gets exercised
+static bool generateObj(const std::string& path, size_t megabytes)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+
+	// roughly 100 bytes of text per grid vertex
+	size_t side = (size_t)std::sqrt(megabytes * 1024.0 * 1024.0 / 100.0) + 2;
+	for (size_t y = 0; y < side; y++) {
+		for (size_t x = 0; x < side; x++) {
+			float h = 0.1f * std::sin(x * 0.05f) * std::cos(y * 0.05f);
+			fprintf(file, "vn %f %f %f\nv %f %f %f\n", 0.0f, 1.0f, 0.0f, x / (float)side, h, y / (float)side);
+		}
+	}
+	for (size_t y = 0; y + 1 < side; y++) {
+		for (size_t x = 0; x + 1 < side; x++) {
+			size_t a = y * side + x + 1;
+			size_t b = a + 1;
+			size_t c = a + side + 1;
+			size_t d = a + side;
+			if (y % 2 == 0) {
+				fprintf(file, "f %zu//%zu %zu//%zu %zu//%zu %zu//%zu\n", a, a, b, b, c, c, d, d);
+			}
+			else {
+				long total = (long)(side * side);
+				fprintf(file, "f %ld//%ld %ld//%ld %ld//%ld\n", (long)a - total - 1, (long)a - total - 1,
+					(long)b - total - 1, (long)b - total - 1, (long)c - total - 1, (long)c - total - 1);
+				fprintf(file, "f %zu %zu %zu\n", a, c, d);
+			}
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--generate") == 0 && i + 2 < argc) {
+			if (!generateObj(argv[i + 1], (size_t)atol(argv[i + 2]))) {
+				fprintf(stderr, "Can't write %s\n", argv[i + 1]);
+				return 1;
+			}
+			files.push_back(argv[i + 1]);
+			i += 2;
+		}
+		else {
+			files.push_back(argv[i]);
+		}
+	}
+	if (files.empty()) {
+		files.push_back("sphere.obj");
+		files.push_back("SandalF20.obj");
+	}
+
+	unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	bool allMatch = true;
+
+	for (const std::string& file : files) {
+		MappedFile mapped;
+		if (!mapped.open(file)) {
+			fprintf(stderr, "Can't open the file %s\n", file.c_str());
+			allMatch = false;
+			continue;
+		}
+		double megabytes = mapped.size() / (1024.0 * 1024.0);
+
+		// bit-for-bit comparison against the serial parse
+		ObjData serial;
+		ParseObj(mapped.begin(), mapped.end(), serial);
+
+		ThreadPool checkPool(std::max(2u, hardwareThreads));
+		ObjData tinyChunks, defaultChunks;
+		ParseObj(mapped.begin(), mapped.end(), tinyChunks, &checkPool, 4096);
+		ParseObj(mapped.begin(), mapped.end(), defaultChunks, &checkPool);
+
+		bool match = sameBits(serial, tinyChunks) && sameBits(serial, defaultChunks);
+		allMatch = allMatch && match;
+		printf("%s: %.2f MB, %zu vertices, %zu triangles, parallel == serial: %s\n", file.c_str(),
+			megabytes, serial.points.size(), serial.faces.size(), match ? "yes" : "NO");
+
+		// thread scaling of the whole load (count + parse)
+		double serialSeconds = 0.0;
+		for (unsigned threads = 1; threads <= hardwareThreads; threads *= 2) {
+			ThreadPool pool(threads);
+			int runs = 0;
+			Clock::time_point start = Clock::now();
+			double elapsed = 0.0;
+			do {
+				ObjData obj;
+				ParseObj(mapped.begin(), mapped.end(), obj, threads > 1 ? &pool : nullptr);
+				runs++;
+				elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			} while (elapsed < 1.0);
+
+			double seconds = elapsed / runs;
+			if (threads == 1) {
+				serialSeconds = seconds;
+			}
+			printf("  %2u threads: %9.2f ms %9.1f MB/s  speedup %.2fx\n", threads, seconds * 1000.0,
+				megabytes / seconds, serialSeconds / seconds);
+
+			if (threads * 2 > hardwareThreads && threads != hardwareThreads) {
+				threads = hardwareThreads / 2;
+			}
+		}
+	}
+
+	return allMatch ? 0 : 1;
+}
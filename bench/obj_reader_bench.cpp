@@ -0,0 +1,119 @@
+// OBJ parsing throughput benchmark.
+//
+// Parses each OBJ file repeatedly with the memory-mapped ObjReader and with
+// the getline/stringstream loop Geometry used before it, and reports MB/s and
+// triangles/s for both. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc bench/obj_reader_bench.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -o obj_reader_bench
+//   ./obj_reader_bench [file.obj ...]     (defaults to sphere.obj and SandalF20.obj)
+
+#include "ObjReader.h"
+#include "MappedFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// the original Geometry parsing loop, kept here as the baseline
+static size_t legacyParse(const std::string& objFilename)
+{
+	std::vector<glm::vec3> points;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::ivec3> faces;
+
+	std::ifstream objFile(objFilename);
+	std::string line;
+	while (std::getline(objFile, line)) {
+		auto idx = line.find("//");
+		while (idx != std::string::npos) {
+			line.replace(idx, 2, " ");
+			idx = line.find("//");
+		}
+
+		std::stringstream ss;
+		ss << line;
+		std::string label;
+		ss >> label;
+
+		if (label == "v") {
+			glm::vec3 point;
+			ss >> point.x >> point.y >> point.z;
+			points.push_back(point);
+		}
+		if (label == "vn") {
+			glm::vec3 normal;
+			ss >> normal.x >> normal.y >> normal.z;
+			normals.push_back(normal);
+		}
+		if (label == "f") {
+			glm::ivec3 face, face2;
+			ss >> face.x >> face2.x >> face.y >> face2.y >> face.z >> face2.z;
+			faces.push_back(face - glm::ivec3(1));
+		}
+	}
+	return faces.size();
+}
+
+// run fn until at least minSeconds have passed, return seconds per run
+template <typename Fn>
+static double timeRuns(Fn fn, double minSeconds, size_t& triangles)
+{
+	int runs = 0;
+	Clock::time_point start = Clock::now();
+	double elapsed = 0.0;
+	do {
+		triangles = fn();
+		runs++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < minSeconds);
+	return elapsed / runs;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		files.push_back(argv[i]);
+	}
+	if (files.empty()) {
+		files.push_back("sphere.obj");
+		files.push_back("SandalF20.obj");
+	}
+
+	printf("%-20s %10s %12s %14s %12s %14s %8s\n", "file", "size", "reader MB/s",
+		"reader Mtri/s", "legacy MB/s", "legacy Mtri/s", "speedup");
+
+	for (const std::string& file : files) {
+		MappedFile mapped;
+		if (!mapped.open(file)) {
+			fprintf(stderr, "Can't open the file %s\n", file.c_str());
+			continue;
+		}
+		double megabytes = mapped.size() / (1024.0 * 1024.0);
+		mapped.close();
+
+		size_t readerTriangles = 0;
+		double readerSeconds = timeRuns([&file]() {
+			ObjData obj;
+			LoadObj(file, obj);
+			return obj.faces.size();
+		}, 1.0, readerTriangles);
+
+		size_t legacyTriangles = 0;
+		double legacySeconds = timeRuns([&file]() {
+			return legacyParse(file);
+		}, 1.0, legacyTriangles);
+
+		printf("%-20s %8.2fMB %12.1f %14.2f %12.1f %14.2f %7.1fx\n", file.c_str(), megabytes,
+			megabytes / readerSeconds, readerTriangles / readerSeconds / 1e6,
+			megabytes / legacySeconds, legacyTriangles / legacySeconds / 1e6,
+			legacySeconds / readerSeconds);
+	}
+
+	return 0;
+}
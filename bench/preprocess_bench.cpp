@@ -0,0 +1,240 @@
+// Mesh preprocessing: fitting and normal generation on a 10M-vertex mesh.
+//
+// Builds a torus of about 10M vertices (20M triangles) without normals, off
+// center and at an arbitrary size, and times PreprocessMesh with 1, 2, 4, ...
+// threads up to the hardware's: fitting alone against the three serial
+// passes Geometry used to make (min/max, center and normalize, scale by 15),
+// then smooth normal generation weighted by area and by angle, and with a
+// crease angle. Checks that the fitted points match the old passes, that the
+// generated normals match the torus's own, that a smooth surface is not split
+// at creases while a cube's corners are, and exits with 1 if not. Run from
+// the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc bench/preprocess_bench.cpp src/MeshPreprocess.cpp src/ThreadPool.cpp -o preprocess_bench
+//   ./preprocess_bench [--vertices N]     (default 10000000)
+
+#include "MeshPreprocess.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const float twoPi = 6.28318531f;
+static const float majorRadius = 30.0f;
+static const float minorRadius = 10.0f;
+static const glm::vec3 torusCenter(7.0f, -3.0f, 12.0f);
+
+// rings x segments vertices, wrapped in both directions; the normals of
+// the surface itself go to exact
+static void buildTorus(size_t rings, size_t segments, MeshData& mesh, std::vector<glm::vec3>& exact)
+{
+	mesh = MeshData();
+	mesh.points.resize(rings * segments);
+	exact.resize(rings * segments);
+	for (size_t r = 0; r < rings; r++) {
+		float u = twoPi * r / rings;
+		for (size_t s = 0; s < segments; s++) {
+			float v = twoPi * s / segments;
+			glm::vec3 normal(std::cos(u) * std::cos(v), std::sin(u) * std::cos(v), std::sin(v));
+			glm::vec3 ring(std::cos(u) * majorRadius, std::sin(u) * majorRadius, 0.0f);
+			mesh.points[r * segments + s] = torusCenter + ring + normal * minorRadius;
+			exact[r * segments + s] = normal;
+		}
+	}
+	mesh.faces.reserve(rings * segments * 2);
+	for (size_t r = 0; r < rings; r++) {
+		for (size_t s = 0; s < segments; s++) {
+			int a = (int)(r * segments + s);
+			int b = (int)(((r + 1) % rings) * segments + s);
+			int c = (int)(((r + 1) % rings) * segments + (s + 1) % segments);
+			int d = (int)(r * segments + (s + 1) % segments);
+			mesh.faces.push_back(glm::ivec3(a, b, c));
+			mesh.faces.push_back(glm::ivec3(a, c, d));
+		}
+	}
+}
+
+// the unit cube as 8 shared corners
+static void buildCube(MeshData& mesh)
+{
+	mesh = MeshData();
+	for (int i = 0; i < 8; i++) {
+		mesh.points.push_back(glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f));
+	}
+	const int quads[6][4] = {
+		{ 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 }
+	};
+	for (const int* q : quads) {
+		mesh.faces.push_back(glm::ivec3(q[0], q[1], q[2]));
+		mesh.faces.push_back(glm::ivec3(q[0], q[2], q[3]));
+	}
+}
+
+// what Geometry did before PreprocessMesh
+static void legacyNormalize(std::vector<glm::vec3>& points)
+{
+	float minX = points[0].x, maxX = points[0].x;
+	float minY = points[0].y, maxY = points[0].y;
+	float minZ = points[0].z, maxZ = points[0].z;
+	for (size_t i = 0; i < points.size(); i++) {
+		minX = std::min(minX, points[i].x);
+		minY = std::min(minY, points[i].y);
+		minZ = std::min(minZ, points[i].z);
+		maxX = std::max(maxX, points[i].x);
+		maxY = std::max(maxY, points[i].y);
+		maxZ = std::max(maxZ, points[i].z);
+	}
+	glm::vec3 center((minX + maxX) / 2, (minY + maxY) / 2, (minZ + maxZ) / 2);
+	float dist = std::max(std::max(maxX - minX, maxY - minY), maxZ - minZ);
+	for (size_t i = 0; i < points.size(); i++) {
+		points[i] = (points[i] - center) * (1 / dist);
+	}
+	for (size_t i = 0; i < points.size(); i++) {
+		points[i] = points[i] * 15.0f;
+	}
+}
+
+static double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	size_t vertexTarget = 10000000;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--vertices" && i + 1 < argc) {
+			vertexTarget = std::max(atol(argv[++i]), 64L);
+		}
+	}
+	size_t rings = (size_t)std::sqrt(vertexTarget * majorRadius / minorRadius);
+	size_t segments = vertexTarget / rings;
+
+	bool ok = true;
+	MeshData source;
+	std::vector<glm::vec3> exact;
+	buildTorus(rings, segments, source, exact);
+	printf("torus: %zu vertices, %zu triangles, %u hardware threads\n", source.points.size(), source.faces.size(),
+		std::thread::hardware_concurrency());
+
+	std::vector<unsigned> threadCounts;
+	unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned threads = 1; threads < hardware; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(hardware);
+
+	// fitting: the old serial passes, then the fused ones
+	std::vector<glm::vec3> legacy = source.points;
+	Clock::time_point start = Clock::now();
+	legacyNormalize(legacy);
+	double legacyMs = millisecondsSince(start);
+	printf("\n%-26s %8s %10s %12s %9s\n", "fit", "threads", "ms", "Mvertices/s", "speedup");
+	printf("%-26s %8d %10.2f %12.1f %9s\n", "3 serial passes", 1, legacyMs, legacy.size() / (legacyMs * 1000.0), "-");
+
+	MeshData mesh;
+	for (unsigned threads : threadCounts) {
+		std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);
+		mesh.points = source.points;
+		// normals present, so only the fit runs
+		mesh.normals = exact;
+		mesh.faces.clear();
+		start = Clock::now();
+		PreprocessMesh(mesh, MeshPreprocessOptions(), pool.get());
+		double ms = millisecondsSince(start);
+		printf("%-26s %8u %10.2f %12.1f %8.2fx\n", "fused SIMD", threads, ms, mesh.points.size() / (ms * 1000.0),
+			legacyMs / ms);
+	}
+	float largest = 0.0f;
+	for (size_t i = 0; i < legacy.size(); i++) {
+		glm::vec3 difference = glm::abs(mesh.points[i] - legacy[i]);
+		largest = std::max(largest, std::max(difference.x, std::max(difference.y, difference.z)));
+	}
+	printf("largest difference from the old passes: %g\n", largest);
+	if (largest > 1e-4f) {
+		printf("FAIL: the fitted points differ from the old passes\n");
+		ok = false;
+	}
+
+	// normal generation
+	struct NormalRun
+	{
+		const char* name;
+		NormalWeighting weighting;
+		float creaseAngle;
+	};
+	const NormalRun runs[] = {
+		{ "area weighted", normalsByArea, 180.0f },
+		{ "angle weighted", normalsByAngle, 180.0f },
+		{ "angle weighted, crease 30", normalsByAngle, 30.0f },
+	};
+	printf("\n%-26s %8s %10s %12s %9s %12s\n", "normals", "threads", "ms", "Mvertices/s", "speedup", "worst dot");
+	for (const NormalRun& run : runs) {
+		MeshPreprocessOptions options;
+		options.weighting = run.weighting;
+		options.creaseAngle = run.creaseAngle;
+		double oneThreadMs = 0.0;
+		for (unsigned threads : threadCounts) {
+			std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);
+			mesh.points = source.points;
+			mesh.normals.clear();
+			mesh.faces = source.faces;
+			PreprocessStats stats;
+			start = Clock::now();
+			PreprocessMesh(mesh, options, pool.get(), &stats);
+			double ms = millisecondsSince(start);
+			if (threads == 1) {
+				oneThreadMs = ms;
+			}
+
+			// the torus is smooth: no vertex splits, and each normal close
+			// to the surface's
+			float worst = 1.0f;
+			for (size_t i = 0; i < exact.size(); i++) {
+				worst = std::min(worst, glm::dot(mesh.normals[i], exact[i]));
+			}
+			printf("%-26s %8u %10.2f %12.1f %8.2fx %12.6f\n", run.name, threads, ms, exact.size() / (ms * 1000.0),
+				oneThreadMs / ms, worst);
+			if (stats.generatedNormals != exact.size() || stats.creaseVertices != 0 || worst < 0.999f) {
+				printf("FAIL: %s normals are off (%zu generated, %zu added at creases)\n", run.name,
+					stats.generatedNormals, stats.creaseVertices);
+				ok = false;
+			}
+		}
+	}
+
+	// a cube keeps hard edges below 90 degrees and is rounded above
+	MeshData cube;
+	MeshPreprocessOptions hard;
+	hard.creaseAngle = 60.0f;
+	buildCube(cube);
+	PreprocessMesh(cube, hard);
+	bool axisAligned = true;
+	for (size_t f = 0; f < cube.faces.size(); f++) {
+		for (int c = 0; c < 3; c++) {
+			const glm::vec3& normal = cube.normals[cube.faces[f][c]];
+			axisAligned = axisAligned && std::abs(std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z) - 1.0f) < 1e-5f;
+		}
+	}
+	MeshData rounded;
+	buildCube(rounded);
+	PreprocessMesh(rounded, MeshPreprocessOptions());
+	printf("\ncube: %zu vertices at a 60 degree crease, %zu without\n", cube.points.size(), rounded.points.size());
+	if (cube.points.size() != 24 || !axisAligned || rounded.points.size() != 8) {
+		printf("FAIL: the cube's creases are not kept\n");
+		ok = false;
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
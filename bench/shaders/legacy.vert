@@ -0,0 +1,36 @@
+#version 330 core
+
+// Vertex shader. GLSL is very similar to C.
+// You can define extra functions if needed, and the main() function is
+// called when the vertex shader gets run.
+// The vertex shader gets called once per vertex.
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+// Outputs of the vertex shader are the inputs of the same name of the fragment shader.
+// The default output, gl_Position, should be assigned something. You can define as many
+// extra outputs as you need.
+
+out vec3 normalOutput;
+out vec3 posOutput;
+
+void main()
+{
+    // OpenGL maintains the D matrix so you only need to multiply by P, V (aka C inverse), and M
+    gl_Position = projection * view * model * vec4(position, 1.0);
+
+    // fragment position
+    posOutput = vec3(model * vec4(position, 1.0));
+
+    // normal vector
+    vec3 convertedNormal = normalize(normal);
+    convertedNormal.x = (convertedNormal.x + 1) / 2;
+    convertedNormal.y = (convertedNormal.y + 1) / 2;
+    convertedNormal.z = (convertedNormal.z + 1) / 2;
+    normalOutput = convertedNormal;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef _EGL_CONTEXT_H_
+#define _EGL_CONTEXT_H_
+
+#include "shader.h"
+
+#include <EGL/egl.h>
+
+// OpenGL 3.3 core context without a window, made current on creation: Mesa's
+// surfaceless platform when offered (llvmpipe on machines without a GPU or
+// display), the default EGL display otherwise. Renders go to an FBO.
+class EglContext
+{
+private:
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+
+public:
+	EglContext() {}
+	~EglContext();
+
+	EglContext(const EglContext&) = delete;
+	EglContext& operator=(const EglContext&) = delete;
+
+	bool create();
+};
+
+// color and depth renderbuffers of the given size, bound for drawing
+class OffscreenTarget
+{
+private:
+	GLuint framebuffer = 0;
+	GLuint color = 0;
+	GLuint depth = 0;
+
+public:
+	OffscreenTarget() {}
+	~OffscreenTarget();
+
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+	bool create(int width, int height);
+};
+
+// pixels of the bound framebuffer that are not black
+size_t CoveredPixels(int width, int height);
+
+#endif
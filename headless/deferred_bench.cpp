@@ -0,0 +1,281 @@
+// Forward vs. deferred shading over resolution and light count.
+//
+// Renders a model lit by the main light and 0 to 1024 point lights
+// offscreen (headless, like headless_bench) through the forward shaders and
+// through DeferredRenderer, at several resolutions. Reports the frame time
+// of both and their framebuffer traffic, estimated from the fragments that
+// pass the depth test (GL_SAMPLES_PASSED queries): forward writes color and
+// depth per passing fragment; deferred writes the G-buffer's depth,
+// surface and normal per passing fragment, then reads the depth of every
+// pixel and, for each covered one, the surface and normal, and writes color
+// and depth once. The overdraw is the forward fragments per covered pixel.
+// Forward and deferred images are compared at the first resolution with
+// 256 lights, without and with main light shadows; the program exits with 1
+// if they differ by more than the G-buffer's quantization explains, or if
+// the shadows do not show. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/deferred_bench.cpp headless/EglContext.cpp src/DeferredRenderer.cpp src/ClusteredLights.cpp src/PointShadowMap.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o deferred_bench
+//   ./deferred_bench [--frames N] [--sizes WxH,WxH,...] [model.obj]
+//
+// Defaults: 640x360, 1280x720 and 1920x1080, 10 frames per measurement,
+// SandalF20.obj.
+
+#include "Geometry.h"
+#include "ClusteredLights.h"
+#include "DeferredRenderer.h"
+#include "PointShadowMap.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int warmupFrames = 2;
+static const int lightCounts[] = { 0, 256, 1024 };
+
+// wall clock milliseconds per frame, each finished on the GPU
+static double timeMs(int frames, const std::function<void()>& drawFrame)
+{
+	for (int i = 0; i < warmupFrames; i++) {
+		drawFrame();
+	}
+	glFinish();
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < frames; i++) {
+		drawFrame();
+		glFinish();
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+}
+
+static std::vector<unsigned char> readPixels(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+int main(int argc, char** argv)
+{
+	int frames = 10;
+	std::vector<glm::ivec2> sizes = { glm::ivec2(640, 360), glm::ivec2(1280, 720), glm::ivec2(1920, 1080) };
+	std::string file = "SandalF20.obj";
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--sizes" && i + 1 < argc) {
+			sizes.clear();
+			const char* text = argv[++i];
+			int width = 0, height = 0, read = 0;
+			while (sscanf(text, "%dx%d%n", &width, &height, &read) == 2) {
+				sizes.push_back(glm::ivec2(width, height));
+				text += read;
+				if (*text != ',') {
+					break;
+				}
+				text++;
+			}
+		}
+		else {
+			file = arg;
+		}
+	}
+	if (sizes.empty()) {
+		printf("No sizes given\n");
+		return 1;
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+	bool ok = true;
+	{
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		DeferredRenderer deferred;
+		if (!deferred.load("shaders/deferred.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		PointShadowMap shadowMap;
+		if (!shadowMap.load("shaders/shadow.vert", "shaders/shadow.frag", 512)) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+		LightClusters clusters;
+
+		Geometry object(file, "object");
+		object.loadNow(&pool);
+		if (!object.isResident()) {
+			return 1;
+		}
+		object.toSandalMat();
+		// turned towards the camera, rather than edge on
+		glm::mat4 facing = glm::rotate(glm::mat4(1.0f), 0.9f, glm::vec3(1, 0, 0))
+			* glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(0, 1, 0));
+		object.setModel(facing);
+		std::vector<const Geometry*> casters(1, &object);
+
+		GLuint samplesQuery = 0;
+		GLuint litQuery = 0;
+		glGenQueries(1, &samplesQuery);
+		glGenQueries(1, &litQuery);
+
+		printf("%s, %d frames per measurement\n", file.c_str(), frames);
+		printf("%11s %7s %12s %12s %9s %10s %12s %12s\n", "size", "lights", "forward ms", "deferred ms", "speedup",
+			"overdraw", "forward MB", "deferred MB");
+		for (size_t s = 0; s < sizes.size(); s++) {
+			int width = sizes[s].x;
+			int height = sizes[s].y;
+			OffscreenTarget target;
+			if (!target.create(width, height)) {
+				return 1;
+			}
+			glEnable(GL_DEPTH_TEST);
+			glDepthFunc(GL_LEQUAL);
+			glClearColor(0.0, 0.0, 0.0, 0.0);
+
+			glm::vec3 eyePos(0, 0, 20);
+			FrameUniforms uniforms;
+			uniforms.view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+			uniforms.projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+			uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+			uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+
+			std::vector<PointLight> lights;
+			bool shadows = false;
+			GLuint passed = 0;
+			auto setFrame = [&]() {
+				uniforms.clusterGrid = glm::ivec4(0);
+				uniforms.shadow = glm::vec4(0.0f);
+				if (shadows) {
+					shadowMap.update(Geometry::getLightPos(), casters);
+					shadowMap.bind();
+					shadowMap.setUniforms(uniforms);
+				}
+				if (!lights.empty()) {
+					clusters.build(lights, uniforms.view, uniforms.projection, &pool);
+					clusters.upload();
+					clusters.bind();
+					clusters.setUniforms(uniforms, width, height);
+				}
+				frameUniforms.update(uniforms);
+			};
+			auto forwardFrame = [&]() {
+				setFrame();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+				object.draw(uniforms.view, uniforms.projection, shaders);
+				glEndQuery(GL_SAMPLES_PASSED);
+			};
+			auto deferredFrame = [&]() {
+				setFrame();
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				deferred.beginGeometryPass(width, height);
+				Geometry::gbufferPass = true;
+				glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+				object.draw(uniforms.view, uniforms.projection, shaders);
+				glEndQuery(GL_SAMPLES_PASSED);
+				Geometry::gbufferPass = false;
+				deferred.endGeometryPass();
+				glBeginQuery(GL_SAMPLES_PASSED, litQuery);
+				deferred.light(uniforms.view, uniforms.projection);
+				glEndQuery(GL_SAMPLES_PASSED);
+			};
+
+			// both paths give the same picture, up to the packed normals, also
+			// with shadows; for those the model is scrolled in, as in
+			// shadow_bench, so it shades much of itself
+			for (int withShadows = 0; s == 0 && withShadows < 2; withShadows++) {
+				GeneratePointLights(lights, 256);
+				size_t shadowed = 0;
+				if (withShadows) {
+					object.setModel(facing * glm::scale(glm::mat4(1.0f), glm::vec3(2.5f)));
+					forwardFrame();
+					std::vector<unsigned char> unshadowedImage = readPixels(width, height);
+					shadows = true;
+					forwardFrame();
+					std::vector<unsigned char> shadowedImage = readPixels(width, height);
+					for (size_t i = 0; i < shadowedImage.size(); i++) {
+						shadowed += shadowedImage[i] != unshadowedImage[i] ? 1 : 0;
+					}
+				}
+				forwardFrame();
+				std::vector<unsigned char> forwardImage = readPixels(width, height);
+				size_t covered = CoveredPixels(width, height);
+				deferredFrame();
+				std::vector<unsigned char> deferredImage = readPixels(width, height);
+				int largest = 0;
+				size_t total = 0;
+				size_t over = 0;
+				for (size_t i = 0; i < forwardImage.size(); i++) {
+					int difference = std::abs((int)forwardImage[i] - (int)deferredImage[i]);
+					largest = std::max(largest, difference);
+					total += difference;
+					over += difference > 8 ? 1 : 0;
+				}
+				double mean = covered > 0 ? (double)total / (covered * 4) : 0.0;
+				printf("image difference at %dx%d with 256 lights%s: mean %.3f over covered pixels, max %d, "
+					"%zu channels off by more than 8\n", width, height, shadows ? " and shadows" : "", mean, largest,
+					over);
+				if (covered == 0 || mean > 0.5 || over > forwardImage.size() / 1000) {
+					printf("FAIL: the deferred image does not match\n");
+					ok = false;
+				}
+				if (shadows) {
+					printf("channels the shadows change: %zu\n", shadowed);
+					if (shadowed < covered / 100) {
+						printf("FAIL: the shadows do not show\n");
+						ok = false;
+					}
+				}
+			}
+			shadows = false;
+			object.setModel(facing);
+
+			for (int count : lightCounts) {
+				GeneratePointLights(lights, count);
+				double forwardMs = timeMs(frames, forwardFrame);
+				glGetQueryObjectuiv(samplesQuery, GL_QUERY_RESULT, &passed);
+				size_t forwardPassed = passed;
+				double deferredMs = timeMs(frames, deferredFrame);
+				glGetQueryObjectuiv(samplesQuery, GL_QUERY_RESULT, &passed);
+				size_t deferredPassed = passed;
+				glGetQueryObjectuiv(litQuery, GL_QUERY_RESULT, &passed);
+				size_t covered = passed;
+				size_t pixels = (size_t)width * height;
+
+				// 4 byte color and depth
+				double forwardMb = forwardPassed * 8.0 / 1e6;
+				double deferredMb = (deferredPassed * DeferredRenderer::bytesPerPixel() + pixels * 4.0
+					+ covered * (DeferredRenderer::bytesPerPixel() - 4 + 8)) / 1e6;
+				char size[32];
+				snprintf(size, sizeof(size), "%dx%d", width, height);
+				printf("%11s %7d %12.3f %12.3f %8.2fx %10.2f %12.2f %12.2f\n", size, count, forwardMs, deferredMs,
+					forwardMs / deferredMs, covered > 0 ? (double)forwardPassed / covered : 0.0, forwardMb,
+					deferredMb);
+			}
+		}
+		glDeleteQueries(1, &samplesQuery);
+		glDeleteQueries(1, &litQuery);
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+// Headless rendering benchmark for machines without a display or GPU.
+//
+// Creates an OpenGL 3.3 core context through EGL with no window (the Mesa
+// surfaceless platform when available, so llvmpipe works on a plain Linux
+// box), renders into a width x height framebuffer object and drives the
+// app's interaction code (RotateInteraction/ScrollInteraction, i.e.
+// rotateControl, scale and moveCloserToModel) from a fixed timeline: each
+// model in each interaction mode for a fixed number of frames. Reports load
+// time, frame time percentiles and triangles per second, prints a table and
+// writes the same as JSON. Exits with 1 if a run draws nothing. Run from the
+// repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/headless_bench.cpp headless/EglContext.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/Interaction.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o headless_bench
+//   ./headless_bench [--width W] [--height H] [--frames N] [--compact] [--output results.json] [model.obj ...]
+//
+// Defaults: 1280x720, 600 frames per run, bunny.obj, SandalF20.obj and
+// bear.obj (missing files are skipped). LIBGL_ALWAYS_SOFTWARE=1 forces
+// llvmpipe where a GPU is present.
+
+#include "Geometry.h"
+#include "Interaction.h"
+#include "Profiler.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+struct ModelInfo
+{
+	const char* file;
+	const char* name;
+	void (Geometry::*setMaterial)();
+};
+
+// the models behind keys 1, 2 and 3, with their materials
+static const ModelInfo appModels[] = {
+	{ "bunny.obj", "bunny", &Geometry::toRabbitMat },
+	{ "SandalF20.obj", "sandal", &Geometry::toSandalMat },
+	{ "bear.obj", "bear", &Geometry::toBearMat },
+};
+
+static const char* modeNames[] = { "model", "light", "both" };
+
+// one scroll step every scrollInterval frames; seven out, nine in scales the
+// model down to ~1/7 (far LOD levels) and back to about where it started
+static const int scrollInterval = 15;
+static const int scrollSteps[] = { -1, -1, -1, -1, -1, -1, -1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+static const int scrollStepCount = sizeof(scrollSteps) / sizeof(scrollSteps[0]);
+
+// untimed frames first, so shader compilation on first use is not measured
+static const int warmupFrames = 10;
+
+struct RunResult
+{
+	std::string model;
+	std::string mode;
+	double loadMs = 0.0;
+	bool fromCache = false;
+	std::vector<double> frameMs;
+	double totalTriangles = 0.0;
+	double drawCalls = 0.0;
+	ProfileStats gpuFrameMs;
+	size_t coveredPixels = 0;
+};
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	size_t index = (size_t)std::ceil(p * sorted.size());
+	return sorted[std::min(std::max(index, (size_t)1), sorted.size()) - 1];
+}
+
+// one model in one interaction mode, loaded fresh so every run starts from
+// the app's initial transforms
+static RunResult runTimeline(const ModelInfo& info, InteractionMode mode, int frames, int width, int height,
+	const ShaderVariants& shaders, FrameUniformBuffer& frameUniforms, ThreadPool& pool)
+{
+	RunResult result;
+	result.model = info.name;
+	result.mode = modeNames[mode];
+
+	glm::vec3 eyePos(0, 0, 20);
+	glm::mat4 view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+
+	Geometry::setLightPos(glm::vec3(-8.0f, 8.0f, 0.0f));
+	Geometry light("sphere.obj", "sphere");
+	Geometry object(info.file, info.name);
+	light.loadNow(&pool);
+	Geometry::setPlaceholder(&light);
+
+	Clock::time_point start = Clock::now();
+	object.loadNow(&pool);
+	result.loadMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	result.fromCache = object.loadedFromCache();
+
+	// material of the model on both, as keys 1-3 do
+	(object.*info.setMaterial)();
+	(light.*info.setMaterial)();
+
+	Profiler::reset();
+	int frameSection = Profiler::section("frame");
+	for (int frame = -warmupFrames; frame < frames; frame++) {
+		// a slowly precessing drag axis, and the scroll wheel every few frames
+		if (frame >= 0) {
+			Profiler::enabled = true;
+			float t = frame / 60.0f;
+			glm::vec3 axis = glm::normalize(glm::vec3(std::sin(0.7f * t), 1.0f, std::cos(0.3f * t)));
+			RotateInteraction(mode, &object, &light, axis, 0.02f);
+			if (frame % scrollInterval == scrollInterval - 1) {
+				ScrollInteraction(mode, &object, &light, scrollSteps[(frame / scrollInterval) % scrollStepCount]);
+			}
+		}
+
+		Clock::time_point frameStart = Clock::now();
+		Profiler::beginFrame();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		FrameUniforms uniforms;
+		uniforms.view = view;
+		uniforms.projection = projection;
+		uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+		uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+		frameUniforms.update(uniforms);
+
+		object.draw(view, projection, shaders);
+		light.draw(view, projection, shaders);
+
+		// no swap to wait on; the frame is done when the GPU is
+		glFinish();
+		Profiler::endFrame();
+		if (frame < 0) {
+			continue;
+		}
+		result.totalTriangles += Profiler::frameTriangles();
+		result.drawCalls += Profiler::frameDrawCalls();
+		result.frameMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+	}
+	Profiler::enabled = false;
+	result.gpuFrameMs = Profiler::gpuStats(frameSection);
+	result.coveredPixels = CoveredPixels(width, height);
+	Geometry::setPlaceholder(nullptr);
+	return result;
+}
+
+static void writeJson(const std::string& filename, const std::vector<RunResult>& results, int width, int height,
+	int frames, const char* renderer)
+{
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file) {
+		fprintf(stderr, "Failed to write %s\n", filename.c_str());
+		return;
+	}
+	file << "{\n\"renderer\": \"" << renderer << "\",\n\"width\": " << width << ",\n\"height\": " << height
+		<< ",\n\"frames\": " << frames << ",\n\"compact_vertices\": " << (Geometry::compactVertices ? "true" : "false")
+		<< ",\n\"runs\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const RunResult& run = results[i];
+		std::vector<double> sorted = run.frameMs;
+		std::sort(sorted.begin(), sorted.end());
+		double totalMs = 0.0;
+		for (double ms : sorted) {
+			totalMs += ms;
+		}
+		file << "  {\"model\": \"" << run.model << "\", \"mode\": \"" << run.mode << "\", \"load_ms\": " << run.loadMs
+			<< ", \"from_cache\": " << (run.fromCache ? "true" : "false")
+			<< ", \"frame_ms\": {\"min\": " << sorted.front() << ", \"avg\": " << totalMs / sorted.size()
+			<< ", \"p50\": " << percentile(sorted, 0.5) << ", \"p95\": " << percentile(sorted, 0.95)
+			<< ", \"p99\": " << percentile(sorted, 0.99) << ", \"max\": " << sorted.back() << "}"
+			<< ", \"gpu_frame_ms\": {\"avg\": " << run.gpuFrameMs.avg << ", \"p95\": " << run.gpuFrameMs.p95
+			<< ", \"p99\": " << run.gpuFrameMs.p99 << "}"
+			<< ", \"triangles_per_second\": " << run.totalTriangles / (totalMs / 1000.0)
+			<< ", \"triangles_per_frame\": " << run.totalTriangles / sorted.size()
+			<< ", \"draw_calls_per_frame\": " << run.drawCalls / sorted.size()
+			<< ", \"covered_pixels\": " << run.coveredPixels << "}"
+			<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "]\n}\n";
+	printf("results written to %s\n", filename.c_str());
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1280;
+	int height = 720;
+	int frames = 600;
+	std::string output = "headless_results.json";
+	std::vector<ModelInfo> models;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--output" && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (arg == "--compact") {
+			Geometry::compactVertices = true;
+		}
+		else {
+			// a model from the command line, with the app's material if it is one of them
+			ModelInfo info = { argv[i], argv[i], &Geometry::toRabbitMat };
+			for (const ModelInfo& app : appModels) {
+				if (arg == app.file) {
+					info = app;
+				}
+			}
+			models.push_back(info);
+		}
+	}
+	if (models.empty()) {
+		models.assign(appModels, appModels + 3);
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	printf("Renderer: %s\nOpenGL version: %s\n", renderer, (const char*)glGetString(GL_VERSION));
+
+	bool ok = true;
+	std::vector<RunResult> results;
+	{
+		// offscreen target in place of the window's framebuffer
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+
+		// the app's GL state
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+
+		for (const ModelInfo& info : models) {
+			if (!std::ifstream(info.file)) {
+				printf("%s not found, skipped\n", info.file);
+				continue;
+			}
+			for (int mode = interactModel; mode <= interactBoth; mode++) {
+				results.push_back(runTimeline(info, (InteractionMode)mode, frames, width, height, shaders,
+					frameUniforms, pool));
+			}
+		}
+		Profiler::reset();
+	}
+
+	printf("%dx%d, %d frames per run\n", width, height, frames);
+	printf("%-8s %-6s %9s %9s %9s %9s %9s %14s\n", "model", "mode", "load ms", "avg ms", "p50 ms", "p95 ms", "p99 ms",
+		"Mtriangles/s");
+	for (const RunResult& run : results) {
+		std::vector<double> sorted = run.frameMs;
+		std::sort(sorted.begin(), sorted.end());
+		double totalMs = 0.0;
+		for (double ms : sorted) {
+			totalMs += ms;
+		}
+		printf("%-8s %-6s %9.2f %9.3f %9.3f %9.3f %9.3f %14.2f\n", run.model.c_str(), run.mode.c_str(), run.loadMs,
+			totalMs / sorted.size(), percentile(sorted, 0.5), percentile(sorted, 0.95), percentile(sorted, 0.99),
+			run.totalTriangles / (totalMs / 1000.0) / 1e6);
+		if (run.coveredPixels == 0) {
+			printf("  FAIL: %s (%s) rendered nothing\n", run.model.c_str(), run.mode.c_str());
+			ok = false;
+		}
+	}
+	if (results.empty()) {
+		printf("no models found\n");
+		ok = false;
+	}
+	writeJson(output, results, width, height, frames, renderer);
+	return ok ? 0 : 1;
+}
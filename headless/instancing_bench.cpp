@@ -0,0 +1,185 @@
+// Instanced vs. one-draw-per-object rendering of a stress scene.
+//
+// Generates fields of 1 to 50000 instances of a model with
+// GenerateInstanceField and renders each offscreen (headless, like
+// headless_bench) two ways: every instance as its own Geometry::draw with
+// its transform and material set before the draw, and the whole field in a
+// single Geometry::drawInstanced. Reports frame time and objects per second
+// of both as the count grows. Levels of detail are off so both draw the same
+// triangles; the two images are compared at 100 instances and the program
+// exits with 1 if they differ. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/instancing_bench.cpp headless/EglContext.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o instancing_bench
+//   ./instancing_bench [--width W] [--height H] [--frames N] [--max-separate N] [model.obj]
+//
+// Defaults: 1280x720, 50 frames per measurement, SandalF20.obj; the
+// per-object path is skipped above 10000 instances.
+
+#include "Geometry.h"
+#include "InstanceBuffer.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int warmupFrames = 5;
+static const int instanceCounts[] = { 1, 10, 100, 1000, 10000, 50000 };
+
+// material setters by MaterialId
+static void (Geometry::*const materialSetters[materialCount])() = {
+	&Geometry::toRabbitMat,
+	&Geometry::toSandalMat,
+	&Geometry::toBearMat,
+};
+
+// wall clock milliseconds per frame, each frame finished on the GPU
+static double timeFrames(int frames, const std::function<void()>& drawFrame)
+{
+	for (int i = 0; i < warmupFrames; i++) {
+		drawFrame();
+	}
+	glFinish();
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < frames; i++) {
+		drawFrame();
+		glFinish();
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+}
+
+static std::vector<unsigned char> readPixels(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1280;
+	int height = 720;
+	int frames = 50;
+	int maxSeparate = 10000;
+	std::string file = "SandalF20.obj";
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--max-separate" && i + 1 < argc) {
+			maxSeparate = atoi(argv[++i]);
+		}
+		else {
+			file = arg;
+		}
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+	bool ok = true;
+	{
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+
+		// same triangles on both paths; the app's caches hold LODs, so they
+		// are left alone
+		Geometry::buildLods = false;
+		Geometry::useMeshCache = false;
+		Geometry object(file, "object");
+		object.loadNow(&pool);
+		if (!object.isResident()) {
+			return 1;
+		}
+
+		glm::vec3 eyePos(0, 0, 20);
+		FrameUniforms uniforms;
+		uniforms.view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		uniforms.projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+		uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+		uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+		frameUniforms.update(uniforms);
+
+		InstanceBuffer instances;
+		auto separateFrame = [&]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			for (size_t i = 0; i < instances.size(); i++) {
+				object.setModel(instances[i].model);
+				(object.*materialSetters[instances[i].material])();
+				object.draw(uniforms.view, uniforms.projection, shaders);
+			}
+		};
+		auto instancedFrame = [&]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			object.setModel(glm::mat4(1.0f));
+			object.drawInstanced(uniforms.view, uniforms.projection, shaders, instances);
+		};
+
+		// both paths should give the same picture
+		GenerateInstanceField(instances, 100);
+		separateFrame();
+		std::vector<unsigned char> separateImage = readPixels(width, height);
+		instancedFrame();
+		std::vector<unsigned char> instancedImage = readPixels(width, height);
+		int difference = 0;
+		for (size_t i = 0; i < separateImage.size(); i++) {
+			difference = std::max(difference, std::abs((int)separateImage[i] - (int)instancedImage[i]));
+		}
+		printf("image difference at 100 instances: %d\n", difference);
+		if (difference > 2 || CoveredPixels(width, height) == 0) {
+			printf("FAIL: the instanced image does not match\n");
+			ok = false;
+		}
+
+		printf("%dx%d, %s, %d frames per measurement\n", width, height, file.c_str(), frames);
+		printf("%10s %14s %14s %16s %16s %9s\n", "instances", "separate ms", "instanced ms", "separate obj/s",
+			"instanced obj/s", "speedup");
+		for (int count : instanceCounts) {
+			GenerateInstanceField(instances, count);
+			double instancedMs = timeFrames(frames, instancedFrame);
+			if (count <= maxSeparate) {
+				double separateMs = timeFrames(frames, separateFrame);
+				printf("%10d %14.3f %14.3f %16.0f %16.0f %8.2fx\n", count, separateMs, instancedMs,
+					count / (separateMs / 1000.0), count / (instancedMs / 1000.0), separateMs / instancedMs);
+			}
+			else {
+				printf("%10d %14s %14.3f %16s %16.0f %9s\n", count, "-", instancedMs, "-",
+					count / (instancedMs / 1000.0), "-");
+			}
+		}
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+// Clustered point lights vs. every light per fragment, over the light count.
+//
+// Renders a model lit by the main light and 0 to 4096 moving point lights
+// offscreen (headless, like headless_bench), once with LightClusters'
+// 16x9x24 grid and once with a single cluster, where every fragment loops
+// over every light in view. Reports the frame time of both and the CPU
+// binning time on the thread pool and on one thread, and the average
+// lights per non-empty cluster. At 256 lights the two images are compared
+// with each other and with the unlit image; the program exits with 1 if
+// the two differ or the lights do not show. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/light_bench.cpp headless/EglContext.cpp src/ClusteredLights.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o light_bench
+//   ./light_bench [--width W] [--height H] [--frames N] [--max-all N] [model.obj]
+//
+// Defaults: 1280x720, 20 frames per measurement, SandalF20.obj; the
+// single-cluster path is skipped above 1024 lights.
+
+#include "Geometry.h"
+#include "ClusteredLights.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int warmupFrames = 3;
+static const int lightCounts[] = { 0, 16, 64, 256, 1024, 4096 };
+
+// wall clock milliseconds per call, each finished on the GPU
+static double timeMs(int repeat, const std::function<void()>& work)
+{
+	for (int i = 0; i < warmupFrames; i++) {
+		work();
+	}
+	glFinish();
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < repeat; i++) {
+		work();
+		glFinish();
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / repeat;
+}
+
+static std::vector<unsigned char> readPixels(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1280;
+	int height = 720;
+	int frames = 20;
+	int maxAll = 1024;
+	std::string file = "SandalF20.obj";
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--max-all" && i + 1 < argc) {
+			maxAll = atoi(argv[++i]);
+		}
+		else {
+			file = arg;
+		}
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+	bool ok = true;
+	{
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+
+		Geometry object(file, "object");
+		object.loadNow(&pool);
+		if (!object.isResident()) {
+			return 1;
+		}
+		object.toSandalMat();
+
+		glm::vec3 eyePos(0, 0, 20);
+		FrameUniforms uniforms;
+		uniforms.view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		uniforms.projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+		uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+		uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+
+		LightClusters clustered;
+		LightClusters single(1, 1, 1);
+		std::vector<PointLight> field;
+		std::vector<PointLight> lights;
+		// the lights move between frames, so every frame bins them again
+		double seconds = 0.0;
+		auto drawFrame = [&](LightClusters& clusters) {
+			seconds += 1.0 / 60.0;
+			AnimatePointLights(field, seconds, lights);
+			clusters.build(lights, uniforms.view, uniforms.projection, &pool);
+			clusters.upload();
+			clusters.bind();
+			clusters.setUniforms(uniforms, width, height);
+			frameUniforms.update(uniforms);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			object.draw(uniforms.view, uniforms.projection, shaders);
+		};
+
+		// the clusters drop no light a fragment would have shaded, and the
+		// lights do show
+		GeneratePointLights(field, 0);
+		drawFrame(clustered);
+		std::vector<unsigned char> unlitImage = readPixels(width, height);
+		GeneratePointLights(field, 256);
+		seconds = 0.0;
+		drawFrame(clustered);
+		std::vector<unsigned char> clusteredImage = readPixels(width, height);
+		seconds = 0.0;
+		drawFrame(single);
+		std::vector<unsigned char> singleImage = readPixels(width, height);
+		int difference = 0;
+		int lightsShown = 0;
+		for (size_t i = 0; i < clusteredImage.size(); i++) {
+			difference = std::max(difference, std::abs((int)clusteredImage[i] - (int)singleImage[i]));
+			lightsShown = std::max(lightsShown, std::abs((int)clusteredImage[i] - (int)unlitImage[i]));
+		}
+		printf("image difference at 256 lights: %d (%d from the unlit image)\n", difference, lightsShown);
+		if (difference > 2 || CoveredPixels(width, height) == 0) {
+			printf("FAIL: the clustered image does not match\n");
+			ok = false;
+		}
+		if (lightsShown <= 2) {
+			printf("FAIL: the point lights do not show\n");
+			ok = false;
+		}
+
+		printf("%dx%d, %s, %d frames per measurement\n", width, height, file.c_str(), frames);
+		printf("%8s %14s %14s %12s %14s %14s\n", "lights", "clustered ms", "all lights ms", "bin ms",
+			"bin 1 thread", "per cluster");
+		for (int count : lightCounts) {
+			GeneratePointLights(field, count);
+			AnimatePointLights(field, 0.0, lights);
+
+			double clusteredMs = timeMs(frames, [&]() { drawFrame(clustered); });
+			Clock::time_point start = Clock::now();
+			for (int i = 0; i < frames; i++) {
+				clustered.build(lights, uniforms.view, uniforms.projection, &pool);
+			}
+			double binMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+			start = Clock::now();
+			for (int i = 0; i < frames; i++) {
+				clustered.build(lights, uniforms.view, uniforms.projection, nullptr);
+			}
+			double serialBinMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+			size_t used = 0;
+			for (size_t i = 0; i < clustered.clusterCount(); i++) {
+				used += clustered.cluster(i).y > 0 ? 1 : 0;
+			}
+			double perCluster = used > 0 ? (double)clustered.indexCount() / used : 0.0;
+
+			if (count <= maxAll) {
+				double allMs = timeMs(frames, [&]() { drawFrame(single); });
+				printf("%8d %14.3f %14.3f %12.3f %14.3f %14.1f\n", count, clusteredMs, allMs, binMs, serialBinMs,
+					perCluster);
+			}
+			else {
+				printf("%8d %14.3f %14s %12.3f %14.3f %14.1f\n", count, clusteredMs, "-", binMs, serialBinMs,
+					perCluster);
+			}
+		}
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
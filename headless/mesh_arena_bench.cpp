@@ -0,0 +1,323 @@
+// Meshes in shared arenas vs. buffers and a VAO of their own.
+//
+// Loads the app's four models (those in the checkout) twice, once with Geometry::useMeshArena off
+// (every mesh with its own buffers and VAOs, bound and unbound around each
+// draw) and once on (every mesh in the arena of its layout, drawn with
+// base-vertex draws from the one VAO), and renders the same scene of
+// --objects objects cycling through them offscreen (headless, like
+// headless_bench). Before drawing, the first arena mesh is unloaded, the
+// arena compacted and the mesh loaded again, so every mesh is drawn from
+// where it was moved. Reports VAO and buffer binds, draws and the frame
+// time per frame of both, in the float and the compact layout, and exits
+// with 1 if their images differ. Then allocates and frees synthetic meshes
+// at random in an arena of its own, checks every live mesh still reads back
+// what was uploaded after the arena grew and after compact(), and reports
+// occupancy and fragmentation before and after. Run from the repository
+// root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/mesh_arena_bench.cpp headless/EglContext.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o mesh_arena_bench
+//   ./mesh_arena_bench [--width W] [--height H] [--frames N] [--objects N] [--operations N] [--seed N]
+//
+// Defaults: 1280x720, 50 frames per measurement, 200 objects, 4000
+// allocations and frees.
+
+#include "Geometry.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int warmupFrames = 5;
+static const char* const modelFiles[] = { "bunny.obj", "SandalF20.obj", "bear.obj", "sphere.obj" };
+
+// wall clock milliseconds per frame, each frame finished on the GPU
+static double timeFrames(int frames, const std::function<void()>& drawFrame)
+{
+	for (int i = 0; i < warmupFrames; i++) {
+		drawFrame();
+	}
+	glFinish();
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < frames; i++) {
+		drawFrame();
+		glFinish();
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+}
+
+static std::vector<unsigned char> readPixels(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+// the models there are files of, with or without the arena
+static bool loadModels(std::vector<std::unique_ptr<Geometry>>& models, bool arena, ThreadPool& pool)
+{
+	Geometry::useMeshArena = arena;
+	models.clear();
+	for (const char* file : modelFiles) {
+		if (!std::filesystem::exists(file)) {
+			continue;
+		}
+		models.emplace_back(new Geometry(file, arena ? "arena" : "own"));
+		models.back()->loadNow(&pool);
+		if (!models.back()->isResident()) {
+			return false;
+		}
+	}
+	return !models.empty();
+}
+
+// a grid filling the view, the models and materials taken in turn
+static std::vector<glm::mat4> placeObjects(int count)
+{
+	int columns = 20;
+	int rows = (count + columns - 1) / columns;
+	std::vector<glm::mat4> placements;
+	for (int i = 0; i < count; i++) {
+		glm::vec3 position((i % columns - (columns - 1) * 0.5f) * 2.2f, ((rows - 1) * 0.5f - i / columns) * 2.2f,
+			0.0f);
+		placements.push_back(glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.9f)));
+	}
+	return placements;
+}
+
+struct SyntheticMesh
+{
+	int id;
+	std::vector<unsigned char> streams[2];
+	std::vector<unsigned char> indices;
+};
+
+static bool readsBack(const MeshArena& arena, const SyntheticMesh& mesh)
+{
+	std::vector<unsigned char> data;
+	for (int s = 0; s < 3; s++) {
+		const std::vector<unsigned char>& expected = s < 2 ? mesh.streams[s] : mesh.indices;
+		data.assign(expected.size(), 0);
+		arena.download(mesh.id, s, 0, data.size(), data.data());
+		if (data != expected) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void printStats(const char* when, const MeshArenaStats& stats)
+{
+	printf("%-16s %7zu %10.1f %10.1f %8zu %9.1f %9.1f %9.1f\n", when, stats.meshes,
+		100.0 * stats.vertexUsed / stats.vertexCapacity, 100.0 * stats.indexUsed / stats.indexCapacity,
+		stats.freeBlocks, 100.0f * stats.vertexFragmentation, 100.0f * stats.indexFragmentation,
+		stats.bytes / (1024.0 * 1024.0));
+}
+
+// random allocations and frees of meshes filled with random bytes
+static bool stressArena(int operations, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> vertexCounts(50, 5000);
+	std::uniform_int_distribution<int> byteValues(0, 255);
+	MeshArena arena(meshLayoutFloat);
+	std::vector<SyntheticMesh> live;
+	bool ok = true;
+
+	auto check = [&](const char* when) {
+		for (const SyntheticMesh& mesh : live) {
+			if (!readsBack(arena, mesh)) {
+				printf("FAIL: mesh %d reads back wrong %s\n", mesh.id, when);
+				ok = false;
+				return;
+			}
+		}
+	};
+
+	for (int i = 0; i < operations; i++) {
+		// mostly allocating at first, as many frees as allocations later
+		bool allocate = live.empty() || random() % 100 < (i < operations / 4 ? 75u : 50u);
+		if (allocate) {
+			SyntheticMesh mesh;
+			size_t vertexCount = vertexCounts(random);
+			// odd 16-bit index counts too, rounded up to whole words
+			size_t indexBytes = (vertexCount * 3 + random() % 2) * sizeof(GLushort);
+			for (int s = 0; s < 2; s++) {
+				mesh.streams[s].resize(vertexCount * MeshArena::streamStride(meshLayoutFloat, s));
+			}
+			mesh.indices.resize(indexBytes);
+			for (std::vector<unsigned char>* data : { &mesh.streams[0], &mesh.streams[1], &mesh.indices }) {
+				for (unsigned char& byte : *data) {
+					byte = (unsigned char)byteValues(random);
+				}
+			}
+			mesh.id = arena.allocate(vertexCount, indexBytes);
+			arena.upload(mesh.id, 0, 0, mesh.streams[0].size(), mesh.streams[0].data());
+			arena.upload(mesh.id, 1, 0, mesh.streams[1].size(), mesh.streams[1].data());
+			arena.upload(mesh.id, 2, 0, mesh.indices.size(), mesh.indices.data());
+			live.push_back(std::move(mesh));
+		}
+		else {
+			size_t victim = random() % live.size();
+			arena.free(live[victim].id);
+			live[victim] = std::move(live.back());
+			live.pop_back();
+		}
+	}
+	check("after growing and packing");
+
+	printf("\n%d random allocations and frees, %d packs on the way\n", operations, arena.stats().compactions);
+	printf("%-16s %7s %10s %10s %8s %9s %9s %9s\n", "arena", "meshes", "vertex %", "index %", "gaps",
+		"v frag %", "i frag %", "MB");
+	printStats("before compact", arena.stats());
+	arena.compact();
+	MeshArenaStats after = arena.stats();
+	printStats("after compact", after);
+	check("after compact");
+	// one free block left at the end of each buffer
+	if (after.freeBlocks > 2 || after.vertexFragmentation != 0.0f || after.indexFragmentation != 0.0f) {
+		printf("FAIL: compact left %zu free blocks\n", after.freeBlocks);
+		ok = false;
+	}
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1280;
+	int height = 720;
+	int frames = 50;
+	int objectCount = 200;
+	int operations = 4000;
+	unsigned seed = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--objects" && i + 1 < argc) {
+			objectCount = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--operations" && i + 1 < argc) {
+			operations = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--seed" && i + 1 < argc) {
+			seed = (unsigned)atoi(argv[++i]);
+		}
+		else {
+			printf("Unknown argument %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+	bool ok = true;
+	{
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+
+		glm::vec3 eyePos(0, 0, 40);
+		FrameUniforms uniforms;
+		uniforms.view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		uniforms.projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+		uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+		uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+		frameUniforms.update(uniforms);
+		std::vector<glm::mat4> placements = placeObjects(objectCount);
+
+		std::vector<std::unique_ptr<Geometry>> models;
+		auto drawFrame = [&]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			for (int i = 0; i < objectCount; i++) {
+				Geometry& object = *models[i % models.size()];
+				object.setModel(placements[i]);
+				object.setMaterial(i % materialCount);
+				object.draw(uniforms.view, uniforms.projection, shaders);
+			}
+		};
+
+		printf("%dx%d, %d objects, %d frames per measurement\n", width, height, objectCount, frames);
+		printf("%-8s %-6s %10s %10s %10s\n", "layout", "meshes", "binds", "draws", "ms");
+		for (bool compact : { false, true }) {
+			Geometry::compactVertices = compact;
+			const char* layoutName = compact ? "compact" : "float";
+			std::vector<unsigned char> images[2];
+			for (bool arena : { false, true }) {
+				if (!loadModels(models, arena, pool)) {
+					return 1;
+				}
+				if (arena) {
+					// a hole where the first mesh was, closed by moving the rest
+					// down; the first goes back in after them
+					models[0]->unload();
+					Geometry::arena(compact ? meshLayoutCompact : meshLayoutFloat)->compact();
+					models[0]->loadNow(&pool);
+				}
+
+				// one frame counted, the rest timed with the profiler off
+				Profiler::enabled = true;
+				Profiler::beginFrame();
+				drawFrame();
+				Profiler::endFrame();
+				Profiler::enabled = false;
+				size_t binds = Profiler::frameBinds();
+				size_t draws = Profiler::frameDrawCalls();
+				images[arena] = readPixels(width, height);
+				double ms = timeFrames(frames, drawFrame);
+				printf("%-8s %-6s %10zu %10zu %10.3f\n", layoutName, arena ? "arena" : "own", binds, draws, ms);
+			}
+			models.clear();
+
+			int difference = 0;
+			for (size_t i = 0; i < images[0].size(); i++) {
+				difference = std::max(difference, std::abs((int)images[0][i] - (int)images[1][i]));
+			}
+			if (difference > 2 || CoveredPixels(width, height) == 0) {
+				printf("FAIL: the %s arena image differs by %d\n", layoutName, difference);
+				ok = false;
+			}
+		}
+		Profiler::reset();
+		Geometry::releaseArenas();
+
+		ok = stressArena(operations, seed) && ok;
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
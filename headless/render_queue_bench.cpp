@@ -0,0 +1,300 @@
+// Draws issued one by one vs. through the sorted RenderQueue.
+//
+// Renders offscreen (headless, like headless_bench) a block of --objects
+// objects cycling through the models and materials, layers of them behind
+// each other, submitted farthest first: each drawn right away with
+// Geometry::draw, as Window::displayCallback did, and all submitted to a
+// RenderQueue, radix-sorted and executed. Reports per frame the GL calls
+// made (programs, VAOs, instance attributes, uniforms) and the ones the
+// queue found redundant, the samples that passed the depth test (fewer
+// when near objects are drawn first) and the frame time of both, and
+// checks the two images match. Then sorts random keys with
+// RenderQueue::sort and std::stable_sort, checks both give the same order and
+// reports keys per second. Exits with 1 if a check fails. Run from the
+// repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/render_queue_bench.cpp headless/EglContext.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o render_queue_bench
+//   ./render_queue_bench [--width W] [--height H] [--frames N] [--objects N] [--keys N]
+//
+// Defaults: 1280x720, 30 frames per measurement, 500 objects, 1000000 keys.
+
+#include "Geometry.h"
+#include "RenderQueue.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int warmupFrames = 3;
+static const char* const modelFiles[] = { "bunny.obj", "SandalF20.obj", "bear.obj", "sphere.obj" };
+static const char* const callNames[stateCallCount] = { "programs", "VAOs", "instances", "uniforms" };
+
+// wall clock milliseconds per frame, each frame finished on the GPU
+static double timeFrames(int frames, const std::function<void()>& drawFrame)
+{
+	for (int i = 0; i < warmupFrames; i++) {
+		drawFrame();
+	}
+	glFinish();
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < frames; i++) {
+		drawFrame();
+		glFinish();
+	}
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+}
+
+static std::vector<unsigned char> readPixels(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+// what one frame of a path did, counted with the profiler on
+struct FrameCounts
+{
+	size_t draws;
+	size_t uniforms;
+	size_t binds;
+	size_t stateCalls;
+	size_t skippedCalls;
+	GLuint samplesPassed;
+};
+
+static FrameCounts countFrame(const std::function<void()>& drawFrame)
+{
+	GLuint query;
+	glGenQueries(1, &query);
+	Profiler::enabled = true;
+	Profiler::beginFrame();
+	glBeginQuery(GL_SAMPLES_PASSED, query);
+	drawFrame();
+	glEndQuery(GL_SAMPLES_PASSED);
+	Profiler::endFrame();
+	Profiler::enabled = false;
+
+	FrameCounts counts;
+	counts.draws = Profiler::frameDrawCalls();
+	counts.uniforms = Profiler::frameUniformUploads();
+	counts.binds = Profiler::frameBinds();
+	counts.stateCalls = Profiler::frameStateCalls();
+	counts.skippedCalls = Profiler::frameSkippedCalls();
+	glGetQueryObjectuiv(query, GL_QUERY_RESULT, &counts.samplesPassed);
+	glDeleteQueries(1, &query);
+	return counts;
+}
+
+// the same order as a stable sort by key
+static bool checkSort(size_t keyCount)
+{
+	// few programs and materials, many depths, as in a frame
+	std::mt19937_64 random(1);
+	std::uniform_real_distribution<float> depths(0.0f, 100.0f);
+	std::vector<RenderKey> keys(keyCount);
+	for (size_t i = 0; i < keyCount; i++) {
+		keys[i].key = RenderQueue::makeKey((int)(random() % 2), (GLuint)(random() % 8 + 1), (int)(random() % 3),
+			(GLuint)(random() % 64 + 1), depths(random));
+		keys[i].packet = (uint32_t)i;
+	}
+
+	std::vector<RenderKey> stable = keys;
+	Clock::time_point start = Clock::now();
+	std::stable_sort(stable.begin(), stable.end(),
+		[](const RenderKey& a, const RenderKey& b) { return a.key < b.key; });
+	double stableSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::vector<RenderKey> radix = keys;
+	std::vector<RenderKey> scratch;
+	start = Clock::now();
+	RadixSortKeys(radix, scratch);
+	double radixSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	bool same = true;
+	for (size_t i = 0; i < keyCount && same; i++) {
+		same = radix[i].key == stable[i].key && radix[i].packet == stable[i].packet;
+	}
+	printf("\nsorting %zu keys: radix %.1f Mkeys/s, std::stable_sort %.1f Mkeys/s\n", keyCount,
+		keyCount / radixSeconds / 1e6, keyCount / stableSeconds / 1e6);
+	if (!same) {
+		printf("FAIL: the radix sort gives another order\n");
+	}
+	return same;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1280;
+	int height = 720;
+	int frames = 30;
+	int objectCount = 500;
+	size_t keyCount = 1000000;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--objects" && i + 1 < argc) {
+			objectCount = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--keys" && i + 1 < argc) {
+			keyCount = (size_t)std::max(atol(argv[++i]), 1L);
+		}
+		else {
+			printf("Unknown argument %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+	bool ok = true;
+	{
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+
+		// the models there are files of; each is drawn as many objects, moved
+		// and given their material before every draw or submit
+		std::vector<std::unique_ptr<Geometry>> models;
+		for (const char* file : modelFiles) {
+			if (std::filesystem::exists(file)) {
+				models.emplace_back(new Geometry(file, "model"));
+				models.back()->loadNow(&pool);
+			}
+		}
+		if (models.empty()) {
+			printf("FAIL: no models found\n");
+			return 1;
+		}
+
+		glm::vec3 eyePos(0, 0, 30);
+		FrameUniforms uniforms;
+		uniforms.view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		uniforms.projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+		uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+		uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+		frameUniforms.update(uniforms);
+
+		// layers of 10x5 objects, each shifted against the one behind it so
+		// it covers most of it; the farthest layer is drawn first
+		struct SceneObject
+		{
+			Geometry* geometry;
+			glm::mat4 model;
+			int material;
+		};
+		std::vector<SceneObject> objects;
+		int layers = (objectCount + 49) / 50;
+		for (int i = 0; i < objectCount; i++) {
+			int layer = layers - 1 - i / 50;
+			glm::vec3 position((i % 10 - 4.5f) * 3.0f + (layer % 2) * 1.5f, (i / 10 % 5 - 2.0f) * 3.0f,
+				-layer * 2.0f);
+			glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(1.6f));
+			objects.push_back(SceneObject{ models[i % models.size()].get(), model, i % materialCount });
+		}
+
+		RenderQueue queue;
+		auto directFrame = [&]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			for (const SceneObject& object : objects) {
+				object.geometry->setModel(object.model);
+				object.geometry->setMaterial(object.material);
+				object.geometry->draw(uniforms.view, uniforms.projection, shaders);
+			}
+		};
+		auto queuedFrame = [&]() {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			queue.clear();
+			for (const SceneObject& object : objects) {
+				object.geometry->setModel(object.model);
+				object.geometry->setMaterial(object.material);
+				object.geometry->submit(uniforms.view, uniforms.projection, shaders, queue, renderPassForward);
+			}
+			queue.sort();
+			queue.execute(renderPassForward);
+		};
+
+		FrameCounts direct = countFrame(directFrame);
+		std::vector<unsigned char> directImage = readPixels(width, height);
+		FrameCounts queued = countFrame(queuedFrame);
+		std::vector<unsigned char> queuedImage = readPixels(width, height);
+		double directMs = timeFrames(frames, directFrame);
+		double queuedMs = timeFrames(frames, queuedFrame);
+
+		printf("%dx%d, %d objects in %d layers, %d frames per measurement\n", width, height, objectCount, layers,
+			frames);
+		printf("%-8s %8s %10s %8s %12s %12s %16s %10s\n", "path", "draws", "uniforms", "binds", "state calls",
+			"skipped", "samples passed", "ms");
+		printf("%-8s %8zu %10zu %8zu %12s %12s %16u %10.3f\n", "direct", direct.draws, direct.uniforms, direct.binds,
+			"-", "-", direct.samplesPassed, directMs);
+		printf("%-8s %8zu %10zu %8zu %12zu %12zu %16u %10.3f\n", "queued", queued.draws, queued.uniforms, queued.binds,
+			queued.stateCalls, queued.skippedCalls, queued.samplesPassed, queuedMs);
+		const RenderQueueStats& stats = queue.stats();
+		printf("queued calls by kind:");
+		for (int call = 0; call < stateCallCount; call++) {
+			printf("  %s %zu/%zu", callNames[call], stats.issued[call], stats.issued[call] + stats.skipped[call]);
+		}
+		printf("\n");
+
+		// the depth test resolves the same picture in either order
+		size_t differing = 0;
+		for (size_t i = 0; i < directImage.size(); i += 4) {
+			for (size_t c = 0; c < 4; c++) {
+				if (std::abs((int)directImage[i + c] - (int)queuedImage[i + c]) > 2) {
+					differing++;
+					break;
+				}
+			}
+		}
+		printf("pixels differing: %zu\n", differing);
+		if (differing > (size_t)width * height / 1000 || CoveredPixels(width, height) == 0) {
+			printf("FAIL: the queued image does not match\n");
+			ok = false;
+		}
+		if (queued.draws != direct.draws || queued.samplesPassed > direct.samplesPassed) {
+			printf("FAIL: the queue drew other objects or passed more samples\n");
+			ok = false;
+		}
+		Profiler::reset();
+	}
+
+	ok = checkSort(keyCount) && ok;
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,437 @@
+// Render thread: input latency and frame time jitter with and without it.
+//
+// A simulated mouse sends drag events at a fixed rate into an event queue,
+// the way the window system delivers them, while a stress scene is drawn
+// offscreen (headless, like headless_bench). The same events are handled
+// two ways, as in the app with and without --single-thread:
+//   single thread  the render loop drains the queue between frames, like
+//                  glfwPollEvents, applies the events and draws
+//   render thread  an input thread waits on the queue, applies each batch
+//                  to a SceneState at once and publishes it through the
+//                  triple buffer; the render loop draws the newest one
+// Every frame is finished with glFinish, standing in for the swap. Reports
+// the latency of each event up to the end of the first frame that shows
+// it, how long events waited before they were handled, and the frame
+// interval with its standard deviation (jitter). Also checks the triple
+// buffer from two threads (no torn or out of order reads), and that both
+// loops end on the same scene and draw something; exits with 1 if not. Run
+// from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/render_thread_bench.cpp headless/EglContext.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/Interaction.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o render_thread_bench
+//   ./render_thread_bench [--width W] [--height H] [--seconds S] [--rate N] [--instances N] [model.obj]
+//
+// Defaults: 1280x720, 3 seconds of events per loop at 500 events/s (a
+// typical mouse), 10 instances, SandalF20.obj; more instances make slower
+// frames.
+
+#include "Geometry.h"
+#include "Interaction.h"
+#include "InstanceBuffer.h"
+#include "SceneState.h"
+#include "TripleBuffer.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// each drag event turns the model and the light a little further
+static const glm::vec3 dragAxis = glm::normalize(glm::vec3(0.3f, 1.0f, 0.0f));
+static const float dragAngle = 0.002f;
+
+// events as the window system queues them: the device appends, the
+// application drains
+class EventQueue
+{
+private:
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<size_t> pending;
+	bool closed = false;
+
+public:
+	void push(size_t event)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.push_back(event);
+		}
+		condition.notify_one();
+	}
+	// the device sends nothing more
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		condition.notify_one();
+	}
+	// whatever is queued, without waiting (glfwPollEvents)
+	void poll(std::vector<size_t>& events)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		events.assign(pending.begin(), pending.end());
+		pending.clear();
+	}
+	// at least one event, waiting for it (glfwWaitEvents); false once the
+	// queue is closed and empty
+	bool wait(std::vector<size_t>& events)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [&] { return closed || !pending.empty(); });
+		events.assign(pending.begin(), pending.end());
+		pending.clear();
+		return !events.empty();
+	}
+};
+
+// a scene and how many of the events it holds
+struct Snapshot
+{
+	SceneState scene;
+	size_t events = 0;
+};
+
+// what one loop measured, in milliseconds
+struct LoopResult
+{
+	std::vector<double> latencies;
+	std::vector<double> handleDelays;
+	std::vector<double> intervals;
+	SceneState scene;
+	size_t covered = 0;
+};
+
+static double percentile(std::vector<double> values, double fraction)
+{
+	if (values.empty()) {
+		return 0.0;
+	}
+	std::sort(values.begin(), values.end());
+	return values[(size_t)std::ceil(fraction * values.size()) - 1];
+}
+
+static double average(const std::vector<double>& values)
+{
+	double sum = 0.0;
+	for (double value : values) {
+		sum += value;
+	}
+	return values.empty() ? 0.0 : sum / values.size();
+}
+
+static double deviation(const std::vector<double>& values)
+{
+	double mean = average(values);
+	double squares = 0.0;
+	for (double value : values) {
+		squares += (value - mean) * (value - mean);
+	}
+	return values.empty() ? 0.0 : std::sqrt(squares / values.size());
+}
+
+// one producer publishing numbered payloads as fast as it can, one consumer
+// checking that every value it takes is whole and newer than the last
+static bool checkTripleBuffer(uint64_t count)
+{
+	struct Payload
+	{
+		uint64_t words[16] = {};
+	};
+	TripleBuffer<Payload> buffer;
+	std::thread producer([&] {
+		for (uint64_t sequence = 1; sequence <= count; sequence++) {
+			Payload& payload = buffer.write();
+			for (uint64_t& word : payload.words) {
+				word = sequence;
+			}
+			buffer.publish();
+			// lets the consumer in on a single core too
+			if (sequence % 64 == 0) {
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	uint64_t last = 0;
+	uint64_t taken = 0;
+	bool ok = true;
+	while (ok && last < count) {
+		if (!buffer.update()) {
+			std::this_thread::yield();
+			continue;
+		}
+		const Payload& payload = buffer.read();
+		uint64_t sequence = payload.words[0];
+		for (uint64_t word : payload.words) {
+			ok = ok && word == sequence;
+		}
+		ok = ok && sequence > last;
+		last = sequence;
+		taken++;
+	}
+	producer.join();
+	printf("triple buffer: %llu values published, %llu taken, %s\n", (unsigned long long)count,
+		(unsigned long long)taken, ok ? "none torn or out of order" : "FAIL: torn or out of order read");
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1280;
+	int height = 720;
+	double seconds = 3.0;
+	int rate = 500;
+	int instanceCount = 10;
+	std::string file = "SandalF20.obj";
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--seconds" && i + 1 < argc) {
+			seconds = std::max(atof(argv[++i]), 0.1);
+		}
+		else if (arg == "--rate" && i + 1 < argc) {
+			rate = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--instances" && i + 1 < argc) {
+			instanceCount = std::max(atoi(argv[++i]), 1);
+		}
+		else {
+			file = arg;
+		}
+	}
+
+	bool ok = checkTripleBuffer(1000000);
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s, %u hardware threads\n", (const char*)glGetString(GL_RENDERER),
+		std::thread::hardware_concurrency());
+
+	{
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+		glViewport(0, 0, width, height);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+
+		Geometry object(file, "object");
+		Geometry light("sphere.obj", "sphere");
+		object.loadNow(&pool);
+		light.loadNow(&pool);
+		if (!object.isResident() || !light.isResident()) {
+			return 1;
+		}
+		object.toSandalMat();
+		light.toSandalMat();
+		InstanceBuffer instances;
+		GenerateInstanceField(instances, instanceCount);
+
+		glm::vec3 eyePos(0, 0, 20);
+		FrameUniforms uniforms;
+		uniforms.view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		uniforms.projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+		uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+
+		// the app's starting scene, the sandal selected
+		SceneState initial;
+		initial.current = sceneSandal;
+		initial.models[sceneSandal].model = object.getModel();
+		initial.models[sceneLight].model = light.getModel();
+		for (ModelState& model : initial.models) {
+			model.transform = Transform::fromMatrix(model.model);
+		}
+		initial.lightPos = Geometry::getLightPos();
+
+		auto drawFrame = [&](const SceneState& scene) {
+			object.setModel(scene.models[scene.current].model);
+			light.setModel(scene.models[sceneLight].model);
+			Geometry::setLightPos(scene.lightPos);
+			uniforms.lightPos = glm::vec4(scene.lightPos, 1.0f);
+			frameUniforms.update(uniforms);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			object.drawInstanced(uniforms.view, uniforms.projection, shaders, instances);
+			light.draw(uniforms.view, uniforms.projection, shaders);
+			glFinish();
+		};
+		// untimed, so shader compilation on first use is not measured
+		for (int i = 0; i < 3; i++) {
+			drawFrame(initial);
+		}
+
+		size_t eventCount = (size_t)(seconds * rate);
+		std::vector<double> eventTimes(eventCount);
+
+		// runs the device for one loop; events are stamped in seconds since
+		// start as they are queued
+		auto runDevice = [&](EventQueue& queue, Clock::time_point start) {
+			for (size_t i = 0; i < eventCount; i++) {
+				std::this_thread::sleep_until(start + std::chrono::microseconds((long long)(i * 1e6 / rate)));
+				eventTimes[i] = std::chrono::duration<double>(Clock::now() - start).count();
+				queue.push(i);
+			}
+			queue.close();
+		};
+		auto now = [](Clock::time_point start) {
+			return std::chrono::duration<double>(Clock::now() - start).count();
+		};
+
+		// the events a finished frame shows for the first time
+		auto recordShown = [&](LoopResult& result, size_t& shown, size_t events, double finished) {
+			for (; shown < events; shown++) {
+				result.latencies.push_back((finished - eventTimes[shown]) * 1000.0);
+			}
+		};
+
+		// draw between batches of events on one thread
+		auto singleThread = [&]() {
+			LoopResult result;
+			EventQueue queue;
+			SceneState scene = initial;
+			size_t applied = 0;
+			size_t shown = 0;
+			std::vector<size_t> batch;
+			Clock::time_point start = Clock::now();
+			std::thread device(runDevice, std::ref(queue), start);
+			double lastFrame = -1.0;
+			while (shown < eventCount) {
+				queue.poll(batch);
+				for (size_t event : batch) {
+					result.handleDelays.push_back((now(start) - eventTimes[event]) * 1000.0);
+					RotateInteraction(interactBoth, scene, dragAxis, dragAngle);
+					applied++;
+				}
+				double frameStart = now(start);
+				if (lastFrame >= 0.0) {
+					result.intervals.push_back((frameStart - lastFrame) * 1000.0);
+				}
+				lastFrame = frameStart;
+				drawFrame(scene);
+				recordShown(result, shown, applied, now(start));
+			}
+			device.join();
+			result.scene = scene;
+			return result;
+		};
+
+		// handle events on their own thread and draw the newest scene
+		auto renderThread = [&]() {
+			LoopResult result;
+			EventQueue queue;
+			Snapshot first;
+			first.scene = initial;
+			TripleBuffer<Snapshot> snapshots(first);
+			std::vector<double> handleDelays;
+			Clock::time_point start = Clock::now();
+			std::thread device(runDevice, std::ref(queue), start);
+			std::thread input([&] {
+				Snapshot current = first;
+				std::vector<size_t> batch;
+				while (queue.wait(batch)) {
+					for (size_t event : batch) {
+						handleDelays.push_back((now(start) - eventTimes[event]) * 1000.0);
+						RotateInteraction(interactBoth, current.scene, dragAxis, dragAngle);
+						current.events++;
+					}
+					snapshots.publish(current);
+				}
+			});
+
+			size_t shown = 0;
+			double lastFrame = -1.0;
+			while (shown < eventCount) {
+				snapshots.update();
+				const Snapshot& snapshot = snapshots.read();
+				double frameStart = now(start);
+				if (lastFrame >= 0.0) {
+					result.intervals.push_back((frameStart - lastFrame) * 1000.0);
+				}
+				lastFrame = frameStart;
+				drawFrame(snapshot.scene);
+				recordShown(result, shown, snapshot.events, now(start));
+			}
+			device.join();
+			input.join();
+			result.handleDelays = handleDelays;
+			result.scene = snapshots.read().scene;
+			return result;
+		};
+
+		printf("%dx%d, %s, %d instances, %zu drag events at %d/s per loop\n", width, height, file.c_str(),
+			instanceCount, eventCount, rate);
+		printf("%-14s %7s %9s %9s %9s %9s %9s %9s %11s %11s\n", "loop", "frames", "frame ms", "jitter", "latency",
+			"p95", "p99", "max", "handled in", "p99");
+		struct Loop
+		{
+			const char* name;
+			std::function<LoopResult()> run;
+		};
+		const Loop loops[] = { { "single thread", singleThread }, { "render thread", renderThread } };
+		std::vector<LoopResult> results;
+		for (const Loop& loop : loops) {
+			LoopResult result = loop.run();
+			result.covered = CoveredPixels(width, height);
+			std::vector<double>& latencies = result.latencies;
+			printf("%-14s %7zu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %11.3f %11.3f\n", loop.name,
+				result.intervals.size() + 1, average(result.intervals), deviation(result.intervals),
+				percentile(latencies, 0.5), percentile(latencies, 0.95), percentile(latencies, 0.99),
+				percentile(latencies, 1.0), average(result.handleDelays), percentile(result.handleDelays, 0.99));
+			if (result.covered == 0) {
+				printf("FAIL: %s drew nothing\n", loop.name);
+				ok = false;
+			}
+			results.push_back(result);
+		}
+		printf("latency: from the event to the end of the first frame showing it (p50 to max); handled in: "
+			"from the event to its change to the scene; all in ms\n");
+
+		// the same events in the same order
+		float largest = 0.0f;
+		for (int i = 0; i < sceneModelCount; i++) {
+			for (int c = 0; c < 4; c++) {
+				glm::vec4 difference = glm::abs(results[0].scene.models[i].model[c] - results[1].scene.models[i].model[c]);
+				largest = std::max(largest, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+			}
+		}
+		if (largest > 1e-5f) {
+			printf("FAIL: the loops end on different scenes (largest difference %g)\n", largest);
+			ok = false;
+		}
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
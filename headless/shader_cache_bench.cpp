@@ -0,0 +1,257 @@
+// Shader setup at startup: compiled one at a time, compiled in parallel, and
+// restored from the program binary cache.
+//
+// Builds every program the app builds at startup (the shader variants, the
+// deferred lighting pass, the overlay and the shadow cube) on a surfaceless
+// context, like headless_bench: each waited for before the next is started
+// (how LoadShaders always worked), all started and then finished as the
+// driver completes them (ShaderVariants::begin/finish, in parallel with
+// KHR_parallel_shader_compile), with an empty binary cache (cold: compile
+// and store), and with the cache filled (warm). Every cold repetition adds
+// an unused define of its own, so neither this cache nor the driver's (Mesa
+// keeps one on disk, and offers program binaries only with it on) has seen
+// its sources. Checks that warm runs compile nothing, that cached programs have
+// the same uniforms and attributes as compiled ones, and that a binary the
+// driver rejects is compiled again. Exits with 1 if a check fails. Run from
+// the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/shader_cache_bench.cpp headless/EglContext.cpp src/ShaderProgram.cpp src/shader.cpp src/Material.cpp src/Profiler.cpp -lEGL -lGLEW -lGL -o shader_cache_bench
+//   ./shader_cache_bench [--repeat N] 2>/dev/null
+
+#include "ShaderProgram.h"
+#include "EglContext.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* cacheDirectory = "shaders/cache_bench";
+
+struct ProgramSource
+{
+	const char* vertexFilePath;
+	const char* fragmentFilePath;
+	std::vector<std::string> defines;
+};
+
+// what Window::initializeProgram builds, with a define that makes the
+// sources new to every cache
+static std::vector<ProgramSource> startupPrograms(int run)
+{
+	std::vector<ProgramSource> programs;
+	for (int flags = 0; flags < shaderVariantCount; flags++) {
+		if (ShaderVariantBuilt(flags)) {
+			programs.push_back({ "shaders/shader.vert", "shaders/shader.frag", ShaderVariantDefines(flags) });
+		}
+	}
+	programs.push_back({ "shaders/deferred.vert", "shaders/shader.frag",
+		{ "MATERIAL_COUNT " + std::to_string((int)materialCount), "DEFERRED_LIGHTING" } });
+	programs.push_back({ "shaders/overlay.vert", "shaders/overlay.frag", {} });
+	programs.push_back({ "shaders/shadow.vert", "shaders/shadow.frag", {} });
+	for (ProgramSource& program : programs) {
+		program.defines.push_back("BENCH_RUN " + std::to_string(run));
+	}
+	return programs;
+}
+
+// each program finished before the next is started
+static std::vector<GLuint> loadSerial(const std::vector<ProgramSource>& sources)
+{
+	std::vector<GLuint> programs;
+	for (const ProgramSource& source : sources) {
+		programs.push_back(LoadShaders(source.vertexFilePath, source.fragmentFilePath, source.defines));
+	}
+	return programs;
+}
+
+// all started, then finished in the order the driver completes them
+static std::vector<GLuint> loadParallel(const std::vector<ProgramSource>& sources)
+{
+	std::vector<PendingProgram> pending(sources.size());
+	std::vector<GLuint> programs(sources.size(), 0);
+	size_t left = 0;
+	for (size_t i = 0; i < sources.size(); i++) {
+		left += BeginLoadShaders(sources[i].vertexFilePath, sources[i].fragmentFilePath, sources[i].defines,
+			pending[i]);
+	}
+	while (left > 0) {
+		bool waited = true;
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (pending[i].program && ShadersReady(pending[i])) {
+				programs[i] = FinishLoadShaders(pending[i]);
+				left--;
+				waited = false;
+			}
+		}
+		if (waited) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	return programs;
+}
+
+static bool allLinked(const std::vector<GLuint>& programs)
+{
+	for (GLuint program : programs) {
+		if (!program) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void deletePrograms(const std::vector<GLuint>& programs)
+{
+	for (GLuint program : programs) {
+		glDeleteProgram(program);
+	}
+}
+
+// the interface a program shows to the code that draws with it
+static bool sameInterface(GLuint a, GLuint b)
+{
+	const GLenum queries[] = { GL_ACTIVE_UNIFORMS, GL_ACTIVE_ATTRIBUTES, GL_ACTIVE_UNIFORM_BLOCKS };
+	for (GLenum query : queries) {
+		GLint countA = -1, countB = -2;
+		glGetProgramiv(a, query, &countA);
+		glGetProgramiv(b, query, &countB);
+		if (countA != countB) {
+			return false;
+		}
+	}
+	const char* names[] = { "model", "normalMatrix", "material", "screenSize", "lightViewProjection" };
+	for (const char* name : names) {
+		if (glGetUniformLocation(a, name) != glGetUniformLocation(b, name)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	int repeat = 3;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--repeat" && i + 1 < argc) {
+			repeat = std::max(atoi(argv[++i]), 1);
+		}
+		else {
+			printf("Unknown argument %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s\n", glGetString(GL_RENDERER));
+#ifndef __APPLE__
+	printf("Parallel compile: %s\n\n", GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile ? "yes" : "no");
+#endif
+
+	int runNumber = 0;
+	std::vector<ProgramSource> sources = startupPrograms(runNumber);
+	std::error_code error;
+	std::filesystem::remove_all(cacheDirectory, error);
+
+	bool ok = true;
+	struct Run
+	{
+		const char* name;
+		bool cache;
+		bool parallel;
+		// every repetition on sources no cache has seen
+		bool cold;
+	};
+	const Run runs[] = {
+		{ "one at a time", false, false, true },
+		{ "parallel", false, true, true },
+		{ "cold cache", true, true, true },
+		{ "warm cache", true, true, false },
+	};
+	std::vector<GLuint> compiled;
+	printf("%zu programs\n%-16s %12s %10s %10s\n", sources.size(), "setup", "ms", "compiled", "cached");
+	for (const Run& run : runs) {
+		SetShaderCacheDirectory(run.cache ? cacheDirectory : "");
+		double totalMs = 0.0;
+		ShaderLoadCounts before = GetShaderLoadCounts();
+		for (int r = 0; r < repeat; r++) {
+			if (run.cold) {
+				sources = startupPrograms(++runNumber);
+			}
+			Clock::time_point start = Clock::now();
+			std::vector<GLuint> programs = run.parallel ? loadParallel(sources) : loadSerial(sources);
+			totalMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			if (!allLinked(programs)) {
+				printf("FAIL: %s: a program did not link\n", run.name);
+				ok = false;
+			}
+			if (run.cache && !run.cold) {
+				for (size_t i = 0; i < programs.size() && i < compiled.size(); i++) {
+					if (!sameInterface(programs[i], compiled[i])) {
+						printf("FAIL: cached program %zu differs from the compiled one\n", i);
+						ok = false;
+					}
+				}
+			}
+			if (compiled.empty()) {
+				compiled = programs;
+			}
+			else {
+				deletePrograms(programs);
+			}
+		}
+		ShaderLoadCounts after = GetShaderLoadCounts();
+		int compiledCount = after.compiled - before.compiled;
+		int cachedCount = after.cached - before.cached;
+		printf("%-16s %12.1f %10d %10d\n", run.name, totalMs / repeat, compiledCount / repeat, cachedCount / repeat);
+		if (run.cache && !run.cold && compiledCount > 0) {
+			printf("FAIL: the warm cache still compiled %d programs\n", compiledCount);
+			ok = false;
+		}
+	}
+
+	// a binary in a format the driver does not know is compiled again
+	std::vector<std::filesystem::path> files;
+	for (const auto& entry : std::filesystem::directory_iterator(cacheDirectory, error)) {
+		files.push_back(entry.path());
+	}
+	if (files.empty()) {
+		printf("FAIL: nothing was written to %s\n", cacheDirectory);
+		ok = false;
+	}
+	else {
+		for (const std::filesystem::path& file : files) {
+			// the format follows the 8-byte magic and the 4-byte version
+			std::fstream stream(file, std::ios::in | std::ios::out | std::ios::binary);
+			uint32_t badFormat = 0xdeadbeef;
+			stream.seekp(12);
+			stream.write((const char*)&badFormat, sizeof(badFormat));
+		}
+		ShaderLoadCounts before = GetShaderLoadCounts();
+		std::vector<GLuint> programs = loadParallel(sources);
+		ShaderLoadCounts after = GetShaderLoadCounts();
+		printf("\nrejected binaries: %d, compiled again: %d\n", after.rejected - before.rejected,
+			after.compiled - before.compiled);
+		if (!allLinked(programs) || after.rejected - before.rejected != (int)sources.size()
+			|| after.compiled - before.compiled != (int)sources.size()) {
+			printf("FAIL: rejected binaries were not compiled again\n");
+			ok = false;
+		}
+		deletePrograms(programs);
+	}
+	deletePrograms(compiled);
+	std::filesystem::remove_all(cacheDirectory, error);
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
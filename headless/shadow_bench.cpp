@@ -0,0 +1,260 @@
+// Cost of the main light's shadow cube, cached vs. redrawn every frame.
+//
+// Renders a model with main light shadows offscreen (headless, like
+// headless_bench) while the app's interaction code leaves everything still,
+// drags the model (Z), the light (X) or both (C). Each run is done once with
+// PointShadowMap's cache, which redraws only the faces the moves touched,
+// and once with every face redrawn each frame. Reports the time of the
+// shadow pass alone, the faces it drew per frame and the whole frame time,
+// next to a frame without shadows. The program exits with 1 if the shadows
+// do not show, if a still scene redraws any face, or if the cached cube
+// ever gives a different image than a freshly drawn one. Run from the
+// repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc headless/shadow_bench.cpp headless/EglContext.cpp src/PointShadowMap.cpp src/Geometry.cpp src/SoftwareRasterizer.cpp src/MeshArena.cpp src/RenderQueue.cpp src/Interaction.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o shadow_bench
+//   ./shadow_bench [--width W] [--height H] [--frames N] [--cube N] [--compact] [model.obj]
+//
+// Defaults: 1280x720, 30 frames per run, 1024x1024 texels per cube face,
+// SandalF20.obj.
+
+#include "Geometry.h"
+#include "Interaction.h"
+#include "PointShadowMap.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int warmupFrames = 2;
+
+// still, or dragging in one of the interaction modes
+struct Phase
+{
+	const char* name;
+	bool moving;
+	InteractionMode mode;
+};
+static const Phase phases[] = {
+	{ "static", false, interactModel },
+	{ "drag model", true, interactModel },
+	{ "drag light", true, interactLight },
+	{ "drag both", true, interactBoth },
+};
+
+static std::vector<unsigned char> readPixels(int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+static int largestDifference(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+{
+	int largest = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		largest = std::max(largest, std::abs((int)a[i] - (int)b[i]));
+	}
+	return largest;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1280;
+	int height = 720;
+	int frames = 30;
+	int cubeSize = 1024;
+	std::string file = "SandalF20.obj";
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--cube" && i + 1 < argc) {
+			cubeSize = atoi(argv[++i]);
+		}
+		else if (arg == "--compact") {
+			Geometry::compactVertices = true;
+		}
+		else {
+			file = arg;
+		}
+	}
+
+	EglContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+	bool ok = true;
+	{
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+		glViewport(0, 0, width, height);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		PointShadowMap shadowMap;
+		if (!shadowMap.load("shaders/shadow.vert", "shaders/shadow.frag", cubeSize)) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		ThreadPool pool;
+
+		glm::vec3 eyePos(0, 0, 20);
+		glm::mat4 view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+
+		Geometry light("sphere.obj", "sphere");
+		Geometry object(file, "object");
+		light.loadNow(&pool);
+		object.loadNow(&pool);
+		if (!object.isResident()) {
+			return 1;
+		}
+		object.toSandalMat();
+		light.toSandalMat();
+		// turned towards the camera rather than edge on, and scrolled in a
+		// few steps
+		glm::mat4 facing = glm::rotate(glm::mat4(1.0f), 0.9f, glm::vec3(1, 0, 0))
+			* glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(0, 1, 0)) * glm::scale(glm::mat4(1.0f), glm::vec3(2.5f));
+		object.setModel(facing);
+		std::vector<const Geometry*> casters(1, &object);
+
+		// the shadow pass timed on its own, finished on the GPU before the
+		// scene is drawn
+		double shadowMs = 0.0;
+		int faces = 0;
+		auto drawFrame = [&](bool shadows, bool cached) {
+			FrameUniforms uniforms;
+			uniforms.view = view;
+			uniforms.projection = projection;
+			uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+			uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+			shadowMs = 0.0;
+			faces = 0;
+			if (shadows) {
+				glFinish();
+				Clock::time_point start = Clock::now();
+				if (!cached) {
+					shadowMap.invalidate();
+				}
+				faces = shadowMap.update(Geometry::getLightPos(), casters);
+				glFinish();
+				shadowMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				shadowMap.bind();
+				shadowMap.setUniforms(uniforms);
+			}
+			frameUniforms.update(uniforms);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			object.draw(view, projection, shaders);
+			light.draw(view, projection, shaders);
+		};
+
+		// the shadows show
+		drawFrame(false, true);
+		std::vector<unsigned char> unshadowed = readPixels(width, height);
+		size_t covered = CoveredPixels(width, height);
+		drawFrame(true, true);
+		std::vector<unsigned char> shadowed = readPixels(width, height);
+		size_t darker = 0;
+		for (size_t i = 0; i < shadowed.size(); i += 4) {
+			darker += (int)unshadowed[i] + unshadowed[i + 1] + unshadowed[i + 2]
+				- shadowed[i] - shadowed[i + 1] - shadowed[i + 2] > 24 ? 1 : 0;
+		}
+		printf("%zu of %zu covered pixels in shadow\n", darker, covered);
+		if (covered == 0 || darker == 0) {
+			printf("FAIL: no shadows\n");
+			ok = false;
+		}
+
+		printf("%dx%d, %s, %dx%d cube faces, %d frames per run\n", width, height, file.c_str(), cubeSize, cubeSize,
+			frames);
+		printf("%-12s %-8s %12s %12s %12s\n", "run", "cube", "shadow ms", "faces", "frame ms");
+		for (const Phase& phase : phases) {
+			for (int cached = 1; cached >= 0; cached--) {
+				// every run starts from the same transforms
+				object.setModel(facing);
+				Geometry::setLightPos(glm::vec3(-8.0f, 8.0f, 0.0f));
+				light.setModel(glm::scale(glm::translate(glm::mat4(1.0f), Geometry::getLightPos()), glm::vec3(0.1f)));
+
+				double totalShadowMs = 0.0;
+				double totalFrameMs = 0.0;
+				int totalFaces = 0;
+				for (int frame = -warmupFrames; frame < frames; frame++) {
+					if (phase.moving) {
+						float t = (frame + warmupFrames) / 60.0f;
+						glm::vec3 axis = glm::normalize(glm::vec3(std::sin(0.7f * t), 1.0f, std::cos(0.3f * t)));
+						RotateInteraction(phase.mode, &object, &light, axis, 0.02f);
+					}
+					Clock::time_point start = Clock::now();
+					drawFrame(true, cached != 0);
+					glFinish();
+					if (frame < 0) {
+						continue;
+					}
+					totalFrameMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+					totalShadowMs += shadowMs;
+					totalFaces += faces;
+				}
+				printf("%-12s %-8s %12.3f %12.2f %12.3f\n", phase.name, cached ? "cached" : "redrawn",
+					totalShadowMs / frames, (double)totalFaces / frames, totalFrameMs / frames);
+
+				if (cached && !phase.moving && totalFaces > 0) {
+					printf("FAIL: a still scene redrew %d faces\n", totalFaces);
+					ok = false;
+				}
+				// what the cache kept matches drawing every face now
+				if (cached) {
+					drawFrame(true, true);
+					std::vector<unsigned char> cachedImage = readPixels(width, height);
+					drawFrame(true, false);
+					int difference = largestDifference(cachedImage, readPixels(width, height));
+					if (difference > 0) {
+						printf("FAIL: the cached cube is out of date after \"%s\" (difference %d)\n", phase.name,
+							difference);
+						ok = false;
+					}
+				}
+			}
+		}
+
+		object.setModel(facing);
+		double totalFrameMs = 0.0;
+		for (int frame = -warmupFrames; frame < frames; frame++) {
+			Clock::time_point start = Clock::now();
+			drawFrame(false, true);
+			glFinish();
+			if (frame >= 0) {
+				totalFrameMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			}
+		}
+		printf("%-12s %-8s %12s %12s %12.3f\n", "no shadows", "-", "-", "-", totalFrameMs / frames);
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
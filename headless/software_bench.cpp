@@ -0,0 +1,274 @@
+// Software rasterizer: agreement with GL and throughput per thread count.
+//
+// Draws a model and the light sphere with SoftwareRasterizer, through the
+// same Geometry::draw interface the GL path uses, and compares the images
+// with GL's (an EGL context, offscreen like headless_bench) for Phong and
+// normal coloring. Pixels may differ where the two rasterizers decide
+// coverage of an edge differently, so a small share of the covered pixels
+// is allowed to differ; the rest must agree within a few levels. The GL
+// part is skipped when no context can be created. Then times two scenes
+// with 1, 2, 4, ... threads up to the hardware's: an instance field drawn
+// object by object (triangle bound) and the model close up (fill bound),
+// reporting Mtris/s, Mpixels/s and the speedup over one thread. Exits with
+// 1 on a mismatch or an empty image. Run from the repository root:
+//
+//   g++ -O3 -march=native -std=c++17 -pthread -Isrc headless/software_bench.cpp headless/EglContext.cpp src/SoftwareRasterizer.cpp src/Geometry.cpp src/MeshArena.cpp src/RenderQueue.cpp src/InstanceBuffer.cpp src/Frustum.cpp src/ObjectBvh.cpp src/ShaderProgram.cpp src/Material.cpp src/Profiler.cpp src/shader.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/MeshCache.cpp src/MeshLod.cpp src/MeshOptimizer.cpp src/VertexWeld.cpp src/VertexFormat.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -lEGL -lGLEW -lGL -o software_bench
+//   ./software_bench [--width W] [--height H] [--frames N] [--instances N] [model.obj]
+//
+// Defaults: 1920x1080, 10 frames per measurement, 1000 instances,
+// SandalF20.obj. -march=native picks the AVX2 path where the CPU has it.
+
+#include "Geometry.h"
+#include "InstanceBuffer.h"
+#include "SoftwareRasterizer.h"
+#include "EglContext.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int warmupFrames = 2;
+// channel difference allowed inside, and share of covered pixels allowed
+// beyond it along edges
+static const int channelTolerance = 4;
+static const double edgeShare = 0.01;
+
+// material setters by MaterialId
+static void (Geometry::*const materialSetters[materialCount])() = {
+	&Geometry::toRabbitMat,
+	&Geometry::toSandalMat,
+	&Geometry::toBearMat,
+};
+
+static size_t coveredPixels(const std::vector<unsigned char>& pixels)
+{
+	size_t covered = 0;
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		covered += pixels[i] || pixels[i + 1] || pixels[i + 2] ? 1 : 0;
+	}
+	return covered;
+}
+
+// same as GL within the tolerances; prints what it found
+static bool compareImages(const char* name, const std::vector<unsigned char>& gl,
+	const std::vector<unsigned char>& software)
+{
+	size_t covered = std::max(coveredPixels(gl), coveredPixels(software));
+	size_t differing = 0;
+	int largest = 0;
+	for (size_t i = 0; i < gl.size(); i += 4) {
+		int difference = 0;
+		for (int c = 0; c < 4; c++) {
+			difference = std::max(difference, std::abs((int)gl[i + c] - (int)software[i + c]));
+		}
+		largest = std::max(largest, difference);
+		differing += difference > channelTolerance ? 1 : 0;
+	}
+	printf("%-16s %9zu covered, %7zu differ by more than %d (%.3f%%), largest difference %d\n", name, covered,
+		differing, channelTolerance, covered ? 100.0 * differing / covered : 0.0, largest);
+	if (covered == 0) {
+		printf("FAIL: %s is empty\n", name);
+		return false;
+	}
+	if (differing > covered * edgeShare) {
+		printf("FAIL: %s does not match GL\n", name);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	int width = 1920;
+	int height = 1080;
+	int frames = 10;
+	int instanceCount = 1000;
+	std::string file = "SandalF20.obj";
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--width" && i + 1 < argc) {
+			width = atoi(argv[++i]);
+		}
+		else if (arg == "--height" && i + 1 < argc) {
+			height = atoi(argv[++i]);
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--instances" && i + 1 < argc) {
+			instanceCount = std::max(atoi(argv[++i]), 1);
+		}
+		else {
+			file = arg;
+		}
+	}
+	printf("software rasterizer: %d-wide SIMD, %u hardware threads\n", SoftwareRasterizer::simdWidth(),
+		std::thread::hardware_concurrency());
+
+	bool ok = true;
+	ThreadPool loadPool;
+	Geometry light("sphere.obj", "sphere");
+	Geometry object(file, "object");
+	light.loadForSoftware(&loadPool);
+	object.loadForSoftware(&loadPool);
+	if (!object.isResident() || !light.isResident()) {
+		return 1;
+	}
+	object.toSandalMat();
+	light.toSandalMat();
+
+	glm::vec3 eyePos(0, 0, 20);
+	FrameUniforms uniforms;
+	uniforms.view = glm::lookAt(eyePos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	uniforms.projection = glm::perspective(glm::radians(60.0f), (float)width / height, 1.0f, 1000.0f);
+	uniforms.cameraPos = glm::vec4(eyePos, 1.0f);
+	uniforms.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+	// turned towards the camera rather than edge on
+	glm::mat4 facing = glm::rotate(glm::mat4(1.0f), 0.9f, glm::vec3(1, 0, 0))
+		* glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(0, 1, 0));
+
+	SoftwareRasterizer rasterizer(&loadPool);
+	rasterizer.resize(width, height);
+	rasterizer.setFrame(uniforms);
+
+	// the GL images of the same scene
+	EglContext context;
+	if (context.create()) {
+		printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+		OffscreenTarget target;
+		if (!target.create(width, height)) {
+			return 1;
+		}
+		glViewport(0, 0, width, height);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LEQUAL);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		ShaderVariants shaders;
+		if (!shaders.load("shaders/shader.vert", "shaders/shader.frag")) {
+			return 1;
+		}
+		FrameUniformBuffer frameUniforms;
+		MaterialBuffer materials;
+		frameUniforms.update(uniforms);
+
+		Geometry glLight("sphere.obj", "sphere");
+		Geometry glObject(file, "object");
+		glLight.loadNow(&loadPool);
+		glObject.loadNow(&loadPool);
+		glObject.toSandalMat();
+		glLight.toSandalMat();
+		glObject.setModel(facing);
+		object.setModel(facing);
+
+		const char* names[] = { "phong", "normal coloring" };
+		for (int mode = 0; mode < 2; mode++) {
+			if (mode == 1) {
+				glObject.switchRenderFunc();
+				object.switchRenderFunc();
+			}
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glObject.draw(uniforms.view, uniforms.projection, shaders);
+			glLight.draw(uniforms.view, uniforms.projection, shaders);
+			std::vector<unsigned char> glImage((size_t)width * height * 4);
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, glImage.data());
+
+			rasterizer.clear();
+			object.draw(uniforms.view, uniforms.projection, rasterizer);
+			light.draw(uniforms.view, uniforms.projection, rasterizer);
+			std::vector<unsigned char> softwareImage;
+			rasterizer.readPixels(softwareImage);
+			ok = compareImages(names[mode], glImage, softwareImage) && ok;
+		}
+		object.switchRenderFunc();
+	}
+	else {
+		printf("no GL context, comparison skipped\n");
+	}
+
+	// scenes to time; each returns after drawing one frame
+	InstanceBuffer instances;
+	GenerateInstanceField(instances, instanceCount);
+	glm::mat4 closeUp = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 8.0f)) * facing
+		* glm::scale(glm::mat4(1.0f), glm::vec3(1.5f));
+	struct Scene
+	{
+		const char* name;
+		std::function<void(SoftwareRasterizer&)> draw;
+	};
+	Scene scenes[] = {
+		{ "field", [&](SoftwareRasterizer& target) {
+			for (size_t i = 0; i < instances.size(); i++) {
+				object.setModel(instances[i].model);
+				(object.*materialSetters[instances[i].material])();
+				object.draw(uniforms.view, uniforms.projection, target);
+			}
+			light.draw(uniforms.view, uniforms.projection, target);
+		} },
+		{ "close up", [&](SoftwareRasterizer& target) {
+			object.setModel(closeUp);
+			object.toSandalMat();
+			object.draw(uniforms.view, uniforms.projection, target);
+			light.draw(uniforms.view, uniforms.projection, target);
+		} },
+	};
+
+	std::vector<unsigned> threadCounts;
+	unsigned hardware = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned threads = 1; threads < hardware; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(hardware);
+
+	printf("%dx%d, %s, %d frames per measurement\n", width, height, file.c_str(), frames);
+	printf("%-10s %8s %10s %12s %12s %12s %9s\n", "scene", "threads", "frame ms", "triangles", "Mtris/s",
+		"Mpixels/s", "speedup");
+	for (const Scene& scene : scenes) {
+		double oneThreadMs = 0.0;
+		for (unsigned threads : threadCounts) {
+			// the calling thread works too
+			std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);
+			SoftwareRasterizer timed(pool.get());
+			timed.resize(width, height);
+			timed.setFrame(uniforms);
+
+			double totalMs = 0.0;
+			RasterStats stats;
+			for (int frame = -warmupFrames; frame < frames; frame++) {
+				Clock::time_point start = Clock::now();
+				timed.clear();
+				scene.draw(timed);
+				if (frame >= 0) {
+					totalMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+				}
+				stats = timed.stats();
+			}
+			double frameMs = totalMs / frames;
+			if (threads == 1) {
+				oneThreadMs = frameMs;
+			}
+			printf("%-10s %8u %10.2f %12zu %12.2f %12.2f %8.2fx\n", scene.name, threads, frameMs, stats.triangles,
+				stats.triangles / (frameMs * 1000.0), stats.pixels / (frameMs * 1000.0), oneThreadMs / frameMs);
+
+			std::vector<unsigned char> image;
+			timed.readPixels(image);
+			if (coveredPixels(image) == 0) {
+				printf("FAIL: %s drew nothing\n", scene.name);
+				ok = false;
+			}
+		}
+	}
+
+	printf(ok ? "all checks passed\n" : "checks FAILED\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#version 330 core
+
+// Deferred lighting pass: one triangle covering the screen, made from
+// gl_VertexID without vertex buffers. shader.frag compiled with
+// DEFERRED_LIGHTING shades it from the G-buffer.
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
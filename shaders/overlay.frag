@@ -0,0 +1,12 @@
+#version 330 core
+
+// Fragment shader of the text overlay: one flat color.
+
+uniform vec3 color;
+
+out vec4 fragColor;
+
+void main()
+{
+    fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+// Vertex shader of the text overlay: positions are in framebuffer pixels
+// from the top left corner.
+
+layout (location = 0) in vec2 position;
+
+uniform vec2 screenSize;
+
+void main()
+{
+    vec2 ndc = position / screenSize * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+}
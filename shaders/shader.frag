@@ -2,101 +2,273 @@
 
 // Inputs to the fragment shader are the outputs of the same name from the vertex shader.
 // Note you don't have access to the vertex shader's default output, gl_Position.
+//
+// Compiled in variants; LoadShaders puts these defines after the #version line:
+//   MATERIAL_COUNT  - entries in the Materials block
+//   NORMAL_COLORING - show the normals instead of Phong illumination
+//   LIGHT_PROXY     - the light sphere, shown in the light's color only
+//   INSTANCED       - transforms and materials per instance (InstanceBuffer)
+//   GBUFFER         - write the lit surface to the G-buffer instead of
+//                     shading it (DeferredRenderer's geometry pass)
+//   DEFERRED_LIGHTING - the deferred lighting pass: shade each pixel once
+//                     from the G-buffer, drawn with deferred.vert
+//
+// Besides the main light, shaded variants add the point lights of their
+// cluster (ClusteredLights.h) when FrameUniforms.clusterGrid.w is set, and
+// shadow the main light from its depth cube (PointShadowMap.h) when
+// FrameUniforms.shadow.x is.
 
+#ifdef DEFERRED_LIGHTING
+// the surface, read back from the G-buffer in main()
+vec3 posOutput;
+vec3 lightingNormal;
+vec3 surfaceNormal;
+#else
 in vec3 normalOutput;
 in vec3 posOutput;
+#ifndef NORMAL_COLORING
+// lightingNormal is the normal remapped to [0, 1] before the normal matrix,
+// which the Phong terms are tuned to; surfaceNormal is the true one
+in vec3 lightingNormal;
+in vec3 surfaceNormal;
+#endif
+#endif
 
-uniform mat4 model;
+// per-frame constants, std140 layout matching FrameUniforms in ShaderProgram.h
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 lightPos;
+    ivec4 clusterGrid;      // tiles x, y, depth slices, light count
+    vec4 clusterDepth;      // near depth, slices per log depth unit
+    vec4 clusterScreen;     // viewport size, tiles per pixel
+    vec4 shadow;            // on, cube near and far plane, normal offset
+};
 
-uniform vec3 lightPos;
+#ifndef NORMAL_COLORING
+// material table, std140 layout matching Material in Material.h
+struct Material
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;      // w is the shininess
+    vec4 lightColor;
+};
 
-uniform int switchRender;
-uniform int rabbit;
-uniform int sandal;
-uniform int bear;
-uniform int sphere;
+layout (std140) uniform Materials
+{
+    Material materials[MATERIAL_COUNT];
+};
 
-// final color of the pixel
-out vec4 fragColor;
+#if defined(DEFERRED_LIGHTING)
+// material of the pixel, from the G-buffer
+int material;
+#elif defined(INSTANCED)
+// material of this instance, from the instance buffer
+flat in int materialIndex;
+#else
+// index of the material of the model being shown
+uniform int material;
+#endif
 
-void main()
+#if defined(GBUFFER) || defined(DEFERRED_LIGHTING)
+// a unit direction in octahedral form, mapped to [0, 1]
+vec2 encodeDirection(vec3 n)
 {
-    // material attributes
-    vec3 ambChart;
-    vec3 diffChart;
-    vec3 specChart;
-    float shininess;
-
-    vec3 lightColor;
-
-    // normal calculation for phong illumination
-    vec3 normal = mat3(transpose(inverse(model))) * normalOutput;
-
-    // chrome material rabbit, red light
-    if (rabbit == 1) {
-        ambChart = vec3(0.25, 0.25, 0.25);
-        diffChart = vec3(0.4, 0.4, 0.4);
-        specChart = vec3(0.774597, 0.774597, 0.774597);
-        shininess = 0.6;
-        lightColor = vec3(0.75, 0, 0);
-        // white light to see material clearly
-        // lightColor = vec3(1, 1, 1);
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    if (n.z < 0.0) {
+        p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
     }
-    // yellow plastic material sandal, green light
-    else if (sandal == 1) {
-        ambChart = vec3(0.0, 0.0, 0.0);
-        diffChart = vec3(0.5, 0.5, 0.0);
-        specChart = vec3(0.6, 0.6, 0.6);
-        shininess = 0.25;
-        lightColor = vec3(0, 1, 0);
-        // white light to see material clearly
-        // lightColor = vec3(1, 1, 1);
+    return p * 0.5 + 0.5;
+}
+
+vec3 decodeDirection(vec2 texel)
+{
+    vec2 p = texel * 2.0 - 1.0;
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// G-buffer surface texel (GL_RGB10_A2): the direction of the lighting
+// normal, the log2 of its length (the normal is not unit length, and its
+// length brightens the diffuse term) over [-8, 8], and the material
+vec4 encodeSurface(vec3 normal, int material)
+{
+    float len = max(length(normal), 1e-6);
+    return vec4(encodeDirection(normal / len), clamp((log2(len) + 8.0) / 16.0, 0.0, 1.0), float(material) / 3.0);
+}
+
+vec3 decodeNormal(vec3 texel)
+{
+    return decodeDirection(texel.xy) * exp2(texel.z * 16.0 - 8.0);
+}
+#endif
+
+#ifdef DEFERRED_LIGHTING
+uniform sampler2D gbufferDepth;
+uniform sampler2D gbufferSurface;
+uniform sampler2D gbufferNormal;
+// from normalized device coordinates back to world space
+uniform mat4 inverseViewProjection;
+
+// fill in posOutput, the normals and material for this pixel; false
+// where nothing was drawn
+bool readGBuffer()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gbufferDepth, pixel, 0).r;
+    if (depth >= 1.0) {
+        return false;
     }
-    // obsidian material bear, blue light
-    else {
-        ambChart = vec3(0.05375, 0.05, 0.06625);
-        diffChart = vec3(0.18275, 0.17, 0.22525);
-        specChart = vec3(0.332741, 0.328634, 0.346435);
-        shininess = 0.3;
-        lightColor = vec3(0, 0, 1);
-        // white light to see material clearly
-        // lightColor = vec3(1, 1, 1);
+    gl_FragDepth = depth;
+    vec4 surface = texelFetch(gbufferSurface, pixel, 0);
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(gbufferDepth, 0)) * 2.0 - 1.0;
+    vec4 position = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    posOutput = position.xyz / position.w;
+    lightingNormal = decodeNormal(surface.xyz);
+    surfaceNormal = decodeDirection(texelFetch(gbufferNormal, pixel, 0).xy);
+    material = int(surface.w * 3.0 + 0.5);
+    return true;
+}
+#endif
+
+#ifndef LIGHT_PROXY
+// clustered point lights, see LightClusters: two texels per light
+// (position and radius, color), per cluster the first entry in
+// lightIndices and the count, and the light lists
+uniform samplerBuffer lightData;
+uniform usamplerBuffer lightClusters;
+uniform usamplerBuffer lightIndices;
+
+// diffuse and specular light of the point lights binned into this
+// fragment's cluster
+vec3 clusteredLights(vec3 normal, vec3 viewDir, vec3 diffChart, vec3 specChart, float shininess)
+{
+    float viewDepth = -(view * vec4(posOutput, 1.0)).z;
+    ivec3 cell = ivec3(ivec2(gl_FragCoord.xy * clusterScreen.zw),
+        int(log(max(viewDepth, clusterDepth.x) / clusterDepth.x) * clusterDepth.y));
+    cell = clamp(cell, ivec3(0), clusterGrid.xyz - 1);
+    int cluster = (cell.z * clusterGrid.y + cell.y) * clusterGrid.x + cell.x;
+    uvec2 range = texelFetch(lightClusters, cluster).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).x);
+        vec4 positionRadius = texelFetch(lightData, 2 * light);
+        vec3 color = texelFetch(lightData, 2 * light + 1).rgb;
+
+        vec3 toLight = positionRadius.xyz - posOutput;
+        float dist = length(toLight);
+        // same falloff as the main light, faded to zero at the radius the
+        // light was binned with
+        float attenuation = 2.0 / (1.0 + 0.09 * dist + 0.032 * (dist * dist));
+        float fade = clamp(1.0 - pow(dist / positionRadius.w, 4.0), 0.0, 1.0);
+        attenuation *= fade * fade;
+
+        vec3 lightDir = toLight / max(dist, 1e-4);
+        float diff = max(dot(normal, lightDir), 0.0);
+        float spec = pow(max(dot(viewDir, reflect(-lightDir, normal)), 0.0), shininess);
+        result += attenuation * color * (diff * diffChart + spec * specChart);
     }
+    return result;
+}
 
-    // light sphere gets no diffuse/specular
-    if (sphere == 1) {
-        ambChart = lightColor;
-        diffChart = vec3(0.0, 0.0, 0.0);
-        specChart = vec3(0.0, 0.0, 0.0);
+// depth cube around the main light
+uniform samplerCubeShadow shadowMap;
+
+// share of the main light reaching this fragment, 0 to 1 at shadow edges;
+// normal is the surface normal, pointing away from the surface
+float mainLightVisibility(vec3 normal)
+{
+    if (shadow.x == 0.0) {
+        return 1.0;
     }
+    // pushed off the surface by about a texel, which grows with distance
+    vec3 toFragment = posOutput - lightPos.xyz;
+    vec3 offset = normalize(normal) * (shadow.w * length(toFragment));
+    toFragment += offset;
+
+    // the depth the face looking along the major axis stored for this
+    // direction, mapped like the cube's perspective projection
+    vec3 a = abs(toFragment);
+    float major = max(a.x, max(a.y, a.z));
+    float near = shadow.y;
+    float far = shadow.z;
+    float depth = (far + near) / (far - near) - 2.0 * far * near / ((far - near) * major);
+    return texture(shadowMap, vec4(toFragment, min(depth * 0.5 + 0.5, 1.0)));
+}
+#endif
+#endif
+
+// final color of the pixel
+layout (location = 0) out vec4 fragColor;
+#ifdef GBUFFER
+// the G-buffer's surface normal texel (GL_RG16)
+layout (location = 1) out vec2 fragNormal;
+#endif
+
+void main()
+{
+#ifdef NORMAL_COLORING
+    fragColor = vec4(normalOutput, 1.0);
+#else
+#if defined(INSTANCED) && !defined(DEFERRED_LIGHTING)
+    int material = materialIndex;
+#endif
+#ifdef GBUFFER
+    fragColor = encodeSurface(lightingNormal, material);
+    fragNormal = encodeDirection(normalize(surfaceNormal));
+#else
+#ifdef DEFERRED_LIGHTING
+    // the background keeps the target's clear color and depth
+    if (!readGBuffer()) {
+        discard;
+    }
+#endif
+    vec3 lightColor = materials[material].lightColor.rgb;
 
     // quadratic light attenuation
-    float dist = length(lightPos - posOutput);
+    float dist = length(lightPos.xyz - posOutput);
     float attenuation = 2.0 / (1.0 + 0.09 * dist + 0.032 * (dist * dist));
 
+#ifdef LIGHT_PROXY
+    // light sphere gets no diffuse/specular
+    vec3 result = attenuation * (lightColor * lightColor);
+#else
+    vec3 ambChart = materials[material].ambient.rgb;
+    vec3 diffChart = materials[material].diffuse.rgb;
+    vec3 specChart = materials[material].specular.rgb;
+    float shininess = materials[material].specular.w;
+
+    // normal for phong illumination
+    vec3 normal = lightingNormal;
+
     //ambient
     vec3 ambient = lightColor * ambChart;
 
     //diffuse
-    vec3 lightDir = normalize(lightPos - posOutput);
+    vec3 lightDir = normalize(lightPos.xyz - posOutput);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 diffuse = lightColor * (diff * diffChart);
 
     //specular
-    vec3 viewPos = vec3(0, 0, 20);
-    vec3 viewDir = normalize(viewPos - posOutput);
+    vec3 viewDir = normalize(cameraPos.xyz - posOutput);
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
     vec3 specular = lightColor * (spec * specChart);
 
-    vec3 result = attenuation * (ambient + diffuse + specular);
+    vec3 result = attenuation * (ambient + mainLightVisibility(surfaceNormal) * (diffuse + specular));
 
-    // normal coloring
-    if (switchRender == 0) {
-        fragColor = vec4(result, 1.0);
+    if (clusterGrid.w > 0) {
+        result += clusteredLights(normal, viewDir, diffChart, specChart, shininess);
     }
-    // phong illumination coloring
-    else {
-        fragColor = vec4(vec3(normalOutput.x, normalOutput.y, normalOutput.z), 1.0);
-    }
-}
\ No newline at end of file
+#endif
+
+    fragColor = vec4(result, 1.0);
+#endif
+#endif
+}
@@ -4,13 +4,40 @@
 // You can define extra functions if needed, and the main() function is
 // called when the vertex shader gets run.
 // The vertex shader gets called once per vertex.
+//
+// Compiled in variants; see shader.frag for the defines.
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 normal;
 
-uniform mat4 projection;
-uniform mat4 view;
+// per-frame constants, std140 layout matching FrameUniforms in ShaderProgram.h
+layout (std140) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPos;
+    vec4 lightPos;
+    ivec4 clusterGrid;      // tiles x, y, depth slices, light count
+    vec4 clusterDepth;      // near depth, slices per log depth unit
+    vec4 clusterScreen;     // viewport size, tiles per pixel
+    vec4 shadow;            // on, cube near and far plane, normal offset
+};
+
 uniform mat4 model;
+// computed on the CPU when the model changes
+uniform mat3 normalMatrix;
+
+#ifdef INSTANCED
+// per-instance transform within the set (model moves the whole set), its
+// normal matrix and material, from the instance buffer
+layout (location = 2) in mat4 instanceModel;
+layout (location = 6) in mat3 instanceNormalMatrix;
+layout (location = 9) in int instanceMaterial;
+// maps compact positions back to mesh space, before the instance transform
+uniform mat4 dequantize;
+
+flat out int materialIndex;
+#endif
 
 // Outputs of the vertex shader are the inputs of the same name of the fragment shader.
 // The default output, gl_Position, should be assigned something. You can define as many
@@ -18,14 +45,28 @@ uniform mat4 model;
 
 out vec3 normalOutput;
 out vec3 posOutput;
+#ifndef NORMAL_COLORING
+out vec3 lightingNormal;
+// the unit surface normal in world space, for the shadow lookup
+out vec3 surfaceNormal;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 objectModel = model * instanceModel * dequantize;
+    mat3 objectNormalMatrix = normalMatrix * instanceNormalMatrix;
+    materialIndex = instanceMaterial;
+#else
+    mat4 objectModel = model;
+    mat3 objectNormalMatrix = normalMatrix;
+#endif
+
     // OpenGL maintains the D matrix so you only need to multiply by P, V (aka C inverse), and M
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    gl_Position = projection * view * objectModel * vec4(position, 1.0);
 
     // fragment position
-    posOutput = vec3(model * vec4(position, 1.0));
+    posOutput = vec3(objectModel * vec4(position, 1.0));
 
     // normal vector
     vec3 convertedNormal = normalize(normal);
@@ -33,4 +74,11 @@ void main()
     convertedNormal.y = (convertedNormal.y + 1) / 2;
     convertedNormal.z = (convertedNormal.z + 1) / 2;
     normalOutput = convertedNormal;
-}
\ No newline at end of file
+
+#ifndef NORMAL_COLORING
+    // the normal matrix is linear, so applying it per vertex and
+    // interpolating gives the same normal the fragment shader used to compute
+    lightingNormal = objectNormalMatrix * convertedNormal;
+    surfaceNormal = objectNormalMatrix * normalize(normal);
+#endif
+}
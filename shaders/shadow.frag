@@ -0,0 +1,8 @@
+#version 330 core
+
+// Depth-only pass of PointShadowMap: the framebuffer has no color, the
+// rasterized depth is all that is kept.
+
+void main()
+{
+}
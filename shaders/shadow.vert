@@ -0,0 +1,15 @@
+#version 330 core
+
+// Depth-only pass of PointShadowMap: one face of the light's cube at a
+// time, positions only.
+
+layout (location = 0) in vec3 position;
+
+uniform mat4 model;
+// the face's projection * view from the light
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * model * vec4(position, 1.0);
+}
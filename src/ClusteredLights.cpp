@@ -0,0 +1,303 @@
+#include "ClusteredLights.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// the falloff in shader.frag: 2 / (1 + 0.09 d + 0.032 d^2)
+static const float falloffLinear = 0.09f;
+static const float falloffQuadratic = 0.032f;
+
+float PointLightRadius(const glm::vec3& color)
+{
+	float brightest = std::max(color.r, std::max(color.g, color.b));
+	// solve 2 * brightest / (1 + b d + a d^2) = cutoff for d
+	float c = 1.0f - 2.0f * brightest / pointLightCutoff;
+	if (c >= 0.0f) {
+		return 0.0f;
+	}
+	return (-falloffLinear + std::sqrt(falloffLinear * falloffLinear - 4.0f * falloffQuadratic * c))
+		/ (2.0f * falloffQuadratic);
+}
+
+float PointLightIntensity(float radius)
+{
+	return 0.5f * pointLightCutoff * (1.0f + falloffLinear * radius + falloffQuadratic * radius * radius);
+}
+
+void GeneratePointLights(std::vector<PointLight>& lights, int count, float fieldSize, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// spheres of this radius cover every point of the cube about 16 times
+	float radius = count > 0 ? fieldSize * std::cbrt(3.0f * 16.0f / (4.0f * 3.14159265f * count)) : 0.0f;
+	float intensity = PointLightIntensity(radius);
+
+	lights.resize(std::max(count, 0));
+	for (PointLight& light : lights) {
+		light.position = (glm::vec3(unit(random), unit(random), unit(random)) - 0.5f) * fieldSize;
+
+		// a saturated hue with its brightest channel at intensity
+		float hue = unit(random) * 6.0f;
+		glm::vec3 color = glm::clamp(glm::vec3(std::abs(hue - 3.0f) - 1.0f, 2.0f - std::abs(hue - 2.0f),
+			2.0f - std::abs(hue - 4.0f)), 0.0f, 1.0f);
+		light.color = color * intensity;
+		light.radius = PointLightRadius(light.color);
+		light.unused = 0.0f;
+	}
+}
+
+void AnimatePointLights(const std::vector<PointLight>& field, double seconds, std::vector<PointLight>& lights)
+{
+	lights = field;
+	for (size_t i = 0; i < lights.size(); i++) {
+		float speed = 0.2f + 0.6f * (float)((i * 7919) % 101) / 100.0f;
+		float angle = (float)std::fmod(seconds * speed, 6.283185307179586);
+		float c = std::cos(angle), s = std::sin(angle);
+		glm::vec3 p = field[i].position;
+		lights[i].position = glm::vec3(c * p.x + s * p.z, p.y, c * p.z - s * p.x);
+	}
+}
+
+LightClusters::LightClusters(int tilesX, int tilesY, int slices, float depthRange)
+	: tilesX(std::max(tilesX, 1)), tilesY(std::max(tilesY, 1)), slices(std::max(slices, 1)), depthRange(depthRange)
+{
+}
+
+LightClusters::~LightClusters()
+{
+	if (textures[0]) {
+		glDeleteTextures(3, textures);
+		glDeleteBuffers(3, buffers);
+	}
+}
+
+// where a light lands in the grid
+struct LightBounds
+{
+	glm::vec3 center;
+	float radius;
+	int x0, x1, y0, y1;
+};
+
+void LightClusters::build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+	ThreadPool* pool)
+{
+	lightData = lights;
+	lightTotal = lights.size();
+	size_t tileCount = (size_t)tilesX * tilesY;
+	clusters.assign(tileCount * slices, glm::uvec2(0));
+	indices.clear();
+
+	// near and far planes of the projection; slices are spaced evenly in
+	// log depth between near and depthRange
+	float projectionNear = projection[3][2] / (projection[2][2] - 1.0f);
+	float projectionFar = projection[3][2] / (projection[2][2] + 1.0f);
+	nearDepth = projectionNear;
+	float farDepth = std::max(std::min(depthRange, projectionFar), nearDepth * 1.001f);
+	sliceScale = slices / std::log(farDepth / nearDepth);
+	auto sliceOf = [&](float depth) {
+		int slice = depth > nearDepth ? (int)std::floor(std::log(depth / nearDepth) * sliceScale) : 0;
+		return std::min(std::max(slice, 0), slices - 1);
+	};
+	// view depth where a slice starts; the first reaches back to the eye and
+	// the last out to the far plane, like the shader's clamping
+	auto sliceStart = [&](int slice) {
+		if (slice <= 0) {
+			return 0.0f;
+		}
+		if (slice >= slices) {
+			return projectionFar;
+		}
+		return nearDepth * std::exp(slice / sliceScale);
+	};
+
+	// light spheres in view space with their tile ranges, and the lights
+	// reaching into each slice
+	std::vector<LightBounds> bounds(lights.size());
+	std::vector<std::vector<uint32_t>> sliceLights(slices);
+	for (uint32_t i = 0; i < lights.size(); i++) {
+		LightBounds& light = bounds[i];
+		light.center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+		light.radius = lights[i].radius;
+		float depth = -light.center.z;
+		if (light.radius <= 0.0f || depth + light.radius < projectionNear || depth - light.radius > projectionFar) {
+			continue;
+		}
+
+		// screen extent of the sphere's box; unbounded if it reaches behind
+		// the eye
+		float ndcMin[2] = { -1.0f, -1.0f };
+		float ndcMax[2] = { 1.0f, 1.0f };
+		float nearest = depth - light.radius;
+		if (nearest > 1e-4f) {
+			for (int axis = 0; axis < 2; axis++) {
+				float scale = projection[axis][axis];
+				float offset = projection[2][axis];
+				float low = 1e30f, high = -1e30f;
+				for (float side : { -light.radius, light.radius }) {
+					for (float d : { nearest, depth + light.radius }) {
+						float ndc = scale * (light.center[axis] + side) / d - offset;
+						low = std::min(low, ndc);
+						high = std::max(high, ndc);
+					}
+				}
+				ndcMin[axis] = low;
+				ndcMax[axis] = high;
+			}
+		}
+		if (ndcMax[0] < -1.0f || ndcMin[0] > 1.0f || ndcMax[1] < -1.0f || ndcMin[1] > 1.0f) {
+			continue;
+		}
+		auto tileOf = [](float ndc, int tiles) {
+			int tile = (int)std::floor((ndc * 0.5f + 0.5f) * tiles);
+			return std::min(std::max(tile, 0), tiles - 1);
+		};
+		light.x0 = tileOf(ndcMin[0], tilesX);
+		light.x1 = tileOf(ndcMax[0], tilesX);
+		light.y0 = tileOf(ndcMin[1], tilesY);
+		light.y1 = tileOf(ndcMax[1], tilesY);
+
+		for (int slice = sliceOf(depth - light.radius); slice <= sliceOf(depth + light.radius); slice++) {
+			sliceLights[slice].push_back(i);
+		}
+	}
+
+	// every slice on its own: test the sphere against each cluster box it
+	// might touch and sort the hits by cluster, keeping the light order
+	std::vector<std::vector<uint32_t>> sliceIndices(slices);
+	auto binSlice = [&](size_t slice) {
+		float depth0 = sliceStart((int)slice);
+		float depth1 = sliceStart((int)slice + 1);
+		std::vector<uint32_t>& out = sliceIndices[slice];
+		if (sliceLights[slice].empty()) {
+			return;
+		}
+
+		// boxes around the clusters' corners in view space
+		std::vector<glm::vec3> lows(tileCount, glm::vec3(1e30f));
+		std::vector<glm::vec3> highs(tileCount, glm::vec3(-1e30f));
+		for (int y = 0; y < tilesY; y++) {
+			for (int x = 0; x < tilesX; x++) {
+				size_t tile = (size_t)y * tilesX + x;
+				for (float depth : { depth0, depth1 }) {
+					for (int corner = 0; corner < 4; corner++) {
+						float ndcX = 2.0f * (x + (corner & 1)) / tilesX - 1.0f;
+						float ndcY = 2.0f * (y + (corner >> 1)) / tilesY - 1.0f;
+						glm::vec3 point((ndcX + projection[2][0]) * depth / projection[0][0],
+							(ndcY + projection[2][1]) * depth / projection[1][1], -depth);
+						lows[tile] = glm::min(lows[tile], point);
+						highs[tile] = glm::max(highs[tile], point);
+					}
+				}
+			}
+		}
+
+		std::vector<std::pair<uint32_t, uint32_t>> hits;
+		for (uint32_t i : sliceLights[slice]) {
+			const LightBounds& light = bounds[i];
+			for (int y = light.y0; y <= light.y1; y++) {
+				for (int x = light.x0; x <= light.x1; x++) {
+					size_t tile = (size_t)y * tilesX + x;
+					glm::vec3 closest = glm::clamp(light.center, lows[tile], highs[tile]);
+					glm::vec3 offset = closest - light.center;
+					if (glm::dot(offset, offset) <= light.radius * light.radius) {
+						hits.push_back(std::make_pair((uint32_t)tile, i));
+					}
+				}
+			}
+		}
+
+		std::vector<uint32_t> counts(tileCount + 1, 0);
+		for (const std::pair<uint32_t, uint32_t>& hit : hits) {
+			counts[hit.first + 1]++;
+		}
+		for (size_t tile = 0; tile < tileCount; tile++) {
+			clusters[slice * tileCount + tile].y = counts[tile + 1];
+			counts[tile + 1] += counts[tile];
+		}
+		out.resize(hits.size());
+		for (const std::pair<uint32_t, uint32_t>& hit : hits) {
+			out[counts[hit.first]++] = hit.second;
+		}
+	};
+	if (pool != nullptr) {
+		pool->parallelFor((size_t)slices, binSlice);
+	}
+	else {
+		for (int slice = 0; slice < slices; slice++) {
+			binSlice(slice);
+		}
+	}
+
+	// clusters are numbered slice by slice, so the slices' lists join up in
+	// cluster order
+	size_t total = 0;
+	for (int slice = 0; slice < slices; slice++) {
+		total += sliceIndices[slice].size();
+	}
+	indices.reserve(total);
+	for (int slice = 0; slice < slices; slice++) {
+		indices.insert(indices.end(), sliceIndices[slice].begin(), sliceIndices[slice].end());
+	}
+	uint32_t offset = 0;
+	for (glm::uvec2& cluster : clusters) {
+		cluster.x = offset;
+		offset += cluster.y;
+	}
+}
+
+void LightClusters::upload()
+{
+	if (!textures[0]) {
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	}
+
+	// the shader skips the lights if the lists don't fit
+	if (indices.size() > (size_t)maxTexels || lightData.size() * 2 > (size_t)maxTexels) {
+		std::cerr << "Light clusters need " << indices.size() << " light references, more than the "
+			<< maxTexels << " a buffer texture holds; lights are off" << std::endl;
+		lightTotal = 0;
+		return;
+	}
+
+	const void* data[3] = { lightData.data(), clusters.data(), indices.data() };
+	size_t bytes[3] = { sizeof(PointLight) * lightData.size(), sizeof(glm::uvec2) * clusters.size(),
+		sizeof(uint32_t) * indices.size() };
+	GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	for (int i = 0; i < 3; i++) {
+		// fresh storage every frame, so the previous frame's draws don't stall
+		// the upload; empty buffers still get a texel
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, std::max(bytes[i], (size_t)16), NULL, GL_STREAM_DRAW);
+		if (bytes[i] > 0) {
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes[i], data[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::bind() const
+{
+	const GLint units[3] = { lightDataUnit, lightClustersUnit, lightIndicesUnit };
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::setUniforms(FrameUniforms& frame, int width, int height) const
+{
+	frame.clusterGrid = glm::ivec4(tilesX, tilesY, slices, (int)lightTotal);
+	frame.clusterDepth = glm::vec4(nearDepth, sliceScale, 0.0f, 0.0f);
+	frame.clusterScreen = glm::vec4((float)width, (float)height, (float)tilesX / std::max(width, 1),
+		(float)tilesY / std::max(height, 1));
+}
@@ -0,0 +1,97 @@
+#ifndef _CLUSTERED_LIGHTS_H_
+#define _CLUSTERED_LIGHTS_H_
+
+#include "ShaderProgram.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// texture units of the light buffer textures read by shader.frag
+const GLint lightDataUnit = 1;
+const GLint lightClustersUnit = 2;
+const GLint lightIndicesUnit = 3;
+
+// contributions of a point light below this are dropped; it sets the radius
+// lights are binned with
+const float pointLightCutoff = 1.0f / 32.0f;
+
+// Point light in world space, laid out like two texels of the lightData
+// buffer texture. The shader fades a light out towards its radius.
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float unused;
+};
+
+// distance at which the shader's quadratic falloff brings the brightest
+// channel of color down to pointLightCutoff
+float PointLightRadius(const glm::vec3& color);
+// brightness a light needs to reach pointLightCutoff at radius
+float PointLightIntensity(float radius);
+
+// count lights of random hues in a cube of fieldSize around the origin,
+// with radii that keep about 16 lights overlapping at any point
+void GeneratePointLights(std::vector<PointLight>& lights, int count, float fieldSize = 20.0f, unsigned seed = 1);
+// the field circling the y axis, each light at its own speed
+void AnimatePointLights(const std::vector<PointLight>& field, double seconds, std::vector<PointLight>& lights);
+
+// Clustered light culling: the view frustum is cut into tilesX * tilesY
+// screen tiles and slices exponentially spaced in depth, and every light is
+// binned into the clusters its sphere touches. The fragment shader finds
+// its cluster from gl_FragCoord and its view depth and loops over that
+// cluster's lights only. Binning runs on the CPU, a depth slice per task;
+// the lights, the cluster ranges and the light index lists go to the GPU
+// in buffer textures. No GL calls are made before upload.
+class LightClusters
+{
+private:
+	int tilesX;
+	int tilesY;
+	int slices;
+	// view depth covered by the slices; farther clusters share the last one
+	float depthRange;
+
+	// grid of the last build
+	float nearDepth = 1.0f;
+	float sliceScale = 1.0f;
+	size_t lightTotal = 0;
+	std::vector<PointLight> lightData;
+	// per cluster, x the first entry in indices and y the count
+	std::vector<glm::uvec2> clusters;
+	std::vector<uint32_t> indices;
+
+	GLuint buffers[3] = {};
+	GLuint textures[3] = {};
+	GLint maxTexels = 0;
+
+public:
+	LightClusters(int tilesX = 16, int tilesY = 9, int slices = 24, float depthRange = 200.0f);
+	~LightClusters();
+
+	LightClusters(const LightClusters&) = delete;
+	LightClusters& operator=(const LightClusters&) = delete;
+
+	// bin the lights for this camera; pool may be null to run serially
+	void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+		ThreadPool* pool);
+	// send the last build to the buffer textures; render thread only
+	void upload();
+	// bind the buffer textures to their units
+	void bind() const;
+	// grid and slice constants for a viewport of width x height
+	void setUniforms(FrameUniforms& frame, int width, int height) const;
+
+	size_t lightCount() const { return lightTotal; }
+	size_t clusterCount() const { return clusters.size(); }
+	// light references over all clusters
+	size_t indexCount() const { return indices.size(); }
+	const glm::uvec2& cluster(size_t i) const { return clusters[i]; }
+	uint32_t lightIndex(size_t i) const { return indices[i]; }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "DeferredRenderer.h"
+#include "MeshArena.h"
+#include "Profiler.h"
+
+#include <iostream>
+
+// the surface texel keeps the material in its two alpha bits
+static_assert(materialCount <= 4, "G-buffer material ids need more bits");
+
+DeferredRenderer::~DeferredRenderer()
+{
+	if (framebuffer) {
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &surfaceTexture);
+		glDeleteTextures(1, &normalTexture);
+	}
+	if (emptyVao) {
+		glDeleteVertexArrays(1, &emptyVao);
+	}
+}
+
+bool DeferredRenderer::load(const char* vertexFilePath, const char* fragmentFilePath)
+{
+	std::vector<std::string> defines;
+	defines.push_back("MATERIAL_COUNT " + std::to_string((int)materialCount));
+	defines.push_back("DEFERRED_LIGHTING");
+	if (!lighting.load(vertexFilePath, fragmentFilePath, defines)) {
+		return false;
+	}
+	// core profiles draw only with a vertex array bound, even an empty one
+	glGenVertexArrays(1, &emptyVao);
+	return true;
+}
+
+bool DeferredRenderer::resize(int newWidth, int newHeight)
+{
+	if (framebuffer && newWidth == width && newHeight == height) {
+		return true;
+	}
+	width = newWidth;
+	height = newHeight;
+	if (!framebuffer) {
+		glGenFramebuffers(1, &framebuffer);
+		glGenTextures(1, &depthTexture);
+		glGenTextures(1, &surfaceTexture);
+		glGenTextures(1, &normalTexture);
+	}
+
+	GLuint textures[3] = { depthTexture, surfaceTexture, normalTexture };
+	for (GLuint texture : textures) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	glBindTexture(GL_TEXTURE_2D, surfaceTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
+	glBindTexture(GL_TEXTURE_2D, normalTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, width, height, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, surfaceTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+	const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "G-buffer framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+		width = height = 0;
+		return false;
+	}
+	return true;
+}
+
+bool DeferredRenderer::beginGeometryPass(int newWidth, int newHeight)
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFramebuffer);
+	if (!resize(newWidth, newHeight)) {
+		return false;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	return true;
+}
+
+void DeferredRenderer::endGeometryPass()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+}
+
+void DeferredRenderer::light(const glm::mat4& view, const glm::mat4& projection)
+{
+	lighting.use();
+	glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+	glUniformMatrix4fv(lighting.location(uniformInverseViewProjection), 1, GL_FALSE, &inverseViewProjection[0][0]);
+	PROFILE_COUNT_UNIFORMS(1);
+
+	glActiveTexture(GL_TEXTURE0 + gbufferDepthUnit);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glActiveTexture(GL_TEXTURE0 + gbufferSurfaceUnit);
+	glBindTexture(GL_TEXTURE_2D, surfaceTexture);
+	glActiveTexture(GL_TEXTURE0 + gbufferNormalUnit);
+	glBindTexture(GL_TEXTURE_2D, normalTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	// every covered pixel is written, color and the G-buffer's depth
+	glDepthFunc(GL_ALWAYS);
+	MeshArena::bindVertexArray(emptyVao);
+	PROFILE_COUNT_DRAW(1);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	MeshArena::bindVertexArray(0);
+	glDepthFunc(GL_LEQUAL);
+}
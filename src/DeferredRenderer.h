@@ -0,0 +1,60 @@
+#ifndef _DEFERRED_RENDERER_H_
+#define _DEFERRED_RENDERER_H_
+
+#include "ShaderProgram.h"
+
+#include <glm/glm.hpp>
+
+// texture units of the G-buffer read by the lighting pass
+const GLint gbufferDepthUnit = 4;
+const GLint gbufferSurfaceUnit = 5;
+const GLint gbufferNormalUnit = 7;
+
+// Deferred shading: a geometry pass draws the lit objects with the GBUFFER
+// shader variants into a depth texture, a GL_RGB10_A2 surface texture
+// (packed lighting normal and material) and a GL_RG16 texture holding the
+// surface normal the shadow lookup is offset along, 4 bytes a pixel each;
+// positions come back from depth. The lighting pass then shades every covered pixel exactly once
+// with shader.frag's DEFERRED_LIGHTING variant, main light and clustered
+// point lights alike, and writes the depth back so forward draws can
+// follow; the background is left as cleared. Not multisampled.
+class DeferredRenderer
+{
+private:
+	GLuint framebuffer = 0;
+	GLuint depthTexture = 0;
+	GLuint surfaceTexture = 0;
+	GLuint normalTexture = 0;
+	GLuint emptyVao = 0;
+	int width = 0;
+	int height = 0;
+	// framebuffer the geometry pass took over, lit into afterwards
+	GLint targetFramebuffer = 0;
+
+	ShaderProgram lighting;
+
+	bool resize(int width, int height);
+
+public:
+	DeferredRenderer() {}
+	~DeferredRenderer();
+
+	DeferredRenderer(const DeferredRenderer&) = delete;
+	DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+
+	// compile the lighting pass from the full screen vertex shader and the
+	// scene's fragment shader
+	bool load(const char* vertexFilePath, const char* fragmentFilePath);
+
+	// draw into the (cleared) G-buffer, sized to match the viewport, until
+	// endGeometryPass returns to the framebuffer that was bound
+	bool beginGeometryPass(int width, int height);
+	void endGeometryPass();
+	// shade the G-buffer into that framebuffer
+	void light(const glm::mat4& view, const glm::mat4& projection);
+
+	// G-buffer bytes per pixel: depth, surface and normal
+	static size_t bytesPerPixel() { return 12; }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include "Frustum.h"
+
+Aabb TransformAabb(const Aabb& box, const glm::mat4& transform)
+{
+	// center moves with the transform, the extent grows by |matrix|
+	glm::vec3 center = 0.5f * (box.min + box.max);
+	glm::vec3 extent = 0.5f * (box.max - box.min);
+	glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+	glm::vec3 newExtent(0.0f);
+	for (int column = 0; column < 3; column++) {
+		newExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+	}
+
+	Aabb result;
+	result.min = newCenter - newExtent;
+	result.max = newCenter + newExtent;
+	return result;
+}
+
+Aabb MergeAabb(const Aabb& a, const Aabb& b)
+{
+	Aabb result;
+	result.min = glm::min(a.min, b.min);
+	result.max = glm::max(a.max, b.max);
+	return result;
+}
+
+Frustum::Frustum(const glm::mat4& clip)
+{
+	// Gribb & Hartmann: each plane is the last row of the matrix plus or
+	// minus one of the others
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+	}
+	planes[0] = rows[3] + rows[0];	// left
+	planes[1] = rows[3] - rows[0];	// right
+	planes[2] = rows[3] + rows[1];	// bottom
+	planes[3] = rows[3] - rows[1];	// top
+	planes[4] = rows[3] + rows[2];	// near
+	planes[5] = rows[3] - rows[2];	// far
+}
+
+bool Frustum::intersects(const Aabb& box) const
+{
+	for (const glm::vec4& plane : planes) {
+		// the corner farthest along the normal
+		glm::vec3 corner(plane.x > 0.0f ? box.max.x : box.min.x,
+			plane.y > 0.0f ? box.max.y : box.min.y,
+			plane.z > 0.0f ? box.max.z : box.min.z);
+		// summed in the same order as ObjectBvh's SIMD test, so both agree
+		// on boxes touching a plane
+		float distance = (plane.x * corner.x + plane.y * corner.y) + (plane.z * corner.z + plane.w);
+		if (distance < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
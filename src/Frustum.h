@@ -0,0 +1,32 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <glm/glm.hpp>
+
+// axis aligned bounding box
+struct Aabb
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+};
+
+// box around a transformed box
+Aabb TransformAabb(const Aabb& box, const glm::mat4& transform);
+Aabb MergeAabb(const Aabb& a, const Aabb& b);
+
+// The six clip planes of a projection * view * model matrix, in the space
+// that matrix maps from, so boxes can be tested in model space.
+class Frustum
+{
+public:
+	// xyz is the (unnormalized) inward normal, w the offset; a point p is
+	// inside a plane when dot(xyz, p) + w >= 0
+	glm::vec4 planes[6];
+
+	explicit Frustum(const glm::mat4& clip);
+
+	// false only if the box is entirely outside one of the planes
+	bool intersects(const Aabb& box) const;
+};
+
+#endif
@@ -1,204 +1,733 @@
 #include "Geometry.h"
+#include "SoftwareRasterizer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <iostream>
-#include <sstream>
-#include <fstream>
 
 // initialize static variable light position
 glm::vec3 Geometry::lightPos = glm::vec3(-8.0f, 8.0f, 0.0f);
 
+// load meshes through their .meshbin caches
+bool Geometry::useMeshCache = true;
+bool Geometry::optimizeMeshes = true;
+bool Geometry::buildLods = true;
+bool Geometry::cullObjects = true;
+bool Geometry::gbufferPass = false;
+bool Geometry::compactVertices = false;
+size_t Geometry::uploadSliceBytes = 256 * 1024;
+bool Geometry::useMeshArena = true;
+Geometry* Geometry::placeholder = nullptr;
+MeshArena* Geometry::arenas[meshLayoutCount] = {};
+
 Geometry::Geometry(std::string objFilename, std::string name) 
-	: objectName(name)
+	: objectName(name), objFilename(objFilename), isLightSphere(name == "sphere"),
+	profileSection(Profiler::section("draw " + name))
 {
+	// Set the model matrix to an identity matrix. 
+	model = glm::mat4(1);
 
-	// Parsing obj file
-	std::ifstream objFile(objFilename);
+	// if obj is light sphere, shrink + set it's position where the light is
+	if (isLightSphere) {
+		model = glm::translate(model, lightPos);
+		model = glm::scale(model, glm::vec3(0.1f));
+	}
+	updateNormalMatrix();
+}
 
-	// Check whether the file can be opened.
-	if (objFile.is_open())
-	{
-		std::string line; // A line in the file.
+void Geometry::updateNormalMatrix()
+{
+	normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+}
 
-		// Read lines from the file.
-		while (std::getline(objFile, line))
-		{
+void Geometry::requestLoad(ThreadPool* pool)
+{
+	int expected = notLoaded;
+	if (!loadState.compare_exchange_strong(expected, loading)) {
+		return;
+	}
+	loadTask = pool->submit([this, pool]() { loadMesh(pool); });
+}
 
-			// replace all "//" with " " for easy parsing of face vertices
-			auto idx = line.find("//");
-			while (idx != std::string::npos) {
-				line.replace(idx, 2, " ");
-				idx = line.find("//");
-			}
+void Geometry::loadNow(ThreadPool* loadPool)
+{
+	int expected = notLoaded;
+	if (loadState.compare_exchange_strong(expected, loading)) {
+		loadMesh(loadPool);
+	}
+	else if (loadTask.valid()) {
+		loadTask.wait();
+	}
+
+	while (!uploadSlice(1e9)) {
+	}
+}
+
+// worker half of loading: no GL calls in here
+void Geometry::loadMesh(ThreadPool* loadPool)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Load the normalized mesh from its binary cache when there is a valid
+	// one; otherwise parse the obj file and write the cache for next time
+	std::string cacheFilename = MeshCachePath(objFilename);
+	uint32_t cacheFlags = (optimizeMeshes ? meshCacheOptimized : 0) | (buildLods ? meshCacheLods : 0);
+	uint32_t preprocessKey = MeshPreprocessKey(preprocessOptions);
+	PendingMesh& pending = pendingMesh;
+	if (useMeshCache && pending.cache.open(cacheFilename, objFilename, cacheFlags, preprocessKey)) {
+		fromCache = true;
+		pending.data[0] = pending.cache.points();
+		pending.bytes[0] = sizeof(glm::vec3) * pending.cache.pointCount();
+		pending.data[1] = pending.cache.normals();
+		pending.bytes[1] = sizeof(glm::vec3) * pending.cache.normalCount();
+		pending.data[2] = pending.cache.faces();
+		pending.bytes[2] = sizeof(glm::ivec3) * pending.cache.faceCount();
+		pending.lods.assign(pending.cache.lods(), pending.cache.lods() + pending.cache.lodCount());
+	}
+	else {
+		bool loaded = LoadMesh(objFilename, pending.mesh, loadPool, &weldStats, &preprocessOptions, &preprocessStats);
+
+		// the camera looks at the object from +z, so that is its typical view
+		if (optimizeMeshes) {
+			OptimizeMesh(pending.mesh, glm::vec3(0.0f, 0.0f, 1.0f), &optimizeStats);
+		}
+		// simplified levels on all of the pool's workers
+		if (buildLods) {
+			BuildMeshLods(pending.mesh, loadPool);
+		}
+		if (loaded && useMeshCache) {
+			WriteMeshCache(cacheFilename, objFilename, pending.mesh, cacheFlags, preprocessKey);
+		}
+		pending.data[0] = pending.mesh.points.data();
+		pending.bytes[0] = sizeof(glm::vec3) * pending.mesh.points.size();
+		pending.data[1] = pending.mesh.normals.data();
+		pending.bytes[1] = sizeof(glm::vec3) * pending.mesh.normals.size();
+		pending.data[2] = pending.mesh.faces.data();
+		pending.bytes[2] = sizeof(glm::ivec3) * pending.mesh.faces.size();
+		pending.lods = pending.mesh.lods;
+	}
+
+	// one level covering every triangle when there is no chain
+	if (pending.lods.empty()) {
+		MeshLod full;
+		full.faceCount = (uint32_t)(pending.bytes[2] / sizeof(glm::ivec3));
+		pending.lods.push_back(full);
+	}
+
+	const glm::vec3* points = (const glm::vec3*)pending.data[0];
+	pending.vertexCount = pending.bytes[0] / sizeof(glm::vec3);
+	pending.boundingRadius = 0.0f;
+	pending.bounds = Aabb();
+	if (pending.vertexCount > 0) {
+		pending.bounds.min = pending.bounds.max = points[0];
+	}
+	for (size_t i = 0; i < pending.vertexCount; i++) {
+		pending.boundingRadius = std::max(pending.boundingRadius, glm::length(points[i]));
+		pending.bounds.min = glm::min(pending.bounds.min, points[i]);
+		pending.bounds.max = glm::max(pending.bounds.max, points[i]);
+	}
+
+	// quantize into the compact interleaved layout
+	pending.compact = compactVertices && !cpuOnly;
+	if (pending.compact) {
+		PackMesh((const glm::vec3*)pending.data[0], pending.vertexCount,
+			(const glm::vec3*)pending.data[1], pending.bytes[1] / sizeof(glm::vec3),
+			(const glm::ivec3*)pending.data[2], pending.bytes[2] / sizeof(glm::ivec3), pending.packed);
+
+		pending.data[0] = pending.packed.vertices.data();
+		pending.bytes[0] = sizeof(PackedVertex) * pending.packed.vertices.size();
+		pending.data[1] = nullptr;
+		pending.bytes[1] = 0;
+		pending.positions.resize(pending.packed.vertices.size() * 4);
+		for (size_t i = 0; i < pending.packed.vertices.size(); i++) {
+			std::copy(pending.packed.vertices[i].position, pending.packed.vertices[i].position + 4,
+				&pending.positions[i * 4]);
+		}
+		pending.data[3] = pending.positions.data();
+		pending.bytes[3] = sizeof(int16_t) * pending.positions.size();
+		if (!pending.packed.shortIndices.empty()) {
+			pending.data[2] = pending.packed.shortIndices.data();
+			pending.bytes[2] = sizeof(uint16_t) * pending.packed.shortIndices.size();
+			pending.indexType = GL_UNSIGNED_SHORT;
+		}
+	}
+
+	loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	loadState = loaded;
+}
+
+void Geometry::unload()
+{
+	if (loadTask.valid()) {
+		loadTask.wait();
+	}
+
+	releaseBuffers();
+	indexCount = 0;
+
+	PendingMesh& pending = pendingMesh;
+	pending.cache.close();
+	pending.mesh = MeshData();
+	pending.packed = PackedMesh();
+	pending.positions.clear();
+	pending.compact = false;
+	pending.indexType = GL_UNSIGNED_INT;
+	pending.vertexCount = 0;
+	pending.lods.clear();
+	for (int i = 0; i < 4; i++) {
+		pending.data[i] = nullptr;
+		pending.bytes[i] = 0;
+		pending.uploaded[i] = 0;
+	}
+	pending.buffersCreated = false;
+	cpuOnly = false;
+	uploadSeconds = 0.0;
+	uploadSlices = 0;
+	fromCache = false;
+	weldStats = WeldStats();
+	optimizeStats = OptimizeStats();
+	preprocessStats = PreprocessStats();
+	loadState = notLoaded;
+}
+
+void Geometry::loadForSoftware(ThreadPool* loadPool)
+{
+	cpuOnly = true;
+	int expected = notLoaded;
+	if (loadState.compare_exchange_strong(expected, loading)) {
+		loadMesh(loadPool);
+	}
+	else if (loadTask.valid()) {
+		loadTask.wait();
+	}
+	if (loadState != loaded) {
+		return;
+	}
+
+	// what uploadSlice takes from the pending mesh, which stays put
+	PendingMesh& pending = pendingMesh;
+	compact = false;
+	dequantize = glm::mat4(1.0f);
+	lods = pending.lods;
+	boundingRadius = pending.boundingRadius;
+	bounds = pending.bounds;
+	currentLod = 0;
+	loadState = resident;
+	std::cout << "Loaded " << objectName << (fromCache ? " from cache" : "") << " in " << loadSeconds * 1000.0
+		<< " ms for the software rasterizer (" << pending.vertexCount << " vertices)" << std::endl;
+}
 
-			// Turn the line into a string stream for processing.
-			std::stringstream ss;
-			ss << line;
+// render-thread half of loading: send the mesh to the GPU in slices, which
+// may point straight into a mapped cache file
+bool Geometry::uploadSlice(double budgetSeconds)
+{
+	if (loadState == resident) {
+		return true;
+	}
+	if (loadState != loaded) {
+		return false;
+	}
 
-			// Read the first word of the line.
-			std::string label;
-			ss >> label;
+	auto start = std::chrono::steady_clock::now();
+	auto elapsed = [&start]() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
 
-			// If the line is about vertex (starting with a "v").
-			if (label == "v")
-			{
-				// Read the later three float numbers and use them as the 
-				// coordinates.
-				glm::vec3 point;
-				ss >> point.x >> point.y >> point.z;
+	PendingMesh& pending = pendingMesh;
+	GLenum targets[4] = { GL_ARRAY_BUFFER, GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_ARRAY_BUFFER };
 
-				// Process the point. For example, you can save it to a.
-				points.push_back(point);
+	// the stream of the arena each of the four goes to, and their strides
+	const int arenaStreams[4] = { 0, 1, 2, 1 };
+	MeshLayout layout = pending.compact ? meshLayoutCompact : meshLayoutFloat;
+
+	// ranges in the arena of the layout, or a Vertex Array (VAO) and point,
+	// normal and index buffers of its own, sized up front and filled slice by
+	// slice below
+	if (!pending.buffersCreated && useMeshArena) {
+		if (arenas[layout] == nullptr) {
+			arenas[layout] = new MeshArena(layout);
+		}
+		size_t vertexCount = pending.vertexCount;
+		for (int i : { 0, 1, 3 }) {
+			vertexCount = std::max(vertexCount, pending.bytes[i] / MeshArena::streamStride(layout, arenaStreams[i]));
+		}
+		arenaLayout = layout;
+		arenaMesh = arenas[layout]->allocate(vertexCount, pending.bytes[2]);
+		pending.buffersCreated = true;
+	}
+	if (!pending.buffersCreated) {
+		// binding an element buffer changes the bound VAO's
+		MeshArena::bindVertexArray(0);
+		glGenVertexArrays(1, &VAO);
+		glGenVertexArrays(1, &depthVAO);
+		glGenBuffers(1, &VBO);
+		if (pending.bytes[1] > 0) {
+			glGenBuffers(1, &VBO2);
+		}
+		glGenBuffers(1, &EBO);
+		if (pending.bytes[3] > 0) {
+			glGenBuffers(1, &positionVBO);
+		}
+
+		GLuint buffers[4] = { VBO, VBO2, EBO, positionVBO };
+		for (int i = 0; i < 4; i++) {
+			if (buffers[i] == 0) {
+				continue;
 			}
+			glBindBuffer(targets[i], buffers[i]);
+			glBufferData(targets[i], pending.bytes[i], NULL, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		pending.buffersCreated = true;
+	}
 
-			// store normal vertices
-			if (label == "vn") {
-				glm::vec3 normal;
-				ss >> normal.x >> normal.y >> normal.z;
-				normals.push_back(normal);
+	// always make some progress, then stop once the budget is used up
+	GLuint buffers[4] = { VBO, VBO2, EBO, positionVBO };
+	for (int i = 0; i < 4; i++) {
+		while (pending.uploaded[i] < pending.bytes[i]) {
+			size_t slice = std::min(uploadSliceBytes, pending.bytes[i] - pending.uploaded[i]);
+			const char* data = (const char*)pending.data[i] + pending.uploaded[i];
+			if (arenaMesh >= 0) {
+				arenas[arenaLayout]->upload(arenaMesh, arenaStreams[i], pending.uploaded[i], slice, data);
+			}
+			else {
+				MeshArena::bindVertexArray(0);
+				glBindBuffer(targets[i], buffers[i]);
+				glBufferSubData(targets[i], pending.uploaded[i], slice, data);
+				glBindBuffer(targets[i], 0);
 			}
+			pending.uploaded[i] += slice;
 
-			// store face vertices
-			if (label == "f") {
-				glm::ivec3 face;
-				glm::ivec3 face2; // second int in a face vertex pair
-
-				ss >> face.x >> face2.x >> face.y >> face2.y >> face.z >> face2.z;
-				// change to 1-based indexing
-				face.x = face.x - 1;
-				face.y = face.y - 1;
-				face.z = face.z - 1;
-				faces.push_back(face);
+			if (elapsed() >= budgetSeconds) {
+				uploadSeconds += elapsed();
+				uploadSlices++;
+				return false;
 			}
 		}
 	}
-	else
-	{
-		std::cerr << "Can't open the file " << objFilename << std::endl;
-	}
-
-	objFile.close();
 
-	// find min and max coordinates of the obj along x, y, z axes
-	float minX, maxX, minY, maxY, minZ, maxZ;
-	for (int i = 0; i < points.size(); i++) {
-		if (points[i].x < minX) {
-			minX = points[i].x;
+	compact = pending.compact;
+	indexType = pending.indexType;
+	dequantize = compact ? pending.packed.dequantize : glm::mat4(1.0f);
+	lods = pending.lods;
+	boundingRadius = pending.boundingRadius;
+	bounds = pending.bounds;
+	currentLod = 0;
+	indexCount = (GLsizei)(pending.bytes[2] / (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)));
+
+	// the arena's VAOs cover the mesh already
+	if (arenaMesh < 0) {
+		// Bind VAO
+		MeshArena::bindVertexArray(VAO);
+
+		// Rendering triangles
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (compact) {
+			// interleaved: normalized shorts for the point, 10:10:10:2 for the normal
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex),
+				(void*)offsetof(PackedVertex, normal));
 		}
-		if (points[i].y < minY) {
-			minY = points[i].y;
+		else {
+			// Enable Vertex Attribute 0 to pass point data through to the shader
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+
+			// Send normals info
+			glBindBuffer(GL_ARRAY_BUFFER, VBO2);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
 		}
-		if (points[i].z < minZ) {
-			minZ = points[i].z;
+
+		// the depth pass reads positions and indices only
+		MeshArena::bindVertexArray(depthVAO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glEnableVertexAttribArray(0);
+		if (compact) {
+			glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, 4 * sizeof(GLshort), 0);
 		}
-		if (points[i].x > maxX) {
-			maxX = points[i].x;
+		else {
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
 		}
-		if (points[i].y > maxY) {
-			maxY = points[i].y;
+
+		// Unbind the VBO/VAO
+		MeshArena::bindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	uploadSeconds += elapsed();
+	uploadSlices++;
+
+	// GPU memory of this mesh, and what the other layout would take; the
+	// compact layout adds its position stream
+	size_t vertexCount = pending.vertexCount;
+	size_t compactVertexBytes = sizeof(PackedVertex) + 4 * sizeof(int16_t);
+	size_t floatBytes = vertexCount * 2 * sizeof(glm::vec3) + (size_t)indexCount * sizeof(GLuint);
+	size_t compactBytes = vertexCount * compactVertexBytes
+		+ (size_t)indexCount * (vertexCount <= 65536 ? sizeof(GLushort) : sizeof(GLuint));
+
+	// the GPU has its own copy now
+	pending.cache.close();
+	pending.mesh = MeshData();
+	pending.packed = PackedMesh();
+	pending.positions = std::vector<int16_t>();
+	loadState = resident;
+
+	std::cout << "Loaded " << objectName << (fromCache ? " from cache" : "") << " in "
+		<< loadSeconds * 1000.0 << " ms, uploaded in " << uploadSeconds * 1000.0 << " ms over "
+		<< uploadSlices << " slice(s)" << std::endl;
+	std::cout << "  GPU memory: " << (compact ? compactBytes : floatBytes) / 1024.0 << " KB in the "
+		<< (compact ? "compact" : "float") << " layout (" << vertexCount << " vertices at "
+		<< (compact ? compactVertexBytes : 2 * sizeof(glm::vec3)) << " B, " << indexCount << " "
+		<< (indexType == GL_UNSIGNED_SHORT ? 16 : 32) << "-bit indices); "
+		<< (compact ? floatBytes : compactBytes) / 1024.0 << " KB in the "
+		<< (compact ? "float" : "compact") << " layout" << std::endl;
+	if (arenaMesh >= 0) {
+		arenas[arenaLayout]->printStats(compact ? "compact" : "float");
+	}
+	if (weldStats.corners > 0) {
+		std::cout << "  welded " << weldStats.corners << " corners into " << weldStats.vertices
+			<< " vertices (" << 100.0 * weldStats.vertices / weldStats.corners
+			<< "% of per-corner expansion, " << weldStats.positions << " positions in the file)" << std::endl;
+	}
+	if (preprocessStats.generatedNormals > 0) {
+		std::cout << "  generated normals for " << preprocessStats.generatedNormals << " vertices ("
+			<< preprocessStats.creaseVertices << " added at creases)" << std::endl;
+	}
+	if (lods.size() > 1) {
+		std::cout << "  LOD triangles:";
+		for (const MeshLod& lod : lods) {
+			std::cout << " " << lod.faceCount;
 		}
-		if (points[i].z > maxZ) {
-			maxZ = points[i].z;
+		std::cout << std::endl;
+	}
+	if (optimizeStats.after.acmr > 0.0f) {
+		std::cout << "  vertex cache ACMR " << optimizeStats.before.acmr << " -> " << optimizeStats.after.acmr
+			<< ", ATVR " << optimizeStats.before.atvr << " -> " << optimizeStats.after.atvr
+			<< " (" << optimizeStats.clusters << " overdraw clusters)" << std::endl;
+	}
+	return true;
+}
+
+Geometry::~Geometry() 
+{
+	// the worker may still be reading into pendingMesh
+	if (loadTask.valid()) {
+		loadTask.wait();
+	}
+
+	releaseBuffers();
+}
+
+void Geometry::releaseBuffers()
+{
+	// software meshes never had a GL context to delete from
+	if (VAO) {
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &VBO2);
+		glDeleteBuffers(1, &EBO);
+		glDeleteBuffers(1, &positionVBO);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteVertexArrays(1, &depthVAO);
+	}
+	VAO = VBO = VBO2 = EBO = depthVAO = positionVBO = 0;
+	// the arenas may be gone already at exit
+	if (arenaMesh >= 0 && arenas[arenaLayout]) {
+		arenas[arenaLayout]->free(arenaMesh);
+	}
+	arenaMesh = -1;
+}
+
+void Geometry::releaseArenas()
+{
+	for (MeshArena*& arena : arenas) {
+		delete arena;
+		arena = nullptr;
+	}
+}
+
+// until the mesh is resident, the placeholder's mesh is drawn with this
+// object's transform and material; both are normalized to the same size
+const Geometry* Geometry::drawSource() const
+{
+	if (isResident()) {
+		return this;
+	}
+	if (placeholder == nullptr || !placeholder->isResident()) {
+		return nullptr;
+	}
+	return placeholder;
+}
+
+const MeshLod* Geometry::selectLod(const Geometry* source, const glm::mat4& view, const glm::mat4& projection)
+{
+	if (cullObjects) {
+		PROFILE_SCOPE("cull");
+		bool inside = Frustum(projection * view * model).intersects(source->bounds);
+		PROFILE_COUNT_OBJECTS(inside ? 1 : 0, inside ? 0 : 1);
+		if (!inside) {
+			return nullptr;
 		}
 	}
-	float centerX = (minX + maxX) / 2;
-	float centerY = (minY + maxY) / 2;
-	float centerZ = (minZ + maxZ) / 2;
-	float dist = max((maxX - minX), (maxY - minY));
-	dist = max(dist, (maxZ - minZ));
-	// center + scale obj to fit in 1x1x1 box
-	for (int i = 0; i < points.size(); i++) {
-		points[i].x = (points[i].x - centerX) * (1 / dist);
-		points[i].y = (points[i].y - centerY) * (1 / dist);
-		points[i].z = (points[i].z - centerZ) * (1 / dist);
+	else {
+		PROFILE_COUNT_OBJECTS(1, 0);
+	}
+
+	// coarser levels as the object gets smaller on screen
+	const std::vector<MeshLod>& sourceLods = source->lods;
+	float projectedSize = ProjectedSize(view * model, projection, source->boundingRadius);
+	currentLod = SelectMeshLod((int)sourceLods.size(), currentLod, projectedSize);
+	return &sourceLods[currentLod];
+}
+
+void Geometry::draw(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders)
+{
+	const Geometry* source = drawSource();
+	if (source == nullptr) {
+		return;
 	}
-	// scale up by an arbitrary factor to fit the window
-	for (int i = 0; i < points.size(); i++) {
-		points[i].x = points[i].x * 15;
-		points[i].y = points[i].y * 15;
-		points[i].z = points[i].z * 15;
+	const MeshLod* selected = selectLod(source, view, projection);
+	if (selected == nullptr) {
+		return;
 	}
+	const MeshLod& lod = *selected;
 
-	// Set the model matrix to an identity matrix. 
-	model = glm::mat4(1);
+	// quantized positions are mapped back to mesh space by the model matrix;
+	// normals go through the normal matrix of the unfolded model
+	glm::mat4 drawModel = model * source->dequantize;
 
-	// if obj is light sphere, shrink + set it's position where the light is
-	if (objectName == "sphere") {
-		model = glm::translate(model, lightPos);
-		model = glm::scale(model, glm::vec3(0.1f));
+	// Activate the variant for this object; view, projection, the light and
+	// the materials come from uniform buffers
+	int variant = (switchRender ? shaderNormalColoring : 0) | (isLightSphere ? shaderLightProxy : 0)
+		| (gbufferPass ? shaderGBuffer : 0);
+	const ShaderProgram& shader = shaders.get(variant);
+	shader.use();
+
+	// send the per-object uniform data to the shader
+	glUniformMatrix4fv(shader.location(uniformModel), 1, GL_FALSE, glm::value_ptr(drawModel));
+	glUniformMatrix3fv(shader.location(uniformNormalMatrix), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+
+	// let the shader know which model is shown to shade accordingly
+	glUniform1i(shader.location(uniformMaterial), materialIndex);
+	PROFILE_COUNT_UNIFORMS(3);
+
+	// Bind the VAO
+	PROFILE_GPU_SECTION(profileSection);
+	PROFILE_COUNT_DRAW(lod.faceCount);
+	source->bindVertexArray(false);
+	// Draw the points using triangles
+	source->drawElements(lod, 0);
+}
+
+void Geometry::draw(const glm::mat4& view, const glm::mat4& projection, SoftwareRasterizer& rasterizer)
+{
+	const Geometry* source = drawSource();
+	if (source == nullptr || !source->cpuOnly) {
+		return;
+	}
+	const MeshLod* lod = selectLod(source, view, projection);
+	if (lod == nullptr) {
+		return;
 	}
 
-	// Generate a Vertex Array (VAO) and Vertex Buffer Object (VBO)
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
+	const PendingMesh& mesh = source->pendingMesh;
+	RasterMesh raster;
+	raster.points = (const glm::vec3*)mesh.data[0];
+	raster.pointCount = mesh.vertexCount;
+	raster.normals = (const glm::vec3*)mesh.data[1];
+	raster.normalCount = mesh.bytes[1] / sizeof(glm::vec3);
+	raster.faces = (const glm::ivec3*)mesh.data[2];
+
+	int variant = (switchRender ? shaderNormalColoring : 0) | (isLightSphere ? shaderLightProxy : 0);
+	PROFILE_COUNT_DRAW(lod->faceCount);
+	rasterizer.drawTriangles(raster, lod->firstFace, lod->faceCount, model, normalMatrix, materialIndex, variant);
+}
 
-	// Bind VAO
-	glBindVertexArray(VAO);
+const MeshLod* Geometry::selectInstancesLod(const Geometry* source, const glm::mat4& view,
+	const glm::mat4& projection, InstanceBuffer& instances)
+{
+	// the frustum is taken into the set's space, so moving the whole set with
+	// the trackball needs no refit
+	if (cullObjects) {
+		PROFILE_SCOPE("cull");
+		instances.setMeshBounds(source->bounds);
+		instances.cull(Frustum(projection * view * model));
+	}
+	else {
+		instances.drawAll();
+	}
+	instances.upload();
+	PROFILE_COUNT_OBJECTS(instances.drawCount(), instances.size() - instances.drawCount());
+	if (instances.drawCount() == 0) {
+		return nullptr;
+	}
 
-	// Bind VBO to the bound VAO, and store the point data
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * points.size(), points.data(), GL_STATIC_DRAW);
-	// Enable Vertex Attribute 0 to pass point data through to the shader
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+	// one level for the whole set, fine enough for the nearest instance
+	const std::vector<MeshLod>& sourceLods = source->lods;
+	float projectedSize = instances.projectedSize(view * model, projection, source->boundingRadius);
+	currentLod = SelectMeshLod((int)sourceLods.size(), currentLod, projectedSize);
+	return &sourceLods[currentLod];
+}
 
-	// Rendering triangles
-	glGenBuffers(1, &EBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(glm::ivec3)* faces.size(), faces.data(), GL_STATIC_DRAW);
+void Geometry::drawInstanced(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders,
+	InstanceBuffer& instances)
+{
+	const Geometry* source = drawSource();
+	if (source == nullptr || instances.size() == 0) {
+		return;
+	}
+	const MeshLod* selected = selectInstancesLod(source, view, projection, instances);
+	if (selected == nullptr) {
+		return;
+	}
+	const MeshLod& lod = *selected;
+
+	int variant = (switchRender ? shaderNormalColoring : 0) | (isLightSphere ? shaderLightProxy : 0) | shaderInstanced
+		| (gbufferPass ? shaderGBuffer : 0);
+	const ShaderProgram& shader = shaders.get(variant);
+	shader.use();
+
+	// the set's transform; the instances bring their own and their materials
+	glUniformMatrix4fv(shader.location(uniformModel), 1, GL_FALSE, glm::value_ptr(model));
+	glUniformMatrix3fv(shader.location(uniformNormalMatrix), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	glUniformMatrix4fv(shader.location(uniformDequantize), 1, GL_FALSE, glm::value_ptr(source->dequantize));
+	PROFILE_COUNT_UNIFORMS(3);
+
+	source->bindVertexArray(false);
+	instances.bindAttributes();
+	PROFILE_GPU_SECTION(profileSection);
+	PROFILE_COUNT_DRAW(lod.faceCount * instances.drawCount());
+	source->drawElements(lod, (GLsizei)instances.drawCount());
+}
 
-	// Send normals info
-	glGenBuffers(1, &VBO2);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3)* normals.size(), normals.data(), GL_STATIC_DRAW);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+DrawPacket Geometry::makePacket(const MeshLod& lod, const ShaderProgram& shader) const
+{
+	DrawPacket packet;
+	packet.program = &shader;
+	packet.vertexArray = vertexArray(false);
+	packet.indexType = indexType;
+	packet.indexCount = (GLsizei)lod.faceCount * 3;
+	elementRange(lod, packet.indices, packet.baseVertex);
+	return packet;
+}
+
+void Geometry::submit(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders,
+	RenderQueue& queue, int pass)
+{
+	const Geometry* source = drawSource();
+	if (source == nullptr) {
+		return;
+	}
+	const MeshLod* lod = selectLod(source, view, projection);
+	if (lod == nullptr) {
+		return;
+	}
 
-	// Unbind the VBO/VAO
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	int variant = (switchRender ? shaderNormalColoring : 0) | (isLightSphere ? shaderLightProxy : 0)
+		| (pass == renderPassGBuffer ? shaderGBuffer : 0);
+	DrawPacket packet = source->makePacket(*lod, shaders.get(variant));
+	packet.model = model * source->dequantize;
+	packet.normalMatrix = normalMatrix;
+	packet.material = materialIndex;
+	packet.profileSection = profileSection;
+	// the origin's distance along the view direction orders opaque draws
+	// front to back
+	queue.submit(pass, -(view * model[3]).z, packet);
 }
 
-Geometry::~Geometry() 
+void Geometry::submitInstanced(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders,
+	InstanceBuffer& instances, RenderQueue& queue, int pass)
 {
-	// Delete the VBO and the VAO.
-	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &VBO2);
-	glDeleteVertexArrays(1, &VAO);
+	const Geometry* source = drawSource();
+	if (source == nullptr || instances.size() == 0) {
+		return;
+	}
+	const MeshLod* lod = selectInstancesLod(source, view, projection, instances);
+	if (lod == nullptr) {
+		return;
+	}
+
+	int variant = (switchRender ? shaderNormalColoring : 0) | (isLightSphere ? shaderLightProxy : 0) | shaderInstanced
+		| (pass == renderPassGBuffer ? shaderGBuffer : 0);
+	DrawPacket packet = source->makePacket(*lod, shaders.get(variant));
+	packet.instances = &instances;
+	packet.instanceCount = (GLsizei)instances.drawCount();
+	packet.model = model;
+	packet.normalMatrix = normalMatrix;
+	packet.dequantize = source->dequantize;
+	packet.profileSection = profileSection;
+	queue.submit(pass, -(view * model[3]).z, packet);
 }
 
-void Geometry::draw(const glm::mat4& view, const glm::mat4& projection, GLuint shader)
+void Geometry::drawDepth(GLint modelLocation) const
 {
-	// Activate the shader program 
-	glUseProgram(shader);
+	const Geometry* source = drawSource();
+	if (source == nullptr) {
+		return;
+	}
+	glm::mat4 drawModel = model * source->dequantize;
+	glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(drawModel));
+	PROFILE_COUNT_UNIFORMS(1);
+
+	const MeshLod& lod = source->lods[0];
+	PROFILE_COUNT_DRAW(lod.faceCount);
+	source->bindVertexArray(true);
+	source->drawElements(lod, 0);
+}
 
-	// Get the shader variable locations and send the uniform data to the shader 
-	glUniformMatrix4fv(glGetUniformLocation(shader, "view"), 1, false, glm::value_ptr(view));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "projection"), 1, false, glm::value_ptr(projection));
-	glUniformMatrix4fv(glGetUniformLocation(shader, "model"), 1, GL_FALSE, glm::value_ptr(model));
+GLuint Geometry::vertexArray(bool depth) const
+{
+	if (arenaMesh >= 0) {
+		const MeshArena* arena = arenas[arenaLayout];
+		return depth ? arena->getDepthVertexArray() : arena->getVertexArray();
+	}
+	return depth ? depthVAO : VAO;
+}
 
-	// let the shader know which model is shown to shade accordingly
-	glUniform1i(glGetUniformLocation(shader, "switchRender"), switchRender);
-	glUniform1i(glGetUniformLocation(shader, "rabbit"), rabbitMatInt);
-	glUniform1i(glGetUniformLocation(shader, "sandal"), sandalMatInt);
-	glUniform1i(glGetUniformLocation(shader, "bear"), bearMatInt);
+void Geometry::elementRange(const MeshLod& lod, const void*& indices, GLint& baseVertex) const
+{
+	// indices stay relative to the mesh's first vertex, wherever the arena
+	// put it; a mesh with its own buffers starts at 0
+	size_t indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	size_t firstIndexByte = (size_t)lod.firstFace * 3 * indexSize;
+	indices = (const void*)firstIndexByte;
+	baseVertex = 0;
+	if (arenaMesh >= 0) {
+		indices = arenas[arenaLayout]->indices(arenaMesh, firstIndexByte);
+		baseVertex = arenas[arenaLayout]->baseVertex(arenaMesh);
+	}
+}
 
-	// let the shader know if obj is the light sphere
-	if (objectName == "sphere") {
-		glUniform1i(glGetUniformLocation(shader, "sphere"), 1);
+void Geometry::drawElements(const MeshLod& lod, GLsizei instanceCount) const
+{
+	const void* indices;
+	GLint baseVertex;
+	elementRange(lod, indices, baseVertex);
+	if (instanceCount > 0) {
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)lod.faceCount * 3, indexType, indices,
+			instanceCount, baseVertex);
+		// the instance arrays are VAO state; later draws from it have none
+		InstanceBuffer::unbindAttributes();
 	}
 	else {
-		glUniform1i(glGetUniformLocation(shader, "sphere"), 0);
+		glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)lod.faceCount * 3, indexType, indices, baseVertex);
 	}
+	// the VAO stays bound for the next mesh in the arena
+	if (arenaMesh < 0) {
+		MeshArena::bindVertexArray(0);
+	}
+}
 
-	// send light position
-	glUniform3fv(glGetUniformLocation(shader, "lightPos"), 1, glm::value_ptr(lightPos));
-
-	// Bind the VAO
-	glBindVertexArray(VAO);
-	// Draw the points using triangles
-	glDrawElements(GL_TRIANGLES, 3*faces.size(), GL_UNSIGNED_INT, 0);
-	// Unbind the VAO and shader program
-	glBindVertexArray(0);
-	glUseProgram(0);
+Aabb Geometry::worldBounds() const
+{
+	const Geometry* source = drawSource();
+	return TransformAabb(source ? source->bounds : Aabb(), model);
 }
 
 /*
@@ -209,18 +738,32 @@ void Geometry::draw(const glm::mat4& view, const glm::mat4& projection, GLuint s
 	}
 */
 
+void Geometry::setModel(const glm::mat4& transform)
+{
+	model = transform;
+	updateNormalMatrix();
+}
+
 // scale object when scrolling (mode1, mode3)
 void Geometry::scale(int yoff) {
+	model = scaled(model, yoff);
+	updateNormalMatrix();
+}
+
+glm::mat4 Geometry::scaled(const glm::mat4& model, int yoff) {
 	if (yoff > 0) {
-		model = glm::scale(model, glm::vec3(1.25f));
-	}
-	else {
-		model = glm::scale(model, glm::vec3(0.75f));
+		return glm::scale(model, glm::vec3(1.25f));
 	}
+	return glm::scale(model, glm::vec3(0.75f));
 }
 
 // move light to/from center when scrolling (mode2, mode3)
 void Geometry::moveCloserToModel(int yoff) {
+	model = movedCloserToModel(model, yoff);
+}
+
+glm::mat4 Geometry::movedCloserToModel(const glm::mat4& model, int yoff) {
+	glm::mat4 moved = model;
 	// move distance is (dist from origin)/5
 	float xmove = std::abs(model[3][0])/5;
 	float ymove = std::abs(model[3][1])/5;
@@ -240,19 +783,25 @@ void Geometry::moveCloserToModel(int yoff) {
 	// scroll up = move away from origin
 	// scroll down = move to origin
 	if (yoff > 0) {
-		model[3][0] += -xmove;
-		model[3][1] += -ymove;
-		model[3][2] += -zmove;
+		moved[3][0] += -xmove;
+		moved[3][1] += -ymove;
+		moved[3][2] += -zmove;
 	}
 	else {
-		model[3][0] += xmove;
-		model[3][1] += ymove;
-		model[3][2] += zmove;
+		moved[3][0] += xmove;
+		moved[3][1] += ymove;
+		moved[3][2] += zmove;
 	}
+	return moved;
 }
 
 void Geometry::rotateControl(glm::vec3 axis, float angle) {
-	model = glm::rotate(angle, axis) * model;
+	model = rotated(model, axis, angle);
+	updateNormalMatrix();
+}
+
+glm::mat4 Geometry::rotated(const glm::mat4& model, const glm::vec3& axis, float angle) {
+	return glm::rotate(angle, axis) * model;
 }
 
 // tell shader which render mode to use
@@ -267,19 +816,13 @@ void Geometry::switchRenderFunc() {
 
 // tell shader which obj's material to render
 void Geometry::toRabbitMat() {
-	rabbitMatInt = 1;
-	sandalMatInt = 0;
-	bearMatInt = 0;
+	materialIndex = materialChrome;
 }
 void Geometry::toSandalMat() {
-	rabbitMatInt = 0;
-	sandalMatInt = 1;
-	bearMatInt = 0;
+	materialIndex = materialYellowPlastic;
 }
 void Geometry::toBearMat() {
-	rabbitMatInt = 0;
-	sandalMatInt = 0;
-	bearMatInt = 1;
+	materialIndex = materialObsidian;
 }
 
 // force shader to update coloring when light is moved
@@ -2,45 +2,256 @@
 #define _GEOMETRY_H_
 
 #include "Object.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "VertexWeld.h"
+#include "MeshOptimizer.h"
+#include "MeshLod.h"
+#include "MeshPreprocess.h"
+#include "VertexFormat.h"
+#include "ThreadPool.h"
+#include "ShaderProgram.h"
+#include "InstanceBuffer.h"
+#include "Frustum.h"
+#include "MeshArena.h"
+#include "RenderQueue.h"
+#include "Profiler.h"
 
+#include <atomic>
+#include <future>
 #include <vector>
 #include <string>
 
 using namespace std;
 
+class SoftwareRasterizer;
+struct RasterMesh;
+
 class Geometry : public Object
 {
 private:
-	std::vector<glm::vec3> points;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::ivec3> faces;
 	std::string objectName;
+	std::string objFilename;
+	bool isLightSphere;
+	// profiler section timing this object's draws
+	int profileSection;
+
+	GLuint VAO = 0, VBO = 0, EBO = 0, VBO2 = 0;
+	// positions only, for depth passes: the point buffer itself in the float
+	// layout, a separate copy of the quantized positions in the compact one
+	GLuint depthVAO = 0, positionVBO = 0;
+	GLsizei indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	// or the mesh's ranges in the arena of its layout, in place of all of
+	// the above buffers and VAOs
+	int arenaMesh = -1;
+	MeshLayout arenaLayout = meshLayoutFloat;
+
+	// one per layout, made on the render thread when first needed
+	static MeshArena* arenas[meshLayoutCount];
+
+	// layout of the resident mesh; compact meshes store positions relative to
+	// their bounding box and need dequantize folded into the model matrix
+	bool compact = false;
+	glm::mat4 dequantize = glm::mat4(1.0f);
+
+	// levels of detail in the index buffer, finest first, and the radius of
+	// the bounding sphere around the mesh origin they are selected by
+	std::vector<MeshLod> lods;
+	float boundingRadius = 0.0f;
+	int currentLod = 0;
+	// box around the mesh in its own space, for frustum culling
+	Aabb bounds;
+
+	// Loading runs in two halves: a worker reads the mesh (from its cache or
+	// the obj file) into pendingMesh, then the render thread streams it into
+	// the GPU buffers a slice at a time.
+	enum LoadState { notLoaded, loading, loaded, resident };
+	std::atomic<int> loadState{ notLoaded };
+	std::future<void> loadTask;
+
+	struct PendingMesh
+	{
+		MeshCacheView cache;
+		MeshData mesh;
+		PackedMesh packed;
+		// the packed positions alone (xyzw shorts), compact layout only
+		std::vector<int16_t> positions;
+		bool compact = false;
+		GLenum indexType = GL_UNSIGNED_INT;
+		size_t vertexCount = 0;
+		std::vector<MeshLod> lods;
+		float boundingRadius = 0.0f;
+		Aabb bounds;
+
+		// points, normals, indices and the compact position stream
+		const void* data[4] = {};
+		size_t bytes[4] = {};
+		size_t uploaded[4] = {};
+		bool buffersCreated = false;
+	};
+	PendingMesh pendingMesh;
+	// loaded for the software rasterizer: the mesh stays in pendingMesh and
+	// nothing goes to the GPU
+	bool cpuOnly = false;
+
+	// timings for the startup report
+	double loadSeconds = 0.0;
+	double uploadSeconds = 0.0;
+	int uploadSlices = 0;
+	bool fromCache = false;
+	WeldStats weldStats;
+	OptimizeStats optimizeStats;
+	PreprocessStats preprocessStats;
 
-	GLuint VAO, VBO, EBO, VBO2;
+	// fitting and normal generation of this model's mesh
+	MeshPreprocessOptions preprocessOptions;
 
 	static glm::vec3 lightPos;
 
 	int switchRender = 0;
-	int rabbitMatInt = 1;
-	int sandalMatInt = 0;
-	int bearMatInt = 0;
+	// entry of materialTable to shade with
+	int materialIndex = materialChrome;
+
+	// inverse transpose of the model matrix, redone whenever it changes
+	glm::mat3 normalMatrix = glm::mat3(1.0f);
+	void updateNormalMatrix();
+
+	// drawn in place of a mesh that is not resident yet
+	static Geometry* placeholder;
+
+	void loadMesh(ThreadPool* loadPool);
+	// mesh to draw: this one, the placeholder while loading, or none
+	const Geometry* drawSource() const;
+	// culls against the view frustum and picks the level of detail of
+	// source; nullptr when the object is outside
+	const MeshLod* selectLod(const Geometry* source, const glm::mat4& view, const glm::mat4& projection);
+	// culls the instances against the view frustum and uploads the ones
+	// inside, then picks a level of detail for all of them; nullptr when
+	// none is inside
+	const MeshLod* selectInstancesLod(const Geometry* source, const glm::mat4& view, const glm::mat4& projection,
+		InstanceBuffer& instances);
+	// the resident mesh's VAO, or the one reading positions only
+	GLuint vertexArray(bool depth) const;
+	void bindVertexArray(bool depth) const { MeshArena::bindVertexArray(vertexArray(depth)); }
+	// where a level's indices start and the vertex they count from
+	void elementRange(const MeshLod& lod, const void*& indices, GLint& baseVertex) const;
+	// the draw of a level as a packet, with the VAO and index range filled in
+	DrawPacket makePacket(const MeshLod& lod, const ShaderProgram& shader) const;
+	// faces of a level with the VAO bound, as many times as instanceCount
+	// (once for 0); meshes with their own buffers unbind it afterwards
+	void drawElements(const MeshLod& lod, GLsizei instanceCount) const;
+	// give the mesh's buffers or arena ranges back
+	void releaseBuffers();
 
 public:
+	// read/write .meshbin caches next to the obj files
+	static bool useMeshCache;
+	// reorder triangles and vertices for the GPU after loading
+	static bool optimizeMeshes;
+	// build simplified levels of detail after loading and draw them for
+	// objects that are small on screen
+	static bool buildLods;
+	// skip objects and instances outside the view frustum
+	static bool cullObjects;
+	// draws write the G-buffer of a DeferredRenderer instead of shading;
+	// only for lit objects, not the light sphere or normal coloring
+	static bool gbufferPass;
+	// upload meshes in the quantized, interleaved PackedVertex layout with
+	// 16-bit indices where they fit; applies to meshes loaded afterwards
+	static bool compactVertices;
+	// largest piece of a buffer sent to the GPU in one glBufferSubData call
+	static size_t uploadSliceBytes;
+	// keep meshes in the shared arena of their layout, all drawn from one VAO,
+	// rather than in buffers and VAOs of their own; applies to meshes loaded
+	// afterwards
+	static bool useMeshArena;
+
+	// nothing is read until the mesh is requested
 	Geometry(std::string objFilename, std::string name);
 	~Geometry();
+
+	// queue the mesh to be read on the pool (once); it is parsed on all of the
+	// pool's workers
+	void requestLoad(ThreadPool* pool);
+	// read and upload the mesh right away on the calling (render) thread
+	void loadNow(ThreadPool* loadPool);
+	// stream the loaded mesh into GPU buffers for at most budgetSeconds;
+	// render thread only. Returns true once the mesh is resident.
+	bool uploadSlice(double budgetSeconds);
+	// read the mesh right away and keep it in memory for the software
+	// rasterizer, in the float layout, without touching GL. Call it before
+	// any other load; such a mesh can't be drawn by GL.
+	void loadForSoftware(ThreadPool* loadPool);
+	bool isResident() const { return loadState == resident; }
+	// read or upload still in progress
+	bool isLoading() const { return loadState == loading || loadState == loaded; }
+	// the last load came from the .meshbin cache rather than the obj file
+	bool loadedFromCache() const { return fromCache; }
+	// drop the GPU copy so the next request loads the mesh again, e.g. in
+	// another vertex layout
+	void unload();
+	// how the mesh is fitted and given normals; applies to the next load
+	void setPreprocess(const MeshPreprocessOptions& options) { preprocessOptions = options; }
+
+	static void setPlaceholder(Geometry* geometry) { placeholder = geometry; }
+	// arena of a layout, nullptr until a mesh went into it
+	static MeshArena* arena(MeshLayout layout) { return arenas[layout]; }
+	// delete the arenas while the GL context is still there; meshes still in
+	// them can't be drawn afterwards
+	static void releaseArenas();
+	static glm::vec3 getLightPos() { return lightPos; }
+	static void setLightPos(const glm::vec3& position) { lightPos = position; }
 	
-	void draw(const glm::mat4& view, const glm::mat4& projection, GLuint shader);
+	// view and projection pick the level of detail; the shader gets them from
+	// the per-frame uniform buffer. The variant matching the render mode is
+	// taken from shaders.
+	void draw(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders);
+	// every instance of the mesh in one draw call, placed by the instance
+	// transforms and then by this object's model matrix, so the trackball and
+	// scroll move the whole set
+	void drawInstanced(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders,
+		InstanceBuffer& instances);
+	// the same draws into a queue, sorted and issued later; pass picks the
+	// G-buffer variant for renderPassGBuffer
+	void submit(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders,
+		RenderQueue& queue, int pass);
+	void submitInstanced(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders,
+		InstanceBuffer& instances, RenderQueue& queue, int pass);
+	// the same draw on the CPU, for meshes loaded with loadForSoftware; the
+	// rasterizer takes the frame uniforms from its own setFrame
+	void draw(const glm::mat4& view, const glm::mat4& projection, SoftwareRasterizer& rasterizer);
 	//void update();
 
+	// place the object directly, e.g. one instance at a time in a benchmark
+	void setModel(const glm::mat4& transform);
+
 	void scale(int yoff);
 	void rotateControl(glm::vec3 axis, float angle);
 	void moveCloserToModel(int yoff);
+	// the same changes to a model matrix kept elsewhere, e.g. in a SceneState
+	static glm::mat4 scaled(const glm::mat4& model, int yoff);
+	static glm::mat4 rotated(const glm::mat4& model, const glm::vec3& axis, float angle);
+	static glm::mat4 movedCloserToModel(const glm::mat4& model, int yoff);
+
+	// depth of the finest level into the bound framebuffer with the bound
+	// program, reading positions only; modelLocation gets the model matrix
+	void drawDepth(GLint modelLocation) const;
+	// mesh drawDepth draws, which changes when a loading mesh replaces the
+	// placeholder (nullptr while there is none), and its box in world space
+	const Geometry* depthSource() const { return drawSource(); }
+	Aabb worldBounds() const;
 
 	void switchRenderFunc();
+	// normal coloring instead of Phong illumination
+	bool showsNormals() const { return switchRender != 0; }
 
 	void toRabbitMat();
 	void toSandalMat();
 	void toBearMat();
+	// entry of materialTable, a MaterialId
+	int getMaterial() const { return materialIndex; }
+	void setMaterial(int index) { materialIndex = index; }
 
 	void updateLight();
 };
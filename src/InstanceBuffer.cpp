@@ -0,0 +1,227 @@
+#include "InstanceBuffer.h"
+#include "Material.h"
+#include "MeshLod.h"
+#include "Profiler.h"
+
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+
+InstanceBuffer::InstanceBuffer()
+{
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	if (buffer) {
+		glDeleteBuffers(1, &buffer);
+	}
+}
+
+void InstanceBuffer::clear()
+{
+	instances.clear();
+	dirty = true;
+	bvhDirty = true;
+	updateBounds();
+}
+
+void InstanceBuffer::add(const glm::mat4& model, int material)
+{
+	InstanceData instance;
+	instance.model = model;
+	instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	instance.material = material;
+	instances.push_back(instance);
+	dirty = true;
+	bvhDirty = true;
+	updateBounds();
+}
+
+void InstanceBuffer::setModel(size_t i, const glm::mat4& model)
+{
+	instances[i].model = model;
+	instances[i].normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	dirty = true;
+	if (!bvhDirty) {
+		bvh.refit((uint32_t)i, instanceBounds(i));
+	}
+
+	// the LOD bounds only grow; they stay conservative
+	glm::vec3 origin(model[3]);
+	float distance = glm::length(origin - boundsCenter);
+	boundsRadius = std::max(boundsRadius, distance);
+	maxScale = std::max(maxScale, std::max(glm::length(glm::vec3(model[0])),
+		std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])))));
+}
+
+Aabb InstanceBuffer::instanceBounds(size_t i) const
+{
+	return TransformAabb(meshBounds, instances[i].model);
+}
+
+void InstanceBuffer::setMeshBounds(const Aabb& bounds)
+{
+	if (bounds.min != meshBounds.min || bounds.max != meshBounds.max) {
+		meshBounds = bounds;
+		bvhDirty = true;
+	}
+}
+
+size_t InstanceBuffer::cull(const Frustum& frustum)
+{
+	if (bvhDirty) {
+		std::vector<Aabb> boxes(instances.size());
+		for (size_t i = 0; i < instances.size(); i++) {
+			boxes[i] = instanceBounds(i);
+		}
+		bvh.build(boxes);
+		bvhDirty = false;
+	}
+
+	std::vector<uint32_t> previous;
+	previous.swap(visible);
+	bvh.cull(frustum, visible);
+	// the same instances as last time need no upload
+	if (!culled || visible != previous) {
+		dirty = true;
+	}
+	culled = true;
+	return visible.size();
+}
+
+void InstanceBuffer::drawAll()
+{
+	if (culled) {
+		culled = false;
+		dirty = true;
+	}
+}
+
+// bounds grow with every added instance and are exact again after clear
+void InstanceBuffer::updateBounds()
+{
+	if (instances.empty()) {
+		boundsCenter = glm::vec3(0.0f);
+		boundsRadius = 0.0f;
+		maxScale = 0.0f;
+		return;
+	}
+	const glm::mat4& model = instances.back().model;
+	glm::vec3 origin(model[3]);
+	float scale = std::max(glm::length(glm::vec3(model[0])),
+		std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	maxScale = std::max(maxScale, scale);
+	if (instances.size() == 1) {
+		boundsCenter = origin;
+		boundsRadius = 0.0f;
+		return;
+	}
+
+	// grow the sphere just enough to hold the new origin
+	float distance = glm::length(origin - boundsCenter);
+	if (distance > boundsRadius) {
+		float radius = 0.5f * (boundsRadius + distance);
+		boundsCenter += (origin - boundsCenter) * ((radius - boundsRadius) / distance);
+		boundsRadius = radius;
+	}
+}
+
+void InstanceBuffer::upload()
+{
+	if (!dirty) {
+		return;
+	}
+	dirty = false;
+	if (!buffer) {
+		glGenBuffers(1, &buffer);
+	}
+
+	// the culled instances are gathered into one block first
+	const InstanceData* data = instances.data();
+	uploadedCount = instances.size();
+	if (culled) {
+		staging.resize(visible.size());
+		for (size_t i = 0; i < visible.size(); i++) {
+			staging[i] = instances[visible[i]];
+		}
+		data = staging.data();
+		uploadedCount = staging.size();
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (instances.size() > capacity) {
+		capacity = instances.size();
+	}
+	// orphan the old storage, then fill the new one
+	glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * capacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(InstanceData) * uploadedCount, data);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::bindAttributes() const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	// a mat4 attribute takes four vec4 locations, a mat3 three vec3 ones
+	for (GLuint column = 0; column < 4; column++) {
+		GLuint location = instanceModelLocation + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(void*)(offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+	for (GLuint column = 0; column < 3; column++) {
+		GLuint location = instanceNormalMatrixLocation + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+			(void*)(offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+		glVertexAttribDivisor(location, 1);
+	}
+	glEnableVertexAttribArray(instanceMaterialLocation);
+	glVertexAttribIPointer(instanceMaterialLocation, 1, GL_INT, sizeof(InstanceData),
+		(void*)offsetof(InstanceData, material));
+	glVertexAttribDivisor(instanceMaterialLocation, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	PROFILE_COUNT_BINDS(2);
+}
+
+void InstanceBuffer::unbindAttributes()
+{
+	for (GLuint location = instanceModelLocation; location <= instanceMaterialLocation; location++) {
+		glDisableVertexAttribArray(location);
+	}
+}
+
+float InstanceBuffer::projectedSize(const glm::mat4& modelView, const glm::mat4& projection, float meshRadius) const
+{
+	float setScale = std::max(glm::length(glm::vec3(modelView[0])),
+		std::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+	float centerDistance = -(modelView * glm::vec4(boundsCenter, 1.0f)).z;
+	return ProjectedSphereSize(meshRadius * maxScale * setScale, centerDistance - boundsRadius * setScale, projection);
+}
+
+void GenerateInstanceField(InstanceBuffer& instances, int count, float meshSize, float fieldSize, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	int side = std::max((int)std::ceil(std::cbrt((double)count)), 1);
+	float cell = fieldSize / side;
+
+	instances.clear();
+	for (int i = 0; i < count; i++) {
+		glm::vec3 gridPos((float)(i % side), (float)(i / side % side), (float)(i / (side * side)));
+		glm::vec3 jitter(unit(random), unit(random), unit(random));
+		glm::vec3 position = (gridPos + 0.25f + 0.5f * jitter) * cell - 0.5f * fieldSize;
+
+		glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) - 0.5f + 1e-4f);
+		float angle = unit(random) * 6.2831853f;
+		float scale = cell / meshSize * (0.5f + 0.3f * unit(random));
+
+		glm::mat4 model = glm::translate(position) * glm::rotate(angle, axis) * glm::scale(glm::vec3(scale));
+		instances.add(model, (int)(random() % materialCount));
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef _INSTANCE_BUFFER_H_
+#define _INSTANCE_BUFFER_H_
+
+#include "shader.h"
+#include "Frustum.h"
+#include "ObjectBvh.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Per-instance attributes of the INSTANCED shader variant: the transform
+// within the set, its normal matrix and the entry of materialTable.
+struct InstanceData
+{
+	glm::mat4 model;
+	glm::mat3 normalMatrix;
+	int32_t material;
+};
+
+// vertex attribute locations of InstanceData: model takes 2-5, the normal
+// matrix 6-8 and the material 9
+const GLuint instanceModelLocation = 2;
+const GLuint instanceNormalMatrixLocation = 6;
+const GLuint instanceMaterialLocation = 9;
+
+// Instances of one mesh, drawn with a single glDrawElementsInstanced call.
+// They are kept on the CPU and streamed to the GPU after they change. With
+// culling, a BVH over the instance boxes picks the ones in the view frustum
+// and only those are streamed and drawn. No GL calls are made before
+// upload, so the culling also works without a context.
+class InstanceBuffer
+{
+private:
+	GLuint buffer = 0;
+	size_t capacity = 0;
+	std::vector<InstanceData> instances;
+	bool dirty = false;
+
+	// box of the mesh in its own space, the instance boxes in set space and
+	// the hierarchy over them
+	Aabb meshBounds;
+	ObjectBvh bvh;
+	bool bvhDirty = true;
+	Aabb instanceBounds(size_t i) const;
+
+	// instances to upload and draw: every one, or the ones the last cull kept
+	bool culled = false;
+	std::vector<uint32_t> visible;
+	std::vector<InstanceData> staging;
+	size_t uploadedCount = 0;
+
+	// sphere around the instance origins and the largest instance scale,
+	// for picking the level of detail
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+	float maxScale = 0.0f;
+	void updateBounds();
+
+public:
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	void clear();
+	void add(const glm::mat4& model, int material);
+	// move one instance; the BVH is refit rather than rebuilt
+	void setModel(size_t i, const glm::mat4& model);
+	size_t size() const { return instances.size(); }
+	const InstanceData& operator[](size_t i) const { return instances[i]; }
+
+	// the box instances are culled by, in mesh space
+	void setMeshBounds(const Aabb& bounds);
+	// keep only the instances intersecting the frustum (given in the set's
+	// space) for the next upload; returns how many are left
+	size_t cull(const Frustum& frustum);
+	// draw every instance again
+	void drawAll();
+	const std::vector<uint32_t>& visibleInstances() const { return visible; }
+
+	// send the instances to draw to the GPU if they changed, in fresh
+	// storage so draws still reading the old data don't stall the upload
+	void upload();
+	// instances in the buffer after upload
+	size_t drawCount() const { return uploadedCount; }
+
+	// point the instance attributes of the bound VAO at the buffer
+	void bindAttributes() const;
+	// disable them again; arena VAOs are shared with draws without instances
+	static void unbindAttributes();
+
+	// screen size (as ProjectedSize) of the largest instance as close to the
+	// camera as any instance gets, for a mesh of radius meshRadius
+	float projectedSize(const glm::mat4& modelView, const glm::mat4& projection, float meshRadius) const;
+};
+
+// Stress scene: count instances on a jittered grid filling a cube of side
+// fieldSize around the origin, randomly turned and scaled to fit their cells.
+// meshSize is the side of the box the meshes are normalized to. Materials
+// are random; the same seed gives the same field.
+void GenerateInstanceField(InstanceBuffer& instances, int count, float meshSize = 15.0f, float fieldSize = 15.0f,
+	unsigned seed = 1);
+
+#endif
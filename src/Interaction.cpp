@@ -0,0 +1,127 @@
+#include "Interaction.h"
+
+// map 2d point on screen to 3d point on object
+glm::vec3 TrackballPoint(const glm::vec2& cursor, int width, int height)
+{
+	glm::vec3 v;
+	float d;
+	v.x = (2.0 * cursor.x - width) / width;
+	v.y = (height - 2.0 * cursor.y) / height;
+	v.z = 0.0;
+	d = glm::length(v);
+	d = (d < 1.0) ? d : 1.0;
+	v.z = sqrtf(1.001 - d * d);
+	v = glm::normalize(v);
+	return v;
+}
+
+void RotateInteraction(InteractionMode mode, Geometry* object, Geometry* light, const glm::vec3& axis, float angle)
+{
+	// rotate obj if mode1
+	if (mode == interactModel) {
+		object->rotateControl(axis, angle);
+	}
+	// rotate light about model if mode2
+	else if (mode == interactLight) {
+		light->rotateControl(axis, angle);
+		light->updateLight();
+	}
+	// rotate both light and model together
+	else {
+		object->rotateControl(axis, angle);
+		light->rotateControl(axis, angle);
+		light->updateLight();
+	}
+}
+
+void ScrollInteraction(InteractionMode mode, Geometry* object, Geometry* light, int offset)
+{
+	// scale obj if mode1
+	if (mode == interactModel) {
+		object->scale(offset);
+	}
+	// move light closer to/farther from object if mode2
+	else if (mode == interactLight) {
+		light->moveCloserToModel(offset);
+		light->updateLight();
+	}
+	// scale obj and move light closer/farther from center if mode3
+	else {
+		object->scale(offset);
+		light->moveCloserToModel(offset);
+		light->updateLight();
+	}
+}
+
+// a scroll step: the model grows or shrinks as in Geometry::scale, the
+// light moves a fifth of its distance away or back as in moveCloserToModel
+static float objectScaleStep(int offset)
+{
+	return offset > 0 ? 1.25f : 0.75f;
+}
+
+static float lightDistanceStep(int offset)
+{
+	return offset > 0 ? 1.2f : 0.8f;
+}
+
+void RotateInteraction(InteractionMode mode, InteractionDelta& delta, const glm::vec3& axis, float angle)
+{
+	glm::quat rotation = glm::angleAxis(angle, glm::normalize(axis));
+	if (mode != interactLight) {
+		delta.objectRotation = rotation * delta.objectRotation;
+		delta.objectMoved = true;
+	}
+	if (mode != interactModel) {
+		delta.lightRotation = rotation * delta.lightRotation;
+		delta.lightMoved = true;
+	}
+	delta.events++;
+}
+
+void ScrollInteraction(InteractionMode mode, InteractionDelta& delta, int offset)
+{
+	if (mode != interactLight) {
+		delta.objectScale *= objectScaleStep(offset);
+		delta.objectMoved = true;
+	}
+	if (mode != interactModel) {
+		delta.lightDistance *= lightDistanceStep(offset);
+		delta.lightMoved = true;
+	}
+	delta.events++;
+}
+
+void ApplyInteraction(InteractionDelta& delta, SceneState& scene)
+{
+	if (delta.objectMoved) {
+		Transform& object = scene.models[scene.current].transform;
+		object.rotation = glm::normalize(delta.objectRotation * object.rotation);
+		object.translation = delta.objectRotation * object.translation;
+		object.scale *= delta.objectScale;
+		scene.models[scene.current].model = object.matrix();
+	}
+	// the light sphere turns around the origin with its position
+	if (delta.lightMoved) {
+		Transform& light = scene.models[sceneLight].transform;
+		light.rotation = glm::normalize(delta.lightRotation * light.rotation);
+		light.translation = delta.lightRotation * light.translation * delta.lightDistance;
+		scene.models[sceneLight].model = light.matrix();
+		scene.lightPos = light.translation;
+	}
+	delta = InteractionDelta();
+}
+
+void RotateInteraction(InteractionMode mode, SceneState& scene, const glm::vec3& axis, float angle)
+{
+	InteractionDelta delta;
+	RotateInteraction(mode, delta, axis, angle);
+	ApplyInteraction(delta, scene);
+}
+
+void ScrollInteraction(InteractionMode mode, SceneState& scene, int offset)
+{
+	InteractionDelta delta;
+	ScrollInteraction(mode, delta, offset);
+	ApplyInteraction(delta, scene);
+}
@@ -0,0 +1,58 @@
+#ifndef _INTERACTION_H_
+#define _INTERACTION_H_
+
+#include "Geometry.h"
+#include "SceneState.h"
+
+#include <glm/glm.hpp>
+
+// what dragging and scrolling move: the model (Z), the light around it (X)
+// or both together (C)
+enum InteractionMode
+{
+	interactModel,
+	interactLight,
+	interactBoth
+};
+
+// point on the unit sphere under the cursor, for trackball drags in a
+// window of the given size
+glm::vec3 TrackballPoint(const glm::vec2& cursor, int width, int height);
+
+// trackball drag: rotate by angle around axis
+void RotateInteraction(InteractionMode mode, Geometry* object, Geometry* light, const glm::vec3& axis, float angle);
+
+// scroll wheel: scale the model and/or move the light to or from it
+void ScrollInteraction(InteractionMode mode, Geometry* object, Geometry* light, int offset);
+
+// Drags and scrolls not applied to the scene yet, one rotation and one
+// scale factor each for the model and for the light. Drags compose as
+// quaternions, scroll steps multiply, and rotating about the origin
+// commutes with both kinds of scaling, so applying the delta once gives
+// what the events give one by one, at the cost of a quaternion product
+// per event instead of a matrix build and multiply.
+struct InteractionDelta
+{
+	glm::quat objectRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::quat lightRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	// of the model's size, and of the light's distance from the origin
+	float objectScale = 1.0f;
+	float lightDistance = 1.0f;
+	bool objectMoved = false;
+	bool lightMoved = false;
+	// events folded in
+	int events = 0;
+};
+
+// fold an event into the delta
+void RotateInteraction(InteractionMode mode, InteractionDelta& delta, const glm::vec3& axis, float angle);
+void ScrollInteraction(InteractionMode mode, InteractionDelta& delta, int offset);
+// move the scene's current model and light by the delta, composing the
+// matrices of what moved once, and start a new delta
+void ApplyInteraction(InteractionDelta& delta, SceneState& scene);
+
+// a single event straight on a scene's current model and light
+void RotateInteraction(InteractionMode mode, SceneState& scene, const glm::vec3& axis, float angle);
+void ScrollInteraction(InteractionMode mode, SceneState& scene, int offset);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Read-only view of a whole file. Backed by mmap on POSIX and a file mapping
+// on Windows, so the parser can walk the bytes in place without copying them.
+class MappedFile
+{
+private:
+	const char* bytes = nullptr;
+	size_t length = 0;
+	bool opened = false;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fd = -1;
+#endif
+
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return opened; }
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+	const char* begin() const { return bytes; }
+	const char* end() const { return bytes + length; }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include "Material.h"
+
+const Material materialTable[materialCount] = {
+	// chrome rabbit, red light
+	{
+		glm::vec4(0.25f, 0.25f, 0.25f, 0.0f),
+		glm::vec4(0.4f, 0.4f, 0.4f, 0.0f),
+		glm::vec4(0.774597f, 0.774597f, 0.774597f, 0.6f),
+		glm::vec4(0.75f, 0.0f, 0.0f, 1.0f),
+	},
+	// yellow plastic sandal, green light
+	{
+		glm::vec4(0.0f, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.5f, 0.5f, 0.0f, 0.0f),
+		glm::vec4(0.6f, 0.6f, 0.6f, 0.25f),
+		glm::vec4(0.0f, 1.0f, 0.0f, 1.0f),
+	},
+	// obsidian bear, blue light
+	{
+		glm::vec4(0.05375f, 0.05f, 0.06625f, 0.0f),
+		glm::vec4(0.18275f, 0.17f, 0.22525f, 0.0f),
+		glm::vec4(0.332741f, 0.328634f, 0.346435f, 0.3f),
+		glm::vec4(0.0f, 0.0f, 1.0f, 1.0f),
+	},
+};
+
+MaterialBuffer::MaterialBuffer()
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(materialTable), materialTable, GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, materialsBinding, buffer);
+}
+
+MaterialBuffer::~MaterialBuffer()
+{
+	glDeleteBuffers(1, &buffer);
+}
@@ -0,0 +1,46 @@
+#ifndef _MATERIAL_H_
+#define _MATERIAL_H_
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+// Surface colors of a model and the color of the light while it is shown,
+// laid out like the std140 Material struct in shader.frag.
+struct Material
+{
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	// w holds the shininess
+	glm::vec4 specular;
+	glm::vec4 lightColor;
+};
+
+enum MaterialId
+{
+	materialChrome,
+	materialYellowPlastic,
+	materialObsidian,
+	materialCount
+};
+
+extern const Material materialTable[materialCount];
+
+// uniform buffer binding point of the Materials block
+const GLuint materialsBinding = 1;
+
+// std140 uniform buffer holding materialTable, uploaded once
+class MaterialBuffer
+{
+private:
+	GLuint buffer = 0;
+
+public:
+	MaterialBuffer();
+	~MaterialBuffer();
+
+	MaterialBuffer(const MaterialBuffer&) = delete;
+	MaterialBuffer& operator=(const MaterialBuffer&) = delete;
+};
+
+#endif
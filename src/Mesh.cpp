@@ -0,0 +1,23 @@
+#include "Mesh.h"
+#include "ObjReader.h"
+#include "VertexWeld.h"
+#include "MeshPreprocess.h"
+
+bool LoadMesh(const std::string& objFilename, MeshData& mesh, ThreadPool* pool, WeldStats* weldStats,
+	const MeshPreprocessOptions* options, PreprocessStats* preprocessStats)
+{
+	// Parsing obj file
+	ObjData obj;
+	// a file that failed to parse may have faces pointing at positions it
+	// doesn't have; nothing of it is used
+	if (!LoadObj(objFilename, obj, pool)) {
+		mesh = MeshData();
+		return false;
+	}
+
+	// one vertex per unique position/normal pair
+	WeldVertices(obj, mesh, false, weldStats);
+
+	PreprocessMesh(mesh, options ? *options : MeshPreprocessOptions(), pool, preprocessStats);
+	return true;
+}
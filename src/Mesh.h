@@ -0,0 +1,47 @@
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+struct WeldStats;
+struct MeshPreprocessOptions;
+struct PreprocessStats;
+
+// one level of detail: a run of triangles in MeshData::faces
+struct MeshLod
+{
+	uint32_t firstFace = 0;
+	uint32_t faceCount = 0;
+	// simplification error of the level, in mesh units
+	float error = 0.0f;
+};
+
+// CPU-side mesh in the layout Geometry uploads: one point and one normal per
+// vertex and triangle indices into them, already centered and scaled.
+struct MeshData
+{
+	std::vector<glm::vec3> points;
+	std::vector<glm::vec3> normals;
+	// empty unless texture coordinates were asked for when welding
+	std::vector<glm::vec2> texcoords;
+	std::vector<glm::ivec3> faces;
+	// levels of detail stored back to back in faces, finest first; empty
+	// means faces is a single level
+	std::vector<MeshLod> lods;
+};
+
+// parse an OBJ file, weld its vertices and preprocess it (PreprocessMesh,
+// with the default options when there are none); with a pool the file is
+// parsed and preprocessed in parallel. Fails, leaving mesh empty, if the
+// file is missing or malformed
+bool LoadMesh(const std::string& objFilename, MeshData& mesh, ThreadPool* pool = nullptr,
+	WeldStats* weldStats = nullptr, const MeshPreprocessOptions* options = nullptr,
+	PreprocessStats* preprocessStats = nullptr);
+
+#endif
@@ -0,0 +1,360 @@
+#include "MeshArena.h"
+#include "VertexFormat.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+// sizes of a new arena; it doubles from there
+static const size_t minVertexCapacity = 64 * 1024;
+static const size_t minIndexCapacity = 256 * 1024;
+// index ranges start on a 32-bit index boundary
+static const size_t indexAlignment = 4;
+
+static size_t alignUp(size_t offset, size_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+void RangeAllocator::reset(size_t newCapacity, size_t usedAtStart)
+{
+	capacity = newCapacity;
+	used = usedAtStart;
+	freeBlocks.clear();
+	if (usedAtStart < newCapacity) {
+		freeBlocks.push_back(Block{ usedAtStart, newCapacity - usedAtStart });
+	}
+}
+
+bool RangeAllocator::allocate(size_t size, size_t alignment, size_t& offset)
+{
+	if (size == 0) {
+		offset = 0;
+		return true;
+	}
+	for (size_t i = 0; i < freeBlocks.size(); i++) {
+		Block& block = freeBlocks[i];
+		size_t start = alignUp(block.offset, alignment);
+		size_t padding = start - block.offset;
+		if (padding + size > block.size) {
+			continue;
+		}
+		// the padding stays free in front, the rest after
+		Block rest = { start + size, block.size - padding - size };
+		if (padding > 0) {
+			block.size = padding;
+			if (rest.size > 0) {
+				freeBlocks.insert(freeBlocks.begin() + i + 1, rest);
+			}
+		}
+		else if (rest.size > 0) {
+			block = rest;
+		}
+		else {
+			freeBlocks.erase(freeBlocks.begin() + i);
+		}
+		used += size;
+		offset = start;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::free(size_t offset, size_t size)
+{
+	if (size == 0) {
+		return;
+	}
+	used -= size;
+	auto next = std::lower_bound(freeBlocks.begin(), freeBlocks.end(), offset,
+		[](const Block& block, size_t offset) { return block.offset < offset; });
+	size_t i = next - freeBlocks.begin();
+	freeBlocks.insert(next, Block{ offset, size });
+	// merge with the following block, then with the preceding one
+	if (i + 1 < freeBlocks.size() && freeBlocks[i].offset + freeBlocks[i].size == freeBlocks[i + 1].offset) {
+		freeBlocks[i].size += freeBlocks[i + 1].size;
+		freeBlocks.erase(freeBlocks.begin() + i + 1);
+	}
+	if (i > 0 && freeBlocks[i - 1].offset + freeBlocks[i - 1].size == freeBlocks[i].offset) {
+		freeBlocks[i - 1].size += freeBlocks[i].size;
+		freeBlocks.erase(freeBlocks.begin() + i);
+	}
+}
+
+size_t RangeAllocator::largestFreeBlock() const
+{
+	size_t largest = 0;
+	for (const Block& block : freeBlocks) {
+		largest = std::max(largest, block.size);
+	}
+	return largest;
+}
+
+float RangeAllocator::fragmentation() const
+{
+	size_t freeSpace = capacity - used;
+	if (freeSpace == 0) {
+		return 0.0f;
+	}
+	return 1.0f - (float)largestFreeBlock() / freeSpace;
+}
+
+GLuint MeshArena::currentVertexArray = 0;
+
+MeshArena::MeshArena(MeshLayout layout)
+	: layout(layout)
+{
+	strides[0] = streamStride(layout, 0);
+	strides[1] = streamStride(layout, 1);
+	glGenVertexArrays(1, &vertexArray);
+	glGenVertexArrays(1, &depthVertexArray);
+}
+
+MeshArena::~MeshArena()
+{
+	if (currentVertexArray == vertexArray || currentVertexArray == depthVertexArray) {
+		currentVertexArray = 0;
+	}
+	glDeleteBuffers(2, streams);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteVertexArrays(1, &vertexArray);
+	glDeleteVertexArrays(1, &depthVertexArray);
+}
+
+size_t MeshArena::streamStride(MeshLayout layout, int stream)
+{
+	if (layout == meshLayoutCompact) {
+		return stream == 0 ? sizeof(PackedVertex) : 4 * sizeof(int16_t);
+	}
+	return sizeof(glm::vec3);
+}
+
+int MeshArena::allocate(size_t vertexCount, size_t indexBytes)
+{
+	// whole 32-bit words, so packed ranges never need padding between them
+	indexBytes = alignUp(indexBytes, indexAlignment);
+	size_t firstVertex = 0, indexOffset = 0;
+	bool fits = vertexRanges.allocate(vertexCount, 1, firstVertex);
+	if (fits && !indexRanges.allocate(indexBytes, indexAlignment, indexOffset)) {
+		vertexRanges.free(firstVertex, vertexCount);
+		fits = false;
+	}
+
+	// pack the live meshes, into larger buffers if the gaps are not enough
+	if (!fits) {
+		size_t vertexNeed = vertexRanges.getUsed() + vertexCount;
+		size_t indexNeed = indexRanges.getUsed() + indexBytes;
+		size_t vertexCapacity = std::max(vertexRanges.getCapacity(), minVertexCapacity);
+		while (vertexCapacity < vertexNeed) {
+			vertexCapacity *= 2;
+		}
+		size_t indexCapacity = std::max(indexRanges.getCapacity(), minIndexCapacity);
+		while (indexCapacity < indexNeed) {
+			indexCapacity *= 2;
+		}
+		rebuild(vertexCapacity, indexCapacity);
+		vertexRanges.allocate(vertexCount, 1, firstVertex);
+		indexRanges.allocate(indexBytes, indexAlignment, indexOffset);
+	}
+
+	int id;
+	if (freeIds.empty()) {
+		id = (int)meshes.size();
+		meshes.push_back(Mesh());
+	}
+	else {
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	Mesh& mesh = meshes[id];
+	mesh.firstVertex = firstVertex;
+	mesh.vertexCount = vertexCount;
+	mesh.indexOffset = indexOffset;
+	mesh.indexBytes = indexBytes;
+	mesh.live = true;
+	return id;
+}
+
+void MeshArena::free(int id)
+{
+	Mesh& mesh = meshes[id];
+	vertexRanges.free(mesh.firstVertex, mesh.vertexCount);
+	indexRanges.free(mesh.indexOffset, mesh.indexBytes);
+	mesh = Mesh();
+	freeIds.push_back(id);
+}
+
+void MeshArena::compact()
+{
+	if (vertexRanges.freeBlockCount() > 1 || indexRanges.freeBlockCount() > 1) {
+		rebuild(vertexRanges.getCapacity(), indexRanges.getCapacity());
+	}
+}
+
+void MeshArena::rebuild(size_t newVertexCapacity, size_t newIndexCapacity)
+{
+	GLuint newStreams[2];
+	GLuint newIndexBuffer;
+	glGenBuffers(2, newStreams);
+	glGenBuffers(1, &newIndexBuffer);
+	for (int s = 0; s < 2; s++) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newStreams[s]);
+		glBufferData(GL_COPY_WRITE_BUFFER, newVertexCapacity * strides[s], NULL, GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newIndexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newIndexCapacity, NULL, GL_STATIC_DRAW);
+
+	// the live meshes in the order they lie in the old buffers, moved down
+	// to the start of the new ones; both go through the copy targets, so no
+	// vertex array's bindings change
+	std::vector<int> order;
+	for (int id = 0; id < (int)meshes.size(); id++) {
+		if (meshes[id].live) {
+			order.push_back(id);
+		}
+	}
+	std::sort(order.begin(), order.end(),
+		[this](int a, int b) { return meshes[a].firstVertex < meshes[b].firstVertex; });
+	size_t nextVertex = 0;
+	for (int s = 0; s < 2; s++) {
+		glBindBuffer(GL_COPY_READ_BUFFER, streams[s]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newStreams[s]);
+		size_t vertex = 0;
+		for (int id : order) {
+			const Mesh& mesh = meshes[id];
+			if (mesh.vertexCount > 0) {
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, mesh.firstVertex * strides[s],
+					vertex * strides[s], mesh.vertexCount * strides[s]);
+			}
+			vertex += mesh.vertexCount;
+		}
+		nextVertex = vertex;
+	}
+	size_t vertex = 0;
+	for (int id : order) {
+		meshes[id].firstVertex = vertex;
+		vertex += meshes[id].vertexCount;
+	}
+
+	std::sort(order.begin(), order.end(),
+		[this](int a, int b) { return meshes[a].indexOffset < meshes[b].indexOffset; });
+	glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newIndexBuffer);
+	size_t nextIndex = 0;
+	for (int id : order) {
+		Mesh& mesh = meshes[id];
+		if (mesh.indexBytes > 0) {
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, mesh.indexOffset, nextIndex,
+				mesh.indexBytes);
+		}
+		mesh.indexOffset = nextIndex;
+		nextIndex += mesh.indexBytes;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glDeleteBuffers(2, streams);
+	glDeleteBuffers(1, &indexBuffer);
+	streams[0] = newStreams[0];
+	streams[1] = newStreams[1];
+	indexBuffer = newIndexBuffer;
+	vertexRanges.reset(newVertexCapacity, nextVertex);
+	indexRanges.reset(newIndexCapacity, nextIndex);
+	if (nextVertex > 0 || nextIndex > 0) {
+		compactions++;
+	}
+	bindAttributes();
+}
+
+void MeshArena::bindAttributes()
+{
+	bindVertexArray(vertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, streams[0]);
+	if (layout == meshLayoutCompact) {
+		// interleaved: normalized shorts for the point, 10:10:10:2 for the normal
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex),
+			(void*)offsetof(PackedVertex, normal));
+	}
+	else {
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+		glBindBuffer(GL_ARRAY_BUFFER, streams[1]);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+	}
+
+	// the depth pass reads positions and indices only
+	bindVertexArray(depthVertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glEnableVertexAttribArray(0);
+	if (layout == meshLayoutCompact) {
+		glBindBuffer(GL_ARRAY_BUFFER, streams[1]);
+		glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, 4 * sizeof(GLshort), 0);
+	}
+	else {
+		glBindBuffer(GL_ARRAY_BUFFER, streams[0]);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), 0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshArena::upload(int id, int stream, size_t offset, size_t bytes, const void* data)
+{
+	const Mesh& mesh = meshes[id];
+	GLuint buffer = stream < 2 ? streams[stream] : indexBuffer;
+	size_t start = stream < 2 ? mesh.firstVertex * strides[stream] : mesh.indexOffset;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, start + offset, bytes, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void MeshArena::download(int id, int stream, size_t offset, size_t bytes, void* data) const
+{
+	const Mesh& mesh = meshes[id];
+	GLuint buffer = stream < 2 ? streams[stream] : indexBuffer;
+	size_t start = stream < 2 ? mesh.firstVertex * strides[stream] : mesh.indexOffset;
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, start + offset, bytes, data);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+MeshArenaStats MeshArena::stats() const
+{
+	MeshArenaStats stats;
+	for (const Mesh& mesh : meshes) {
+		stats.meshes += mesh.live ? 1 : 0;
+	}
+	stats.vertexCapacity = vertexRanges.getCapacity();
+	stats.vertexUsed = vertexRanges.getUsed();
+	stats.indexCapacity = indexRanges.getCapacity();
+	stats.indexUsed = indexRanges.getUsed();
+	stats.freeBlocks = vertexRanges.freeBlockCount() + indexRanges.freeBlockCount();
+	stats.vertexFragmentation = vertexRanges.fragmentation();
+	stats.indexFragmentation = indexRanges.fragmentation();
+	stats.bytes = stats.vertexCapacity * (strides[0] + strides[1]) + stats.indexCapacity;
+	stats.compactions = compactions;
+	return stats;
+}
+
+void MeshArena::printStats(const char* name) const
+{
+	MeshArenaStats s = stats();
+	printf("  %s arena: %zu meshes, %zu of %zu vertices (%.0f%%), %.0f of %.0f KB of indices (%.0f%%), "
+		"%zu free blocks, fragmentation %.0f%% / %.0f%%, %.1f MB, %d compactions\n", name, s.meshes, s.vertexUsed,
+		s.vertexCapacity, s.vertexCapacity ? 100.0 * s.vertexUsed / s.vertexCapacity : 0.0, s.indexUsed / 1024.0,
+		s.indexCapacity / 1024.0, s.indexCapacity ? 100.0 * s.indexUsed / s.indexCapacity : 0.0, s.freeBlocks,
+		100.0f * s.vertexFragmentation, 100.0f * s.indexFragmentation, s.bytes / (1024.0 * 1024.0), s.compactions);
+}
+
+void MeshArena::bindVertexArray(GLuint vertexArray)
+{
+	if (currentVertexArray != vertexArray) {
+		glBindVertexArray(vertexArray);
+		currentVertexArray = vertexArray;
+		PROFILE_COUNT_BINDS(1);
+	}
+}
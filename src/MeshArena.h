@@ -0,0 +1,151 @@
+#ifndef _MESH_ARENA_H_
+#define _MESH_ARENA_H_
+
+#include "shader.h"
+
+#include <cstddef>
+#include <vector>
+
+// First-fit allocator of ranges in a buffer of some capacity (in vertices
+// or bytes). Freed ranges merge with free neighbours; the space past the
+// last range is one more free block.
+class RangeAllocator
+{
+private:
+	struct Block
+	{
+		size_t offset;
+		size_t size;
+	};
+	// free blocks by offset
+	std::vector<Block> freeBlocks;
+	size_t capacity = 0;
+	size_t used = 0;
+
+public:
+	// everything free
+	void reset(size_t newCapacity, size_t usedAtStart = 0);
+	// false if no free block holds size once aligned
+	bool allocate(size_t size, size_t alignment, size_t& offset);
+	void free(size_t offset, size_t size);
+
+	size_t getCapacity() const { return capacity; }
+	size_t getUsed() const { return used; }
+	size_t freeBlockCount() const { return freeBlocks.size(); }
+	size_t largestFreeBlock() const;
+	// share of the free space outside the largest free block: 0 when it is
+	// all in one piece
+	float fragmentation() const;
+};
+
+// Vertex layouts meshes are stored in, one arena each
+enum MeshLayout
+{
+	// positions and normals as float vec3s in two streams, 32-bit indices
+	meshLayoutFloat,
+	// PackedVertex, plus the packed positions alone (xyzw shorts) for depth
+	// passes; 16-bit indices where they fit
+	meshLayoutCompact,
+	meshLayoutCount
+};
+
+// occupancy of an arena, for reports and benchmarks
+struct MeshArenaStats
+{
+	size_t meshes = 0;
+	size_t vertexCapacity = 0;
+	size_t vertexUsed = 0;
+	size_t indexCapacity = 0;
+	size_t indexUsed = 0;
+	size_t freeBlocks = 0;
+	float vertexFragmentation = 0.0f;
+	float indexFragmentation = 0.0f;
+	// GPU memory of the arena's buffers, and the moves done to close gaps
+	size_t bytes = 0;
+	int compactions = 0;
+};
+
+// GPU storage of every mesh of one layout: two vertex streams and an index
+// buffer, each a single large buffer meshes get ranges of, and one VAO over
+// them for drawing (plus one reading positions only, for depth passes).
+// Meshes are drawn with glDrawElementsBaseVertex, so their indices stay
+// relative to their first vertex and a mesh can be moved without touching
+// them. When a new mesh does not fit, the live ranges are copied packed
+// into new buffers, doubled in size if the freed gaps are not enough; ids
+// stay valid across moves.
+class MeshArena
+{
+private:
+	struct Mesh
+	{
+		size_t firstVertex = 0;
+		size_t vertexCount = 0;
+		size_t indexOffset = 0;
+		size_t indexBytes = 0;
+		bool live = false;
+	};
+
+	MeshLayout layout;
+	// bytes per vertex in each stream
+	size_t strides[2];
+	GLuint streams[2] = {};
+	GLuint indexBuffer = 0;
+	GLuint vertexArray = 0;
+	GLuint depthVertexArray = 0;
+	RangeAllocator vertexRanges;
+	RangeAllocator indexRanges;
+	std::vector<Mesh> meshes;
+	// ids of freed meshes, reused first
+	std::vector<int> freeIds;
+	int compactions = 0;
+
+	// copy the live ranges packed into new buffers of these capacities
+	void rebuild(size_t newVertexCapacity, size_t newIndexCapacity);
+	// point the VAOs at the current buffers
+	void bindAttributes();
+
+	// vertex array last bound through bindVertexArray
+	static GLuint currentVertexArray;
+
+public:
+	explicit MeshArena(MeshLayout layout);
+	~MeshArena();
+
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	// bytes per vertex of a layout's two streams
+	static size_t streamStride(MeshLayout layout, int stream);
+
+	// room for a mesh; returns its id
+	int allocate(size_t vertexCount, size_t indexBytes);
+	void free(int id);
+	// move every mesh down to close the gaps freed ones left
+	void compact();
+
+	// write part of a mesh's stream (0 or 1) or, for stream 2, of its
+	// indices, at a byte offset into the mesh's range
+	void upload(int id, int stream, size_t offset, size_t bytes, const void* data);
+	// read the same back, for checks
+	void download(int id, int stream, size_t offset, size_t bytes, void* data) const;
+
+	GLint baseVertex(int id) const { return (GLint)meshes[id].firstVertex; }
+	// offset of the mesh's indices for glDrawElements*, plus indexBytes
+	const void* indices(int id, size_t indexBytes) const
+	{
+		return (const void*)(meshes[id].indexOffset + indexBytes);
+	}
+	GLuint getVertexArray() const { return vertexArray; }
+	GLuint getDepthVertexArray() const { return depthVertexArray; }
+
+	MeshArenaStats stats() const;
+	// one line of occupancy and fragmentation
+	void printStats(const char* name) const;
+
+	// glBindVertexArray, skipped when it is already bound. Everything that
+	// binds vertex arrays goes through this, so the cache stays right;
+	// counted by the profiler.
+	static void bindVertexArray(GLuint vertexArray);
+};
+
+#endif
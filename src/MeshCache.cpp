@@ -0,0 +1,260 @@
+#include "MeshCache.h"
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+namespace
+{
+	const char meshCacheMagic[8] = { 'M', 'E', 'S', 'H', 'B', 'I', 'N', 0 };
+	const uint32_t byteOrderMark = 0x01020304;
+	const uint64_t arrayAlignment = 16;
+
+	// size and modification time of the source OBJ
+	struct SourceStamp
+	{
+		uint64_t size = 0;
+		int64_t time = 0;
+	};
+
+	bool stampSource(const std::string& objFilename, SourceStamp& stamp)
+	{
+		std::error_code error;
+		uintmax_t size = std::filesystem::file_size(objFilename, error);
+		if (error) {
+			return false;
+		}
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(objFilename, error);
+		if (error) {
+			return false;
+		}
+
+		stamp.size = (uint64_t)size;
+		stamp.time = (int64_t)time.time_since_epoch().count();
+		return true;
+	}
+
+	// 64-bit FNV-1a over the whole file
+	bool hashSource(const std::string& objFilename, uint64_t& hash)
+	{
+		MappedFile source;
+		if (!source.open(objFilename)) {
+			return false;
+		}
+
+		hash = 14695981039346656037ull;
+		const unsigned char* p = (const unsigned char*)source.begin();
+		const unsigned char* end = (const unsigned char*)source.end();
+		for (; p < end; ++p) {
+			hash ^= *p;
+			hash *= 1099511628211ull;
+		}
+		return true;
+	}
+
+	// overwrite the source time in the header of an existing cache
+	bool writeSourceTime(const std::string& cacheFilename, int64_t time)
+	{
+		std::fstream cacheFile(cacheFilename, std::ios::binary | std::ios::in | std::ios::out);
+		if (!cacheFile.is_open()) {
+			return false;
+		}
+		cacheFile.seekp(offsetof(MeshCacheHeader, sourceTime));
+		cacheFile.write((const char*)&time, sizeof(time));
+		return (bool)cacheFile;
+	}
+
+	uint64_t alignUp(uint64_t offset)
+	{
+		return (offset + arrayAlignment - 1) & ~(arrayAlignment - 1);
+	}
+
+	bool fitsInFile(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+	{
+		return offset % arrayAlignment == 0 && offset <= fileSize
+			&& count <= (fileSize - offset) / elementSize;
+	}
+}
+
+std::string MeshCachePath(const std::string& objFilename)
+{
+	std::filesystem::path path(objFilename);
+	path.replace_extension(".meshbin");
+	return path.string();
+}
+
+bool WriteMeshCache(const std::string& cacheFilename, const std::string& objFilename, const MeshData& mesh,
+	uint32_t flags, uint32_t preprocessKey)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, meshCacheMagic, sizeof(header.magic));
+	header.version = meshCacheVersion;
+	header.byteOrder = byteOrderMark;
+	header.flags = flags;
+	header.preprocessKey = preprocessKey;
+
+	SourceStamp stamp;
+	if (!stampSource(objFilename, stamp) || !hashSource(objFilename, header.sourceHash)) {
+		std::cerr << "Can't read " << objFilename << " to build its mesh cache" << std::endl;
+		return false;
+	}
+	header.sourceSize = stamp.size;
+	header.sourceTime = stamp.time;
+
+	header.pointCount = mesh.points.size();
+	header.normalCount = mesh.normals.size();
+	header.faceCount = mesh.faces.size();
+	header.lodCount = mesh.lods.size();
+	header.pointsOffset = alignUp(sizeof(MeshCacheHeader));
+	header.normalsOffset = alignUp(header.pointsOffset + sizeof(glm::vec3) * header.pointCount);
+	header.facesOffset = alignUp(header.normalsOffset + sizeof(glm::vec3) * header.normalCount);
+	header.lodsOffset = alignUp(header.facesOffset + sizeof(glm::ivec3) * header.faceCount);
+
+	std::string tempFilename = cacheFilename + ".tmp";
+	std::ofstream cacheFile(tempFilename, std::ios::binary | std::ios::trunc);
+	if (!cacheFile.is_open()) {
+		std::cerr << "Can't write the mesh cache " << cacheFilename << std::endl;
+		return false;
+	}
+
+	// pad the stream up to the next array offset
+	auto padTo = [&cacheFile](uint64_t offset) {
+		static const char zeros[arrayAlignment] = {};
+		uint64_t position = (uint64_t)cacheFile.tellp();
+		cacheFile.write(zeros, (std::streamsize)(offset - position));
+	};
+
+	cacheFile.write((const char*)&header, sizeof(header));
+	padTo(header.pointsOffset);
+	cacheFile.write((const char*)mesh.points.data(), sizeof(glm::vec3) * mesh.points.size());
+	padTo(header.normalsOffset);
+	cacheFile.write((const char*)mesh.normals.data(), sizeof(glm::vec3) * mesh.normals.size());
+	padTo(header.facesOffset);
+	cacheFile.write((const char*)mesh.faces.data(), sizeof(glm::ivec3) * mesh.faces.size());
+	padTo(header.lodsOffset);
+	cacheFile.write((const char*)mesh.lods.data(), sizeof(MeshLod) * mesh.lods.size());
+	cacheFile.close();
+
+	std::error_code error;
+	if (cacheFile) {
+		std::filesystem::rename(tempFilename, cacheFilename, error);
+	}
+	if (!cacheFile || error) {
+		std::cerr << "Can't write the mesh cache " << cacheFilename << std::endl;
+		std::filesystem::remove(tempFilename, error);
+		return false;
+	}
+	return true;
+}
+
+bool MeshCacheView::open(const std::string& cacheFilename, const std::string& objFilename, uint32_t flags,
+	uint32_t preprocessKey)
+{
+	close();
+
+	if (!file.open(cacheFilename)) {
+		return false;
+	}
+
+	// reject files from another version, another platform, built with other
+	// processing steps, or cut short
+	const MeshCacheHeader* candidate = (const MeshCacheHeader*)file.data();
+	uint64_t fileSize = file.size();
+	if (fileSize < sizeof(MeshCacheHeader)
+		|| memcmp(candidate->magic, meshCacheMagic, sizeof(meshCacheMagic)) != 0
+		|| candidate->version != meshCacheVersion
+		|| candidate->byteOrder != byteOrderMark
+		|| candidate->flags != flags
+		|| candidate->preprocessKey != preprocessKey
+		|| !fitsInFile(candidate->pointsOffset, candidate->pointCount, sizeof(glm::vec3), fileSize)
+		|| !fitsInFile(candidate->normalsOffset, candidate->normalCount, sizeof(glm::vec3), fileSize)
+		|| !fitsInFile(candidate->facesOffset, candidate->faceCount, sizeof(glm::ivec3), fileSize)
+		|| !fitsInFile(candidate->lodsOffset, candidate->lodCount, sizeof(MeshLod), fileSize)) {
+		file.close();
+		return false;
+	}
+
+	// every level has to lie within the triangles
+	const MeshLod* lods = (const MeshLod*)(file.data() + candidate->lodsOffset);
+	for (uint64_t i = 0; i < candidate->lodCount; i++) {
+		if ((uint64_t)lods[i].firstFace + lods[i].faceCount > candidate->faceCount) {
+			file.close();
+			return false;
+		}
+	}
+
+	// one normal per point, and every corner has to name one of them: the
+	// indices go to the GPU and the software rasterizer unchecked
+	if (candidate->normalCount != candidate->pointCount) {
+		file.close();
+		return false;
+	}
+	const glm::ivec3* faces = (const glm::ivec3*)(file.data() + candidate->facesOffset);
+	for (uint64_t i = 0; i < candidate->faceCount; i++) {
+		for (int c = 0; c < 3; c++) {
+			if (faces[i][c] < 0 || (uint64_t)faces[i][c] >= candidate->pointCount) {
+				file.close();
+				return false;
+			}
+		}
+	}
+
+	// the source has to exist with the same size and time; when only the time
+	// differs the content hash decides
+	SourceStamp stamp;
+	if (!stampSource(objFilename, stamp) || stamp.size != candidate->sourceSize) {
+		file.close();
+		return false;
+	}
+	if (stamp.time != candidate->sourceTime) {
+		uint64_t hash = 0;
+		if (!hashSource(objFilename, hash) || hash != candidate->sourceHash) {
+			file.close();
+			return false;
+		}
+
+		// same content: store the new time so the next open doesn't hash the
+		// source again. The mapping keeps other writers out on some systems,
+		// so it is dropped for the write and made again
+		file.close();
+		writeSourceTime(cacheFilename, stamp.time);
+		if (!file.open(cacheFilename) || file.size() != fileSize) {
+			file.close();
+			return false;
+		}
+		candidate = (const MeshCacheHeader*)file.data();
+	}
+
+	header = candidate;
+	return true;
+}
+
+void MeshCacheView::close()
+{
+	header = nullptr;
+	file.close();
+}
+
+const glm::vec3* MeshCacheView::points() const
+{
+	return (const glm::vec3*)(file.data() + header->pointsOffset);
+}
+
+const glm::vec3* MeshCacheView::normals() const
+{
+	return (const glm::vec3*)(file.data() + header->normalsOffset);
+}
+
+const glm::ivec3* MeshCacheView::faces() const
+{
+	return (const glm::ivec3*)(file.data() + header->facesOffset);
+}
+
+const MeshLod* MeshCacheView::lods() const
+{
+	return (const MeshLod*)(file.data() + header->lodsOffset);
+}
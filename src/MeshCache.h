@@ -0,0 +1,92 @@
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+#include "Mesh.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+
+// On-disk layout of a .meshbin file: this header followed by the normalized
+// points, normals and triangle indices exactly as they are uploaded to the GPU,
+// and the table of levels of detail in those triangles. Every array starts on
+// a 16-byte boundary.
+struct MeshCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+
+	// MeshCacheFlags the mesh was processed with, and MeshPreprocessKey of
+	// the options it was fitted and given normals with
+	uint32_t flags;
+	uint32_t preprocessKey;
+
+	// identity of the OBJ file the cache was built from
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+
+	uint64_t pointCount;
+	uint64_t normalCount;
+	uint64_t faceCount;
+	uint64_t lodCount;
+
+	uint64_t pointsOffset;
+	uint64_t normalsOffset;
+	uint64_t facesOffset;
+	uint64_t lodsOffset;
+};
+
+// 2: vertices are welded (v, vn) pairs rather than raw v records
+// 3: processing flags in the header
+// 4: LOD table
+// 5: preprocessing options in the header, generated normals
+const uint32_t meshCacheVersion = 5;
+
+// processing steps applied before the mesh was cached; a cache built with
+// different steps than requested is treated as stale
+enum MeshCacheFlags
+{
+	meshCacheOptimized = 1 << 0,
+	meshCacheLods = 1 << 1,
+};
+
+// "bunny.obj" -> "bunny.meshbin", next to the source file
+std::string MeshCachePath(const std::string& objFilename);
+
+// write the cache for a mesh built from objFilename; the file is written
+// under a temporary name and renamed so readers never see a partial cache
+bool WriteMeshCache(const std::string& cacheFilename, const std::string& objFilename, const MeshData& mesh,
+	uint32_t flags = 0, uint32_t preprocessKey = 0);
+
+// Memory-mapped view of a cache file. The arrays point straight into the
+// mapping and can be handed to glBufferData without copying.
+class MeshCacheView
+{
+private:
+	MappedFile file;
+	const MeshCacheHeader* header = nullptr;
+
+public:
+	// maps the cache and checks it against the current state of objFilename
+	// and the requested processing flags and preprocessing key; fails if the
+	// cache is missing, malformed, or stale, or objFilename is gone. A cache
+	// whose source was only touched gets the new modification time
+	bool open(const std::string& cacheFilename, const std::string& objFilename, uint32_t flags = 0,
+		uint32_t preprocessKey = 0);
+	void close();
+
+	bool isOpen() const { return header != nullptr; }
+
+	const glm::vec3* points() const;
+	const glm::vec3* normals() const;
+	const glm::ivec3* faces() const;
+	const MeshLod* lods() const;
+	size_t pointCount() const { return (size_t)header->pointCount; }
+	size_t normalCount() const { return (size_t)header->normalCount; }
+	size_t faceCount() const { return (size_t)header->faceCount; }
+	size_t lodCount() const { return (size_t)header->lodCount; }
+};
+
+#endif
@@ -0,0 +1,448 @@
+#include "MeshLod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+	// levels stop once they would drop below this many triangles
+	const size_t minLodFaces = 64;
+	// a level has to have at most this fraction of the previous one's triangles
+	const float minLodReduction = 0.8f;
+
+	// weight of the planes that keep open borders in place
+	const double boundaryWeight = 10.0;
+	// cost of merging vertices with opposite normals, relative to the edge
+	const double normalWeight = 1.0;
+
+	// symmetric 4x4 error quadric, upper triangle only, plus the total area of
+	// the planes summed into it
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double weight = 0;
+
+		// plane n.p + d = 0 with unit normal n
+		void addPlane(const glm::dvec3& n, double d, double w)
+		{
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+			a22 += w * n.z * n.z; a23 += w * n.z * d;
+			a33 += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			weight += q.weight;
+		}
+
+		// weighted sum of squared distances of p to the planes
+		double evaluate(const glm::dvec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double error = a00 * x * x + a11 * y * y + a22 * z * z
+				+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2.0 * (a03 * x + a13 * y + a23 * z) + a33;
+			return std::max(error, 0.0);
+		}
+	};
+
+	struct PositionKey
+	{
+		uint32_t bits[3];
+		bool operator==(const PositionKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			uint64_t h = key.bits[0] * 0x9e3779b97f4a7c15ull;
+			h ^= key.bits[1] + 0x7f4a7c159e3779b9ull + (h << 6) + (h >> 2);
+			h ^= key.bits[2] + 0x94d049bb133111ebull + (h << 6) + (h >> 2);
+			return (size_t)h;
+		}
+	};
+
+	uint64_t edgeKey(int a, int b)
+	{
+		if (a > b) {
+			std::swap(a, b);
+		}
+		return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+	}
+
+	// rows of ints indexed by an id, in compressed form
+	struct Rows
+	{
+		std::vector<size_t> offsets;
+		std::vector<int> items;
+
+		size_t begin(int id) const { return offsets[id]; }
+		size_t end(int id) const { return offsets[id + 1]; }
+	};
+
+	struct Collapse
+	{
+		int from, to;
+		double cost;
+		double error;
+	};
+}
+
+std::vector<glm::ivec3> SimplifyMesh(const MeshData& mesh, size_t targetFaces, float* error)
+{
+	size_t vertexCount = mesh.points.size();
+	bool hasNormals = mesh.normals.size() == vertexCount;
+	std::vector<glm::ivec3> faces = mesh.faces;
+	if (error != nullptr) {
+		*error = 0.0f;
+	}
+	if (faces.size() <= targetFaces || vertexCount == 0) {
+		return faces;
+	}
+
+	// vertices sharing a point (normal seams) move together as one position
+	std::vector<int> position(vertexCount);
+	std::vector<glm::dvec3> positions;
+	{
+		std::unordered_map<PositionKey, int, PositionKeyHash> lookup;
+		lookup.reserve(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			PositionKey key;
+			memcpy(key.bits, &mesh.points[v], sizeof(key.bits));
+			auto inserted = lookup.emplace(key, (int)positions.size());
+			if (inserted.second) {
+				positions.push_back(glm::dvec3(mesh.points[v]));
+			}
+			position[v] = inserted.first->second;
+		}
+	}
+	int positionCount = (int)positions.size();
+
+	Rows positionVertices;
+	positionVertices.offsets.assign(positionCount + 1, 0);
+	positionVertices.items.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		positionVertices.offsets[position[v] + 1]++;
+	}
+	for (int p = 0; p < positionCount; p++) {
+		positionVertices.offsets[p + 1] += positionVertices.offsets[p];
+	}
+	{
+		std::vector<size_t> fill(positionVertices.offsets.begin(), positionVertices.offsets.end() - 1);
+		for (size_t v = 0; v < vertexCount; v++) {
+			positionVertices.items[fill[position[v]]++] = (int)v;
+		}
+	}
+
+	// area weighted plane quadrics of the triangles around each position, and
+	// planes standing on open edges so borders keep their shape
+	std::vector<Quadric> quadrics(positionCount);
+	std::unordered_map<uint64_t, int> edgeUse;
+	edgeUse.reserve(faces.size() * 3);
+	for (const glm::ivec3& face : faces) {
+		for (int c = 0; c < 3; c++) {
+			edgeUse[edgeKey(position[face[c]], position[face[(c + 1) % 3]])]++;
+		}
+	}
+	for (const glm::ivec3& face : faces) {
+		int p[3] = { position[face.x], position[face.y], position[face.z] };
+		glm::dvec3 normal = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+		double length = glm::length(normal);
+		if (length <= 0.0) {
+			continue;
+		}
+		normal /= length;
+		double d = -glm::dot(normal, positions[p[0]]);
+		for (int c = 0; c < 3; c++) {
+			quadrics[p[c]].addPlane(normal, d, 0.5 * length);
+		}
+
+		for (int c = 0; c < 3; c++) {
+			int a = p[c], b = p[(c + 1) % 3];
+			if (edgeUse[edgeKey(a, b)] != 1) {
+				continue;
+			}
+			glm::dvec3 edge = positions[b] - positions[a];
+			glm::dvec3 side = glm::cross(edge, normal);
+			double sideLength = glm::length(side);
+			if (sideLength <= 0.0) {
+				continue;
+			}
+			side /= sideLength;
+			double sideD = -glm::dot(side, positions[a]);
+			double w = boundaryWeight * glm::dot(edge, edge);
+			quadrics[a].addPlane(side, sideD, w);
+			quadrics[b].addPlane(side, sideD, w);
+		}
+	}
+
+	// vertex at position 'to' that takes over vertex v, and how far apart
+	// their normals are (0 same, 2 opposite)
+	auto matchVertex = [&](int v, int to, double& mismatch) {
+		int best = positionVertices.items[positionVertices.begin(to)];
+		double bestDot = -2.0;
+		if (hasNormals) {
+			glm::vec3 n = mesh.normals[v];
+			for (size_t i = positionVertices.begin(to); i < positionVertices.end(to); i++) {
+				int candidate = positionVertices.items[i];
+				double dot = glm::dot(n, mesh.normals[candidate]);
+				if (dot > bestDot) {
+					bestDot = dot;
+					best = candidate;
+				}
+			}
+		}
+		mismatch = hasNormals ? 1.0 - std::min(bestDot, 1.0) : 0.0;
+		return best;
+	};
+
+	std::vector<int> vertexRemap(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		vertexRemap[v] = (int)v;
+	}
+	double maxError = 0.0;
+
+	// collapse the cheapest independent edges pass by pass, then rebuild the
+	// triangle list, until the target is met or nothing can collapse
+	Rows positionTriangles;
+	std::vector<uint64_t> edges;
+	std::vector<Collapse> collapses;
+	std::vector<char> locked(positionCount);
+	while (faces.size() > targetFaces) {
+		positionTriangles.offsets.assign(positionCount + 1, 0);
+		positionTriangles.items.resize(faces.size() * 3);
+		for (const glm::ivec3& face : faces) {
+			for (int c = 0; c < 3; c++) {
+				positionTriangles.offsets[position[face[c]] + 1]++;
+			}
+		}
+		for (int p = 0; p < positionCount; p++) {
+			positionTriangles.offsets[p + 1] += positionTriangles.offsets[p];
+		}
+		{
+			std::vector<size_t> fill(positionTriangles.offsets.begin(), positionTriangles.offsets.end() - 1);
+			for (size_t t = 0; t < faces.size(); t++) {
+				for (int c = 0; c < 3; c++) {
+					positionTriangles.items[fill[position[faces[t][c]]]++] = (int)t;
+				}
+			}
+		}
+
+		edges.clear();
+		for (const glm::ivec3& face : faces) {
+			for (int c = 0; c < 3; c++) {
+				edges.push_back(edgeKey(position[face[c]], position[face[(c + 1) % 3]]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		// cheaper direction of every edge
+		collapses.clear();
+		for (uint64_t key : edges) {
+			int a = (int)(key >> 32), b = (int)(key & 0xffffffffu);
+			Quadric q = quadrics[a];
+			q.add(quadrics[b]);
+			glm::dvec3 edge = positions[b] - positions[a];
+			double edgeScale = glm::dot(edge, edge);
+			edgeScale *= edgeScale;
+
+			Collapse best = { -1, -1, 0.0, 0.0 };
+			for (int direction = 0; direction < 2; direction++) {
+				int from = direction ? b : a, to = direction ? a : b;
+				double quadricError = q.evaluate(positions[to]);
+				double mismatch = 0.0;
+				for (size_t i = positionVertices.begin(from); i < positionVertices.end(from); i++) {
+					double vertexMismatch;
+					matchVertex(positionVertices.items[i], to, vertexMismatch);
+					mismatch = std::max(mismatch, vertexMismatch);
+				}
+				double cost = quadricError + normalWeight * mismatch * edgeScale;
+				if (best.from < 0 || cost < best.cost) {
+					double distance = q.weight > 0.0 ? std::sqrt(quadricError / q.weight) : 0.0;
+					best = { from, to, cost, distance };
+				}
+			}
+			collapses.push_back(best);
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+			return x.cost < y.cost;
+		});
+
+		std::fill(locked.begin(), locked.end(), 0);
+		size_t facesLeft = faces.size();
+		size_t collapsed = 0;
+		for (const Collapse& collapse : collapses) {
+			if (facesLeft <= targetFaces) {
+				break;
+			}
+			int from = collapse.from, to = collapse.to;
+			if (locked[from] || locked[to]) {
+				continue;
+			}
+
+			// triangles around 'from' that keep existing must not flip or
+			// turn into slivers
+			bool valid = true;
+			size_t removed = 0;
+			for (size_t i = positionTriangles.begin(from); i < positionTriangles.end(from) && valid; i++) {
+				const glm::ivec3& face = faces[positionTriangles.items[i]];
+				glm::dvec3 corners[3];
+				glm::dvec3 moved[3];
+				bool hasTo = false;
+				for (int c = 0; c < 3; c++) {
+					int p = position[face[c]];
+					hasTo = hasTo || p == to;
+					corners[c] = positions[p];
+					moved[c] = (p == from) ? positions[to] : positions[p];
+				}
+				if (hasTo) {
+					removed++;
+					continue;
+				}
+				glm::dvec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+				glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				double beforeLength = glm::length(before), afterLength = glm::length(after);
+				valid = afterLength > 0.0 && glm::dot(before, after) > 0.25 * beforeLength * afterLength;
+			}
+			if (!valid) {
+				continue;
+			}
+
+			for (size_t i = positionVertices.begin(from); i < positionVertices.end(from); i++) {
+				int v = positionVertices.items[i];
+				double mismatch;
+				vertexRemap[v] = matchVertex(v, to, mismatch);
+			}
+			quadrics[to].add(quadrics[from]);
+			maxError = std::max(maxError, collapse.error);
+			facesLeft -= std::min(removed, facesLeft);
+			collapsed++;
+
+			// everything sharing a triangle with either end waits for the
+			// next pass, so the adjacency above stays valid for this one
+			for (int end : { from, to }) {
+				for (size_t i = positionTriangles.begin(end); i < positionTriangles.end(end); i++) {
+					const glm::ivec3& face = faces[positionTriangles.items[i]];
+					locked[position[face.x]] = locked[position[face.y]] = locked[position[face.z]] = 1;
+				}
+			}
+		}
+		if (collapsed == 0) {
+			break;
+		}
+
+		// apply the collapses and drop the triangles that became degenerate
+		size_t kept = 0;
+		for (glm::ivec3 face : faces) {
+			face = glm::ivec3(vertexRemap[face.x], vertexRemap[face.y], vertexRemap[face.z]);
+			int p0 = position[face.x], p1 = position[face.y], p2 = position[face.z];
+			if (p0 != p1 && p1 != p2 && p0 != p2) {
+				faces[kept++] = face;
+			}
+		}
+		faces.resize(kept);
+	}
+
+	if (error != nullptr) {
+		*error = (float)maxError;
+	}
+	return faces;
+}
+
+void BuildMeshLods(MeshData& mesh, ThreadPool* pool, int cacheSize)
+{
+	mesh.lods.clear();
+	size_t faceCount = mesh.faces.size();
+
+	int levelCount = 1;
+	while (levelCount < maxMeshLods && (faceCount >> levelCount) >= minLodFaces) {
+		levelCount++;
+	}
+
+	std::vector<std::vector<glm::ivec3>> levels(levelCount);
+	std::vector<float> errors(levelCount, 0.0f);
+	auto simplify = [&](size_t level) {
+		if (level == 0) {
+			return;
+		}
+		levels[level] = SimplifyMesh(mesh, faceCount >> level, &errors[level]);
+		OptimizeFaceOrder(levels[level], mesh.points.size(), cacheSize);
+	};
+	if (pool != nullptr) {
+		pool->parallelFor(levelCount, simplify);
+	}
+	else {
+		for (int level = 0; level < levelCount; level++) {
+			simplify(level);
+		}
+	}
+
+	MeshLod full;
+	full.faceCount = (uint32_t)faceCount;
+	mesh.lods.push_back(full);
+
+	// keep the levels that came out clearly smaller than the one before; a
+	// mesh that can't be simplified further ends its chain early
+	for (int level = 1; level < levelCount; level++) {
+		const MeshLod& previous = mesh.lods.back();
+		if (levels[level].empty() || levels[level].size() > minLodReduction * previous.faceCount) {
+			continue;
+		}
+		MeshLod lod;
+		lod.firstFace = (uint32_t)mesh.faces.size();
+		lod.faceCount = (uint32_t)levels[level].size();
+		lod.error = errors[level];
+		mesh.faces.insert(mesh.faces.end(), levels[level].begin(), levels[level].end());
+		mesh.lods.push_back(lod);
+	}
+}
+
+float ProjectedSize(const glm::mat4& modelView, const glm::mat4& projection, float radius)
+{
+	// the largest axis scale bounds the radius of the transformed sphere
+	float scale = std::max(glm::length(glm::vec3(modelView[0])),
+		std::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+	return ProjectedSphereSize(radius * scale, -modelView[3].z, projection);
+}
+
+float ProjectedSphereSize(float worldRadius, float distance, const glm::mat4& projection)
+{
+	if (distance <= worldRadius) {
+		// the camera is inside or at the sphere
+		return 1e9f;
+	}
+	return worldRadius * projection[1][1] / distance;
+}
+
+int SelectMeshLod(int lodCount, int currentLod, float projectedSize)
+{
+	if (lodCount <= 1) {
+		return 0;
+	}
+	currentLod = std::min(std::max(currentLod, 0), lodCount - 1);
+	if (projectedSize <= 0.0f) {
+		return lodCount - 1;
+	}
+
+	// continuous level for this size: 0 at lodFullDetailSize, one more for
+	// every halving of the covered area
+	float level = 2.0f * std::log2(lodFullDetailSize / projectedSize);
+	if (level > currentLod - lodHysteresis && level < currentLod + 1 + lodHysteresis) {
+		return currentLod;
+	}
+	int selected = (int)std::floor(level);
+	return std::min(std::max(selected, 0), lodCount - 1);
+}
@@ -0,0 +1,44 @@
+#ifndef _MESH_LOD_H_
+#define _MESH_LOD_H_
+
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// most levels BuildMeshLods makes, the full mesh included
+const int maxMeshLods = 6;
+
+// projected size (fraction of the screen height) down to which the full mesh
+// is drawn; every level below halves the triangles for a size 1/sqrt(2) smaller
+const float lodFullDetailSize = 0.5f;
+// how far, in levels, the size has to move past a switch point before the
+// level changes, so a mesh sitting on the boundary does not flicker
+const float lodHysteresis = 0.25f;
+
+// Simplify the mesh to about targetFaces triangles by quadric error edge
+// collapse (Garland & Heckbert 1997). Every edge collapses into one of its
+// endpoints, so the result indexes the mesh's own vertices and keeps their
+// normals; collapses that would merge vertices with different normals are
+// made expensive. error receives the largest collapse error in mesh units.
+std::vector<glm::ivec3> SimplifyMesh(const MeshData& mesh, size_t targetFaces, float* error = nullptr);
+
+// Turn mesh.faces into a chain of levels, each with about half the triangles
+// of the one before, stored back to back and described by mesh.lods. Every
+// level is simplified from the full mesh, in parallel on the pool if given.
+void BuildMeshLods(MeshData& mesh, ThreadPool* pool = nullptr, int cacheSize = vertexCacheSize);
+
+// fraction of the screen height covered by a bounding sphere of the given
+// radius around the model space origin
+float ProjectedSize(const glm::mat4& modelView, const glm::mat4& projection, float radius);
+// same for a sphere of world space radius at distance in front of the camera
+float ProjectedSphereSize(float worldRadius, float distance, const glm::mat4& projection);
+
+// level to draw for a projected size; currentLod is kept while the size stays
+// within the hysteresis band around it
+int SelectMeshLod(int lodCount, int currentLod, float projectedSize);
+
+#endif
@@ -0,0 +1,364 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	// FIFO post-transform cache simulated with insertion timestamps: a vertex
+	// is cached while fewer than cacheSize misses happened since it went in
+	class FifoCache
+	{
+	private:
+		std::vector<size_t> insertedAt;
+		size_t misses = 0;
+		size_t size;
+
+	public:
+		FifoCache(size_t vertexCount, int cacheSize)
+			: insertedAt(vertexCount, (size_t)-1), size((size_t)cacheSize) {}
+
+		void reset()
+		{
+			// pushing every cached vertex out is the same as clearing it
+			misses += size + 1;
+		}
+
+		// returns true on a miss
+		bool access(int v)
+		{
+			size_t inserted = insertedAt[v];
+			if (inserted != (size_t)-1 && misses - inserted <= size) {
+				return false;
+			}
+			insertedAt[v] = misses++;
+			return true;
+		}
+	};
+
+	// vertex -> triangles adjacency in compressed rows
+	struct Adjacency
+	{
+		std::vector<size_t> offsets;
+		std::vector<int> triangles;
+
+		Adjacency(const std::vector<glm::ivec3>& faces, size_t vertexCount)
+			: offsets(vertexCount + 1, 0), triangles(faces.size() * 3)
+		{
+			for (const glm::ivec3& face : faces) {
+				offsets[face.x + 1]++;
+				offsets[face.y + 1]++;
+				offsets[face.z + 1]++;
+			}
+			for (size_t v = 0; v < vertexCount; v++) {
+				offsets[v + 1] += offsets[v];
+			}
+			std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t t = 0; t < faces.size(); t++) {
+				for (int c = 0; c < 3; c++) {
+					triangles[fill[faces[t][c]]++] = (int)t;
+				}
+			}
+		}
+	};
+
+	// Tipsify: returns the new triangle order and the positions where the
+	// walk had to jump to an unrelated part of the mesh (hard boundaries)
+	std::vector<int> tipsify(const std::vector<glm::ivec3>& faces, size_t vertexCount, int cacheSize,
+		std::vector<size_t>& hardBoundaries)
+	{
+		Adjacency adjacency(faces, vertexCount);
+
+		std::vector<int> live(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			live[v] = (int)(adjacency.offsets[v + 1] - adjacency.offsets[v]);
+		}
+		std::vector<int> cacheTime(vertexCount, 0);
+		std::vector<char> emitted(faces.size(), 0);
+		std::vector<int> deadEnd;
+		std::vector<int> candidates;
+
+		std::vector<int> order;
+		order.reserve(faces.size());
+
+		int time = cacheSize + 1;
+		size_t cursor = 0;
+
+		// pop the dead-end stack, then scan for any vertex with work left
+		auto skipDeadEnd = [&]() {
+			while (!deadEnd.empty()) {
+				int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0) {
+					return v;
+				}
+			}
+			while (cursor < vertexCount) {
+				if (live[cursor] > 0) {
+					return (int)cursor;
+				}
+				cursor++;
+			}
+			return -1;
+		};
+
+		int fan = skipDeadEnd();
+		hardBoundaries.push_back(0);
+		while (fan >= 0) {
+			// emit every remaining triangle around the fanning vertex
+			candidates.clear();
+			for (size_t a = adjacency.offsets[fan]; a < adjacency.offsets[fan + 1]; a++) {
+				int t = adjacency.triangles[a];
+				if (emitted[t]) {
+					continue;
+				}
+				order.push_back(t);
+				for (int c = 0; c < 3; c++) {
+					int v = faces[t][c];
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cacheTime[v] > cacheSize) {
+						cacheTime[v] = time++;
+					}
+				}
+				emitted[t] = 1;
+			}
+
+			// next fan: the candidate that stays in the cache longest while
+			// its remaining triangles are emitted
+			int best = -1;
+			int bestPriority = -1;
+			for (int v : candidates) {
+				if (live[v] <= 0) {
+					continue;
+				}
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+					priority = time - cacheTime[v];
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					best = v;
+				}
+			}
+			if (best < 0) {
+				best = skipDeadEnd();
+				if (best >= 0 && order.size() < faces.size()) {
+					hardBoundaries.push_back(order.size());
+				}
+			}
+			fan = best;
+		}
+
+		return order;
+	}
+
+	// split hard clusters further wherever the cluster so far already reuses
+	// the cache well, so the overdraw sort has finer pieces to work with
+	std::vector<size_t> softBoundaries(const std::vector<glm::ivec3>& faces, const std::vector<int>& order,
+		const std::vector<size_t>& hardBoundaries, size_t vertexCount, int cacheSize)
+	{
+		const float lambda = 0.85f;
+		const size_t minimumCluster = 32;
+
+		std::vector<size_t> boundaries;
+		FifoCache cache(vertexCount, cacheSize);
+
+		for (size_t h = 0; h < hardBoundaries.size(); h++) {
+			size_t begin = hardBoundaries[h];
+			size_t end = (h + 1 < hardBoundaries.size()) ? hardBoundaries[h + 1] : order.size();
+
+			// ACMR of the whole hard cluster
+			cache.reset();
+			size_t clusterMisses = 0;
+			for (size_t i = begin; i < end; i++) {
+				for (int c = 0; c < 3; c++) {
+					clusterMisses += cache.access(faces[order[i]][c]);
+				}
+			}
+			float clusterAcmr = (end > begin) ? (float)clusterMisses / (end - begin) : 0.0f;
+
+			// cut wherever the running ACMR drops below lambda times that
+			cache.reset();
+			size_t start = begin;
+			size_t misses = 0;
+			boundaries.push_back(begin);
+			for (size_t i = begin; i < end; i++) {
+				for (int c = 0; c < 3; c++) {
+					misses += cache.access(faces[order[i]][c]);
+				}
+				size_t length = i - start + 1;
+				if (length >= minimumCluster && i + 1 < end
+					&& (float)misses / length <= lambda * clusterAcmr) {
+					start = i + 1;
+					misses = 0;
+					boundaries.push_back(start);
+					cache.reset();
+				}
+			}
+		}
+		return boundaries;
+	}
+}
+
+CacheStats MeasureVertexCache(const MeshData& mesh, int cacheSize)
+{
+	CacheStats stats;
+	if (mesh.faces.empty() || mesh.points.empty()) {
+		return stats;
+	}
+
+	FifoCache cache(mesh.points.size(), cacheSize);
+	size_t misses = 0;
+	for (const glm::ivec3& face : mesh.faces) {
+		misses += cache.access(face.x);
+		misses += cache.access(face.y);
+		misses += cache.access(face.z);
+	}
+
+	stats.acmr = (float)misses / mesh.faces.size();
+	stats.atvr = (float)misses / mesh.points.size();
+	return stats;
+}
+
+void OptimizeMesh(MeshData& mesh, glm::vec3 viewDirection, OptimizeStats* stats, int cacheSize)
+{
+	size_t vertexCount = mesh.points.size();
+	if (stats != nullptr) {
+		stats->before = MeasureVertexCache(mesh, cacheSize);
+	}
+	if (mesh.faces.empty() || vertexCount == 0) {
+		return;
+	}
+
+	// 1. vertex cache order
+	std::vector<size_t> hardBoundaries;
+	std::vector<int> order = tipsify(mesh.faces, vertexCount, cacheSize, hardBoundaries);
+	std::vector<size_t> boundaries = softBoundaries(mesh.faces, order, hardBoundaries, vertexCount, cacheSize);
+
+	// 2. overdraw order of the clusters
+	struct Cluster
+	{
+		size_t begin, end;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float key;
+	};
+	std::vector<Cluster> clusters(boundaries.size());
+
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusters.size(); c++) {
+		Cluster& cluster = clusters[c];
+		cluster.begin = boundaries[c];
+		cluster.end = (c + 1 < boundaries.size()) ? boundaries[c + 1] : order.size();
+
+		// area-weighted centroid and normal
+		glm::vec3 weightedCentroid(0.0f);
+		glm::vec3 normalSum(0.0f);
+		float area = 0.0f;
+		for (size_t i = cluster.begin; i < cluster.end; i++) {
+			const glm::ivec3& face = mesh.faces[order[i]];
+			glm::vec3 a = mesh.points[face.x], b = mesh.points[face.y], d = mesh.points[face.z];
+			glm::vec3 scaledNormal = glm::cross(b - a, d - a);
+			float triangleArea = 0.5f * glm::length(scaledNormal);
+			weightedCentroid += (a + b + d) * (triangleArea / 3.0f);
+			normalSum += scaledNormal;
+			area += triangleArea;
+		}
+		cluster.centroid = (area > 0.0f) ? weightedCentroid / area : mesh.points[mesh.faces[order[cluster.begin]].x];
+		float normalLength = glm::length(normalSum);
+		cluster.normal = (normalLength > 0.0f) ? normalSum / normalLength : glm::vec3(0.0f);
+
+		meshCentroid += weightedCentroid;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	bool viewDependent = glm::length(viewDirection) > 0.0f;
+	glm::vec3 toViewer = viewDependent ? glm::normalize(viewDirection) : glm::vec3(0.0f);
+	for (Cluster& cluster : clusters) {
+		glm::vec3 offset = cluster.centroid - meshCentroid;
+		// nearest to the camera first for a known view; otherwise clusters
+		// that are likely to occlude the rest of the mesh first
+		cluster.key = viewDependent ? glm::dot(offset, toViewer) : glm::dot(offset, cluster.normal);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+		return a.key > b.key;
+	});
+
+	std::vector<glm::ivec3> faces;
+	faces.reserve(mesh.faces.size());
+	for (const Cluster& cluster : clusters) {
+		for (size_t i = cluster.begin; i < cluster.end; i++) {
+			faces.push_back(mesh.faces[order[i]]);
+		}
+	}
+
+	// 3. vertices in first-use order
+	std::vector<int> remap(vertexCount, -1);
+	int next = 0;
+	for (glm::ivec3& face : faces) {
+		for (int c = 0; c < 3; c++) {
+			int& v = face[c];
+			if (remap[v] < 0) {
+				remap[v] = next++;
+			}
+			v = remap[v];
+		}
+	}
+	// vertices no triangle uses go last
+	for (size_t v = 0; v < vertexCount; v++) {
+		if (remap[v] < 0) {
+			remap[v] = next++;
+		}
+	}
+
+	MeshData reordered;
+	reordered.points.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++) {
+		reordered.points[remap[v]] = mesh.points[v];
+	}
+	if (mesh.normals.size() == vertexCount) {
+		reordered.normals.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			reordered.normals[remap[v]] = mesh.normals[v];
+		}
+	}
+	else {
+		reordered.normals = std::move(mesh.normals);
+	}
+	if (mesh.texcoords.size() == vertexCount) {
+		reordered.texcoords.resize(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			reordered.texcoords[remap[v]] = mesh.texcoords[v];
+		}
+	}
+	reordered.faces = std::move(faces);
+	mesh = std::move(reordered);
+
+	if (stats != nullptr) {
+		stats->after = MeasureVertexCache(mesh, cacheSize);
+		stats->clusters = clusters.size();
+	}
+}
+
+void OptimizeFaceOrder(std::vector<glm::ivec3>& faces, size_t vertexCount, int cacheSize)
+{
+	if (faces.empty() || vertexCount == 0) {
+		return;
+	}
+
+	std::vector<size_t> hardBoundaries;
+	std::vector<int> order = tipsify(faces, vertexCount, cacheSize, hardBoundaries);
+
+	std::vector<glm::ivec3> reordered;
+	reordered.reserve(faces.size());
+	for (int t : order) {
+		reordered.push_back(faces[t]);
+	}
+	faces = std::move(reordered);
+}
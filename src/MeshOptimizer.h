@@ -0,0 +1,43 @@
+#ifndef _MESH_OPTIMIZER_H_
+#define _MESH_OPTIMIZER_H_
+
+#include "Mesh.h"
+
+// Post-transform cache efficiency of a triangle order, measured on a FIFO
+// cache of the given size.
+struct CacheStats
+{
+	// average cache miss ratio: transformed vertices per triangle (0.5 - 3)
+	float acmr = 0.0f;
+	// average transform to vertex ratio: transformed vertices per vertex (>= 1)
+	float atvr = 0.0f;
+};
+
+struct OptimizeStats
+{
+	CacheStats before;
+	CacheStats after;
+	// clusters the overdraw pass sorted
+	size_t clusters = 0;
+};
+
+// typical post-transform cache size of current GPUs
+const int vertexCacheSize = 16;
+
+CacheStats MeasureVertexCache(const MeshData& mesh, int cacheSize = vertexCacheSize);
+
+// Reorder the mesh for the GPU:
+// 1. triangles for post-transform cache reuse (Tipsify, Sander et al. 2007),
+// 2. the resulting clusters front to back for less overdraw - along
+//    viewDirection when it is nonzero (pointing from the object toward the
+//    camera), else by the view-independent occlusion potential,
+// 3. vertices in first-use order for fetch locality.
+// The mesh's geometry is unchanged, only the order of its triangles/vertices.
+void OptimizeMesh(MeshData& mesh, glm::vec3 viewDirection = glm::vec3(0.0f),
+	OptimizeStats* stats = nullptr, int cacheSize = vertexCacheSize);
+
+// only the Tipsify triangle order of step 1, e.g. for the coarser levels of
+// a mesh whose vertices are already ordered
+void OptimizeFaceOrder(std::vector<glm::ivec3>& faces, size_t vertexCount, int cacheSize = vertexCacheSize);
+
+#endif
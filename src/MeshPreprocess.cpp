@@ -0,0 +1,376 @@
+#include "MeshPreprocess.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MESH_PREPROCESS_SSE 1
+#endif
+
+// vertices or faces per task
+static const size_t batchSize = 1 << 16;
+
+// fn(begin, end) over count items a batch at a time, on the pool's workers
+// when there is a pool
+static void forBatches(ThreadPool* pool, size_t count, const std::function<void(size_t, size_t)>& fn)
+{
+	size_t batches = (count + batchSize - 1) / batchSize;
+	auto run = [&](size_t batch) {
+		fn(batch * batchSize, std::min(count, (batch + 1) * batchSize));
+	};
+	if (pool) {
+		pool->parallelFor(batches, run);
+	}
+	else {
+		for (size_t batch = 0; batch < batches; batch++) {
+			run(batch);
+		}
+	}
+}
+
+uint32_t MeshPreprocessKey(const MeshPreprocessOptions& options)
+{
+	uint32_t fields[5];
+	memcpy(&fields[0], &options.targetSize, sizeof(float));
+	fields[1] = options.center ? 1 : 0;
+	fields[2] = options.regenerateNormals ? 1 : 0;
+	fields[3] = (uint32_t)options.weighting;
+	memcpy(&fields[4], &options.creaseAngle, sizeof(float));
+
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (uint32_t field : fields) {
+		for (int byte = 0; byte < 4; byte++) {
+			hash = (hash ^ ((field >> (8 * byte)) & 0xff)) * 16777619u;
+		}
+	}
+	return hash;
+}
+
+// box around points[begin, end), which is not empty
+static void boundsOfRange(const glm::vec3* points, size_t begin, size_t end, glm::vec3& low, glm::vec3& high)
+{
+	low = high = points[begin];
+	size_t i = begin;
+#ifdef MESH_PREPROCESS_SSE
+	// four points fill three registers, x y z x | y z x y | z x y z, and
+	// each register keeps its own running min and max
+	if (end - begin >= 4) {
+		const float* p = &points[begin].x;
+		__m128 low0 = _mm_loadu_ps(p);
+		__m128 low1 = _mm_loadu_ps(p + 4);
+		__m128 low2 = _mm_loadu_ps(p + 8);
+		__m128 high0 = low0, high1 = low1, high2 = low2;
+		for (i = begin + 4; i + 4 <= end; i += 4) {
+			const float* q = &points[i].x;
+			__m128 a = _mm_loadu_ps(q);
+			__m128 b = _mm_loadu_ps(q + 4);
+			__m128 c = _mm_loadu_ps(q + 8);
+			low0 = _mm_min_ps(low0, a);
+			low1 = _mm_min_ps(low1, b);
+			low2 = _mm_min_ps(low2, c);
+			high0 = _mm_max_ps(high0, a);
+			high1 = _mm_max_ps(high1, b);
+			high2 = _mm_max_ps(high2, c);
+		}
+		float lows[12], highs[12];
+		_mm_storeu_ps(lows, low0);
+		_mm_storeu_ps(lows + 4, low1);
+		_mm_storeu_ps(lows + 8, low2);
+		_mm_storeu_ps(highs, high0);
+		_mm_storeu_ps(highs + 4, high1);
+		_mm_storeu_ps(highs + 8, high2);
+		for (int k = 0; k < 12; k++) {
+			low[k % 3] = std::min(low[k % 3], lows[k]);
+			high[k % 3] = std::max(high[k % 3], highs[k]);
+		}
+	}
+#endif
+	for (; i < end; i++) {
+		low = glm::min(low, points[i]);
+		high = glm::max(high, points[i]);
+	}
+}
+
+// points[begin, end) * scale + offset
+static void fitRange(glm::vec3* points, size_t begin, size_t end, float scale, const glm::vec3& offset)
+{
+	size_t i = begin;
+#ifdef MESH_PREPROCESS_SSE
+	// the offset laid out like the three registers of four points
+	__m128 scales = _mm_set1_ps(scale);
+	__m128 offset0 = _mm_setr_ps(offset.x, offset.y, offset.z, offset.x);
+	__m128 offset1 = _mm_setr_ps(offset.y, offset.z, offset.x, offset.y);
+	__m128 offset2 = _mm_setr_ps(offset.z, offset.x, offset.y, offset.z);
+	for (; i + 4 <= end; i += 4) {
+		float* q = &points[i].x;
+		_mm_storeu_ps(q, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(q), scales), offset0));
+		_mm_storeu_ps(q + 4, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(q + 4), scales), offset1));
+		_mm_storeu_ps(q + 8, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(q + 8), scales), offset2));
+	}
+#endif
+	for (; i < end; i++) {
+		points[i] = points[i] * scale + offset;
+	}
+}
+
+static glm::vec3 normalizeOrZero(const glm::vec3& v)
+{
+	float length = glm::length(v);
+	return length > 0.0f ? v / length : glm::vec3(0.0f);
+}
+
+// angle between two edges leaving a corner, given their lengths
+static float cornerAngle(const glm::vec3& a, const glm::vec3& b, float lengthA, float lengthB)
+{
+	float product = lengthA * lengthB;
+	return product > 0.0f ? std::acos(glm::clamp(glm::dot(a, b) / product, -1.0f, 1.0f)) : 0.0f;
+}
+
+static void generateNormals(MeshData& mesh, const MeshPreprocessOptions& options, ThreadPool* pool,
+	PreprocessStats* stats)
+{
+	std::vector<glm::vec3>& points = mesh.points;
+	std::vector<glm::vec3>& normals = mesh.normals;
+	std::vector<glm::ivec3>& faces = mesh.faces;
+	size_t vertexCount = points.size();
+	size_t faceCount = faces.size();
+	normals.assign(vertexCount, glm::vec3(0.0f));
+
+	// unit normal of each face, the weight it gets at each of its corners,
+	// and the number of corners at each vertex. The counters are only
+	// updated atomically when other threads share them; a locked add costs
+	// as much as the rest of the work on a face.
+	std::vector<glm::vec3> faceNormals(faceCount);
+	std::vector<glm::vec3> cornerWeights(faceCount);
+	std::vector<std::atomic<uint32_t>> cornerCounts(vertexCount);
+	bool shared = pool != nullptr && pool->size() > 0;
+	auto addCount = [shared](std::atomic<uint32_t>& count, int delta) {
+		if (shared) {
+			return count.fetch_add(delta, std::memory_order_relaxed);
+		}
+		uint32_t before = count.load(std::memory_order_relaxed);
+		count.store(before + delta, std::memory_order_relaxed);
+		return before;
+	};
+	bool byAngle = options.weighting == normalsByAngle;
+	forBatches(pool, faceCount, [&](size_t begin, size_t end) {
+		for (size_t f = begin; f < end; f++) {
+			const glm::ivec3& face = faces[f];
+			glm::vec3 e0 = points[face.y] - points[face.x];
+			glm::vec3 e1 = points[face.z] - points[face.y];
+			glm::vec3 e2 = points[face.x] - points[face.z];
+			glm::vec3 normal = glm::cross(e0, -e2);
+			float length = glm::length(normal);
+			faceNormals[f] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+			if (byAngle && length > 0.0f) {
+				float l0 = glm::length(e0);
+				float l1 = glm::length(e1);
+				float l2 = glm::length(e2);
+				cornerWeights[f] = glm::vec3(cornerAngle(e0, -e2, l0, l2), cornerAngle(e1, -e0, l1, l0),
+					cornerAngle(e2, -e1, l2, l1));
+			}
+			else {
+				cornerWeights[f] = glm::vec3(length);
+			}
+			for (int c = 0; c < 3; c++) {
+				addCount(cornerCounts[face[c]], 1);
+			}
+		}
+	});
+
+	// the corners (face * 3 + corner) around each vertex, back to back; a
+	// single thread files them in descending order
+	std::vector<uint32_t> firstCorner(vertexCount + 1);
+	uint32_t cornerTotal = 0;
+	for (size_t v = 0; v < vertexCount; v++) {
+		firstCorner[v] = cornerTotal;
+		cornerTotal += cornerCounts[v].load(std::memory_order_relaxed);
+	}
+	firstCorner[vertexCount] = cornerTotal;
+	std::vector<uint32_t> corners(cornerTotal);
+	forBatches(pool, faceCount, [&](size_t begin, size_t end) {
+		for (size_t f = begin; f < end; f++) {
+			for (int c = 0; c < 3; c++) {
+				int v = faces[f][c];
+				uint32_t slot = firstCorner[v] + addCount(cornerCounts[v], -1) - 1;
+				corners[slot] = (uint32_t)(f * 3 + c);
+			}
+		}
+	});
+
+	// Normals of the corners around v, each the weighted sum over the faces
+	// within the crease angle of its own face, and equal ones grouped; group 0
+	// keeps the vertex, the others get copies of it. Returns the group count.
+	bool smooth = options.creaseAngle >= 180.0f;
+	float cosCrease = std::cos(glm::radians(options.creaseAngle));
+	auto groupCorners = [&](size_t v, std::vector<glm::vec3>& groupNormals, std::vector<uint32_t>& cornerGroups) {
+		uint32_t* begin = corners.data() + firstCorner[v];
+		uint32_t* end = corners.data() + firstCorner[v + 1];
+		size_t count = end - begin;
+		// the same order, and so the same sums, as a single thread
+		if (shared) {
+			std::sort(begin, end, std::greater<uint32_t>());
+		}
+		groupNormals.clear();
+		auto weighted = [&](uint32_t corner) {
+			return faceNormals[corner / 3] * cornerWeights[corner / 3][corner % 3];
+		};
+		if (count == 0) {
+			return (size_t)0;
+		}
+		if (smooth) {
+			glm::vec3 sum(0.0f);
+			for (size_t i = 0; i < count; i++) {
+				sum += weighted(begin[i]);
+			}
+			groupNormals.push_back(normalizeOrZero(sum));
+			return (size_t)1;
+		}
+
+		cornerGroups.assign(count, 0);
+		for (size_t i = 0; i < count; i++) {
+			// degenerate faces take group 0, whatever it turns out to be
+			const glm::vec3& own = faceNormals[begin[i] / 3];
+			if (own == glm::vec3(0.0f)) {
+				continue;
+			}
+			glm::vec3 sum(0.0f);
+			for (size_t j = 0; j < count; j++) {
+				if (glm::dot(own, faceNormals[begin[j] / 3]) >= cosCrease) {
+					sum += weighted(begin[j]);
+				}
+			}
+			glm::vec3 normal = normalizeOrZero(sum);
+			size_t group = std::find(groupNormals.begin(), groupNormals.end(), normal) - groupNormals.begin();
+			if (group == groupNormals.size()) {
+				groupNormals.push_back(normal);
+			}
+			cornerGroups[i] = (uint32_t)group;
+		}
+		if (groupNormals.empty()) {
+			groupNormals.push_back(glm::vec3(0.0f));
+		}
+		return groupNormals.size();
+	};
+
+	// vertices to add at creases, counted first so every vertex knows
+	// where its copies go
+	std::vector<uint32_t> firstAdded(vertexCount + 1);
+	forBatches(pool, vertexCount, [&](size_t begin, size_t end) {
+		std::vector<glm::vec3> groupNormals;
+		std::vector<uint32_t> cornerGroups;
+		for (size_t v = begin; v < end; v++) {
+			size_t groups = groupCorners(v, groupNormals, cornerGroups);
+			if (groups > 0) {
+				normals[v] = groupNormals[0];
+			}
+			firstAdded[v] = groups > 1 ? (uint32_t)groups - 1 : 0;
+		}
+	});
+	uint32_t added = 0;
+	for (size_t v = 0; v < vertexCount; v++) {
+		uint32_t count = firstAdded[v];
+		firstAdded[v] = added;
+		added += count;
+	}
+	firstAdded[vertexCount] = added;
+
+	if (added > 0) {
+		points.resize(vertexCount + added);
+		normals.resize(vertexCount + added);
+		if (!mesh.texcoords.empty()) {
+			mesh.texcoords.resize(vertexCount + added);
+		}
+		// each face corner belongs to one vertex, so only v's task rewrites it
+		forBatches(pool, vertexCount, [&](size_t begin, size_t end) {
+			std::vector<glm::vec3> groupNormals;
+			std::vector<uint32_t> cornerGroups;
+			for (size_t v = begin; v < end; v++) {
+				if (firstAdded[v + 1] == firstAdded[v]) {
+					continue;
+				}
+				groupCorners(v, groupNormals, cornerGroups);
+				size_t first = vertexCount + firstAdded[v] - 1;
+				for (size_t group = 1; group < groupNormals.size(); group++) {
+					points[first + group] = points[v];
+					normals[first + group] = groupNormals[group];
+					if (!mesh.texcoords.empty()) {
+						mesh.texcoords[first + group] = mesh.texcoords[v];
+					}
+				}
+				const uint32_t* around = corners.data() + firstCorner[v];
+				for (size_t i = 0; i < cornerGroups.size(); i++) {
+					if (cornerGroups[i] > 0) {
+						faces[around[i] / 3][around[i] % 3] = (int)(first + cornerGroups[i]);
+					}
+				}
+			}
+		});
+	}
+
+	if (stats != nullptr) {
+		stats->generatedNormals = vertexCount;
+		stats->creaseVertices = added;
+	}
+}
+
+void PreprocessMesh(MeshData& mesh, const MeshPreprocessOptions& options, ThreadPool* pool, PreprocessStats* stats)
+{
+	std::vector<glm::vec3>& points = mesh.points;
+	size_t vertexCount = points.size();
+	if (mesh.normals.size() != vertexCount) {
+		mesh.normals.resize(vertexCount, glm::vec3(0.0f));
+	}
+	if (stats != nullptr) {
+		*stats = PreprocessStats();
+	}
+	if (vertexCount == 0) {
+		return;
+	}
+
+	// the box and the vertices without a normal, per batch in one pass
+	size_t batches = (vertexCount + batchSize - 1) / batchSize;
+	std::vector<glm::vec3> lows(batches), highs(batches);
+	std::vector<size_t> missing(batches);
+	forBatches(pool, vertexCount, [&](size_t begin, size_t end) {
+		size_t batch = begin / batchSize;
+		boundsOfRange(points.data(), begin, end, lows[batch], highs[batch]);
+		size_t count = 0;
+		for (size_t i = begin; i < end; i++) {
+			count += mesh.normals[i] == glm::vec3(0.0f) ? 1 : 0;
+		}
+		missing[batch] = count;
+	});
+	glm::vec3 low = lows[0], high = highs[0];
+	size_t missingNormals = 0;
+	for (size_t batch = 0; batch < batches; batch++) {
+		low = glm::min(low, lows[batch]);
+		high = glm::max(high, highs[batch]);
+		missingNormals += missing[batch];
+	}
+	if (stats != nullptr) {
+		stats->sourceMin = low;
+		stats->sourceMax = high;
+	}
+
+	// center and scale folded into one multiply-add
+	glm::vec3 extent = high - low;
+	float size = std::max(extent.x, std::max(extent.y, extent.z));
+	float scale = options.targetSize > 0.0f && size > 0.0f ? options.targetSize / size : 1.0f;
+	glm::vec3 center = options.center ? (low + high) * 0.5f : glm::vec3(0.0f);
+	glm::vec3 offset = -center * scale;
+	if (scale != 1.0f || offset != glm::vec3(0.0f)) {
+		forBatches(pool, vertexCount, [&](size_t begin, size_t end) {
+			fitRange(points.data(), begin, end, scale, offset);
+		});
+	}
+
+	if (options.regenerateNormals || missingNormals > 0) {
+		generateNormals(mesh, options, pool, stats);
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef _MESH_PREPROCESS_H_
+#define _MESH_PREPROCESS_H_
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+// how generated normals weigh the faces around a vertex
+enum NormalWeighting
+{
+	// by face area: large faces dominate
+	normalsByArea,
+	// by the face's angle at the vertex: independent of how the surface
+	// around it is triangulated
+	normalsByAngle,
+};
+
+// What is done to a mesh after welding, set per model.
+struct MeshPreprocessOptions
+{
+	// the longest side of the bounding box is scaled to this; 0 keeps the
+	// file's units
+	float targetSize = 15.0f;
+	// move the center of the bounding box to the origin
+	bool center = true;
+	// generate smooth normals even where the file has them; without this
+	// they are only generated when some vertex has none
+	bool regenerateNormals = false;
+	NormalWeighting weighting = normalsByAngle;
+	// faces meeting at a vertex at more than this many degrees keep separate
+	// normals there (the vertex is split); 180 smooths across every edge
+	float creaseAngle = 180.0f;
+};
+
+// identifies the options in a mesh cache, so a cache built with others is stale
+uint32_t MeshPreprocessKey(const MeshPreprocessOptions& options);
+
+struct PreprocessStats
+{
+	// bounding box before fitting
+	glm::vec3 sourceMin = glm::vec3(0.0f);
+	glm::vec3 sourceMax = glm::vec3(0.0f);
+	// vertices the normals were generated for, and the ones added at creases
+	size_t generatedNormals = 0;
+	size_t creaseVertices = 0;
+};
+
+// Fit the mesh into the target size around the origin and generate normals,
+// on the pool's workers. Bounding box and missing normals are found in one
+// SIMD pass over the points, then one SIMD pass centers and scales them
+// with a single multiply-add. Generated normals are shared by all faces
+// around a vertex (within the crease angle), so they follow the welded
+// vertices: a mesh whose file normals split a vertex stays split there.
+void PreprocessMesh(MeshData& mesh, const MeshPreprocessOptions& options, ThreadPool* pool = nullptr,
+	PreprocessStats* stats = nullptr);
+
+#endif
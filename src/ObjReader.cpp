@@ -0,0 +1,419 @@
+#include "ObjReader.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// kinds of records the reader cares about, everything else is skipped
+	enum RecordType { otherRecord, vertexRecord, texcoordRecord, normalRecord, faceRecord };
+
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char* skipBlanks(const char* p, const char* end)
+	{
+		while (p < end && isBlank(*p)) {
+			++p;
+		}
+		return p;
+	}
+
+	inline const char* skipToken(const char* p, const char* end)
+	{
+		while (p < end && !isBlank(*p)) {
+			++p;
+		}
+		return p;
+	}
+
+	inline const char* findLineEnd(const char* p, const char* end)
+	{
+		const char* newline = (const char*)memchr(p, '\n', end - p);
+		return newline ? newline : end;
+	}
+
+	// end of a record's data: a trailing "# comment" is not part of it
+	inline const char* findDataEnd(const char* p, const char* lineEnd)
+	{
+		const char* comment = (const char*)memchr(p, '#', lineEnd - p);
+		return comment ? comment : lineEnd;
+	}
+
+	// classify the record starting at p and move p past its keyword
+	inline RecordType readKeyword(const char*& p, const char* lineEnd)
+	{
+		p = skipBlanks(p, lineEnd);
+		if (lineEnd - p < 2) {
+			return otherRecord;
+		}
+
+		if (p[0] == 'v') {
+			if (isBlank(p[1])) {
+				p += 2;
+				return vertexRecord;
+			}
+			if (lineEnd - p >= 3 && isBlank(p[2])) {
+				if (p[1] == 'n') {
+					p += 3;
+					return normalRecord;
+				}
+				if (p[1] == 't') {
+					p += 3;
+					return texcoordRecord;
+				}
+			}
+		}
+		else if (p[0] == 'f' && isBlank(p[1])) {
+			p += 2;
+			return faceRecord;
+		}
+		return otherRecord;
+	}
+
+	// parse a float in place; a malformed number reads as 0
+	inline const char* parseFloat(const char* p, const char* end, float& value)
+	{
+		p = skipBlanks(p, end);
+		if (p < end && *p == '+') {
+			++p;
+		}
+
+		std::from_chars_result result = std::from_chars(p, end, value);
+		if (result.ec == std::errc::invalid_argument) {
+			value = 0.0f;
+			return p;
+		}
+		if (result.ec != std::errc()) {
+			value = 0.0f;
+		}
+		return result.ptr;
+	}
+
+	// parse an integer in place; a missing or malformed index reads as 0
+	inline const char* parseIndex(const char* p, const char* end, int& value)
+	{
+		if (p < end && *p == '+') {
+			++p;
+		}
+
+		std::from_chars_result result = std::from_chars(p, end, value);
+		if (result.ec == std::errc::invalid_argument) {
+			value = 0;
+			return p;
+		}
+		if (result.ec != std::errc()) {
+			value = 0;
+		}
+		return result.ptr;
+	}
+
+	// parse one face vertex ("v", "v/vt", "v//vn" or "v/vt/vn") into raw OBJ
+	// indices (1-based or negative); absent components stay 0
+	inline const char* parseCorner(const char* p, const char* end, glm::ivec3& raw)
+	{
+		raw = glm::ivec3(0);
+		p = parseIndex(p, end, raw.x);
+		if (p < end && *p == '/') {
+			++p;
+			if (p < end && *p != '/') {
+				p = parseIndex(p, end, raw.y);
+			}
+			if (p < end && *p == '/') {
+				++p;
+				p = parseIndex(p, end, raw.z);
+			}
+		}
+		return p;
+	}
+
+	// turn a raw OBJ index into a 0-based one; negative indices are relative
+	// to the number of records declared so far, 0 means "absent"
+	inline int resolveIndex(int raw, size_t declared)
+	{
+		if (raw > 0) {
+			return raw - 1;
+		}
+		if (raw < 0) {
+			return (int)declared + raw;
+		}
+		return -1;
+	}
+
+	inline int countTokens(const char* p, const char* lineEnd)
+	{
+		int tokens = 0;
+		p = skipBlanks(p, lineEnd);
+		while (p < lineEnd) {
+			++tokens;
+			p = skipBlanks(skipToken(p, lineEnd), lineEnd);
+		}
+		return tokens;
+	}
+}
+
+void ObjData::clear()
+{
+	points.clear();
+	texcoords.clear();
+	normals.clear();
+	faces.clear();
+	texcoordFaces.clear();
+	normalFaces.clear();
+}
+
+ObjCounts CountObjRecords(const char* begin, const char* end)
+{
+	ObjCounts counts;
+
+	const char* p = begin;
+	while (p < end) {
+		const char* lineEnd = findLineEnd(p, end);
+
+		switch (readKeyword(p, lineEnd)) {
+		case vertexRecord:
+			counts.points++;
+			break;
+		case texcoordRecord:
+			counts.texcoords++;
+			break;
+		case normalRecord:
+			counts.normals++;
+			break;
+		case faceRecord: {
+			// an n-gon becomes a fan of n - 2 triangles
+			int corners = countTokens(p, findDataEnd(p, lineEnd));
+			if (corners >= 3) {
+				counts.triangles += corners - 2;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+
+		p = (lineEnd < end) ? lineEnd + 1 : end;
+	}
+
+	return counts;
+}
+
+namespace
+{
+	// byte range of the file that starts and ends on a line boundary, plus the
+	// number of records that precede it (filled in by a prefix sum)
+	struct ObjChunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		ObjCounts counts;
+		ObjCounts offsets;
+	};
+
+	// split [begin, end) into roughly equal line-aligned chunks
+	std::vector<ObjChunk> splitChunks(const char* begin, const char* end, size_t chunkCount)
+	{
+		std::vector<ObjChunk> chunks;
+		size_t approxSize = (end - begin) / chunkCount + 1;
+
+		const char* p = begin;
+		while (p < end) {
+			ObjChunk chunk;
+			chunk.begin = p;
+			if ((size_t)(end - p) <= approxSize) {
+				p = end;
+			}
+			else {
+				p = findLineEnd(p + approxSize, end);
+				p = (p < end) ? p + 1 : end;
+			}
+			chunk.end = p;
+			chunks.push_back(chunk);
+		}
+		return chunks;
+	}
+
+	// parse one chunk into the slots reserved for it; relative indices are
+	// resolved against the records of all previous chunks
+	bool parseChunk(const ObjChunk& chunk, const ObjCounts& totals, ObjData& out)
+	{
+		size_t pointCount = chunk.offsets.points;
+		size_t texcoordCount = chunk.offsets.texcoords;
+		size_t normalCount = chunk.offsets.normals;
+		size_t triangleCount = chunk.offsets.triangles;
+		bool valid = true;
+
+		// check an index against the totals of the whole file
+		auto checkIndex = [&valid](int& index, size_t total, bool required) {
+			if (index >= 0 && (size_t)index < total) {
+				return;
+			}
+			if (index >= 0 || required) {
+				valid = false;
+			}
+			// keep the GPU from ever reading outside the uploaded buffers
+			index = required ? 0 : -1;
+		};
+
+		const char* p = chunk.begin;
+		const char* end = chunk.end;
+		while (p < end) {
+			const char* lineEnd = findLineEnd(p, end);
+
+			switch (readKeyword(p, lineEnd)) {
+			case vertexRecord: {
+				glm::vec3& point = out.points[pointCount++];
+				p = parseFloat(p, lineEnd, point.x);
+				p = parseFloat(p, lineEnd, point.y);
+				p = parseFloat(p, lineEnd, point.z);
+				break;
+			}
+			case texcoordRecord: {
+				glm::vec2& texcoord = out.texcoords[texcoordCount++];
+				p = parseFloat(p, lineEnd, texcoord.x);
+				p = parseFloat(p, lineEnd, texcoord.y);
+				break;
+			}
+			case normalRecord: {
+				glm::vec3& normal = out.normals[normalCount++];
+				p = parseFloat(p, lineEnd, normal.x);
+				p = parseFloat(p, lineEnd, normal.y);
+				p = parseFloat(p, lineEnd, normal.z);
+				break;
+			}
+			case faceRecord: {
+				glm::ivec3 first, previous;
+				int corners = 0;
+
+				const char* dataEnd = findDataEnd(p, lineEnd);
+				p = skipBlanks(p, dataEnd);
+				while (p < dataEnd) {
+					glm::ivec3 raw;
+					p = parseCorner(p, dataEnd, raw);
+					p = skipBlanks(skipToken(p, dataEnd), dataEnd);
+
+					glm::ivec3 corner(resolveIndex(raw.x, pointCount),
+						resolveIndex(raw.y, texcoordCount),
+						resolveIndex(raw.z, normalCount));
+					checkIndex(corner.x, totals.points, true);
+					checkIndex(corner.y, totals.texcoords, false);
+					checkIndex(corner.z, totals.normals, false);
+
+					// fan-triangulate quads and larger polygons
+					if (corners == 0) {
+						first = corner;
+					}
+					else if (corners >= 2) {
+						out.faces[triangleCount] = glm::ivec3(first.x, previous.x, corner.x);
+						if (!out.texcoordFaces.empty()) {
+							out.texcoordFaces[triangleCount] = glm::ivec3(first.y, previous.y, corner.y);
+						}
+						if (!out.normalFaces.empty()) {
+							out.normalFaces[triangleCount] = glm::ivec3(first.z, previous.z, corner.z);
+						}
+						triangleCount++;
+					}
+					previous = corner;
+					corners++;
+				}
+				break;
+			}
+			default:
+				break;
+			}
+
+			p = (lineEnd < end) ? lineEnd + 1 : end;
+		}
+
+		return valid;
+	}
+}
+
+bool ParseObj(const char* begin, const char* end, ObjData& out, ThreadPool* pool, size_t chunkBytes)
+{
+	if (chunkBytes == 0) {
+		chunkBytes = defaultObjChunkBytes;
+	}
+
+	// one chunk per slice of the file, but never fewer bytes than chunkBytes
+	size_t chunkCount = 1;
+	if (pool != nullptr && pool->size() > 1) {
+		chunkCount = std::max<size_t>(1, std::min<size_t>((end - begin) / chunkBytes, pool->size() * 4));
+	}
+	std::vector<ObjChunk> chunks = splitChunks(begin, end, chunkCount);
+
+	// count every chunk, then prefix-sum the counts into per-chunk offsets
+	auto countChunk = [&chunks](size_t i) {
+		chunks[i].counts = CountObjRecords(chunks[i].begin, chunks[i].end);
+	};
+	if (chunks.size() > 1) {
+		pool->parallelFor(chunks.size(), countChunk);
+	}
+	else if (chunks.size() == 1) {
+		countChunk(0);
+	}
+
+	ObjCounts totals;
+	for (ObjChunk& chunk : chunks) {
+		chunk.offsets = totals;
+		totals.points += chunk.counts.points;
+		totals.texcoords += chunk.counts.texcoords;
+		totals.normals += chunk.counts.normals;
+		totals.triangles += chunk.counts.triangles;
+	}
+
+	// size every output array once, up front
+	out.clear();
+	out.points.resize(totals.points);
+	out.texcoords.resize(totals.texcoords);
+	out.normals.resize(totals.normals);
+	out.faces.resize(totals.triangles);
+	if (totals.texcoords > 0) {
+		out.texcoordFaces.resize(totals.triangles);
+	}
+	if (totals.normals > 0) {
+		out.normalFaces.resize(totals.triangles);
+	}
+
+	// every chunk writes only its own slots, so the result does not depend on
+	// how the file was split
+	std::vector<char> chunkValid(chunks.size(), 1);
+	auto parseOne = [&](size_t i) {
+		chunkValid[i] = parseChunk(chunks[i], totals, out) ? 1 : 0;
+	};
+	if (chunks.size() > 1) {
+		pool->parallelFor(chunks.size(), parseOne);
+	}
+	else if (chunks.size() == 1) {
+		parseOne(0);
+	}
+
+	return std::find(chunkValid.begin(), chunkValid.end(), 0) == chunkValid.end();
+}
+
+bool LoadObj(const std::string& objFilename, ObjData& out, ThreadPool* pool)
+{
+	MappedFile file;
+
+	// Check whether the file can be opened.
+	if (!file.open(objFilename))
+	{
+		std::cerr << "Can't open the file " << objFilename << std::endl;
+		out.clear();
+		return false;
+	}
+
+	if (!ParseObj(file.begin(), file.end(), out, pool))
+	{
+		std::cerr << "Face indices out of range in " << objFilename << std::endl;
+		return false;
+	}
+
+	return true;
+}
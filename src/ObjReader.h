@@ -0,0 +1,56 @@
+#ifndef _OBJ_READER_H_
+#define _OBJ_READER_H_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Geometry records of a Wavefront OBJ file. Faces are fan-triangulated, so
+// every entry of the face arrays is one triangle, and all indices are already
+// resolved to 0-based (negative/relative OBJ indices included).
+struct ObjData
+{
+	std::vector<glm::vec3> points;
+	std::vector<glm::vec2> texcoords;
+	std::vector<glm::vec3> normals;
+
+	// position indices of every triangle
+	std::vector<glm::ivec3> faces;
+	// texture coordinate / normal indices of every triangle, -1 where a face
+	// vertex has none; left empty when the file has no vt / vn records
+	std::vector<glm::ivec3> texcoordFaces;
+	std::vector<glm::ivec3> normalFaces;
+
+	void clear();
+};
+
+// Number of records of each kind, gathered by a cheap counting pass so the
+// output arrays can be sized once before any number is parsed.
+struct ObjCounts
+{
+	size_t points = 0;
+	size_t texcoords = 0;
+	size_t normals = 0;
+	size_t triangles = 0;
+};
+
+ObjCounts CountObjRecords(const char* begin, const char* end);
+
+class ThreadPool;
+
+// Files are cut into chunks of at least this many bytes for parallel parsing.
+const size_t defaultObjChunkBytes = 1 << 20;
+
+// Parse OBJ text held in [begin, end). Returns false if the text contained
+// face indices that point outside the declared vertex data.
+// With a pool, the text is split into line-aligned chunks that are counted and
+// parsed in parallel; the result is identical to the serial parse.
+bool ParseObj(const char* begin, const char* end, ObjData& out,
+	ThreadPool* pool = nullptr, size_t chunkBytes = 0);
+
+// Memory-map an OBJ file and parse it in place.
+bool LoadObj(const std::string& objFilename, ObjData& out, ThreadPool* pool = nullptr);
+
+#endif
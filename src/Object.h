@@ -11,6 +11,8 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "ShaderProgram.h"
+
 class Object
 {
 protected:
@@ -18,10 +20,10 @@ protected:
 	glm::vec3 color;
 
 public:
-	glm::mat4 getModel() { return model; }
-	glm::vec3 getColor() { return color; }
+	glm::mat4 getModel() const { return model; }
+	glm::vec3 getColor() const { return color; }
 
-	virtual void draw(const glm::mat4& view, const glm::mat4& projection, GLuint shader) = 0;
+	virtual void draw(const glm::mat4& view, const glm::mat4& projection, const ShaderVariants& shaders) = 0;
 	// virtual void update() = 0;
 
 	virtual void scale(int yoff) = 0;
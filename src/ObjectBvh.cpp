@@ -0,0 +1,267 @@
+#include "ObjectBvh.h"
+
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OBJECT_BVH_SSE 1
+#endif
+
+void ObjectBvh::clear()
+{
+	nodes.clear();
+	boxes.clear();
+	objectNode.clear();
+	objectLane.clear();
+}
+
+void ObjectBvh::build(const std::vector<Aabb>& objectBoxes)
+{
+	clear();
+	boxes = objectBoxes;
+	objectNode.assign(boxes.size(), -1);
+	objectLane.assign(boxes.size(), -1);
+	if (boxes.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> objects(boxes.size());
+	for (uint32_t i = 0; i < objects.size(); i++) {
+		objects[i] = i;
+	}
+	// doubled box centers, split on while building
+	centers.resize(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		centers[i] = boxes[i].min + boxes[i].max;
+	}
+	nodes.reserve(boxes.size() / 2 + 1);
+	buildNode(objects.data(), objects.size(), -1, -1);
+	centers.clear();
+	centers.shrink_to_fit();
+}
+
+// split at the median of the longest axis of the centers
+static size_t splitObjects(uint32_t* objects, size_t count, const std::vector<glm::vec3>& centers)
+{
+	glm::vec3 low = centers[objects[0]];
+	glm::vec3 high = low;
+	for (size_t i = 1; i < count; i++) {
+		low = glm::min(low, centers[objects[i]]);
+		high = glm::max(high, centers[objects[i]]);
+	}
+	glm::vec3 size = high - low;
+	int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+
+	size_t half = count / 2;
+	std::nth_element(objects, objects + half, objects + count, [&](uint32_t a, uint32_t b) {
+		return centers[a][axis] < centers[b][axis];
+	});
+	return half;
+}
+
+int32_t ObjectBvh::buildNode(uint32_t* objects, size_t count, int32_t parent, int32_t parentLane)
+{
+	int32_t index = (int32_t)nodes.size();
+	nodes.push_back(Node());
+	nodes[index].parent = parent;
+	nodes[index].parentLane = parentLane;
+	nodes[index].laneMask = 0;
+
+	// up to four groups: the objects themselves, or two median splits
+	size_t first[4] = {};
+	size_t sizes[4] = {};
+	int groups = 0;
+	if (count <= 4) {
+		for (size_t i = 0; i < count; i++) {
+			first[i] = i;
+			sizes[i] = 1;
+		}
+		groups = (int)count;
+	}
+	else {
+		size_t half = splitObjects(objects, count, centers);
+		size_t quarter = splitObjects(objects, half, centers);
+		size_t threeQuarters = half + splitObjects(objects + half, count - half, centers);
+		first[0] = 0;
+		sizes[0] = quarter;
+		first[1] = quarter;
+		sizes[1] = half - quarter;
+		first[2] = half;
+		sizes[2] = threeQuarters - half;
+		first[3] = threeQuarters;
+		sizes[3] = count - threeQuarters;
+		groups = 4;
+	}
+
+	for (int lane = 0; lane < 4; lane++) {
+		Aabb box;
+		if (lane >= groups) {
+			// unused lanes are never read; keep them empty
+			nodes[index].child[lane] = 0;
+		}
+		else if (sizes[lane] == 1) {
+			uint32_t object = objects[first[lane]];
+			nodes[index].child[lane] = ~(int32_t)object;
+			nodes[index].laneMask |= 1 << lane;
+			objectNode[object] = index;
+			objectLane[object] = lane;
+			box = boxes[object];
+		}
+		else {
+			int32_t child = buildNode(objects + first[lane], sizes[lane], index, lane);
+			nodes[index].child[lane] = child;
+			nodes[index].laneMask |= 1 << lane;
+			box = laneBounds(nodes[child], 0);
+			for (int childLane = 1; childLane < 4; childLane++) {
+				if (nodes[child].laneMask & (1 << childLane)) {
+					box = MergeAabb(box, laneBounds(nodes[child], childLane));
+				}
+			}
+		}
+		setLaneBounds(nodes[index], lane, box);
+	}
+	return index;
+}
+
+Aabb ObjectBvh::laneBounds(const Node& node, int lane) const
+{
+	Aabb box;
+	box.min = glm::vec3(node.minX[lane], node.minY[lane], node.minZ[lane]);
+	box.max = glm::vec3(node.maxX[lane], node.maxY[lane], node.maxZ[lane]);
+	return box;
+}
+
+void ObjectBvh::setLaneBounds(Node& node, int lane, const Aabb& box)
+{
+	node.minX[lane] = box.min.x;
+	node.minY[lane] = box.min.y;
+	node.minZ[lane] = box.min.z;
+	node.maxX[lane] = box.max.x;
+	node.maxY[lane] = box.max.y;
+	node.maxZ[lane] = box.max.z;
+}
+
+void ObjectBvh::refit(uint32_t object, const Aabb& box)
+{
+	boxes[object] = box;
+	int32_t index = objectNode[object];
+	setLaneBounds(nodes[index], objectLane[object], box);
+
+	// every node above gets the union of its lanes
+	while (nodes[index].parent >= 0) {
+		const Node& node = nodes[index];
+		Aabb bounds;
+		bool first = true;
+		for (int lane = 0; lane < 4; lane++) {
+			if (node.laneMask & (1 << lane)) {
+				bounds = first ? laneBounds(node, lane) : MergeAabb(bounds, laneBounds(node, lane));
+				first = false;
+			}
+		}
+		setLaneBounds(nodes[node.parent], node.parentLane, bounds);
+		index = node.parent;
+	}
+}
+
+// every object below a node that is entirely inside the frustum
+void ObjectBvh::collect(int32_t index, std::vector<uint32_t>& visible) const
+{
+	const Node& node = nodes[index];
+	for (int lane = 0; lane < 4; lane++) {
+		if (!(node.laneMask & (1 << lane))) {
+			continue;
+		}
+		if (node.child[lane] < 0) {
+			visible.push_back(~node.child[lane]);
+		}
+		else {
+			collect(node.child[lane], visible);
+		}
+	}
+}
+
+void ObjectBvh::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	visible.clear();
+	if (nodes.empty()) {
+		return;
+	}
+
+	// per plane, whether the farthest corner along the normal takes the max
+	// or the min of each axis; the nearest corner takes the other
+	bool positive[6][3];
+	for (int p = 0; p < 6; p++) {
+		for (int axis = 0; axis < 3; axis++) {
+			positive[p][axis] = frustum.planes[p][axis] > 0.0f;
+		}
+	}
+
+	int32_t stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+
+		// lanes outside any plane, and lanes inside all of them
+		int outsideMask = 0;
+		int insideMask = 0;
+#ifdef OBJECT_BVH_SSE
+		__m128 minX = _mm_load_ps(node.minX), minY = _mm_load_ps(node.minY), minZ = _mm_load_ps(node.minZ);
+		__m128 maxX = _mm_load_ps(node.maxX), maxY = _mm_load_ps(node.maxY), maxZ = _mm_load_ps(node.maxZ);
+		__m128 outside = _mm_setzero_ps();
+		__m128 inside = _mm_cmpeq_ps(outside, outside);
+		__m128 zero = _mm_setzero_ps();
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			__m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+			__m128 w = _mm_set1_ps(plane.w);
+			__m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, positive[p][0] ? maxX : minX),
+				_mm_mul_ps(ny, positive[p][1] ? maxY : minY)),
+				_mm_add_ps(_mm_mul_ps(nz, positive[p][2] ? maxZ : minZ), w));
+			__m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, positive[p][0] ? minX : maxX),
+				_mm_mul_ps(ny, positive[p][1] ? minY : maxY)),
+				_mm_add_ps(_mm_mul_ps(nz, positive[p][2] ? minZ : maxZ), w));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(farDistance, zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(nearDistance, zero));
+		}
+		outsideMask = _mm_movemask_ps(outside);
+		insideMask = _mm_movemask_ps(inside);
+#else
+		insideMask = 0xf;
+		for (int lane = 0; lane < 4; lane++) {
+			for (int p = 0; p < 6; p++) {
+				const glm::vec4& plane = frustum.planes[p];
+				float farDistance = (plane.x * (positive[p][0] ? node.maxX[lane] : node.minX[lane])
+					+ plane.y * (positive[p][1] ? node.maxY[lane] : node.minY[lane]))
+					+ (plane.z * (positive[p][2] ? node.maxZ[lane] : node.minZ[lane]) + plane.w);
+				float nearDistance = (plane.x * (positive[p][0] ? node.minX[lane] : node.maxX[lane])
+					+ plane.y * (positive[p][1] ? node.minY[lane] : node.maxY[lane]))
+					+ (plane.z * (positive[p][2] ? node.minZ[lane] : node.maxZ[lane]) + plane.w);
+				if (farDistance < 0.0f) {
+					outsideMask |= 1 << lane;
+				}
+				if (nearDistance < 0.0f) {
+					insideMask &= ~(1 << lane);
+				}
+			}
+		}
+#endif
+
+		int laneMask = node.laneMask & ~outsideMask;
+		for (int lane = 0; lane < 4; lane++) {
+			if (!(laneMask & (1 << lane))) {
+				continue;
+			}
+			int32_t child = node.child[lane];
+			if (child < 0) {
+				visible.push_back(~child);
+			}
+			else if (insideMask & (1 << lane)) {
+				collect(child, visible);
+			}
+			else {
+				stack[stackSize++] = child;
+			}
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef _OBJECT_BVH_H_
+#define _OBJECT_BVH_H_
+
+#include "Frustum.h"
+
+#include <cstdint>
+#include <vector>
+
+// Four-wide bounding volume hierarchy over object boxes for frustum culling.
+// Each node holds the boxes of its four children side by side, so one SIMD
+// plane test covers all of them; a child is another node or one object.
+// Moving objects are refit in place, walking from the object up to the
+// root; build again after many large moves.
+class ObjectBvh
+{
+public:
+	struct alignas(16) Node
+	{
+		float minX[4], minY[4], minZ[4];
+		float maxX[4], maxY[4], maxZ[4];
+		// node index, or ~object for an object
+		int32_t child[4];
+		int32_t parent;
+		int32_t parentLane;
+		// lanes in use
+		int32_t laneMask;
+	};
+
+	void build(const std::vector<Aabb>& boxes);
+	void clear();
+
+	// give one object a new box and refit the nodes above it
+	void refit(uint32_t object, const Aabb& box);
+
+	// objects whose boxes intersect the frustum, in tree order
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	size_t objectCount() const { return boxes.size(); }
+	size_t nodeCount() const { return nodes.size(); }
+
+private:
+	std::vector<Node> nodes;
+	std::vector<Aabb> boxes;
+	// node and lane holding each object
+	std::vector<int32_t> objectNode;
+	std::vector<int32_t> objectLane;
+	std::vector<glm::vec3> centers;
+
+	int32_t buildNode(uint32_t* objects, size_t count, int32_t parent, int32_t parentLane);
+	Aabb laneBounds(const Node& node, int lane) const;
+	void setLaneBounds(Node& node, int lane, const Aabb& box);
+	void collect(int32_t node, std::vector<uint32_t>& visible) const;
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "PointShadowMap.h"
+#include "Geometry.h"
+#include "Profiler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+// look direction and up vector of each cube face, in the order of
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+static const glm::vec3 faceDirections[6] = {
+	glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+	glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)
+};
+static const glm::vec3 faceUps[6] = {
+	glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+	glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0)
+};
+
+PointShadowMap::~PointShadowMap()
+{
+	if (framebuffer) {
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &cubeTexture);
+	}
+	glDeleteProgram(program);
+}
+
+bool PointShadowMap::load(const char* vertexFilePath, const char* fragmentFilePath, int cubeSize)
+{
+	program = LoadShaders(vertexFilePath, fragmentFilePath);
+	if (!program) {
+		return false;
+	}
+	modelLocation = glGetUniformLocation(program, "model");
+	viewProjectionLocation = glGetUniformLocation(program, "lightViewProjection");
+
+	size = cubeSize;
+	glGenTextures(1, &cubeTexture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+	for (int face = 0; face < 6; face++) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0,
+			GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	}
+	// depth comparisons filtered over 2x2 texels
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	// filtering across face edges
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	GLint previous = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X, cubeTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Shadow map framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+		return false;
+	}
+	invalidate();
+	return true;
+}
+
+void PointShadowMap::invalidate()
+{
+	std::fill(faceDirty, faceDirty + 6, true);
+}
+
+// faces that see any part of the box
+void PointShadowMap::invalidateBox(const Aabb& bounds)
+{
+	for (int face = 0; face < 6; face++) {
+		if (!faceDirty[face] && Frustum(faceViewProjection[face]).intersects(bounds)) {
+			faceDirty[face] = true;
+		}
+	}
+}
+
+int PointShadowMap::update(const glm::vec3& lightPosition, const std::vector<const Geometry*>& objects)
+{
+	if (!lightValid || lightPosition != lightPos) {
+		lightValid = true;
+		lightPos = lightPosition;
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
+		for (int face = 0; face < 6; face++) {
+			faceViewProjection[face] = projection
+				* glm::lookAt(lightPos, lightPos + faceDirections[face], faceUps[face]);
+		}
+		invalidate();
+	}
+
+	// casters that moved, changed mesh, appeared or went away
+	std::vector<CasterState> current;
+	for (const Geometry* object : objects) {
+		const Geometry* mesh = object->depthSource();
+		if (mesh == nullptr) {
+			continue;
+		}
+		CasterState state = { object, mesh, object->getModel(), object->worldBounds() };
+		current.push_back(state);
+	}
+	auto unchangedIn = [](const CasterState& state, const std::vector<CasterState>& list) {
+		return std::any_of(list.begin(), list.end(), [&](const CasterState& other) {
+			return state.object == other.object && state.mesh == other.mesh && state.model == other.model;
+		});
+	};
+	for (const CasterState& before : casters) {
+		if (!unchangedIn(before, current)) {
+			invalidateBox(before.bounds);
+		}
+	}
+	for (const CasterState& now : current) {
+		if (!unchangedIn(now, casters)) {
+			invalidateBox(now.bounds);
+		}
+	}
+	casters.swap(current);
+
+	lastFacesDrawn = 0;
+	if (std::none_of(faceDirty, faceDirty + 6, [](bool dirty) { return dirty; })) {
+		return 0;
+	}
+
+	GLint previousFramebuffer = 0;
+	GLint previousViewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, size, size);
+	// slope-scaled offset against acne on surfaces lit at a grazing angle
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(1.5f, 4.0f);
+	ShaderProgram::bind(program);
+
+	for (int face = 0; face < 6; face++) {
+		if (!faceDirty[face]) {
+			continue;
+		}
+		faceDirty[face] = false;
+		lastFacesDrawn++;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+			cubeTexture, 0);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, &faceViewProjection[face][0][0]);
+		PROFILE_COUNT_UNIFORMS(1);
+
+		Frustum frustum(faceViewProjection[face]);
+		for (const CasterState& caster : casters) {
+			if (frustum.intersects(caster.bounds)) {
+				caster.object->drawDepth(modelLocation);
+			}
+		}
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+	PROFILE_COUNT_SHADOW_FACES(lastFacesDrawn);
+	return lastFacesDrawn;
+}
+
+void PointShadowMap::bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + shadowMapUnit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void PointShadowMap::setUniforms(FrameUniforms& frame) const
+{
+	// the receiver is pushed out along its normal by about 1.5 texels, a
+	// texel being 2 / size of the distance to the light
+	frame.shadow = glm::vec4(1.0f, nearPlane, farPlane, 3.0f / size);
+}
@@ -0,0 +1,81 @@
+#ifndef _POINT_SHADOW_MAP_H_
+#define _POINT_SHADOW_MAP_H_
+
+#include "ShaderProgram.h"
+#include "Frustum.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class Geometry;
+
+// texture unit of the shadow cube read by the lit shaders
+const GLint shadowMapUnit = 6;
+
+// Shadows of the main (point) light: a depth cube map around the light,
+// drawn with a depth-only program from the casters' position streams. The
+// cube is kept between frames. Moving the light redraws all six faces; a
+// caster whose model matrix or mesh changed (or that appeared or went
+// away) only redraws the faces its old and new boxes fall into, and with
+// nothing changed no face is drawn at all.
+class PointShadowMap
+{
+private:
+	GLuint program = 0;
+	GLint modelLocation = -1;
+	GLint viewProjectionLocation = -1;
+	GLuint framebuffer = 0;
+	GLuint cubeTexture = 0;
+	int size = 0;
+
+	// light the faces were drawn from, and each face's view projection
+	bool lightValid = false;
+	glm::vec3 lightPos = glm::vec3(0.0f);
+	glm::mat4 faceViewProjection[6];
+	bool faceDirty[6] = {};
+
+	// casters as the cube last saw them
+	struct CasterState
+	{
+		const Geometry* object;
+		const Geometry* mesh;
+		glm::mat4 model;
+		Aabb bounds;
+	};
+	std::vector<CasterState> casters;
+
+	int lastFacesDrawn = 0;
+
+	void invalidateBox(const Aabb& bounds);
+
+public:
+	// distance of the cube's near and far planes from the light
+	float nearPlane = 0.1f;
+	float farPlane = 100.0f;
+
+	PointShadowMap() {}
+	~PointShadowMap();
+
+	PointShadowMap(const PointShadowMap&) = delete;
+	PointShadowMap& operator=(const PointShadowMap&) = delete;
+
+	// compile the depth-only program and allocate a cube of size x size
+	// texels per face
+	bool load(const char* vertexFilePath, const char* fragmentFilePath, int size = 1024);
+
+	// redraw the faces that are out of date for the light at lightPosition
+	// and these casters; restores the framebuffer and viewport. Returns the
+	// number of faces drawn.
+	int update(const glm::vec3& lightPosition, const std::vector<const Geometry*>& casters);
+	// draw every face on the next update
+	void invalidate();
+	int facesDrawn() const { return lastFacesDrawn; }
+
+	// bind the cube to shadowMapUnit and turn shadows on in the frame
+	// uniforms; shadows stay off in frames this is not called for
+	void bind() const;
+	void setUniforms(FrameUniforms& frame) const;
+};
+
+#endif
@@ -0,0 +1,443 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+
+typedef std::chrono::steady_clock Clock;
+
+// frames between issuing a GPU timer and reading it back
+static const int gpuLatency = 3;
+
+// section 0 is the whole frame, timed by beginFrame/endFrame
+static const int frameSection = 0;
+
+struct ProfileSection
+{
+	std::string name;
+	Clock::time_point cpuStart;
+	double cpuMs = -1.0;
+};
+
+// one timestamp pair around a GPU section
+struct GpuTimer
+{
+	int section;
+	GLuint queries[2];
+};
+
+// timers issued in one frame; the queries are reused gpuLatency frames later
+struct GpuFrame
+{
+	long long frame = -1;
+	std::vector<GpuTimer> timers;
+	size_t used = 0;
+	GLuint lastQuery = 0;
+};
+
+// what one frame measured; -1 for sections it did not time
+struct FrameRecord
+{
+	long long frame;
+	size_t drawCalls;
+	size_t triangles;
+	size_t uniformUploads;
+	size_t binds;
+	size_t stateCalls;
+	size_t skippedCalls;
+	size_t drawnObjects;
+	size_t culledObjects;
+	size_t shadowFaces;
+	std::vector<float> cpuMs;
+	std::vector<float> gpuMs;
+};
+
+bool Profiler::enabled = false;
+size_t Profiler::drawCalls = 0;
+size_t Profiler::triangleCount = 0;
+size_t Profiler::uniformUploads = 0;
+size_t Profiler::bindCalls = 0;
+size_t Profiler::stateCalls = 0;
+size_t Profiler::skippedCalls = 0;
+size_t Profiler::drawnObjects = 0;
+size_t Profiler::culledObjects = 0;
+size_t Profiler::shadowFaces = 0;
+
+static std::vector<ProfileSection> sections(1, ProfileSection{ "frame", Clock::time_point(), -1.0 });
+static GpuFrame gpuFrames[gpuLatency];
+// GPU timers open in the current frame, innermost last
+static std::vector<size_t> openGpuTimers;
+static std::deque<FrameRecord> records;
+static long long frameIndex = -1;
+static bool frameActive = false;
+static size_t droppedGpuFrames = 0;
+
+static FrameRecord* findRecord(long long frame)
+{
+	if (records.empty() || frame < records.front().frame || frame > records.back().frame) {
+		return nullptr;
+	}
+	return &records[(size_t)(frame - records.front().frame)];
+}
+
+// read a frame's timers if the GPU is done with them, never waiting for it
+static void resolveGpuFrame(GpuFrame& gpuFrame)
+{
+	if (gpuFrame.used == 0) {
+		return;
+	}
+	GLuint available = 0;
+	glGetQueryObjectuiv(gpuFrame.lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+	FrameRecord* record = findRecord(gpuFrame.frame);
+	if (!available || record == nullptr) {
+		droppedGpuFrames += available ? 0 : 1;
+		gpuFrame.used = 0;
+		return;
+	}
+
+	for (size_t i = 0; i < gpuFrame.used; i++) {
+		const GpuTimer& timer = gpuFrame.timers[i];
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(timer.queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(timer.queries[1], GL_QUERY_RESULT, &end);
+		if (record->gpuMs.size() <= (size_t)timer.section) {
+			record->gpuMs.resize(sections.size(), -1.0f);
+		}
+		float& ms = record->gpuMs[timer.section];
+		ms = std::max(ms, 0.0f) + (float)((end - start) / 1e6);
+	}
+	gpuFrame.used = 0;
+}
+
+void Profiler::beginFrame()
+{
+	if (!enabled) {
+		return;
+	}
+	frameActive = true;
+	frameIndex++;
+	for (ProfileSection& section : sections) {
+		section.cpuMs = -1.0;
+	}
+	drawCalls = 0;
+	triangleCount = 0;
+	uniformUploads = 0;
+	bindCalls = 0;
+	stateCalls = 0;
+	skippedCalls = 0;
+	drawnObjects = 0;
+	culledObjects = 0;
+	shadowFaces = 0;
+
+	// the slot this frame reuses was last filled gpuLatency frames ago
+	GpuFrame& gpuFrame = gpuFrames[frameIndex % gpuLatency];
+	resolveGpuFrame(gpuFrame);
+	gpuFrame.frame = frameIndex;
+	openGpuTimers.clear();
+
+	beginCpu(frameSection);
+	beginGpu(frameSection);
+}
+
+void Profiler::endFrame()
+{
+	if (!frameActive) {
+		return;
+	}
+	endGpu(frameSection);
+	endCpu(frameSection);
+	frameActive = false;
+
+	FrameRecord record;
+	record.frame = frameIndex;
+	record.drawCalls = drawCalls;
+	record.triangles = triangleCount;
+	record.uniformUploads = uniformUploads;
+	record.binds = bindCalls;
+	record.stateCalls = stateCalls;
+	record.skippedCalls = skippedCalls;
+	record.drawnObjects = drawnObjects;
+	record.culledObjects = culledObjects;
+	record.shadowFaces = shadowFaces;
+	record.cpuMs.reserve(sections.size());
+	for (const ProfileSection& section : sections) {
+		record.cpuMs.push_back((float)section.cpuMs);
+	}
+	record.gpuMs.assign(sections.size(), -1.0f);
+	records.push_back(std::move(record));
+	if (records.size() > (size_t)recordedFrames) {
+		records.pop_front();
+	}
+}
+
+int Profiler::section(const std::string& name)
+{
+	for (size_t i = 0; i < sections.size(); i++) {
+		if (sections[i].name == name) {
+			return (int)i;
+		}
+	}
+	ProfileSection section;
+	section.name = name;
+	sections.push_back(section);
+	return (int)sections.size() - 1;
+}
+
+void Profiler::beginCpu(int id)
+{
+	if (frameActive) {
+		sections[id].cpuStart = Clock::now();
+	}
+}
+
+// sections entered several times in a frame add up
+void Profiler::endCpu(int id)
+{
+	if (frameActive) {
+		ProfileSection& section = sections[id];
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - section.cpuStart).count();
+		section.cpuMs = std::max(section.cpuMs, 0.0) + ms;
+	}
+}
+
+void Profiler::recordCpu(int id, double ms)
+{
+	if (frameActive) {
+		ProfileSection& section = sections[id];
+		section.cpuMs = std::max(section.cpuMs, 0.0) + ms;
+	}
+}
+
+// timestamp pairs rather than GL_TIME_ELAPSED, which cannot nest
+void Profiler::beginGpu(int id)
+{
+	if (!frameActive) {
+		return;
+	}
+	GpuFrame& gpuFrame = gpuFrames[frameIndex % gpuLatency];
+	if (gpuFrame.used == gpuFrame.timers.size()) {
+		GpuTimer timer;
+		glGenQueries(2, timer.queries);
+		gpuFrame.timers.push_back(timer);
+	}
+	GpuTimer& timer = gpuFrame.timers[gpuFrame.used];
+	timer.section = id;
+	glQueryCounter(timer.queries[0], GL_TIMESTAMP);
+	gpuFrame.lastQuery = timer.queries[0];
+	openGpuTimers.push_back(gpuFrame.used++);
+}
+
+void Profiler::endGpu(int)
+{
+	if (!frameActive || openGpuTimers.empty()) {
+		return;
+	}
+	GpuFrame& gpuFrame = gpuFrames[frameIndex % gpuLatency];
+	GpuTimer& timer = gpuFrame.timers[openGpuTimers.back()];
+	openGpuTimers.pop_back();
+	glQueryCounter(timer.queries[1], GL_TIMESTAMP);
+	gpuFrame.lastQuery = timer.queries[1];
+}
+
+// statistics of a section over the last frames recorded
+static ProfileStats computeStats(int id, bool gpu, size_t frames)
+{
+	std::vector<float> values;
+	size_t first = records.size() > frames ? records.size() - frames : 0;
+	for (size_t i = first; i < records.size(); i++) {
+		const std::vector<float>& ms = gpu ? records[i].gpuMs : records[i].cpuMs;
+		if ((size_t)id < ms.size() && ms[id] >= 0.0f) {
+			values.push_back(ms[id]);
+		}
+	}
+
+	ProfileStats stats;
+	stats.samples = (int)values.size();
+	if (values.empty()) {
+		return stats;
+	}
+	std::sort(values.begin(), values.end());
+	double sum = 0.0;
+	for (float value : values) {
+		sum += value;
+	}
+	size_t n = values.size();
+	stats.min = values.front();
+	stats.avg = sum / n;
+	double squares = 0.0;
+	for (float value : values) {
+		squares += (value - stats.avg) * (value - stats.avg);
+	}
+	stats.stddev = std::sqrt(squares / n);
+	stats.p95 = values[(size_t)std::ceil(0.95 * n) - 1];
+	stats.p99 = values[(size_t)std::ceil(0.99 * n) - 1];
+	return stats;
+}
+
+ProfileStats Profiler::cpuStats(int id)
+{
+	return computeStats(id, false, statsFrames);
+}
+
+ProfileStats Profiler::gpuStats(int id)
+{
+	return computeStats(id, true, statsFrames);
+}
+
+std::vector<std::string> Profiler::summary()
+{
+	std::vector<std::string> lines;
+	char line[160];
+
+	snprintf(line, sizeof(line), "%-16s %8s %8s %8s %8s %8s", "MS", "MIN", "AVG", "P95", "P99", "SD");
+	lines.push_back(line);
+	for (size_t i = 0; i < sections.size(); i++) {
+		for (int gpu = 0; gpu < 2; gpu++) {
+			ProfileStats stats = computeStats((int)i, gpu != 0, statsFrames);
+			if (stats.samples == 0) {
+				continue;
+			}
+			std::string name = sections[i].name + (gpu ? " GPU" : " CPU");
+			snprintf(line, sizeof(line), "%-16s %8.3f %8.3f %8.3f %8.3f %8.3f", name.c_str(), stats.min, stats.avg,
+				stats.p95, stats.p99, stats.stddev);
+			lines.push_back(line);
+		}
+	}
+
+	if (!records.empty()) {
+		const FrameRecord& last = records.back();
+		snprintf(line, sizeof(line), "DRAWS %zu  TRIANGLES %zu  UNIFORMS %zu  BINDS %zu", last.drawCalls,
+			last.triangles, last.uniformUploads, last.binds);
+		lines.push_back(line);
+		snprintf(line, sizeof(line), "STATE CALLS %zu  SKIPPED %zu", last.stateCalls, last.skippedCalls);
+		lines.push_back(line);
+		snprintf(line, sizeof(line), "OBJECTS DRAWN %zu  CULLED %zu  SHADOW FACES %zu", last.drawnObjects,
+			last.culledObjects, last.shadowFaces);
+		lines.push_back(line);
+	}
+	snprintf(line, sizeof(line), "GPU FRAMES DROPPED %zu", droppedGpuFrames);
+	lines.push_back(line);
+	return lines;
+}
+
+bool Profiler::dumpCsv(const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file) {
+		std::cerr << "Failed to write " << filename << std::endl;
+		return false;
+	}
+
+	file << "frame,draw_calls,triangles,uniform_uploads,binds,state_calls,skipped_calls,objects_drawn,objects_culled,shadow_faces";
+	for (const ProfileSection& section : sections) {
+		file << "," << section.name << "_cpu_ms," << section.name << "_gpu_ms";
+	}
+	file << "\n";
+
+	for (const FrameRecord& record : records) {
+		file << record.frame << "," << record.drawCalls << "," << record.triangles << "," << record.uniformUploads
+			<< "," << record.binds << "," << record.stateCalls << "," << record.skippedCalls << ","
+			<< record.drawnObjects << "," << record.culledObjects << "," << record.shadowFaces;
+		for (size_t i = 0; i < sections.size(); i++) {
+			file << ",";
+			if (i < record.cpuMs.size() && record.cpuMs[i] >= 0.0f) {
+				file << record.cpuMs[i];
+			}
+			file << ",";
+			if (i < record.gpuMs.size() && record.gpuMs[i] >= 0.0f) {
+				file << record.gpuMs[i];
+			}
+		}
+		file << "\n";
+	}
+	std::cout << "Profile of " << records.size() << " frames written to " << filename << std::endl;
+	return (bool)file;
+}
+
+static std::string jsonString(const std::string& text)
+{
+	std::string quoted = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			quoted += '\\';
+		}
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+static void writeJsonStats(std::ofstream& file, const ProfileStats& stats)
+{
+	file << "{\"min\": " << stats.min << ", \"avg\": " << stats.avg << ", \"p95\": " << stats.p95
+		<< ", \"p99\": " << stats.p99 << ", \"stddev\": " << stats.stddev << ", \"samples\": " << stats.samples
+		<< "}";
+}
+
+// writes the times of one frame as {"section": ms, ...}
+static void writeJsonTimes(std::ofstream& file, const std::vector<float>& ms)
+{
+	file << "{";
+	bool first = true;
+	for (size_t i = 0; i < ms.size() && i < sections.size(); i++) {
+		if (ms[i] >= 0.0f) {
+			file << (first ? "" : ", ") << jsonString(sections[i].name) << ": " << ms[i];
+			first = false;
+		}
+	}
+	file << "}";
+}
+
+bool Profiler::dumpJson(const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file) {
+		std::cerr << "Failed to write " << filename << std::endl;
+		return false;
+	}
+
+	// statistics over every recorded frame, then the frames themselves
+	file << "{\n\"sections\": [\n";
+	for (size_t i = 0; i < sections.size(); i++) {
+		file << "  {\"name\": " << jsonString(sections[i].name) << ", \"cpu_ms\": ";
+		writeJsonStats(file, computeStats((int)i, false, records.size()));
+		file << ", \"gpu_ms\": ";
+		writeJsonStats(file, computeStats((int)i, true, records.size()));
+		file << "}" << (i + 1 < sections.size() ? "," : "") << "\n";
+	}
+	file << "],\n\"gpu_frames_dropped\": " << droppedGpuFrames << ",\n\"frames\": [\n";
+	for (size_t i = 0; i < records.size(); i++) {
+		const FrameRecord& record = records[i];
+		file << "  {\"frame\": " << record.frame << ", \"draw_calls\": " << record.drawCalls
+			<< ", \"triangles\": " << record.triangles << ", \"uniform_uploads\": " << record.uniformUploads
+			<< ", \"binds\": " << record.binds << ", \"state_calls\": " << record.stateCalls
+			<< ", \"skipped_calls\": " << record.skippedCalls
+			<< ", \"objects_drawn\": " << record.drawnObjects << ", \"objects_culled\": " << record.culledObjects
+			<< ", \"shadow_faces\": " << record.shadowFaces
+			<< ", \"cpu_ms\": ";
+		writeJsonTimes(file, record.cpuMs);
+		file << ", \"gpu_ms\": ";
+		writeJsonTimes(file, record.gpuMs);
+		file << "}" << (i + 1 < records.size() ? "," : "") << "\n";
+	}
+	file << "]\n}\n";
+	std::cout << "Profile of " << records.size() << " frames written to " << filename << std::endl;
+	return (bool)file;
+}
+
+void Profiler::reset()
+{
+	for (GpuFrame& gpuFrame : gpuFrames) {
+		for (GpuTimer& timer : gpuFrame.timers) {
+			glDeleteQueries(2, timer.queries);
+		}
+		gpuFrame = GpuFrame();
+	}
+	openGpuTimers.clear();
+	records.clear();
+	droppedGpuFrames = 0;
+	frameActive = false;
+}
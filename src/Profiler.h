@@ -0,0 +1,199 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+#include <string>
+#include <vector>
+
+// Build with PROFILER_ENABLED 0 to compile every PROFILE_* macro out.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// min/avg/p95/p99 over the recent frames, in milliseconds, and the standard
+// deviation (the jitter of frame times)
+struct ProfileStats
+{
+	double min = 0.0;
+	double avg = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double stddev = 0.0;
+	int samples = 0;
+};
+
+// Per-frame profiler: named sections timed on the CPU and, optionally, on
+// the GPU with timestamp query pairs, plus draw/triangle/uniform counters.
+// GPU results are read back three frames later, and only if they are
+// available by then, so the profiler never waits for the GPU. Everything is
+// a no-op while enabled is false.
+class Profiler
+{
+public:
+	static bool enabled;
+
+	// frames kept for the rolling statistics and for dumps
+	static const int statsFrames = 240;
+	static const int recordedFrames = 3600;
+
+	static void beginFrame();
+	static void endFrame();
+
+	// id of a named section, registering it the first time
+	static int section(const std::string& name);
+
+	static void beginCpu(int section);
+	static void endCpu(int section);
+	static void beginGpu(int section);
+	static void endGpu(int section);
+	// a CPU time measured outside a scope, e.g. across frames, added to the
+	// section in the frame in progress
+	static void recordCpu(int section, double ms);
+
+	static void countDraw(size_t triangles)
+	{
+		if (enabled) {
+			drawCalls++;
+			triangleCount += triangles;
+		}
+	}
+	static void countUniforms(int uploads)
+	{
+		if (enabled) {
+			uniformUploads += uploads;
+		}
+	}
+	// vertex array and buffer binds
+	static void countBinds(int binds)
+	{
+		if (enabled) {
+			bindCalls += binds;
+		}
+	}
+	// state changes a RenderQueue made and the redundant ones it left out
+	static void countStateCalls(size_t issued, size_t skipped)
+	{
+		if (enabled) {
+			stateCalls += issued;
+			skippedCalls += skipped;
+		}
+	}
+	// objects (or instances) that passed and failed frustum culling
+	static void countObjects(size_t drawn, size_t culled)
+	{
+		if (enabled) {
+			drawnObjects += drawn;
+			culledObjects += culled;
+		}
+	}
+	// shadow map faces drawn again this frame
+	static void countShadowFaces(int faces)
+	{
+		if (enabled) {
+			shadowFaces += faces;
+		}
+	}
+
+	// counters of the frame in progress, or of the last one after endFrame
+	static size_t frameDrawCalls() { return drawCalls; }
+	static size_t frameTriangles() { return triangleCount; }
+	static size_t frameUniformUploads() { return uniformUploads; }
+	static size_t frameBinds() { return bindCalls; }
+	static size_t frameStateCalls() { return stateCalls; }
+	static size_t frameSkippedCalls() { return skippedCalls; }
+	static size_t frameDrawnObjects() { return drawnObjects; }
+	static size_t frameCulledObjects() { return culledObjects; }
+	static size_t frameShadowFaces() { return shadowFaces; }
+
+	static ProfileStats cpuStats(int section);
+	static ProfileStats gpuStats(int section);
+
+	// lines for the text overlay
+	static std::vector<std::string> summary();
+
+	// every recorded frame, one row per frame / one object per frame
+	static bool dumpCsv(const std::string& filename);
+	static bool dumpJson(const std::string& filename);
+
+	// drop the recorded frames and the GPU queries; needs the GL context
+	static void reset();
+
+private:
+	static size_t drawCalls;
+	static size_t triangleCount;
+	static size_t uniformUploads;
+	static size_t bindCalls;
+	static size_t stateCalls;
+	static size_t skippedCalls;
+	static size_t drawnObjects;
+	static size_t culledObjects;
+	static size_t shadowFaces;
+};
+
+// times the enclosing scope on the CPU, and on the GPU if gpu is set
+class ProfileScope
+{
+private:
+	int id;
+	bool gpu;
+	bool active;
+
+public:
+	ProfileScope(int section, bool gpu)
+		: id(section), gpu(gpu), active(Profiler::enabled)
+	{
+		if (active) {
+			Profiler::beginCpu(id);
+			if (gpu) {
+				Profiler::beginGpu(id);
+			}
+		}
+	}
+	~ProfileScope()
+	{
+		if (active) {
+			if (gpu) {
+				Profiler::endGpu(id);
+			}
+			Profiler::endCpu(id);
+		}
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#if PROFILER_ENABLED
+// time the rest of the scope under a constant section name
+#define PROFILE_SCOPE(name) \
+	static const int PROFILE_CONCAT(profileSection, __LINE__) = Profiler::section(name); \
+	ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileSection, __LINE__), false)
+#define PROFILE_GPU_SCOPE(name) \
+	static const int PROFILE_CONCAT(profileSection, __LINE__) = Profiler::section(name); \
+	ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileSection, __LINE__), true)
+// same with a section id resolved beforehand, e.g. one per object
+#define PROFILE_GPU_SECTION(id) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(id, true)
+#define PROFILE_COUNT_DRAW(triangles) Profiler::countDraw(triangles)
+#define PROFILE_COUNT_UNIFORMS(uploads) Profiler::countUniforms(uploads)
+#define PROFILE_COUNT_BINDS(binds) Profiler::countBinds(binds)
+#define PROFILE_COUNT_STATE_CALLS(issued, skipped) Profiler::countStateCalls(issued, skipped)
+#define PROFILE_COUNT_OBJECTS(drawn, culled) Profiler::countObjects(drawn, culled)
+#define PROFILE_COUNT_SHADOW_FACES(faces) Profiler::countShadowFaces(faces)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#define PROFILE_GPU_SECTION(id)
+#define PROFILE_COUNT_DRAW(triangles)
+#define PROFILE_COUNT_UNIFORMS(uploads)
+#define PROFILE_COUNT_BINDS(binds)
+#define PROFILE_COUNT_STATE_CALLS(issued, skipped)
+#define PROFILE_COUNT_OBJECTS(drawn, culled)
+#define PROFILE_COUNT_SHADOW_FACES(faces)
+#endif
+
+#endif
@@ -0,0 +1,208 @@
+#include "RenderQueue.h"
+#include "MeshArena.h"
+#include "Profiler.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+// key layout, from the top: 4 bits of pass, 10 of program, 6 of material
+// (0 for none), 20 of vertex array and 24 of depth. Names too large for their
+// field only sort less well; the state itself is compared in full.
+static const int passShift = 60;
+static const int programShift = 50;
+static const int materialShift = 44;
+static const int vertexArrayShift = 24;
+
+size_t RenderQueueStats::totalIssued() const
+{
+	size_t total = 0;
+	for (size_t count : issued) {
+		total += count;
+	}
+	return total;
+}
+
+size_t RenderQueueStats::totalSkipped() const
+{
+	size_t total = 0;
+	for (size_t count : skipped) {
+		total += count;
+	}
+	return total;
+}
+
+uint64_t RenderQueue::makeKey(int pass, GLuint program, int material, GLuint vertexArray, float depth)
+{
+	// positive floats order like their bits; keep the top 24 of 31
+	float distance = std::max(depth, 0.0f);
+	uint32_t bits;
+	memcpy(&bits, &distance, sizeof(bits));
+	return ((uint64_t)(pass & 0xf) << passShift) | ((uint64_t)(program & 0x3ff) << programShift)
+		| ((uint64_t)((material + 1) & 0x3f) << materialShift)
+		| ((uint64_t)(vertexArray & 0xfffff) << vertexArrayShift) | (bits >> 7);
+}
+
+void RenderQueue::clear()
+{
+	packets.clear();
+	keys.clear();
+	counters = RenderQueueStats();
+}
+
+void RenderQueue::submit(int pass, float depth, const DrawPacket& packet)
+{
+	uint64_t key = makeKey(pass, packet.program->id(), packet.material, packet.vertexArray, depth);
+	keys.push_back(RenderKey{ key, (uint32_t)packets.size() });
+	packets.push_back(packet);
+	counters.packets++;
+}
+
+void RadixSortKeys(std::vector<RenderKey>& keys, std::vector<RenderKey>& scratch)
+{
+	size_t count = keys.size();
+	if (count < 2) {
+		return;
+	}
+	scratch.resize(count);
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t offsets[256] = {};
+		for (const RenderKey& key : keys) {
+			offsets[(key.key >> shift) & 0xff]++;
+		}
+		// in a frame most bytes are the same in every key: the pass, the
+		// program, the high bits of the depth
+		if (offsets[(keys[0].key >> shift) & 0xff] == count) {
+			continue;
+		}
+		size_t offset = 0;
+		for (size_t& bucket : offsets) {
+			size_t size = bucket;
+			bucket = offset;
+			offset += size;
+		}
+		for (const RenderKey& key : keys) {
+			scratch[offsets[(key.key >> shift) & 0xff]++] = key;
+		}
+		keys.swap(scratch);
+	}
+}
+
+namespace
+{
+	// per-object uniforms a program was given during one execute(); uniform
+	// values belong to the program, so switching back to it keeps them
+	struct ProgramUniforms
+	{
+		const ShaderProgram* program = nullptr;
+		bool known = false;
+		glm::mat4 model;
+		glm::mat3 normalMatrix;
+		glm::mat4 dequantize;
+		int material = -1;
+	};
+}
+
+void RenderQueue::execute(int pass)
+{
+	auto byKey = [](const RenderKey& item, uint64_t key) { return item.key < key; };
+	auto first = std::lower_bound(keys.begin(), keys.end(), (uint64_t)pass << passShift, byKey);
+	auto last = pass + 1 < 16 ? std::lower_bound(first, keys.end(), (uint64_t)(pass + 1) << passShift, byKey)
+		: keys.end();
+
+	// what the previous packet left; nothing is known at the start
+	const ShaderProgram* program = nullptr;
+	bool vertexArrayKnown = false;
+	GLuint vertexArray = 0;
+	// instance attributes enabled on the bound vertex array, which other
+	// draws from it must not see
+	const InstanceBuffer* attributes = nullptr;
+	std::vector<ProgramUniforms> programUniforms;
+	size_t issuedBefore = counters.totalIssued();
+	size_t skippedBefore = counters.totalSkipped();
+	size_t uniformsBefore = counters.issued[stateCallUniform];
+
+	// counts a call as issued or skipped; true if it has to be made
+	auto needed = [this](bool changed, RenderStateCall call) {
+		(changed ? counters.issued : counters.skipped)[call]++;
+		return changed;
+	};
+	auto disableAttributes = [this, &attributes]() {
+		if (attributes) {
+			InstanceBuffer::unbindAttributes();
+			counters.issued[stateCallInstanceAttributes]++;
+			attributes = nullptr;
+		}
+	};
+
+	for (auto item = first; item != last; ++item) {
+		const DrawPacket& packet = packets[item->packet];
+
+		if (needed(packet.program != program, stateCallProgram)) {
+			packet.program->use();
+			program = packet.program;
+		}
+		if (needed(!vertexArrayKnown || packet.vertexArray != vertexArray, stateCallVertexArray)) {
+			disableAttributes();
+			MeshArena::bindVertexArray(packet.vertexArray);
+			vertexArray = packet.vertexArray;
+			vertexArrayKnown = true;
+		}
+		if (!packet.instances) {
+			disableAttributes();
+		}
+		else if (needed(packet.instances != attributes, stateCallInstanceAttributes)) {
+			packet.instances->bindAttributes();
+			attributes = packet.instances;
+		}
+
+		auto state = std::find_if(programUniforms.begin(), programUniforms.end(),
+			[&packet](const ProgramUniforms& uniforms) { return uniforms.program == packet.program; });
+		if (state == programUniforms.end()) {
+			ProgramUniforms uniforms = ProgramUniforms();
+			uniforms.program = packet.program;
+			programUniforms.push_back(uniforms);
+			state = programUniforms.end() - 1;
+		}
+		bool known = state->known;
+		if (needed(!known || packet.model != state->model, stateCallUniform)) {
+			glUniformMatrix4fv(program->location(uniformModel), 1, GL_FALSE, glm::value_ptr(packet.model));
+			state->model = packet.model;
+		}
+		if (needed(!known || packet.normalMatrix != state->normalMatrix, stateCallUniform)) {
+			glUniformMatrix3fv(program->location(uniformNormalMatrix), 1, GL_FALSE,
+				glm::value_ptr(packet.normalMatrix));
+			state->normalMatrix = packet.normalMatrix;
+		}
+		if (packet.instances) {
+			if (needed(!known || packet.dequantize != state->dequantize, stateCallUniform)) {
+				glUniformMatrix4fv(program->location(uniformDequantize), 1, GL_FALSE,
+					glm::value_ptr(packet.dequantize));
+				state->dequantize = packet.dequantize;
+			}
+		}
+		else if (needed(!known || packet.material != state->material, stateCallUniform)) {
+			glUniform1i(program->location(uniformMaterial), packet.material);
+			state->material = packet.material;
+		}
+		// a program draws either single objects or instances, so the
+		// uniform it leaves unset is never compared
+		state->known = true;
+
+		PROFILE_GPU_SECTION(packet.profileSection);
+		PROFILE_COUNT_DRAW((size_t)packet.indexCount / 3 * (packet.instances ? packet.instanceCount : 1));
+		if (packet.instances) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.indexCount, packet.indexType, packet.indices,
+				packet.instanceCount, packet.baseVertex);
+		}
+		else {
+			glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, packet.indexType, packet.indices,
+				packet.baseVertex);
+		}
+	}
+	disableAttributes();
+
+	PROFILE_COUNT_UNIFORMS((int)(counters.issued[stateCallUniform] - uniformsBefore));
+	PROFILE_COUNT_STATE_CALLS(counters.totalIssued() - issuedBefore, counters.totalSkipped() - skippedBefore);
+}
@@ -0,0 +1,109 @@
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+
+#include "ShaderProgram.h"
+#include "InstanceBuffer.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Passes of a frame in the order they are drawn; the top bits of the key.
+// The deferred lighting pass runs between the two.
+enum RenderPass
+{
+	// lit objects into the G-buffer of a DeferredRenderer
+	renderPassGBuffer,
+	// shaded objects into the bound framebuffer
+	renderPassForward,
+	renderPassCount
+};
+
+// Everything one draw needs, captured at submit time so the queue can draw
+// it later in any order.
+struct DrawPacket
+{
+	const ShaderProgram* program = nullptr;
+	GLuint vertexArray = 0;
+	// instance transforms and materials, or nullptr for a single object
+	const InstanceBuffer* instances = nullptr;
+	GLsizei instanceCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	GLsizei indexCount = 0;
+	const void* indices = nullptr;
+	GLint baseVertex = 0;
+	// entry of materialTable, -1 for instances, which bring their own
+	int material = -1;
+	// profiler section timing the draw
+	int profileSection = 0;
+	glm::mat4 model = glm::mat4(1.0f);
+	glm::mat3 normalMatrix = glm::mat3(1.0f);
+	// instanced draws only; single objects fold it into model
+	glm::mat4 dequantize = glm::mat4(1.0f);
+};
+
+// GL calls a queue made and the ones it found redundant, by kind
+enum RenderStateCall
+{
+	stateCallProgram,
+	stateCallVertexArray,
+	stateCallInstanceAttributes,
+	stateCallUniform,
+	stateCallCount
+};
+
+struct RenderQueueStats
+{
+	size_t packets = 0;
+	size_t issued[stateCallCount] = {};
+	size_t skipped[stateCallCount] = {};
+
+	size_t totalIssued() const;
+	size_t totalSkipped() const;
+};
+
+// a packet's sort key and its index in the queue
+struct RenderKey
+{
+	uint64_t key;
+	uint32_t packet;
+};
+
+// LSD radix sort by key, a byte at a time, skipping the bytes all keys share;
+// stable, so equal keys keep their submit order. scratch is reused storage.
+void RadixSortKeys(std::vector<RenderKey>& keys, std::vector<RenderKey>& scratch);
+
+// Draws of a frame, collected first and then issued sorted by a 64-bit key:
+// pass, program, material, vertex array, then view depth, nearest first, so
+// draws sharing state run back to back and opaque surfaces hide what is
+// behind them before it is shaded. Programs, vertex arrays, instance
+// attributes and per-object uniforms are only set when they differ from
+// what the previous draw left.
+class RenderQueue
+{
+private:
+	std::vector<DrawPacket> packets;
+	std::vector<RenderKey> keys;
+	// the other half of each radix pass
+	std::vector<RenderKey> scratch;
+	RenderQueueStats counters;
+
+public:
+	// the key fields, highest first; the depth is the distance along the view
+	// direction, behind the eye counting as 0
+	static uint64_t makeKey(int pass, GLuint program, int material, GLuint vertexArray, float depth);
+
+	// drop the packets and the counters of the last frame
+	void clear();
+	void submit(int pass, float depth, const DrawPacket& packet);
+	// by key, with RadixSortKeys
+	void sort() { RadixSortKeys(keys, scratch); }
+	// issue the packets of one pass in key order; call sort() first
+	void execute(int pass);
+
+	size_t size() const { return packets.size(); }
+	const RenderQueueStats& stats() const { return counters; }
+};
+
+#endif
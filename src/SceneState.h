@@ -0,0 +1,68 @@
+#ifndef _SCENE_STATE_H_
+#define _SCENE_STATE_H_
+
+#include "Material.h"
+#include "Transform.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// the models keys 1, 2 and 3 select, then the light sphere
+enum SceneModel
+{
+	sceneBunny,
+	sceneSandal,
+	sceneBear,
+	sceneLight,
+	sceneModelCount
+};
+
+// placement and look of one model
+struct ModelState
+{
+	Transform transform;
+	// transform composed, redone only when it changes
+	glm::mat4 model = glm::mat4(1.0f);
+	int material = materialChrome;
+	bool showsNormals = false;
+};
+
+// Everything a frame is drawn from. The thread handling input owns one and
+// changes it; the render thread draws from copies of it, so nothing here
+// points into objects the renderer uses.
+struct SceneState
+{
+	// counts the copies handed out; a frame drawn again from the same one
+	// shows nothing new
+	uint64_t sequence = 0;
+
+	ModelState models[sceneModelCount];
+	// which of the first three is drawn
+	int current = sceneBunny;
+	// where the light sphere is, the light's position in the shaders
+	glm::vec3 lightPos = glm::vec3(0.0f);
+
+	// framebuffer size and the projection for it
+	int width = 0;
+	int height = 0;
+	glm::mat4 projection = glm::mat4(1.0f);
+
+	// options set by keys and on the command line
+	int renderMode = 0;
+	int instanceCount = 0;
+	int pointLightCount = 0;
+	bool useDeferred = false;
+	bool useShadows = true;
+	bool cullObjects = true;
+	bool compactVertices = false;
+	bool profiling = false;
+	// incremented for every dump of the profile asked for
+	int profileDumps = 0;
+
+	// glfwGetTime() of the oldest input in this state that no frame has
+	// shown yet, for the input latency; 0 if there is none
+	double inputTime = 0.0;
+};
+
+#endif
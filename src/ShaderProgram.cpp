@@ -0,0 +1,183 @@
+#include "ShaderProgram.h"
+#include "ClusteredLights.h"
+#include "DeferredRenderer.h"
+#include "PointShadowMap.h"
+#include "Profiler.h"
+
+#include <chrono>
+#include <thread>
+
+
+// names of the ShaderUniform entries in the shaders
+static const char* uniformNames[shaderUniformCount] = {
+	"model",
+	"normalMatrix",
+	"material",
+	"dequantize",
+	"inverseViewProjection",
+};
+
+GLuint ShaderProgram::current = 0;
+
+ShaderProgram::~ShaderProgram()
+{
+	if (current == program) {
+		current = 0;
+	}
+	glDeleteProgram(program);
+}
+
+bool ShaderProgram::load(const char* vertexFilePath, const char* fragmentFilePath,
+	const std::vector<std::string>& defines)
+{
+	return begin(vertexFilePath, fragmentFilePath, defines) && finish();
+}
+
+bool ShaderProgram::begin(const char* vertexFilePath, const char* fragmentFilePath,
+	const std::vector<std::string>& defines)
+{
+	return BeginLoadShaders(vertexFilePath, fragmentFilePath, defines, pending);
+}
+
+bool ShaderProgram::finish()
+{
+	program = FinishLoadShaders(pending);
+	if (!program) {
+		return false;
+	}
+
+	// -1 for uniforms the shaders don't use; glUniform ignores those
+	for (int i = 0; i < shaderUniformCount; i++) {
+		locations[i] = glGetUniformLocation(program, uniformNames[i]);
+	}
+
+	GLuint blockIndex = glGetUniformBlockIndex(program, "FrameUniforms");
+	if (blockIndex == GL_INVALID_INDEX) {
+		std::cerr << "Shader program has no FrameUniforms block" << std::endl;
+		return false;
+	}
+	glUniformBlockBinding(program, blockIndex, frameUniformsBinding);
+
+	// variants that don't shade have no materials
+	blockIndex = glGetUniformBlockIndex(program, "Materials");
+	if (blockIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, blockIndex, materialsBinding);
+	}
+
+	// the point light buffer textures, the G-buffer and the shadow cube have
+	// fixed units
+	const char* samplerNames[] = { "lightData", "lightClusters", "lightIndices", "gbufferDepth", "gbufferSurface",
+		"gbufferNormal", "shadowMap" };
+	const GLint samplerUnits[] = { lightDataUnit, lightClustersUnit, lightIndicesUnit, gbufferDepthUnit,
+		gbufferSurfaceUnit, gbufferNormalUnit, shadowMapUnit };
+	for (int i = 0; i < 7; i++) {
+		GLint location = glGetUniformLocation(program, samplerNames[i]);
+		if (location >= 0) {
+			bind(program);
+			glUniform1i(location, samplerUnits[i]);
+		}
+	}
+	return true;
+}
+
+void ShaderProgram::use() const
+{
+	bind(program);
+}
+
+void ShaderProgram::bind(GLuint program)
+{
+	if (current != program) {
+		glUseProgram(program);
+		current = program;
+	}
+}
+
+bool ShaderVariants::load(const char* vertexFilePath, const char* fragmentFilePath)
+{
+	return begin(vertexFilePath, fragmentFilePath) && finish();
+}
+
+std::vector<std::string> ShaderVariantDefines(int flags)
+{
+	std::vector<std::string> defines;
+	defines.push_back("MATERIAL_COUNT " + std::to_string((int)materialCount));
+	if (flags & shaderNormalColoring) {
+		defines.push_back("NORMAL_COLORING");
+	}
+	if (flags & shaderLightProxy) {
+		defines.push_back("LIGHT_PROXY");
+	}
+	if (flags & shaderInstanced) {
+		defines.push_back("INSTANCED");
+	}
+	if (flags & shaderGBuffer) {
+		defines.push_back("GBUFFER");
+	}
+	return defines;
+}
+
+bool ShaderVariantBuilt(int flags)
+{
+	return !((flags & shaderGBuffer) && (flags & (shaderNormalColoring | shaderLightProxy)));
+}
+
+bool ShaderVariants::begin(const char* vertexFilePath, const char* fragmentFilePath)
+{
+	for (int flags = 0; flags < shaderVariantCount; flags++) {
+		if (!ShaderVariantBuilt(flags)) {
+			continue;
+		}
+		if (!programs[flags].begin(vertexFilePath, fragmentFilePath, ShaderVariantDefines(flags))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ShaderVariants::finish()
+{
+	bool ok = true;
+	int left = 0;
+	for (ShaderProgram& program : programs) {
+		left += program.pendingLoad();
+	}
+	while (left > 0) {
+		// without parallel compiles every one is ready, and this finishes
+		// them in order
+		bool waited = true;
+		for (ShaderProgram& program : programs) {
+			if (program.pendingLoad() && program.ready()) {
+				ok = program.finish() && ok;
+				left--;
+				waited = false;
+			}
+		}
+		if (waited) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	return ok;
+}
+
+FrameUniformBuffer::FrameUniformBuffer()
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frameUniformsBinding, buffer);
+}
+
+FrameUniformBuffer::~FrameUniformBuffer()
+{
+	glDeleteBuffers(1, &buffer);
+}
+
+void FrameUniformBuffer::update(const FrameUniforms& uniforms)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &uniforms);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	PROFILE_COUNT_UNIFORMS(1);
+}
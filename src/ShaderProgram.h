@@ -0,0 +1,142 @@
+#ifndef _SHADER_PROGRAM_H_
+#define _SHADER_PROGRAM_H_
+
+#include "shader.h"
+#include "Material.h"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Per-frame constants shared by every draw, laid out like the std140
+// FrameUniforms block in the shaders (vec3s padded to vec4).
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 cameraPos;
+	glm::vec4 lightPos;
+	// clustered point lights (LightClusters): tiles in x and y, depth slices
+	// and the light count, 0 for none; the near depth and slices per log
+	// depth unit; the viewport size and tiles per pixel
+	glm::ivec4 clusterGrid = glm::ivec4(0);
+	glm::vec4 clusterDepth = glm::vec4(0.0f);
+	glm::vec4 clusterScreen = glm::vec4(0.0f);
+	// main light shadows (PointShadowMap): on if x is set, the cube's near
+	// and far planes, and the normal offset per unit of light distance
+	glm::vec4 shadow = glm::vec4(0.0f);
+};
+
+// uniform buffer binding point of the FrameUniforms block
+const GLuint frameUniformsBinding = 0;
+
+// uniforms set per object, resolved once when the program is linked
+enum ShaderUniform
+{
+	uniformModel,
+	uniformNormalMatrix,
+	uniformMaterial,
+	uniformDequantize,
+	uniformInverseViewProjection,
+	shaderUniformCount
+};
+
+// Program built by LoadShaders with its uniform locations cached.
+class ShaderProgram
+{
+private:
+	GLuint program = 0;
+	GLint locations[shaderUniformCount] = {};
+	// set between begin() and finish()
+	PendingProgram pending;
+
+	// program last bound through use()
+	static GLuint current;
+
+public:
+	ShaderProgram() {}
+	~ShaderProgram();
+
+	ShaderProgram(const ShaderProgram&) = delete;
+	ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+	// compile and link with the given variant defines, then look up the
+	// uniforms and attach the FrameUniforms and Materials blocks to their
+	// binding points
+	bool load(const char* vertexFilePath, const char* fragmentFilePath,
+		const std::vector<std::string>& defines = std::vector<std::string>());
+	// load() in two steps, so the driver can build the program while the
+	// caller does other work: begin() starts compiling (BeginLoadShaders),
+	// ready() tells whether finish() would wait
+	bool begin(const char* vertexFilePath, const char* fragmentFilePath,
+		const std::vector<std::string>& defines = std::vector<std::string>());
+	bool ready() const { return ShadersReady(pending); }
+	bool finish();
+	bool pendingLoad() const { return pending.program != 0; }
+
+	GLuint id() const { return program; }
+	GLint location(ShaderUniform uniform) const { return locations[uniform]; }
+
+	// glUseProgram, skipped when the program is already bound
+	void use() const;
+	// same for programs not wrapped in a ShaderProgram, keeping use() in sync
+	static void bind(GLuint program);
+};
+
+// features a shader variant is compiled with; the flags combine into the
+// variant's index
+enum ShaderVariantFlags
+{
+	// show the normals instead of lighting (NORMAL_COLORING)
+	shaderNormalColoring = 1 << 0,
+	// the light sphere, lit by its own color only (LIGHT_PROXY)
+	shaderLightProxy = 1 << 1,
+	// transforms and materials per instance from an InstanceBuffer (INSTANCED)
+	shaderInstanced = 1 << 2,
+	// write the G-buffer of the deferred path instead of shading (GBUFFER);
+	// not built with the two flags above, which are always drawn forward
+	shaderGBuffer = 1 << 3,
+	shaderVariantCount = 1 << 4
+};
+
+// the defines a variant is compiled with
+std::vector<std::string> ShaderVariantDefines(int flags);
+// false for combinations that are never drawn
+bool ShaderVariantBuilt(int flags);
+
+// Every variant of one shader source, with branches resolved by the
+// preprocessor instead of at run time. Combinations that are never drawn
+// are left unbuilt.
+class ShaderVariants
+{
+private:
+	ShaderProgram programs[shaderVariantCount];
+
+public:
+	bool load(const char* vertexFilePath, const char* fragmentFilePath);
+	// start every variant compiling, then finish them in the order the
+	// driver completes them
+	bool begin(const char* vertexFilePath, const char* fragmentFilePath);
+	bool finish();
+
+	const ShaderProgram& get(int flags) const { return programs[flags]; }
+};
+
+// std140 uniform buffer holding FrameUniforms, written once per frame
+class FrameUniformBuffer
+{
+private:
+	GLuint buffer = 0;
+
+public:
+	FrameUniformBuffer();
+	~FrameUniformBuffer();
+
+	FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+	FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+
+	void update(const FrameUniforms& uniforms);
+};
+
+#endif
@@ -0,0 +1,700 @@
+#include "SoftwareRasterizer.h"
+#include "Material.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RASTER_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTER_LANES 4
+#else
+#define RASTER_LANES 1
+#endif
+
+// Lanes: RASTER_LANES floats worked on together. Comparisons give masks
+// with every bit of a lane set or clear.
+#if RASTER_LANES == 8
+struct Lanes
+{
+	__m256 v;
+	Lanes() {}
+	Lanes(__m256 value) : v(value) {}
+	Lanes(float value) : v(_mm256_set1_ps(value)) {}
+};
+
+static inline Lanes operator+(Lanes a, Lanes b) { return _mm256_add_ps(a.v, b.v); }
+static inline Lanes operator-(Lanes a, Lanes b) { return _mm256_sub_ps(a.v, b.v); }
+static inline Lanes operator*(Lanes a, Lanes b) { return _mm256_mul_ps(a.v, b.v); }
+static inline Lanes operator/(Lanes a, Lanes b) { return _mm256_div_ps(a.v, b.v); }
+static inline Lanes operator&(Lanes a, Lanes b) { return _mm256_and_ps(a.v, b.v); }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return _mm256_min_ps(a.v, b.v); }
+static inline Lanes lanesMax(Lanes a, Lanes b) { return _mm256_max_ps(a.v, b.v); }
+static inline Lanes lanesSqrt(Lanes a) { return _mm256_sqrt_ps(a.v); }
+static inline Lanes lanesFloor(Lanes a) { return _mm256_floor_ps(a.v); }
+static inline Lanes less(Lanes a, Lanes b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+static inline Lanes lessEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+// a where the mask is set, b elsewhere
+static inline Lanes select(Lanes mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+static inline int laneBits(Lanes mask) { return _mm256_movemask_ps(mask.v); }
+static inline Lanes loadLanes(const float* p) { return _mm256_loadu_ps(p); }
+static inline void storeLanes(float* p, Lanes a) { _mm256_storeu_ps(p, a.v); }
+static inline Lanes laneIndex() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+
+// 2^i for whole numbers i in [-126, 127]
+static inline Lanes lanesExp2Whole(Lanes i)
+{
+	__m256i exponent = _mm256_add_epi32(_mm256_cvtps_epi32(i.v), _mm256_set1_epi32(127));
+	return _mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23));
+}
+
+// exponent and mantissa in [1, 2) of positive floats
+static inline Lanes lanesExponent(Lanes a)
+{
+	__m256i bits = _mm256_srli_epi32(_mm256_castps_si256(a.v), 23);
+	return _mm256_cvtepi32_ps(_mm256_sub_epi32(bits, _mm256_set1_epi32(127)));
+}
+static inline Lanes lanesMantissa(Lanes a)
+{
+	__m256i bits = _mm256_and_si256(_mm256_castps_si256(a.v), _mm256_set1_epi32(0x007fffff));
+	return _mm256_castsi256_ps(_mm256_or_si256(bits, _mm256_set1_epi32(0x3f800000)));
+}
+
+// RGBA8 from channels already scaled to [0, 255], where the mask is set
+static inline void storeColor(uint32_t* p, Lanes mask, Lanes r, Lanes g, Lanes b)
+{
+	__m256i rg = _mm256_or_si256(_mm256_cvttps_epi32(r.v), _mm256_slli_epi32(_mm256_cvttps_epi32(g.v), 8));
+	__m256i ba = _mm256_or_si256(_mm256_slli_epi32(_mm256_cvttps_epi32(b.v), 16), _mm256_set1_epi32((int)0xff000000));
+	_mm256_maskstore_epi32((int*)p, _mm256_castps_si256(mask.v), _mm256_or_si256(rg, ba));
+}
+#elif RASTER_LANES == 4
+struct Lanes
+{
+	__m128 v;
+	Lanes() {}
+	Lanes(__m128 value) : v(value) {}
+	Lanes(float value) : v(_mm_set1_ps(value)) {}
+};
+
+static inline Lanes operator+(Lanes a, Lanes b) { return _mm_add_ps(a.v, b.v); }
+static inline Lanes operator-(Lanes a, Lanes b) { return _mm_sub_ps(a.v, b.v); }
+static inline Lanes operator*(Lanes a, Lanes b) { return _mm_mul_ps(a.v, b.v); }
+static inline Lanes operator/(Lanes a, Lanes b) { return _mm_div_ps(a.v, b.v); }
+static inline Lanes operator&(Lanes a, Lanes b) { return _mm_and_ps(a.v, b.v); }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return _mm_min_ps(a.v, b.v); }
+static inline Lanes lanesMax(Lanes a, Lanes b) { return _mm_max_ps(a.v, b.v); }
+static inline Lanes lanesSqrt(Lanes a) { return _mm_sqrt_ps(a.v); }
+// SSE2 has no floor: truncate, then step down where that rounded up
+static inline Lanes lanesFloor(Lanes a)
+{
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+	return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f)));
+}
+static inline Lanes less(Lanes a, Lanes b) { return _mm_cmplt_ps(a.v, b.v); }
+static inline Lanes lessEqual(Lanes a, Lanes b) { return _mm_cmple_ps(a.v, b.v); }
+static inline Lanes select(Lanes mask, Lanes a, Lanes b)
+{
+	return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+static inline int laneBits(Lanes mask) { return _mm_movemask_ps(mask.v); }
+static inline Lanes loadLanes(const float* p) { return _mm_loadu_ps(p); }
+static inline void storeLanes(float* p, Lanes a) { _mm_storeu_ps(p, a.v); }
+static inline Lanes laneIndex() { return _mm_setr_ps(0, 1, 2, 3); }
+
+static inline Lanes lanesExp2Whole(Lanes i)
+{
+	__m128i exponent = _mm_add_epi32(_mm_cvtps_epi32(i.v), _mm_set1_epi32(127));
+	return _mm_castsi128_ps(_mm_slli_epi32(exponent, 23));
+}
+
+static inline Lanes lanesExponent(Lanes a)
+{
+	__m128i bits = _mm_srli_epi32(_mm_castps_si128(a.v), 23);
+	return _mm_cvtepi32_ps(_mm_sub_epi32(bits, _mm_set1_epi32(127)));
+}
+static inline Lanes lanesMantissa(Lanes a)
+{
+	__m128i bits = _mm_and_si128(_mm_castps_si128(a.v), _mm_set1_epi32(0x007fffff));
+	return _mm_castsi128_ps(_mm_or_si128(bits, _mm_set1_epi32(0x3f800000)));
+}
+
+static inline void storeColor(uint32_t* p, Lanes mask, Lanes r, Lanes g, Lanes b)
+{
+	__m128i rg = _mm_or_si128(_mm_cvttps_epi32(r.v), _mm_slli_epi32(_mm_cvttps_epi32(g.v), 8));
+	__m128i ba = _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(b.v), 16), _mm_set1_epi32((int)0xff000000));
+	__m128i keep = _mm_castps_si128(mask.v);
+	__m128i old = _mm_loadu_si128((const __m128i*)p);
+	_mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_and_si128(keep, _mm_or_si128(rg, ba)), _mm_andnot_si128(keep, old)));
+}
+#else
+// one lane: plain floats, masks as all-ones or zero bit patterns
+struct Lanes
+{
+	float v;
+	Lanes() {}
+	Lanes(float value) : v(value) {}
+};
+
+static inline float maskLane(bool set)
+{
+	uint32_t bits = set ? 0xffffffffu : 0u;
+	float mask;
+	memcpy(&mask, &bits, sizeof(mask));
+	return mask;
+}
+static inline int laneBits(Lanes mask)
+{
+	uint32_t bits;
+	memcpy(&bits, &mask.v, sizeof(bits));
+	return bits != 0 ? 1 : 0;
+}
+
+static inline Lanes operator+(Lanes a, Lanes b) { return a.v + b.v; }
+static inline Lanes operator-(Lanes a, Lanes b) { return a.v - b.v; }
+static inline Lanes operator*(Lanes a, Lanes b) { return a.v * b.v; }
+static inline Lanes operator/(Lanes a, Lanes b) { return a.v / b.v; }
+static inline Lanes operator&(Lanes a, Lanes b) { return maskLane(laneBits(a) && laneBits(b)); }
+static inline Lanes lanesMin(Lanes a, Lanes b) { return std::min(a.v, b.v); }
+static inline Lanes lanesMax(Lanes a, Lanes b) { return std::max(a.v, b.v); }
+static inline Lanes lanesSqrt(Lanes a) { return std::sqrt(a.v); }
+static inline Lanes lanesFloor(Lanes a) { return std::floor(a.v); }
+static inline Lanes less(Lanes a, Lanes b) { return maskLane(a.v < b.v); }
+static inline Lanes lessEqual(Lanes a, Lanes b) { return maskLane(a.v <= b.v); }
+static inline Lanes select(Lanes mask, Lanes a, Lanes b) { return laneBits(mask) ? a : b; }
+static inline Lanes loadLanes(const float* p) { return *p; }
+static inline void storeLanes(float* p, Lanes a) { *p = a.v; }
+static inline Lanes laneIndex() { return 0.0f; }
+
+static inline Lanes lanesExp2Whole(Lanes i) { return std::ldexp(1.0f, (int)i.v); }
+static inline Lanes lanesExponent(Lanes a)
+{
+	int exponent;
+	std::frexp(a.v, &exponent);
+	return (float)(exponent - 1);
+}
+static inline Lanes lanesMantissa(Lanes a)
+{
+	int exponent;
+	return std::frexp(a.v, &exponent) * 2.0f;
+}
+
+static inline void storeColor(uint32_t* p, Lanes mask, Lanes r, Lanes g, Lanes b)
+{
+	if (laneBits(mask)) {
+		*p = (uint32_t)r.v | ((uint32_t)g.v << 8) | ((uint32_t)b.v << 16) | 0xff000000u;
+	}
+}
+#endif
+
+// 2^x, to about 2e-5 relative
+static inline Lanes lanesExp2(Lanes x)
+{
+	x = lanesMin(lanesMax(x, -126.0f), 126.0f);
+	Lanes whole = lanesFloor(x);
+	// e^f for f in [0, ln 2)
+	Lanes f = (x - whole) * 0.693147181f;
+	Lanes p = 1.0f + f * (1.0f + f * (0.5f + f * (1.0f / 6.0f + f * (1.0f / 24.0f + f * (1.0f / 120.0f
+		+ f * (1.0f / 720.0f))))));
+	return p * lanesExp2Whole(whole);
+}
+
+// log2 of x > 0, through ln m = 2 atanh((m - 1) / (m + 1)) on the mantissa
+static inline Lanes lanesLog2(Lanes x)
+{
+	Lanes m = lanesMantissa(x);
+	Lanes t = (m - 1.0f) / (m + 1.0f);
+	Lanes t2 = t * t;
+	Lanes ln = 2.0f * t * (1.0f + t2 * (1.0f / 3.0f + t2 * (1.0f / 5.0f + t2 * (1.0f / 7.0f + t2 * (1.0f / 9.0f)))));
+	return lanesExponent(x) + ln * 1.44269504f;
+}
+
+// x^y for x >= 0 and y > 0; 0 where x is
+static inline Lanes lanesPow(Lanes x, float y)
+{
+	return select(lessEqual(x, 0.0f), 0.0f, lanesExp2(lanesLog2(x) * y));
+}
+
+// pixels on an edge belong to the triangle only on its top and left edges
+static inline Lanes insideEdge(Lanes weight, bool topLeft)
+{
+	return topLeft ? lessEqual(0.0f, weight) : less(0.0f, weight);
+}
+
+static inline int countBits(int bits)
+{
+	int count = 0;
+	for (; bits != 0; bits &= bits - 1) {
+		count++;
+	}
+	return count;
+}
+
+SoftwareRasterizer::SoftwareRasterizer(ThreadPool* threadPool)
+	: pool(threadPool)
+{
+}
+
+int SoftwareRasterizer::simdWidth()
+{
+	return RASTER_LANES;
+}
+
+void SoftwareRasterizer::resize(int newWidth, int newHeight)
+{
+	width = newWidth;
+	height = newHeight;
+	stride = (width + blockSize - 1) / blockSize * blockSize;
+	paddedHeight = (height + blockSize - 1) / blockSize * blockSize;
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	color.assign((size_t)stride * paddedHeight, 0);
+	depth.assign((size_t)stride * paddedHeight, 1.0f);
+	blockDepth.assign((size_t)(stride / blockSize) * (paddedHeight / blockSize), 1.0f);
+	chunks.clear();
+}
+
+void SoftwareRasterizer::clear(const glm::vec4& clearColor)
+{
+	glm::vec4 c = glm::clamp(clearColor, 0.0f, 1.0f) * 255.0f + 0.5f;
+	uint32_t packed = (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+	std::fill(color.begin(), color.end(), packed);
+	std::fill(depth.begin(), depth.end(), 1.0f);
+	std::fill(blockDepth.begin(), blockDepth.end(), 1.0f);
+	frameStats = RasterStats();
+}
+
+void SoftwareRasterizer::setFrame(const FrameUniforms& uniforms)
+{
+	frame = uniforms;
+}
+
+void SoftwareRasterizer::readPixels(std::vector<unsigned char>& pixels) const
+{
+	pixels.resize((size_t)width * height * 4);
+	for (int y = 0; y < height; y++) {
+		memcpy(&pixels[(size_t)y * width * 4], &color[(size_t)y * stride], (size_t)width * 4);
+	}
+}
+
+void SoftwareRasterizer::drawTriangles(const RasterMesh& mesh, uint32_t firstFace, uint32_t faceCount,
+	const glm::mat4& model, const glm::mat3& normalMatrix, int material, int variant)
+{
+	if (faceCount == 0 || width == 0 || height == 0) {
+		return;
+	}
+	drawVariant = variant;
+	drawMaterial = material;
+	auto parallel = [this](size_t count, const std::function<void(size_t)>& fn) {
+		if (pool) {
+			pool->parallelFor(count, fn);
+		}
+		else {
+			for (size_t i = 0; i < count; i++) {
+				fn(i);
+			}
+		}
+	};
+
+	// vertex stage (shader.vert) over the whole mesh, or over the vertices
+	// the faces use when they are few, e.g. a coarse level of detail
+	const size_t vertexBatch = 4096;
+	vertices.resize(mesh.pointCount);
+	bool sparse = (size_t)faceCount * 3 < mesh.pointCount;
+	if (sparse) {
+		if (vertexStamps.size() < mesh.pointCount || ++drawStamp == 0) {
+			vertexStamps.assign(std::max(vertexStamps.size(), mesh.pointCount), 0);
+			drawStamp = 1;
+		}
+		usedVertices.clear();
+		for (uint32_t f = firstFace; f < firstFace + faceCount; f++) {
+			for (int corner = 0; corner < 3; corner++) {
+				uint32_t v = (uint32_t)mesh.faces[f][corner];
+				if (vertexStamps[v] != drawStamp) {
+					vertexStamps[v] = drawStamp;
+					usedVertices.push_back(v);
+				}
+			}
+		}
+	}
+	size_t transformCount = sparse ? usedVertices.size() : mesh.pointCount;
+	glm::mat4 clipFromModel = frame.projection * frame.view * model;
+	bool normalColoring = (variant & shaderNormalColoring) != 0;
+	parallel((transformCount + vertexBatch - 1) / vertexBatch, [&](size_t batch) {
+		size_t end = std::min(transformCount, (batch + 1) * vertexBatch);
+		for (size_t j = batch * vertexBatch; j < end; j++) {
+			size_t i = sparse ? usedVertices[j] : j;
+			glm::vec4 point(mesh.points[i], 1.0f);
+			Vertex& vertex = vertices[i];
+			vertex.clip = clipFromModel * point;
+			vertex.position = glm::vec3(model * point);
+			glm::vec3 normal = i < mesh.normalCount ? mesh.normals[i] : glm::vec3(0.0f);
+			glm::vec3 converted = (glm::normalize(normal) + 1.0f) * 0.5f;
+			vertex.normal = normalColoring ? converted : normalMatrix * converted;
+		}
+	});
+
+	// clip, set up and bin in chunks of triangles, kept in submission order
+	size_t threads = pool ? pool->size() + 1 : 1;
+	size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threads * 4, faceCount / 256));
+	size_t tileCount = (size_t)tilesX * tilesY;
+	if (chunks.size() < chunkCount) {
+		chunks.resize(chunkCount);
+	}
+	parallel(chunkCount, [&](size_t c) {
+		Chunk& chunk = chunks[c];
+		chunk.tiles.resize(tileCount);
+		chunk.clear(tilesX);
+		size_t begin = faceCount * c / chunkCount;
+		size_t end = faceCount * (c + 1) / chunkCount;
+		for (size_t f = begin; f < end; f++) {
+			const glm::ivec3& face = mesh.faces[firstFace + f];
+			clipAndSetup(vertices[face.x], vertices[face.y], vertices[face.z], chunk);
+		}
+	});
+	int minTileX = tilesX, minTileY = tilesY, maxTileX = -1, maxTileY = -1;
+	for (size_t c = 0; c < chunks.size(); c++) {
+		if (c >= chunkCount) {
+			chunks[c].clear(tilesX);
+		}
+		minTileX = std::min(minTileX, chunks[c].minTileX);
+		minTileY = std::min(minTileY, chunks[c].minTileY);
+		maxTileX = std::max(maxTileX, chunks[c].maxTileX);
+		maxTileY = std::max(maxTileY, chunks[c].maxTileY);
+	}
+
+	// every tile the triangles reach on its own
+	shadedPixels = 0;
+	int rangeX = maxTileX - minTileX + 1;
+	int rangeY = maxTileY - minTileY + 1;
+	if (rangeX > 0 && rangeY > 0) {
+		parallel((size_t)rangeX * rangeY, [&](size_t i) {
+			int tile = (minTileY + (int)i / rangeX) * tilesX + minTileX + (int)i % rangeX;
+			size_t pixels = rasterizeTile(tile);
+			if (pixels > 0) {
+				shadedPixels += pixels;
+			}
+		});
+	}
+
+	frameStats.triangles += faceCount;
+	for (size_t c = 0; c < chunkCount; c++) {
+		frameStats.rasterized += chunks[c].triangles.size();
+	}
+	frameStats.pixels += shadedPixels;
+}
+
+// cull against the clip volume and clip the part behind the near plane;
+// the other planes are left to the bounding box and the depth range
+void SoftwareRasterizer::clipAndSetup(const Vertex& v0, const Vertex& v1, const Vertex& v2, Chunk& chunk) const
+{
+	const Vertex* corners[3] = { &v0, &v1, &v2 };
+	for (int axis = 0; axis < 3; axis++) {
+		for (float side = -1.0f; side <= 1.0f; side += 2.0f) {
+			bool outside = true;
+			for (const Vertex* v : corners) {
+				outside = outside && side * v->clip[axis] > v->clip.w;
+			}
+			if (outside) {
+				return;
+			}
+		}
+	}
+
+	float distance[3];
+	bool clipped = false;
+	for (int i = 0; i < 3; i++) {
+		distance[i] = corners[i]->clip.z + corners[i]->clip.w;
+		clipped = clipped || distance[i] < 0.0f;
+	}
+	if (!clipped) {
+		setupTriangle(v0, v1, v2, chunk);
+		return;
+	}
+
+	Vertex polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		if (distance[i] >= 0.0f) {
+			polygon[count++] = *corners[i];
+		}
+		if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f)) {
+			float t = distance[i] / (distance[i] - distance[j]);
+			Vertex& v = polygon[count++];
+			v.clip = glm::mix(corners[i]->clip, corners[j]->clip, t);
+			v.position = glm::mix(corners[i]->position, corners[j]->position, t);
+			v.normal = glm::mix(corners[i]->normal, corners[j]->normal, t);
+		}
+	}
+	for (int i = 1; i + 1 < count; i++) {
+		setupTriangle(polygon[0], polygon[i], polygon[i + 1], chunk);
+	}
+}
+
+void SoftwareRasterizer::setupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, Chunk& chunk) const
+{
+	const Vertex* corners[3] = { &v0, &v1, &v2 };
+	glm::vec2 screen[3];
+	float windowDepth[3];
+	float invW[3];
+	for (int i = 0; i < 3; i++) {
+		invW[i] = 1.0f / corners[i]->clip.w;
+		glm::vec3 ndc = glm::vec3(corners[i]->clip) * invW[i];
+		// window coordinates snapped to 1/256 pixel
+		screen[i].x = std::round((ndc.x * 0.5f + 0.5f) * width * 256.0f) / 256.0f;
+		screen[i].y = std::round((ndc.y * 0.5f + 0.5f) * height * 256.0f) / 256.0f;
+		windowDepth[i] = ndc.z * 0.5f + 0.5f;
+	}
+
+	// counterclockwise from here on; both windings are drawn
+	float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y)
+		- (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+	if (!(area != 0.0f)) {
+		return;
+	}
+	int order[3] = { 0, 1, 2 };
+	if (area < 0.0f) {
+		std::swap(order[1], order[2]);
+		area = -area;
+	}
+
+	// pixels whose centers can fall inside
+	Triangle t;
+	glm::vec2 low = glm::min(screen[0], glm::min(screen[1], screen[2]));
+	glm::vec2 high = glm::max(screen[0], glm::max(screen[1], screen[2]));
+	t.minX = std::max(0, (int)std::ceil(low.x - 0.5f));
+	t.minY = std::max(0, (int)std::ceil(low.y - 0.5f));
+	t.maxX = std::min(width - 1, (int)std::floor(high.x - 0.5f));
+	t.maxY = std::min(height - 1, (int)std::floor(high.y - 0.5f));
+	if (t.minX > t.maxX || t.minY > t.maxY) {
+		return;
+	}
+
+	// weight of vertex e: its opposite edge p -> q, scaled to 1 at the vertex
+	t.depthA = t.depthB = t.depthC = 0.0f;
+	t.minDepth = 1.0f;
+	for (int e = 0; e < 3; e++) {
+		const glm::vec2& p = screen[order[(e + 1) % 3]];
+		const glm::vec2& q = screen[order[(e + 2) % 3]];
+		float dx = q.x - p.x;
+		float dy = q.y - p.y;
+		t.edgeA[e] = -dy / area;
+		t.edgeB[e] = dx / area;
+		t.edgeC[e] = (dy * p.x - dx * p.y) / area;
+		t.topLeft[e] = dy < 0.0f || (dy == 0.0f && dx < 0.0f);
+
+		int v = order[e];
+		t.depthA += t.edgeA[e] * windowDepth[v];
+		t.depthB += t.edgeB[e] * windowDepth[v];
+		t.depthC += t.edgeC[e] * windowDepth[v];
+		t.minDepth = std::min(t.minDepth, windowDepth[v]);
+		t.invW[e] = invW[v];
+		t.position[e] = corners[v]->position;
+		t.normal[e] = corners[v]->normal;
+	}
+
+	uint32_t index = (uint32_t)chunk.triangles.size();
+	chunk.triangles.push_back(t);
+	for (int ty = t.minY / tileSize; ty <= t.maxY / tileSize; ty++) {
+		for (int tx = t.minX / tileSize; tx <= t.maxX / tileSize; tx++) {
+			chunk.tiles[(size_t)ty * tilesX + tx].push_back(index);
+		}
+	}
+	chunk.minTileX = std::min(chunk.minTileX, t.minX / tileSize);
+	chunk.minTileY = std::min(chunk.minTileY, t.minY / tileSize);
+	chunk.maxTileX = std::max(chunk.maxTileX, t.maxX / tileSize);
+	chunk.maxTileY = std::max(chunk.maxTileY, t.maxY / tileSize);
+}
+
+// empties the bins the last draw filled
+void SoftwareRasterizer::Chunk::clear(int tilesX)
+{
+	triangles.clear();
+	for (int y = minTileY; y <= maxTileY; y++) {
+		for (int x = minTileX; x <= maxTileX; x++) {
+			tiles[(size_t)y * tilesX + x].clear();
+		}
+	}
+	minTileX = minTileY = std::numeric_limits<int>::max();
+	maxTileX = maxTileY = -1;
+}
+
+size_t SoftwareRasterizer::rasterizeTile(int tile)
+{
+	int tileX = (tile % tilesX) * tileSize;
+	int tileY = (tile / tilesX) * tileSize;
+	int tileMaxX = std::min(tileX + tileSize, width) - 1;
+	int tileMaxY = std::min(tileY + tileSize, height) - 1;
+	size_t pixels = 0;
+
+	for (const Chunk& chunk : chunks) {
+		if (chunk.tiles.empty()) {
+			continue;
+		}
+		for (uint32_t index : chunk.tiles[tile]) {
+			const Triangle& t = chunk.triangles[index];
+			int startX = std::max(t.minX, tileX) / blockSize * blockSize;
+			int startY = std::max(t.minY, tileY) / blockSize * blockSize;
+			int endX = std::min(t.maxX, tileMaxX);
+			int endY = std::min(t.maxY, tileMaxY);
+			for (int blockY = startY; blockY <= endY; blockY += blockSize) {
+				for (int blockX = startX; blockX <= endX; blockX += blockSize) {
+					// the weights at the block's corner pixels bound them inside
+					float left = blockX + 0.5f;
+					float right = blockX + blockSize - 0.5f;
+					float bottom = blockY + 0.5f;
+					float top = blockY + blockSize - 0.5f;
+					bool outside = false;
+					bool covered = true;
+					for (int e = 0; e < 3; e++) {
+						float a = t.edgeA[e];
+						float b = t.edgeB[e];
+						float smallest = a * (a >= 0.0f ? left : right) + b * (b >= 0.0f ? bottom : top) + t.edgeC[e];
+						float largest = a * (a >= 0.0f ? right : left) + b * (b >= 0.0f ? top : bottom) + t.edgeC[e];
+						outside = outside || largest < 0.0f;
+						covered = covered && smallest > 0.0f;
+					}
+					if (outside) {
+						continue;
+					}
+
+					// nothing passes LEQUAL where the block is nearer throughout
+					float nearest = t.depthA * (t.depthA >= 0.0f ? left : right)
+						+ t.depthB * (t.depthB >= 0.0f ? bottom : top) + t.depthC;
+					size_t block = (size_t)(blockY / blockSize) * (stride / blockSize) + blockX / blockSize;
+					if (std::max(nearest, t.minDepth) > blockDepth[block]) {
+						continue;
+					}
+					pixels += rasterizeBlock(t, blockX, blockY, covered);
+				}
+			}
+		}
+	}
+	return pixels;
+}
+
+// shader.frag for one 8x8 block, RASTER_LANES pixels at a time
+size_t SoftwareRasterizer::rasterizeBlock(const Triangle& t, int blockX, int blockY, bool covered)
+{
+	const Material& material = materialTable[drawMaterial];
+	glm::vec3 lightColor = glm::vec3(material.lightColor);
+	bool normalColoring = (drawVariant & shaderNormalColoring) != 0;
+	bool lightProxy = (drawVariant & shaderLightProxy) != 0;
+	size_t shaded = 0;
+
+	for (int group = 0; group < blockSize * blockSize / RASTER_LANES; group++) {
+		int x = blockX + group * RASTER_LANES % blockSize;
+		int y = blockY + group * RASTER_LANES / blockSize;
+		Lanes px = Lanes(x + 0.5f) + laneIndex();
+		Lanes py = y + 0.5f;
+		Lanes mask = less(px, (float)width) & less(py, (float)height);
+
+		Lanes w0 = t.edgeA[0] * px + t.edgeB[0] * py + t.edgeC[0];
+		Lanes w1 = t.edgeA[1] * px + t.edgeB[1] * py + t.edgeC[1];
+		Lanes w2 = t.edgeA[2] * px + t.edgeB[2] * py + t.edgeC[2];
+		if (!covered) {
+			mask = mask & insideEdge(w0, t.topLeft[0]) & insideEdge(w1, t.topLeft[1]) & insideEdge(w2, t.topLeft[2]);
+		}
+		if (laneBits(mask) == 0) {
+			continue;
+		}
+
+		// early depth test, LEQUAL within the depth range
+		float* depthRow = &depth[(size_t)y * stride + x];
+		Lanes z = t.depthA * px + t.depthB * py + t.depthC;
+		Lanes stored = loadLanes(depthRow);
+		mask = mask & lessEqual(z, stored) & lessEqual(0.0f, z) & lessEqual(z, 1.0f);
+		int bits = laneBits(mask);
+		if (bits == 0) {
+			continue;
+		}
+		storeLanes(depthRow, select(mask, z, stored));
+		shaded += countBits(bits);
+
+		// perspective-correct weights
+		Lanes p0 = w0 * t.invW[0];
+		Lanes p1 = w1 * t.invW[1];
+		Lanes p2 = w2 * t.invW[2];
+		Lanes scale = 1.0f / (p0 + p1 + p2);
+		p0 = p0 * scale;
+		p1 = p1 * scale;
+		p2 = p2 * scale;
+		Lanes nx = p0 * t.normal[0].x + p1 * t.normal[1].x + p2 * t.normal[2].x;
+		Lanes ny = p0 * t.normal[0].y + p1 * t.normal[1].y + p2 * t.normal[2].y;
+		Lanes nz = p0 * t.normal[0].z + p1 * t.normal[1].z + p2 * t.normal[2].z;
+
+		Lanes r, g, b;
+		if (normalColoring) {
+			r = nx;
+			g = ny;
+			b = nz;
+		}
+		else {
+			Lanes posX = p0 * t.position[0].x + p1 * t.position[1].x + p2 * t.position[2].x;
+			Lanes posY = p0 * t.position[0].y + p1 * t.position[1].y + p2 * t.position[2].y;
+			Lanes posZ = p0 * t.position[0].z + p1 * t.position[1].z + p2 * t.position[2].z;
+
+			// quadratic light attenuation
+			Lanes lx = frame.lightPos.x - posX;
+			Lanes ly = frame.lightPos.y - posY;
+			Lanes lz = frame.lightPos.z - posZ;
+			Lanes dist = lanesSqrt(lx * lx + ly * ly + lz * lz);
+			Lanes attenuation = 2.0f / (1.0f + 0.09f * dist + 0.032f * (dist * dist));
+
+			if (lightProxy) {
+				r = attenuation * (lightColor.r * lightColor.r);
+				g = attenuation * (lightColor.g * lightColor.g);
+				b = attenuation * (lightColor.b * lightColor.b);
+			}
+			else {
+				Lanes invDist = 1.0f / dist;
+				lx = lx * invDist;
+				ly = ly * invDist;
+				lz = lz * invDist;
+				Lanes normalDotLight = nx * lx + ny * ly + nz * lz;
+				Lanes diff = lanesMax(normalDotLight, 0.0f);
+
+				Lanes vx = frame.cameraPos.x - posX;
+				Lanes vy = frame.cameraPos.y - posY;
+				Lanes vz = frame.cameraPos.z - posZ;
+				Lanes invLength = 1.0f / lanesSqrt(vx * vx + vy * vy + vz * vz);
+				// reflect(-lightDir, normal)
+				Lanes rx = 2.0f * normalDotLight * nx - lx;
+				Lanes ry = 2.0f * normalDotLight * ny - ly;
+				Lanes rz = 2.0f * normalDotLight * nz - lz;
+				Lanes spec = lanesPow(lanesMax((vx * rx + vy * ry + vz * rz) * invLength, 0.0f), material.specular.w);
+
+				r = attenuation * (lightColor.r * material.ambient.r + lightColor.r * (diff * material.diffuse.r)
+					+ lightColor.r * (spec * material.specular.r));
+				g = attenuation * (lightColor.g * material.ambient.g + lightColor.g * (diff * material.diffuse.g)
+					+ lightColor.g * (spec * material.specular.g));
+				b = attenuation * (lightColor.b * material.ambient.b + lightColor.b * (diff * material.diffuse.b)
+					+ lightColor.b * (spec * material.specular.b));
+			}
+		}
+
+		r = lanesMin(lanesMax(r, 0.0f), 1.0f) * 255.0f + 0.5f;
+		g = lanesMin(lanesMax(g, 0.0f), 1.0f) * 255.0f + 0.5f;
+		b = lanesMin(lanesMax(b, 0.0f), 1.0f) * 255.0f + 0.5f;
+		storeColor(&color[(size_t)y * stride + x], mask, r, g, b);
+	}
+
+	// the block's depth bound for the triangles after this one
+	if (shaded > 0) {
+		Lanes largest = 0.0f;
+		for (int row = 0; row < blockSize; row++) {
+			for (int column = 0; column < blockSize; column += RASTER_LANES) {
+				largest = lanesMax(largest, loadLanes(&depth[(size_t)(blockY + row) * stride + blockX + column]));
+			}
+		}
+		float lanes[RASTER_LANES];
+		storeLanes(lanes, largest);
+		size_t block = (size_t)(blockY / blockSize) * (stride / blockSize) + blockX / blockSize;
+		blockDepth[block] = *std::max_element(lanes, lanes + RASTER_LANES);
+	}
+	return shaded;
+}
@@ -0,0 +1,154 @@
+#ifndef _SOFTWARE_RASTERIZER_H_
+#define _SOFTWARE_RASTERIZER_H_
+
+#include "ShaderProgram.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// mesh in the float layout, in memory: a point and a normal per vertex
+struct RasterMesh
+{
+	const glm::vec3* points = nullptr;
+	size_t pointCount = 0;
+	const glm::vec3* normals = nullptr;
+	size_t normalCount = 0;
+	const glm::ivec3* faces = nullptr;
+};
+
+// counters of everything drawn since the last clear
+struct RasterStats
+{
+	size_t triangles = 0;
+	// triangles left after culling and clipping, set up for rasterizing
+	size_t rasterized = 0;
+	// fragments that passed the depth test and were shaded
+	size_t pixels = 0;
+};
+
+// CPU stand-in for the GL pipeline, for machines without a GPU. Runs
+// shader.vert and the unlit, Phong and normal coloring paths of shader.frag
+// (main light only: no point lights, shadows or instancing) into its own
+// color and depth buffers with GL's conventions: clip space with the near
+// plane clipped, LEQUAL depth test, perspective-correct attributes and
+// bottom-up rows. Triangles are set up and binned into 64x64 pixel tiles
+// in parallel chunks, then the tiles are rasterized in parallel, each
+// walking its triangles in submission order. Within a tile 8x8 blocks are
+// rejected or accepted whole by their corners and by a per-block maximum
+// depth, and pixels are tested and shaded 8 (AVX2) or 4 (SSE2) at a time.
+class SoftwareRasterizer
+{
+public:
+	static const int tileSize = 64;
+	static const int blockSize = 8;
+
+	// with no pool everything runs on the calling thread
+	explicit SoftwareRasterizer(ThreadPool* pool = nullptr);
+
+	SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+	SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+	void resize(int width, int height);
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	// like glClear of color and depth, and resets the stats
+	void clear(const glm::vec4& color = glm::vec4(0.0f));
+
+	// the per-frame constants the shaders read; cluster and shadow fields
+	// are ignored
+	void setFrame(const FrameUniforms& frame);
+
+	// the triangles faces[firstFace .. firstFace + faceCount) with the
+	// per-object uniforms of shader.vert and the variant flags of
+	// ShaderVariants; shaderInstanced and shaderGBuffer are not supported
+	void drawTriangles(const RasterMesh& mesh, uint32_t firstFace, uint32_t faceCount, const glm::mat4& model,
+		const glm::mat3& normalMatrix, int material, int variant);
+
+	// RGBA8 rows from the bottom, as glReadPixels returns them
+	void readPixels(std::vector<unsigned char>& pixels) const;
+
+	const RasterStats& stats() const { return frameStats; }
+
+	// lanes the pixels are shaded in, 8, 4 or 1
+	static int simdWidth();
+
+private:
+	// a transformed vertex: clip position, and the world position and the
+	// normal the fragment stage interpolates
+	struct Vertex
+	{
+		glm::vec4 clip;
+		glm::vec3 position;
+		glm::vec3 normal;
+	};
+
+	// a triangle ready to rasterize, in window coordinates
+	struct Triangle
+	{
+		// barycentric weight of each vertex as a plane, weight = a * x + b *
+		// y + c at pixel centers; an edge pixel is inside if it lies on a top
+		// or left edge
+		float edgeA[3], edgeB[3], edgeC[3];
+		bool topLeft[3];
+		// window depth as a plane, and its smallest value on the triangle
+		float depthA, depthB, depthC, minDepth;
+		float invW[3];
+		glm::vec3 position[3];
+		glm::vec3 normal[3];
+		int minX, minY, maxX, maxY;
+	};
+
+	ThreadPool* pool;
+	int width = 0;
+	int height = 0;
+	// buffers padded to whole blocks
+	int stride = 0;
+	int paddedHeight = 0;
+	int tilesX = 0;
+	int tilesY = 0;
+	std::vector<uint32_t> color;
+	std::vector<float> depth;
+	// largest depth in each block, for rejecting hidden blocks
+	std::vector<float> blockDepth;
+
+	FrameUniforms frame;
+	// the draw in progress
+	int drawVariant = 0;
+	int drawMaterial = 0;
+
+	std::vector<Vertex> vertices;
+	// vertices a draw of few faces uses, found through per-vertex stamps
+	std::vector<uint32_t> vertexStamps;
+	uint32_t drawStamp = 0;
+	std::vector<uint32_t> usedVertices;
+	// triangles set up by one chunk, the ones each tile got and the range
+	// of tiles that got any
+	struct Chunk
+	{
+		std::vector<Triangle> triangles;
+		std::vector<std::vector<uint32_t>> tiles;
+		int minTileX = std::numeric_limits<int>::max();
+		int minTileY = std::numeric_limits<int>::max();
+		int maxTileX = -1;
+		int maxTileY = -1;
+		void clear(int tilesX);
+	};
+	std::vector<Chunk> chunks;
+
+	RasterStats frameStats;
+	std::atomic<size_t> shadedPixels{ 0 };
+
+	void setupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, Chunk& chunk) const;
+	void clipAndSetup(const Vertex& v0, const Vertex& v1, const Vertex& v2, Chunk& chunk) const;
+	// pixels shaded in the tile
+	size_t rasterizeTile(int tile);
+	size_t rasterizeBlock(const Triangle& triangle, int blockX, int blockY, bool covered);
+};
+
+#endif
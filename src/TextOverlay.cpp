@@ -0,0 +1,136 @@
+#include "TextOverlay.h"
+#include "MeshArena.h"
+#include "ShaderProgram.h"
+
+#include <cctype>
+#include <cstring>
+
+// 5x7 glyphs, one byte per row from the top, bit 4 the leftmost column
+static const char glyphChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:%/-()=_";
+static const unsigned char glyphRows[][7] = {
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+	{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+	{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+	{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+	{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+	{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+	{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+	{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+	{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+	{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+	{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+	{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+	{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+	{ 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // Y
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+	{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+	{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // _
+};
+
+// glyph cell in font pixels, spacing included
+static const int glyphWidth = 6;
+static const int glyphHeight = 9;
+
+TextOverlay::~TextOverlay()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteProgram(program);
+}
+
+bool TextOverlay::load(const char* vertexFilePath, const char* fragmentFilePath)
+{
+	program = LoadShaders(vertexFilePath, fragmentFilePath);
+	if (!program) {
+		return false;
+	}
+	screenSizeLocation = glGetUniformLocation(program, "screenSize");
+	colorLocation = glGetUniformLocation(program, "color");
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	MeshArena::bindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), 0);
+	MeshArena::bindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+void TextOverlay::draw(const std::vector<std::string>& lines, int width, int height)
+{
+	// two triangles per lit font pixel, in screen pixels from the top left
+	vertices.clear();
+	for (size_t row = 0; row < lines.size(); row++) {
+		for (size_t column = 0; column < lines[row].size(); column++) {
+			const char* found = strchr(glyphChars, toupper((unsigned char)lines[row][column]));
+			if (found == nullptr || *found == '\0') {
+				continue;
+			}
+			const unsigned char* glyph = glyphRows[found - glyphChars];
+			for (int y = 0; y < 7; y++) {
+				for (int x = 0; x < 5; x++) {
+					if (!(glyph[y] & (0x10 >> x))) {
+						continue;
+					}
+					glm::vec2 corner((float)((column * glyphWidth + x + 1) * scale),
+						(float)((row * glyphHeight + y + 1) * scale));
+					glm::vec2 size((float)scale);
+					vertices.push_back(corner);
+					vertices.push_back(corner + glm::vec2(size.x, 0.0f));
+					vertices.push_back(corner + size);
+					vertices.push_back(corner);
+					vertices.push_back(corner + size);
+					vertices.push_back(corner + glm::vec2(0.0f, size.y));
+				}
+			}
+		}
+	}
+	if (vertices.empty()) {
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * vertices.size(), vertices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// through the ShaderProgram cache so the next use() rebinds the scene's
+	ShaderProgram::bind(program);
+	glUniform2f(screenSizeLocation, (float)width, (float)height);
+	glUniform3f(colorLocation, color.r, color.g, color.b);
+
+	glDisable(GL_DEPTH_TEST);
+	MeshArena::bindVertexArray(VAO);
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+	MeshArena::bindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,41 @@
+#ifndef _TEXT_OVERLAY_H_
+#define _TEXT_OVERLAY_H_
+
+#include "shader.h"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Lines of text drawn over the scene in a built-in 5x7 pixel font, for the
+// profiler stats. Letters are shown upper case; characters the font lacks
+// are left blank.
+class TextOverlay
+{
+private:
+	GLuint program = 0;
+	GLint screenSizeLocation = -1;
+	GLint colorLocation = -1;
+	GLuint VAO = 0;
+	GLuint VBO = 0;
+	std::vector<glm::vec2> vertices;
+
+public:
+	// screen pixels per font pixel
+	int scale = 2;
+	glm::vec3 color = glm::vec3(1.0f, 1.0f, 0.2f);
+
+	TextOverlay() {}
+	~TextOverlay();
+
+	TextOverlay(const TextOverlay&) = delete;
+	TextOverlay& operator=(const TextOverlay&) = delete;
+
+	bool load(const char* vertexFilePath, const char* fragmentFilePath);
+
+	// the lines from the top left corner of a width x height framebuffer
+	void draw(const std::vector<std::string>& lines, int width, int height);
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+	if (threadCount == 0) {
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	workers.reserve(threadCount);
+	for (unsigned i = 0; i < threadCount; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCondition.notify_all();
+
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (stopping && tasks.empty()) {
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+	auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+	std::future<void> result = packaged->get_future();
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		tasks.emplace_back([packaged]() { (*packaged)(); });
+	}
+	queueCondition.notify_one();
+	return result;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+	if (count == 0) {
+		return;
+	}
+	if (count == 1 || workers.empty()) {
+		for (size_t i = 0; i < count; i++) {
+			fn(i);
+		}
+		return;
+	}
+
+	// shared so helpers that only get scheduled after the loop has finished
+	// find no work left and exit without touching the caller's stack
+	struct LoopState
+	{
+		std::atomic<size_t> next{ 0 };
+		size_t done = 0;
+		size_t count = 0;
+		const std::function<void(size_t)>* fn = nullptr;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<LoopState>();
+	state->count = count;
+	state->fn = &fn;
+
+	auto runIndices = [](LoopState& s) {
+		size_t completed = 0;
+		for (size_t i = s.next++; i < s.count; i = s.next++) {
+			(*s.fn)(i);
+			completed++;
+		}
+		if (completed > 0) {
+			std::lock_guard<std::mutex> lock(s.mutex);
+			s.done += completed;
+			if (s.done == s.count) {
+				s.finished.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(count - 1, workers.size());
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		for (size_t i = 0; i < helpers; i++) {
+			tasks.emplace_back([state, runIndices]() { runIndices(*state); });
+		}
+	}
+	queueCondition.notify_all();
+
+	// the caller works too, so nested loops on a busy pool still finish
+	runIndices(*state);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]() { return state->done == state->count; });
+}
@@ -0,0 +1,43 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads fed from a single FIFO task queue.
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopping = false;
+
+	void workerLoop();
+
+public:
+	// threadCount 0 uses one worker per hardware thread
+	explicit ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned size() const { return (unsigned)workers.size(); }
+
+	// queue a task; the future becomes ready once it has run
+	std::future<void> submit(std::function<void()> task);
+
+	// run fn(0) .. fn(count - 1) across the workers and the calling thread,
+	// returning once every index is done. Safe to call from a worker.
+	void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+};
+
+#endif
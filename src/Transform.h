@@ -0,0 +1,41 @@
+#ifndef _TRANSFORM_H_
+#define _TRANSFORM_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Placement of a model as translation, rotation and scale, composed in that
+// order (T * R * S). However many rotations are folded in, the rotation
+// stays a unit quaternion, where a matrix multiplied again and again slowly
+// picks up skew and scale from rounding.
+struct Transform
+{
+	glm::vec3 translation = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+
+	glm::mat4 matrix() const
+	{
+		glm::mat4 result = glm::mat4_cast(rotation);
+		result[0] *= scale.x;
+		result[1] *= scale.y;
+		result[2] *= scale.z;
+		result[3] = glm::vec4(translation, 1.0f);
+		return result;
+	}
+
+	// the parts of a matrix without shear or projection
+	static Transform fromMatrix(const glm::mat4& matrix)
+	{
+		Transform transform;
+		transform.translation = glm::vec3(matrix[3]);
+		transform.scale = glm::vec3(glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])),
+			glm::length(glm::vec3(matrix[2])));
+		glm::mat3 rotation(glm::vec3(matrix[0]) / transform.scale.x, glm::vec3(matrix[1]) / transform.scale.y,
+			glm::vec3(matrix[2]) / transform.scale.z);
+		transform.rotation = glm::normalize(glm::quat_cast(rotation));
+		return transform;
+	}
+};
+
+#endif
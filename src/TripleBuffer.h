@@ -0,0 +1,65 @@
+#ifndef _TRIPLE_BUFFER_H_
+#define _TRIPLE_BUFFER_H_
+
+#include <atomic>
+
+// Lock-free handoff of the latest value from one producer thread to one
+// consumer thread. Of three slots the producer owns one (back), the consumer
+// one (front), and the third (middle) is swapped with either side by a
+// single atomic exchange, so neither thread ever waits for the other.
+// Values the consumer did not pick up in time are overwritten, never queued.
+template <typename T>
+class TripleBuffer
+{
+private:
+	// slot index of the middle in the low bits, and whether it holds a value
+	// the consumer has not taken yet
+	static const unsigned freshBit = 4;
+
+	T slots[3];
+	std::atomic<unsigned> middle{ 1 };
+	unsigned back = 0;
+	unsigned front = 2;
+
+public:
+	TripleBuffer() {}
+	// every slot starts as initial, so read() is valid before the first publish
+	explicit TripleBuffer(const T& initial)
+	{
+		slots[0] = slots[1] = slots[2] = initial;
+	}
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// producer: fill this, then publish it
+	T& write() { return slots[back]; }
+	void publish()
+	{
+		// release: the slot's contents before the index
+		back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & ~freshBit;
+	}
+	// producer: copy value in and publish it
+	void publish(const T& value)
+	{
+		slots[back] = value;
+		publish();
+	}
+
+	// consumer: a value was published since the last update
+	bool hasNew() const { return (middle.load(std::memory_order_acquire) & freshBit) != 0; }
+	// consumer: take the newest published value if there is one; returns
+	// whether read() changed
+	bool update()
+	{
+		if (!hasNew()) {
+			return false;
+		}
+		front = middle.exchange(front, std::memory_order_acq_rel) & ~freshBit;
+		return true;
+	}
+	// consumer: the value taken by the last update, stable until the next
+	const T& read() const { return slots[front]; }
+};
+
+#endif
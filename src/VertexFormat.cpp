@@ -0,0 +1,70 @@
+#include "VertexFormat.h"
+
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// float in [-1, 1] -> signed normalized integer with the given bit count
+	int32_t snorm(float value, int bits)
+	{
+		float maximum = (float)((1 << (bits - 1)) - 1);
+		return (int32_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * maximum);
+	}
+}
+
+uint32_t PackNormal(const glm::vec3& normal)
+{
+	uint32_t x = (uint32_t)snorm(normal.x, 10) & 0x3FF;
+	uint32_t y = (uint32_t)snorm(normal.y, 10) & 0x3FF;
+	uint32_t z = (uint32_t)snorm(normal.z, 10) & 0x3FF;
+	return x | (y << 10) | (z << 20);
+}
+
+void PackMesh(const glm::vec3* points, size_t pointCount, const glm::vec3* normals, size_t normalCount,
+	const glm::ivec3* faces, size_t faceCount, PackedMesh& packed)
+{
+	// bounding box the positions are quantized in
+	glm::vec3 minimum(0.0f), maximum(0.0f);
+	if (pointCount > 0) {
+		minimum = maximum = points[0];
+	}
+	for (size_t i = 1; i < pointCount; i++) {
+		minimum = glm::min(minimum, points[i]);
+		maximum = glm::max(maximum, points[i]);
+	}
+	glm::vec3 center = (minimum + maximum) * 0.5f;
+	glm::vec3 halfExtent = (maximum - minimum) * 0.5f;
+	for (int axis = 0; axis < 3; axis++) {
+		if (halfExtent[axis] <= 0.0f) {
+			halfExtent[axis] = 1.0f;
+		}
+	}
+	packed.dequantize = glm::translate(center) * glm::scale(halfExtent);
+
+	packed.vertices.resize(pointCount);
+	for (size_t i = 0; i < pointCount; i++) {
+		glm::vec3 unit = (points[i] - center) / halfExtent;
+		PackedVertex& vertex = packed.vertices[i];
+		vertex.position[0] = (int16_t)snorm(unit.x, 16);
+		vertex.position[1] = (int16_t)snorm(unit.y, 16);
+		vertex.position[2] = (int16_t)snorm(unit.z, 16);
+		vertex.position[3] = 0;
+		vertex.normal = 0;
+		if (i < normalCount && glm::length(normals[i]) > 0.0f) {
+			vertex.normal = PackNormal(glm::normalize(normals[i]));
+		}
+	}
+
+	packed.shortIndices.clear();
+	if (pointCount <= 65536) {
+		packed.shortIndices.resize(faceCount * 3);
+		for (size_t t = 0; t < faceCount; t++) {
+			packed.shortIndices[3 * t] = (uint16_t)faces[t].x;
+			packed.shortIndices[3 * t + 1] = (uint16_t)faces[t].y;
+			packed.shortIndices[3 * t + 2] = (uint16_t)faces[t].z;
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef _VERTEX_FORMAT_H_
+#define _VERTEX_FORMAT_H_
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compact interleaved vertex: position as 16-bit normalized integers inside
+// the mesh's bounding box (w is padding), normal as GL_INT_2_10_10_10_REV.
+// 12 bytes instead of the 24 of two separate float vec3 streams.
+struct PackedVertex
+{
+	int16_t position[4];
+	uint32_t normal;
+};
+
+struct PackedMesh
+{
+	std::vector<PackedVertex> vertices;
+	// 16-bit copy of the indices, filled only when every index fits
+	std::vector<uint16_t> shortIndices;
+	// maps the [-1, 1] normalized positions back to mesh space; meant to be
+	// folded into the model matrix
+	glm::mat4 dequantize = glm::mat4(1.0f);
+};
+
+// signed normalized 10:10:10:2 packing of a unit vector
+uint32_t PackNormal(const glm::vec3& normal);
+
+// quantize a mesh into the compact layout; normals beyond normalCount read
+// as zero
+void PackMesh(const glm::vec3* points, size_t pointCount, const glm::vec3* normals, size_t normalCount,
+	const glm::ivec3* faces, size_t faceCount, PackedMesh& packed);
+
+#endif
@@ -0,0 +1,135 @@
+#include "VertexWeld.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	// Open-addressing (linear probing) map from a (v, vt, vn) tuple to the
+	// welded vertex index. Slots are 16 bytes and stored inline, so a lookup
+	// is usually a single cache line.
+	class VertexTable
+	{
+	private:
+		struct Slot
+		{
+			int v, vt, vn;
+			int index; // -1 marks an empty slot
+		};
+
+		std::vector<Slot> slots;
+		size_t mask = 0;
+		size_t used = 0;
+
+		static size_t hashKey(int v, int vt, int vn)
+		{
+			uint64_t h = (uint64_t)(uint32_t)v * 0x9E3779B97F4A7C15ull;
+			h ^= (uint64_t)(uint32_t)vt * 0xC2B2AE3D27D4EB4Full;
+			h ^= (uint64_t)(uint32_t)vn * 0x165667B19E3779F9ull;
+			h ^= h >> 29;
+			return (size_t)h;
+		}
+
+		void rehash(size_t capacity)
+		{
+			std::vector<Slot> old;
+			old.swap(slots);
+			slots.assign(capacity, Slot{ 0, 0, 0, -1 });
+			mask = capacity - 1;
+
+			for (const Slot& slot : old) {
+				if (slot.index < 0) {
+					continue;
+				}
+				size_t i = hashKey(slot.v, slot.vt, slot.vn) & mask;
+				while (slots[i].index >= 0) {
+					i = (i + 1) & mask;
+				}
+				slots[i] = slot;
+			}
+		}
+
+	public:
+		explicit VertexTable(size_t expected)
+		{
+			size_t capacity = 16;
+			while (capacity < expected * 2) {
+				capacity *= 2;
+			}
+			rehash(capacity);
+		}
+
+		// index of the tuple, inserting nextIndex if it is new
+		int findOrInsert(int v, int vt, int vn, int nextIndex, bool& inserted)
+		{
+			// keep the load factor at or below one half
+			if ((used + 1) * 2 > slots.size()) {
+				rehash(slots.size() * 2);
+			}
+
+			size_t i = hashKey(v, vt, vn) & mask;
+			while (slots[i].index >= 0) {
+				const Slot& slot = slots[i];
+				if (slot.v == v && slot.vt == vt && slot.vn == vn) {
+					inserted = false;
+					return slot.index;
+				}
+				i = (i + 1) & mask;
+			}
+
+			slots[i] = Slot{ v, vt, vn, nextIndex };
+			used++;
+			inserted = true;
+			return nextIndex;
+		}
+	};
+}
+
+void WeldVertices(const ObjData& obj, MeshData& mesh, bool keepTexcoords, WeldStats* stats)
+{
+	size_t triangleCount = obj.faces.size();
+	bool hasTexcoords = keepTexcoords && !obj.texcoordFaces.empty();
+	bool hasNormals = !obj.normalFaces.empty();
+	bool normalPerPosition = obj.normals.size() == obj.points.size();
+
+	mesh.points.clear();
+	mesh.normals.clear();
+	mesh.texcoords.clear();
+	mesh.points.reserve(obj.points.size());
+	mesh.normals.reserve(obj.points.size());
+	if (hasTexcoords) {
+		mesh.texcoords.reserve(obj.points.size());
+	}
+	mesh.faces.resize(triangleCount);
+
+	// most meshes end up with about one vertex per position
+	VertexTable table(obj.points.size());
+
+	for (size_t t = 0; t < triangleCount; t++) {
+		for (int c = 0; c < 3; c++) {
+			int v = obj.faces[t][c];
+			int vt = hasTexcoords ? obj.texcoordFaces[t][c] : -1;
+			int vn = hasNormals ? obj.normalFaces[t][c] : -1;
+			if (vn < 0 && normalPerPosition) {
+				vn = v;
+			}
+
+			bool inserted = false;
+			int index = table.findOrInsert(v, vt, vn, (int)mesh.points.size(), inserted);
+			if (inserted) {
+				mesh.points.push_back(obj.points[v]);
+				mesh.normals.push_back(vn >= 0 ? obj.normals[vn] : glm::vec3(0.0f));
+				if (hasTexcoords) {
+					mesh.texcoords.push_back(vt >= 0 ? obj.texcoords[vt] : glm::vec2(0.0f));
+				}
+			}
+			mesh.faces[t][c] = index;
+		}
+	}
+
+	if (stats != nullptr) {
+		stats->corners = triangleCount * 3;
+		stats->vertices = mesh.points.size();
+		stats->positions = obj.points.size();
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef _VERTEX_WELD_H_
+#define _VERTEX_WELD_H_
+
+#include "Mesh.h"
+#include "ObjReader.h"
+
+#include <cstddef>
+
+// Vertex counts before and after welding.
+struct WeldStats
+{
+	// one vertex per triangle corner, i.e. naive expansion
+	size_t corners = 0;
+	// one vertex per unique (v, vt, vn) tuple
+	size_t vertices = 0;
+	// v records in the file
+	size_t positions = 0;
+};
+
+// Build one vertex per unique (v, vt, vn) tuple of the obj's faces and an index
+// buffer into them, so every vertex carries the normal its faces asked for.
+// Texture coordinates are only part of the tuple when keepTexcoords is set.
+// Corners without a vn index fall back to the normal with the same index as
+// the position when the file has exactly one normal per position.
+void WeldVertices(const ObjData& obj, MeshData& mesh, bool keepTexcoords = false, WeldStats* stats = nullptr);
+
+#endif
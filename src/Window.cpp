@@ -1,5 +1,17 @@
 #include "Window.h"
 
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
 // Window Properties
 int Window::width;
 int Window::height;
@@ -10,12 +22,85 @@ Geometry* Window::bunnyPoints;
 Geometry* Window::sandalPoints;
 Geometry* Window::bearPoints;
 Geometry* Window::spherePoints;
-Object* currObj;
+ThreadPool* Window::workerPool;
+double Window::uploadBudget = 0.002;
+Geometry* currObj;
+
+// Startup latency
+std::chrono::steady_clock::time_point Window::launchTime = std::chrono::steady_clock::now();
+static bool firstFrameShown = false;
+static bool firstCompleteFrameShown = false;
+static bool allModelsShown = false;
+std::string Window::shaderCacheDirectory = "shaders/cache";
+
+// frames averaged for the frame time report after a vertex layout switch;
+// off until switchVertexFormat arms it with -1
+static const int frameTimeFrames = 120;
+static int frameTimeCount = frameTimeFrames;
+static std::chrono::steady_clock::time_point frameTimeStart;
+
+// Scene, as changed by input and as drawn
+SceneState Window::scene;
+SceneState Window::drawnScene;
+TripleBuffer<SceneState> Window::snapshots;
+bool Window::threadedRender = true;
+// sequence of the newest scene published, and of the newest one taken to draw
+static uint64_t publishedSequence = 0;
+static std::atomic<uint64_t> takenSequence{ 0 };
+// a scene was taken that no frame has shown yet
+static bool drawPending = false;
+
+// Render thread
+std::thread Window::renderThread;
+std::atomic<bool> Window::renderStopping{ false };
+std::mutex Window::wakeMutex;
+std::condition_variable Window::wakeCondition;
+
+// Frame pacing
+int Window::frameCap = 0;
+int Window::swapInterval = 1;
+bool Window::sceneDirty = true;
+InteractionDelta Window::pendingInput;
+static double lastFrameTime = 0.0;
+
+// Input latency and frame intervals, recorded by the profiler
+static double lastShownInput = 0.0;
+static double lastFrameStart = 0.0;
+
+// Idle report
+double Window::idleReportSeconds = 60.0;
+static bool reportStarted = false;
+static double reportStart = 0.0;
+static double reportCpuStart = 0.0;
+// counted by whichever thread draws
+static std::atomic<int> reportFrames{ 0 };
+static int reportInputs = 0;
+
+// CPU time used by the whole process (all threads) so far
+static double processCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0.0;
+	}
+	ULARGE_INTEGER kernelTime, userTime;
+	kernelTime.LowPart = kernel.dwLowDateTime;
+	kernelTime.HighPart = kernel.dwHighDateTime;
+	userTime.LowPart = user.dwLowDateTime;
+	userTime.HighPart = user.dwHighDateTime;
+	return (kernelTime.QuadPart + userTime.QuadPart) / 1e7;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0.0;
+	}
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+		+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
 
 // Camera Matrices 
-// Projection matrix:
-glm::mat4 Window::projection; 
-
 // View Matrix:
 glm::vec3 Window::eyePos(0, 0, 20);			// Camera position.
 glm::vec3 Window::lookAtPoint(0, 0, 0);		// The point we are looking at.
@@ -23,7 +108,27 @@ glm::vec3 Window::upVector(0, 1, 0);		// The up direction of the camera.
 glm::mat4 Window::view = glm::lookAt(Window::eyePos, Window::lookAtPoint, Window::upVector);
 
 // Shader Program ID
-GLuint Window::shaderProgram;
+ShaderVariants* Window::shaderProgram;
+FrameUniformBuffer* Window::frameUniforms;
+MaterialBuffer* Window::materials;
+RenderQueue Window::renderQueue;
+TextOverlay* Window::overlay;
+
+// Stress scene
+InstanceBuffer* Window::instances;
+static const int instanceCounts[] = { 0, 100, 1000, 10000, 50000 };
+
+// Point lights
+LightClusters* Window::lightClusters;
+std::vector<PointLight> Window::pointLightField;
+std::vector<PointLight> Window::pointLights;
+static const int pointLightCounts[] = { 0, 64, 256, 1024, 4096 };
+
+// Render path
+DeferredRenderer* Window::deferred;
+
+// Shadows
+PointShadowMap* Window::shadowMap;
 
 // Interaction options
 bool Window::mouseDown;
@@ -33,26 +138,102 @@ bool Window::mode2 = false;
 bool Window::mode3 = false;
 
 bool Window::initializeProgram() {
+	std::chrono::steady_clock::time_point shaderStart = std::chrono::steady_clock::now();
+	SetShaderCacheDirectory(shaderCacheDirectory);
+
 	// Create a shader program with a vertex shader and a fragment shader.
-	shaderProgram = LoadShaders("shaders/shader.vert", "shaders/shader.frag");
+	// every variant of the shaders, compiled up front; the driver builds
+	// them while the other programs below are set up
+	shaderProgram = new ShaderVariants();
 
 	// Check the shader program.
-	if (!shaderProgram)
+	if (!shaderProgram->begin("shaders/shader.vert", "shaders/shader.frag"))
 	{
 		std::cerr << "Failed to initialize shader program" << std::endl;
 		return false;
 	}
 
+	frameUniforms = new FrameUniformBuffer();
+	materials = new MaterialBuffer();
+
+	// stats text, only drawn while profiling
+	overlay = new TextOverlay();
+	if (!overlay->load("shaders/overlay.vert", "shaders/overlay.frag"))
+	{
+		std::cerr << "Failed to initialize overlay shader program" << std::endl;
+		return false;
+	}
+
+	// the stress scene and the point lights are generated once the first
+	// scene is taken
+	instances = new InstanceBuffer();
+
+	deferred = new DeferredRenderer();
+	if (!deferred->load("shaders/deferred.vert", "shaders/shader.frag"))
+	{
+		std::cerr << "Failed to initialize deferred lighting program" << std::endl;
+		return false;
+	}
+
+	shadowMap = new PointShadowMap();
+	if (!shadowMap->load("shaders/shadow.vert", "shaders/shadow.frag"))
+	{
+		std::cerr << "Failed to initialize shadow map" << std::endl;
+		return false;
+	}
+
+	if (!shaderProgram->finish())
+	{
+		std::cerr << "Failed to initialize shader program" << std::endl;
+		return false;
+	}
+
+	// cold: all compiled from source; warm: all from the binary cache
+	ShaderLoadCounts counts = GetShaderLoadCounts();
+	double shaderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
+	const char* start = counts.compiled == 0 ? "warm" : counts.cached == 0 ? "cold" : "partly cached";
+	std::cout << "Shader setup (" << start << "): " << shaderMs << " ms, " << counts.cached
+		<< " programs from the cache, " << counts.compiled << " compiled";
+	if (counts.rejected > 0) {
+		std::cout << " (" << counts.rejected << " cached binaries rejected)";
+	}
+	std::cout << std::endl;
+
+	lightClusters = new LightClusters();
+
 	return true;
 }
 
 bool Window::initializeObjects()
 {
+	// meshes are read on the worker threads; large ones are also parsed in
+	// parallel there
+	workerPool = new ThreadPool();
+
 	bunnyPoints = new Geometry("bunny.obj", "bunny");
 	sandalPoints = new Geometry("SandalF20.obj", "sandal");
 	bearPoints = new Geometry("bear.obj", "bear");
 	spherePoints = new Geometry("sphere.obj", "sphere");
+
+	// the light sphere is tiny and stands in for meshes that are still
+	// loading, so it is ready before the first frame
+	spherePoints->loadNow(workerPool);
+	Geometry::setPlaceholder(spherePoints);
+
+	// the visible object loads in the background; the others are prefetched
+	// once it is resident
 	currObj = bunnyPoints;
+	currObj->requestLoad(workerPool);
+
+	// the scene starts where the models are
+	Geometry* models[] = { bunnyPoints, sandalPoints, bearPoints, spherePoints };
+	for (int i = 0; i < sceneModelCount; i++) {
+		scene.models[i].model = models[i]->getModel();
+		scene.models[i].transform = Transform::fromMatrix(scene.models[i].model);
+		scene.models[i].material = models[i]->getMaterial();
+	}
+	scene.current = sceneBunny;
+	scene.lightPos = Geometry::getLightPos();
 	return true;
 }
 
@@ -63,9 +244,19 @@ void Window::cleanUp()
 	delete sandalPoints;
 	delete bearPoints;
 	delete spherePoints;
-
-	// Delete the shader program.
-	glDeleteProgram(shaderProgram);
+	delete workerPool;
+	Geometry::releaseArenas();
+
+	// Delete the shader programs and their uniform buffers.
+	delete shaderProgram;
+	delete frameUniforms;
+	delete materials;
+	delete overlay;
+	delete instances;
+	delete lightClusters;
+	delete deferred;
+	delete shadowMap;
+	Profiler::reset();
 }
 
 GLFWwindow* Window::createWindow(int width, int height)
@@ -117,8 +308,8 @@ GLFWwindow* Window::createWindow(int width, int height)
 	}
 #endif
 
-	// Set swap interval to 1.
-	glfwSwapInterval(0);
+	// vsync policy
+	applySwapInterval();
 
 	// Call the resize callback to make sure things get drawn immediately.
 	Window::resizeCallback(window, width, height);
@@ -134,34 +325,455 @@ void Window::resizeCallback(GLFWwindow* window, int width, int height)
 #endif
 	Window::width = width;
 	Window::height = height;
-	// Set the viewport size.
-	glViewport(0, 0, width, height);
+	scene.width = width;
+	scene.height = height;
+	markDirty();
 
-	// Set the projection matrix.
-	Window::projection = glm::perspective(glm::radians(60.0), 
+	// Set the projection matrix; the viewport follows when the scene is drawn.
+	scene.projection = glm::perspective(glm::radians(60.0), 
 								double(width) / (double)height, 1.0, 1000.0);
 }
 
+// the window needs repainting, e.g. after being uncovered
+void Window::refreshCallback(GLFWwindow*)
+{
+	markDirty();
+}
+
+void Window::markDirty()
+{
+	sceneDirty = true;
+	reportInputs++;
+}
+
+void Window::applyPendingInput()
+{
+	if (pendingInput.events > 0) {
+		ApplyInteraction(pendingInput, scene);
+	}
+}
+
+void Window::markInput()
+{
+	markDirty();
+	// an earlier input no frame has taken yet stays the oldest
+	if (scene.inputTime == 0.0 || takenSequence >= publishedSequence) {
+		scene.inputTime = glfwGetTime();
+	}
+}
+
+// hand a copy of the scene to the renderer, and wake it if it sleeps; the
+// scene itself never goes through the lock
+void Window::publishScene()
+{
+	scene.sequence++;
+	snapshots.publish(scene);
+	publishedSequence = scene.sequence;
+	sceneDirty = false;
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+	}
+	wakeCondition.notify_one();
+}
+
+bool Window::takeScene()
+{
+	if (!snapshots.update()) {
+		return false;
+	}
+	const SceneState& next = snapshots.read();
+	takenSequence = next.sequence;
+
+	if (next.width != drawnScene.width || next.height != drawnScene.height) {
+		glViewport(0, 0, next.width, next.height);
+	}
+	Geometry* models[] = { bunnyPoints, sandalPoints, bearPoints, spherePoints };
+	for (int i = 0; i < sceneModelCount; i++) {
+		const ModelState& state = next.models[i];
+		// the normal matrix is only redone for models that moved
+		if (state.model != drawnScene.models[i].model) {
+			models[i]->setModel(state.model);
+		}
+		models[i]->setMaterial(state.material);
+		if (models[i]->showsNormals() != state.showsNormals) {
+			models[i]->switchRenderFunc();
+		}
+	}
+	Geometry::setLightPos(next.lightPos);
+	currObj = models[next.current];
+	currObj->requestLoad(workerPool);
+
+	Geometry::cullObjects = next.cullObjects;
+	Profiler::enabled = next.profiling;
+	if (next.profileDumps != drawnScene.profileDumps) {
+		dumpProfile();
+	}
+	if (next.instanceCount != drawnScene.instanceCount) {
+		setInstanceCount(next.instanceCount);
+	}
+	if (next.pointLightCount != drawnScene.pointLightCount) {
+		setPointLightCount(next.pointLightCount);
+	}
+	if (next.compactVertices != Geometry::compactVertices) {
+		switchVertexFormat();
+	}
+
+	drawnScene = next;
+	drawPending = true;
+	return true;
+}
+
+void Window::startRenderThread(GLFWwindow* window)
+{
+	// the context can only be current on one thread
+	glfwMakeContextCurrent(NULL);
+	renderStopping = false;
+	renderThread = std::thread(renderLoop, window);
+}
+
+void Window::stopRenderThread(GLFWwindow* window)
+{
+	renderStopping = true;
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+	}
+	wakeCondition.notify_one();
+	renderThread.join();
+	glfwMakeContextCurrent(window);
+}
+
+// draw whenever needsFrame says so, held to the frame cap; otherwise sleep
+// until a scene is published
+void Window::renderLoop(GLFWwindow* window)
+{
+	glfwMakeContextCurrent(window);
+	while (!renderStopping) {
+		if (!needsFrame()) {
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			wakeCondition.wait(lock, [] { return renderStopping || snapshots.hasNew(); });
+			continue;
+		}
+		if (frameCap > 0) {
+			double wait = lastFrameTime + 1.0 / frameCap - glfwGetTime();
+			if (wait > 0.0) {
+				std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+			}
+		}
+
+		// Main render display callback. Rendering of objects is done here. (Draw)
+		displayCallback(window);
+
+		// Idle callback. Updating objects, etc. can be done here. (Update)
+		idleCallback();
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+void Window::applySwapInterval()
+{
+	int interval = swapInterval;
+	if (interval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+		&& !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+		interval = 1;
+	}
+	glfwSwapInterval(interval);
+}
+
+// a scene was published since the last frame (taken here), a mesh is still
+// streaming in, or the frame time is being measured; render side
+bool Window::needsFrame()
+{
+	takeScene();
+	// moving point lights change every frame
+	if (drawnScene.renderMode == renderContinuous || drawPending || drawnScene.pointLightCount > 0) {
+		return true;
+	}
+	Geometry* models[] = { currObj, spherePoints, bunnyPoints, sandalPoints, bearPoints };
+	for (Geometry* model : models) {
+		if (model->isLoading()) {
+			return true;
+		}
+	}
+	return frameTimeCount < frameTimeFrames;
+}
+
+// process events until the next frame is due, then publish what they
+// changed; with nothing to draw this sleeps in glfwWaitEvents, waking only
+// for input or the idle report. The render thread paces itself, so with one
+// the main thread always sleeps here.
+void Window::waitForFrame()
+{
+	double now = glfwGetTime();
+	double untilReport = std::max(reportStart + idleReportSeconds - now, 0.0);
+
+	if (threadedRender || !needsFrame()) {
+		glfwWaitEventsTimeout(untilReport);
+	}
+	else if (frameCap > 0 && lastFrameTime + 1.0 / frameCap > now) {
+		glfwWaitEventsTimeout(std::min(lastFrameTime + 1.0 / frameCap - now, untilReport));
+	}
+	else {
+		glfwPollEvents();
+	}
+
+	if (sceneDirty) {
+		applyPendingInput();
+		publishScene();
+	}
+	reportIdle();
+}
+
+// print frames per minute and CPU use for every report period without input
+void Window::reportIdle()
+{
+	double now = glfwGetTime();
+	if (now - reportStart < idleReportSeconds) {
+		return;
+	}
+
+	double cpu = processCpuSeconds();
+	if (reportInputs == 0 && reportStarted) {
+		double seconds = now - reportStart;
+		std::cout << "Idle " << (scene.renderMode == renderOnDemand ? "(on demand)" : "(continuous)") << ": "
+			<< reportFrames * 60.0 / seconds << " frames per minute, CPU "
+			<< 100.0 * (cpu - reportCpuStart) / seconds << "% of one core" << std::endl;
+	}
+	reportStarted = true;
+	reportStart = now;
+	reportCpuStart = cpu;
+	reportFrames = 0;
+	reportInputs = 0;
+}
+
 void Window::idleCallback()
 {
 	// Perform any necessary updates here 
 	// currObj->update();
 }
 
+// stream loaded meshes to the GPU within the per-frame budget, the visible
+// object first
+void Window::uploadPendingMeshes()
+{
+	auto start = std::chrono::steady_clock::now();
+	Geometry* models[] = { currObj, bunnyPoints, sandalPoints, bearPoints };
+
+	bool currentResident = currObj->uploadSlice(uploadBudget);
+
+	// prefetch the other models once the visible one is up
+	if (currentResident) {
+		for (Geometry* model : models) {
+			model->requestLoad(workerPool);
+		}
+	}
+
+	for (Geometry* model : models) {
+		double spent = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (spent >= uploadBudget) {
+			break;
+		}
+		model->uploadSlice(uploadBudget - spent);
+	}
+}
+
+// print time-to-first-frame milestones as they are reached
+void Window::reportStartup()
+{
+	double sinceLaunch = std::chrono::duration<double>(std::chrono::steady_clock::now() - launchTime).count() * 1000.0;
+
+	if (!firstFrameShown) {
+		firstFrameShown = true;
+		std::cout << "Time to first frame: " << sinceLaunch << " ms" << std::endl;
+	}
+	if (!firstCompleteFrameShown && currObj->isResident()) {
+		firstCompleteFrameShown = true;
+		std::cout << "Time to first complete frame: " << sinceLaunch << " ms" << std::endl;
+	}
+	if (!allModelsShown && bunnyPoints->isResident() && sandalPoints->isResident()
+		&& bearPoints->isResident()) {
+		allModelsShown = true;
+		std::cout << "All models resident after: " << sinceLaunch << " ms" << std::endl;
+	}
+}
+
+void Window::switchVertexFormat()
+{
+	Geometry::compactVertices = !Geometry::compactVertices;
+	std::cout << "Vertex layout: " << (Geometry::compactVertices ? "compact" : "float") << std::endl;
+
+	Geometry* models[] = { bunnyPoints, sandalPoints, bearPoints };
+	for (Geometry* model : models) {
+		model->unload();
+	}
+	// the sphere is the placeholder, it has to be back before the next draw
+	spherePoints->unload();
+	spherePoints->loadNow(workerPool);
+	currObj->requestLoad(workerPool);
+
+	frameTimeCount = -1;
+}
+
+// average frame time once the visible model is resident in the new layout
+void Window::reportFrameTime()
+{
+	if (!currObj->isResident()) {
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	if (frameTimeCount < 0) {
+		frameTimeCount = 0;
+		frameTimeStart = now;
+		return;
+	}
+	if (++frameTimeCount == frameTimeFrames) {
+		double frameTime = std::chrono::duration<double>(now - frameTimeStart).count() * 1000.0 / frameTimeFrames;
+		std::cout << "Average frame time (" << (Geometry::compactVertices ? "compact" : "float")
+			<< " layout): " << frameTime << " ms" << std::endl;
+	}
+}
+
+void Window::toggleProfiler()
+{
+	scene.profiling = !scene.profiling;
+	std::cout << "Profiler: " << (scene.profiling ? "on" : "off") << std::endl;
+}
+
+void Window::dumpProfile()
+{
+	Profiler::dumpCsv("profile.csv");
+	Profiler::dumpJson("profile.json");
+}
+
+void Window::setInstanceCount(int count)
+{
+	GenerateInstanceField(*instances, count);
+	if (count > 0) {
+		std::cout << "Stress scene: " << count << " instances" << std::endl;
+	}
+	else {
+		std::cout << "Stress scene off" << std::endl;
+	}
+}
+
+void Window::setPointLightCount(int count)
+{
+	GeneratePointLights(pointLightField, count);
+	std::cout << "Point lights: " << count << std::endl;
+}
+
 void Window::displayCallback(GLFWwindow* window)
 {	
+	// input arriving while this frame is drawn is published for the next one
+	drawPending = false;
+	lastFrameTime = glfwGetTime();
+	reportFrames++;
+	Profiler::beginFrame();
+
+	// the snapshot this frame shows, stable while it is drawn
+	const SceneState& state = drawnScene;
+	const glm::mat4& projection = state.projection;
+	int width = state.width;
+	int height = state.height;
+
+	{
+		PROFILE_SCOPE("upload");
+		uploadPendingMeshes();
+	}
+
 	// Clear the color and depth buffers
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	
+	{
+		PROFILE_GPU_SCOPE("clear");
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	// per-frame constants, shared by every draw
+	FrameUniforms frame;
+	frame.view = view;
+	frame.projection = projection;
+	frame.cameraPos = glm::vec4(eyePos, 1.0f);
+	frame.lightPos = glm::vec4(Geometry::getLightPos(), 1.0f);
+
+	// bin the moving point lights for this view
+	if (state.pointLightCount > 0) {
+		PROFILE_SCOPE("light clusters");
+		AnimatePointLights(pointLightField, glfwGetTime(), pointLights);
+		lightClusters->build(pointLights, view, projection, workerPool);
+		lightClusters->upload();
+		lightClusters->bind();
+		lightClusters->setUniforms(frame, width, height);
+	}
+
+	// redraw the shadow cube where the light or the model moved
+	if (state.useShadows && state.instanceCount == 0) {
+		PROFILE_GPU_SCOPE("shadow");
+		shadowMap->update(Geometry::getLightPos(), std::vector<const Geometry*>(1, currObj));
+		shadowMap->bind();
+		shadowMap->setUniforms(frame);
+	}
+	frameUniforms->update(frame);
 
 	// Render the objects
-	currObj->draw(view, projection, shaderProgram);
-	spherePoints->draw(view, projection, shaderProgram);
+	{
+		PROFILE_GPU_SCOPE("scene");
+		// lit objects into the G-buffer and shaded from there, or forward
+		bool deferredFrame = state.useDeferred && !currObj->showsNormals()
+			&& deferred->beginGeometryPass(width, height);
+		int modelPass = deferredFrame ? renderPassGBuffer : renderPassForward;
+
+		renderQueue.clear();
+		if (state.instanceCount > 0) {
+			currObj->submitInstanced(view, projection, *shaderProgram, *instances, renderQueue, modelPass);
+		}
+		else {
+			currObj->submit(view, projection, *shaderProgram, renderQueue, modelPass);
+		}
+		spherePoints->submit(view, projection, *shaderProgram, renderQueue, renderPassForward);
+		renderQueue.sort();
+
+		if (deferredFrame) {
+			{
+				PROFILE_GPU_SCOPE("gbuffer");
+				renderQueue.execute(renderPassGBuffer);
+				deferred->endGeometryPass();
+			}
+			PROFILE_GPU_SCOPE("lighting");
+			deferred->light(view, projection);
+		}
+		renderQueue.execute(renderPassForward);
+	}
 
-	// Gets events, including input such as keyboard and mouse or window resizing
-	glfwPollEvents();
+	// stats of the frames before this one
+	if (Profiler::enabled) {
+		PROFILE_GPU_SCOPE("overlay");
+		overlay->draw(Profiler::summary(), width, height);
+	}
 
 	// Swap buffers.
-	glfwSwapBuffers(window);
+	{
+		PROFILE_SCOPE("swap");
+		glfwSwapBuffers(window);
+	}
+
+	// from the oldest input this frame shows to its swap, and from the start
+	// of the previous frame to this one's
+	static const int inputLatencySection = Profiler::section("input latency");
+	static const int frameIntervalSection = Profiler::section("frame interval");
+	if (state.inputTime > lastShownInput) {
+		Profiler::recordCpu(inputLatencySection, (glfwGetTime() - state.inputTime) * 1000.0);
+		lastShownInput = state.inputTime;
+	}
+	if (lastFrameStart > 0.0) {
+		Profiler::recordCpu(frameIntervalSection, (lastFrameTime - lastFrameStart) * 1000.0);
+	}
+	lastFrameStart = lastFrameTime;
+	Profiler::endFrame();
+
+	if (!allModelsShown) {
+		reportStartup();
+	}
+	if (frameTimeCount < frameTimeFrames) {
+		reportFrameTime();
+	}
 }
 
 void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -170,6 +782,10 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 	// Check for a key press.
 	if (action == GLFW_PRESS)
 	{
+		// drags so far go to the model and mode they were made in
+		applyPendingInput();
+		markInput();
+
 		switch (key)
 		{
 		case GLFW_KEY_ESCAPE:
@@ -179,24 +795,92 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 
 		// switch between Geometrys/objects
 		case GLFW_KEY_1:
-			currObj = bunnyPoints;
-			currObj->toRabbitMat();
-			spherePoints->toRabbitMat();
+			scene.current = sceneBunny;
+			scene.models[sceneBunny].material = materialChrome;
+			scene.models[sceneLight].material = materialChrome;
 			break;
 		case GLFW_KEY_2:
-			currObj = sandalPoints;
-			currObj->toSandalMat();
-			spherePoints->toSandalMat();
+			scene.current = sceneSandal;
+			scene.models[sceneSandal].material = materialYellowPlastic;
+			scene.models[sceneLight].material = materialYellowPlastic;
 			break;
 		case GLFW_KEY_3:
-			currObj = bearPoints;
-			currObj->toBearMat();
-			spherePoints->toBearMat();
+			scene.current = sceneBear;
+			scene.models[sceneBear].material = materialObsidian;
+			scene.models[sceneLight].material = materialObsidian;
 			break;
 
 		// switch coloring scheme (normal vs Phong)
 		case GLFW_KEY_N:
-			currObj->switchRenderFunc();
+			scene.models[scene.current].showsNormals = !scene.models[scene.current].showsNormals;
+			break;
+
+		// switch between drawing on demand and continuously
+		case GLFW_KEY_R:
+			scene.renderMode = (scene.renderMode == renderOnDemand) ? renderContinuous : renderOnDemand;
+			std::cout << "Render mode: " << (scene.renderMode == renderOnDemand ? "on demand" : "continuous")
+				<< std::endl;
+			break;
+
+		// profiler on/off, and writing out what it recorded
+		case GLFW_KEY_P:
+			toggleProfiler();
+			break;
+		case GLFW_KEY_O:
+			scene.profileDumps++;
+			break;
+
+		// next stress scene size
+		case GLFW_KEY_I:
+		{
+			int steps = sizeof(instanceCounts) / sizeof(instanceCounts[0]);
+			int next = 0;
+			for (int i = 0; i < steps; i++) {
+				if (instanceCounts[i] > scene.instanceCount) {
+					next = instanceCounts[i];
+					break;
+				}
+			}
+			scene.instanceCount = next;
+			break;
+		}
+
+		// frustum culling on/off
+		case GLFW_KEY_F:
+			scene.cullObjects = !scene.cullObjects;
+			std::cout << "Frustum culling: " << (scene.cullObjects ? "on" : "off") << std::endl;
+			break;
+
+		// forward or deferred shading
+		case GLFW_KEY_G:
+			scene.useDeferred = !scene.useDeferred;
+			std::cout << "Render path: " << (scene.useDeferred ? "deferred" : "forward") << std::endl;
+			break;
+
+		// main light shadows on/off
+		case GLFW_KEY_S:
+			scene.useShadows = !scene.useShadows;
+			std::cout << "Shadows: " << (scene.useShadows ? "on" : "off") << std::endl;
+			break;
+
+		// next point light count
+		case GLFW_KEY_L:
+		{
+			int steps = sizeof(pointLightCounts) / sizeof(pointLightCounts[0]);
+			int next = 0;
+			for (int i = 0; i < steps; i++) {
+				if (pointLightCounts[i] > scene.pointLightCount) {
+					next = pointLightCounts[i];
+					break;
+				}
+			}
+			scene.pointLightCount = next;
+			break;
+		}
+
+		// switch between float and compact vertex layouts
+		case GLFW_KEY_V:
+			scene.compactVertices = !scene.compactVertices;
 			break;
 
 		// switch between interaction modes
@@ -222,6 +906,15 @@ void Window::keyCallback(GLFWwindow* window, int key, int scancode, int action,
 	}
 }
 
+// the mode picked with Z, X and C
+InteractionMode Window::interactionMode()
+{
+	if (mode1) {
+		return interactModel;
+	}
+	return mode2 ? interactLight : interactBoth;
+}
+
 // when mouse button held down, allow object rotation on cursor move
 void Window::mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
 	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
@@ -251,56 +944,21 @@ void Window::cursor_position_callback(GLFWwindow* window, double xpos, double yp
 		if (velocity > 0.0001) {
 			glm::vec3 rotAxis = glm::cross(lastMousePoint, currPoint);
 			float rot_angle = velocity * 1.5f;
-			// rotate obj if mode1
-			if (mode1) {
-				currObj->rotateControl(rotAxis, rot_angle);
-			}
-			// rotate light about model if mode2
-			else if (mode2) {
-				spherePoints->rotateControl(rotAxis, rot_angle);
-				spherePoints->updateLight();
-			}
-			// rotate both light and model together
-			else {
-				currObj->rotateControl(rotAxis, rot_angle);
-				spherePoints->rotateControl(rotAxis, rot_angle);
-				spherePoints->updateLight();
-			}
+			RotateInteraction(interactionMode(), pendingInput, rotAxis, rot_angle);
 			lastMousePoint = currPoint;
+			markInput();
 		}
 	}
 }
 
 // map 2d point on screen to 3d point on object
 glm::vec3 Window::trackball(glm::vec2 mouseCoord) {
-	glm::vec3 v;
-	float d;
-	v.x = (2.0 * mouseCoord.x - width) / width;
-	v.y = (height - 2.0 * mouseCoord.y) / height;
-	v.z = 0.0;
-	d = glm::length(v);
-	d = (d < 1.0) ? d : 1.0;
-	v.z = sqrtf(1.001 - d * d);
-	v = glm::normalize(v);
-	return v;
+	return TrackballPoint(mouseCoord, width, height);
 }
 
 void Window::scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 	double x_off = xoffset;
 	double y_off = yoffset;
-	// scale obj if mode1
-	if (mode1) {
-		currObj->scale(y_off);
-	}
-	// move light closer to/farther from object if mode2
-	if (mode2) {
-		spherePoints->moveCloserToModel(y_off);
-		spherePoints->updateLight();
-	}
-	// scale obj and move light closer/farther from center if mode3
-	if (mode3) {
-		currObj->scale(y_off);
-		spherePoints->moveCloserToModel(y_off);
-		spherePoints->updateLight();
-	}
+	markInput();
+	ScrollInteraction(interactionMode(), pendingInput, (int)y_off);
 }
\ No newline at end of file
@@ -5,6 +5,21 @@
 #include "shader.h"
 #include "Object.h"
 #include "Geometry.h"
+#include "RenderQueue.h"
+#include "Profiler.h"
+#include "TextOverlay.h"
+#include "Interaction.h"
+#include "ClusteredLights.h"
+#include "DeferredRenderer.h"
+#include "PointShadowMap.h"
+#include "SceneState.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 class Window
 {
@@ -21,13 +36,116 @@ public:
 	static Geometry* bearPoints;
 	static Geometry* spherePoints;
 
-	// Camera Matrices
-	static glm::mat4 projection;
+	// Worker threads for loading
+	static ThreadPool* workerPool;
+	// time per frame the render thread may spend uploading loaded meshes
+	static double uploadBudget;
+	static void uploadPendingMeshes();
+
+	// Startup latency report
+	static std::chrono::steady_clock::time_point launchTime;
+	static void reportStartup();
+	// linked programs are kept here between runs, so later launches skip
+	// compiling; empty (--no-shader-cache) compiles every time
+	static std::string shaderCacheDirectory;
+
+	// Vertex layout comparison: V reloads every model in the other layout and
+	// the average frame time over the next frames is printed
+	static void switchVertexFormat();
+	static void reportFrameTime();
+
+	// Scene: input handling changes scene on the main thread and publishes a
+	// copy of it after each batch of events; frames are drawn from the
+	// newest copy (drawnScene), which the render thread takes through the
+	// lock-free triple buffer without ever waiting for the main thread.
+	// With threadedRender off (--single-thread) both run on the main thread
+	// as before, drawing between the batches of events.
+	static SceneState scene;
+	static SceneState drawnScene;
+	static TripleBuffer<SceneState> snapshots;
+	static bool threadedRender;
+	static void publishScene();
+	// render side: take the newest published scene and apply what changed;
+	// returns whether there was one
+	static bool takeScene();
+
+	// Render thread: owns the GL context while it runs. When nothing needs
+	// drawing it sleeps until the next publish.
+	static std::thread renderThread;
+	static std::atomic<bool> renderStopping;
+	static std::mutex wakeMutex;
+	static std::condition_variable wakeCondition;
+	static void startRenderThread(GLFWwindow* window);
+	static void stopRenderThread(GLFWwindow* window);
+	static void renderLoop(GLFWwindow* window);
+
+	// Frame pacing: on demand, a frame is drawn only after something changed
+	// and the main thread otherwise blocks in glfwWaitEvents; continuous
+	// draws every iteration. Both are held to frameCap frames per second if
+	// it is set.
+	enum RenderMode { renderOnDemand, renderContinuous };
+	static int frameCap;
+	// glfwSwapInterval value: 0 no vsync, 1 vsync, -1 adaptive vsync where
+	// the driver supports it (falls back to 1)
+	static int swapInterval;
+	// scene changed since it was last published (main thread)
+	static bool sceneDirty;
+	// drags and scrolls since the scene was last published, applied to it
+	// in one go just before
+	static InteractionDelta pendingInput;
+	static void applyPendingInput();
+	static void markDirty();
+	// the change came from input: its time is kept for the input latency,
+	// measured from the event to the return of the swap that shows it
+	static void markInput();
+	static bool needsFrame();
+	static void waitForFrame();
+	static void applySwapInterval();
+
+	// frames and CPU use over each idle minute
+	static double idleReportSeconds;
+	static void reportIdle();
+
+	// Camera Matrices; the projection is part of the scene
 	static glm::mat4 view;
 	static glm::vec3 eyePos, lookAtPoint, upVector;
 
-	// Shader Program ID
-	static GLuint shaderProgram;
+	// Shader Program variants, the per-frame uniforms and the material table
+	static ShaderVariants* shaderProgram;
+	static FrameUniformBuffer* frameUniforms;
+	static MaterialBuffer* materials;
+	// the frame's draws, sorted by state and depth before they are issued
+	static RenderQueue renderQueue;
+
+	// Profiler: P turns timing and the stats overlay on and off, O writes
+	// the recorded frames to profile.csv and profile.json
+	static TextOverlay* overlay;
+	static void toggleProfiler();
+	static void dumpProfile();
+
+	// Stress scene: with scene.instanceCount > 0 the current model is drawn
+	// as a field of that many instances in one instanced draw call; I steps
+	// through the counts in instanceCounts
+	static InstanceBuffer* instances;
+	static void setInstanceCount(int count);
+
+	// Point lights: scene.pointLightCount lights circle the model, binned
+	// into view space clusters every frame so each fragment only shades the
+	// lights near it; L steps through the counts in pointLightCounts
+	static LightClusters* lightClusters;
+	static std::vector<PointLight> pointLightField;
+	static std::vector<PointLight> pointLights;
+	static void setPointLightCount(int count);
+
+	// Render path (scene.useDeferred): forward shades every fragment as it
+	// is drawn; deferred writes a G-buffer and shades each pixel once. G
+	// switches between them; normal coloring is always drawn forward
+	static DeferredRenderer* deferred;
+
+	// Shadows of the main light (scene.useShadows), cast by the current
+	// model (not by the stress scene); the cube is only redrawn where the
+	// light or the model moved. S turns them on and off
+	static PointShadowMap* shadowMap;
 
 	// Constructors and Destructors
 	static bool initializeProgram();
@@ -37,6 +155,7 @@ public:
 	// Window functions
 	static GLFWwindow* createWindow(int width, int height);
 	static void resizeCallback(GLFWwindow* window, int width, int height);
+	static void refreshCallback(GLFWwindow* window);
 
 	// Draw and Update functions
 	static void idleCallback();
@@ -54,6 +173,7 @@ public:
 	static bool mode1;
 	static bool mode2;
 	static bool mode3;
+	static InteractionMode interactionMode();
 };
 
 #endif
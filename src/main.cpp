@@ -14,6 +14,9 @@ void setup_callbacks(GLFWwindow* window)
 	// Set the window resize callback.
 	glfwSetWindowSizeCallback(window, Window::resizeCallback);
 
+	// Redraw when the window contents are damaged.
+	glfwSetWindowRefreshCallback(window, Window::refreshCallback);
+
 	// Set the key callback.
 	glfwSetKeyCallback(window, Window::keyCallback);
 
@@ -54,8 +57,65 @@ void print_versions()
 
 
 
-int main(void)
+// --continuous      draw every iteration instead of on demand
+// --fps N           cap the frame rate at N (0 = uncapped)
+// --vsync N         swap interval: 0 off, 1 on, -1 adaptive
+// --profile         start with the profiler and its overlay on
+// --instances N     start with a stress scene of N instances
+// --lights N        start with N point lights
+// --deferred        start with the deferred render path
+// --no-shadows      start without main light shadows
+// --single-thread   draw on the main thread between event batches
+// --no-shader-cache compile every shader instead of loading cached programs
+// --no-mesh-arena   give every mesh buffers and VAOs of its own
+void parse_arguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--continuous") {
+			Window::scene.renderMode = Window::renderContinuous;
+		}
+		else if (arg == "--fps" && i + 1 < argc) {
+			Window::frameCap = atoi(argv[++i]);
+		}
+		else if (arg == "--vsync" && i + 1 < argc) {
+			Window::swapInterval = atoi(argv[++i]);
+		}
+		else if (arg == "--instances" && i + 1 < argc) {
+			Window::scene.instanceCount = atoi(argv[++i]);
+		}
+		else if (arg == "--lights" && i + 1 < argc) {
+			Window::scene.pointLightCount = atoi(argv[++i]);
+		}
+		else if (arg == "--deferred") {
+			Window::scene.useDeferred = true;
+		}
+		else if (arg == "--no-shadows") {
+			Window::scene.useShadows = false;
+		}
+		else if (arg == "--single-thread") {
+			Window::threadedRender = false;
+		}
+		else if (arg == "--no-shader-cache") {
+			Window::shaderCacheDirectory.clear();
+		}
+		else if (arg == "--no-mesh-arena") {
+			Geometry::useMeshArena = false;
+		}
+		else if (arg == "--profile") {
+			Window::scene.profiling = true;
+		}
+		else {
+			std::cerr << "Unknown argument " << arg << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv)
 {
+	// Frame pacing options.
+	parse_arguments(argc, argv);
+
 	// Create the GLFW window.
 	GLFWwindow* window = Window::createWindow(640, 480);
 	if (!window) 
@@ -78,16 +138,33 @@ int main(void)
 	if (!Window::initializeObjects()) 
 		exit(EXIT_FAILURE);
 	
+	// The first scene to draw; the render thread takes over the context.
+	Window::publishScene();
+	if (Window::threadedRender)
+		Window::startRenderThread(window);
+
 	// Loop while GLFW window should stay open.
 	while (!glfwWindowShouldClose(window))
 	{
-		// Main render display callback. Rendering of objects is done here. (Draw)
-		Window::displayCallback(window);
-
-		// Idle callback. Updating objects, etc. can be done here. (Update)
-		Window::idleCallback();
+		if (!Window::threadedRender && Window::needsFrame())
+		{
+			// Main render display callback. Rendering of objects is done here. (Draw)
+			Window::displayCallback(window);
+
+			// Idle callback. Updating objects, etc. can be done here. (Update)
+			Window::idleCallback();
+		}
+
+		// Gets events, including input such as keyboard and mouse or window
+		// resizing, and publishes the scene they changed; blocks while there
+		// is nothing to draw.
+		Window::waitForFrame();
 	}
 
+	// the context comes back to this thread for the clean up
+	if (Window::threadedRender)
+		Window::stopRenderThread(window);
+
 	// destroy objects created
 	Window::cleanUp();
 
@@ -1,107 +1,357 @@
 #include "shader.h"
 
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <system_error>
+
 enum ShaderType { vertex, fragment };
 
-GLuint LoadSingleShader(const char * shaderFilePath, ShaderType type) 
+// On-disk layout of a .progbin file: this header followed by the binary
+// glGetProgramBinary returned.
+struct ProgramCacheHeader
 {
-	// Create a shader id.
-	GLuint shaderID = 0;
-	if (type == vertex) 
-		shaderID = glCreateShader(GL_VERTEX_SHADER);
-	else if (type == fragment) 
-		shaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	char magic[8];
+	uint32_t version;
+	uint32_t binaryFormat;
+	uint64_t key;
+	uint64_t length;
+};
+
+static const char programCacheMagic[8] = { 'P', 'R', 'O', 'G', 'B', 'I', 'N', 0 };
+static const uint32_t programCacheVersion = 1;
+
+static std::string cacheDirectory;
+static ShaderLoadCounts loadCounts;
 
-	// Try to read shader codes from the shader file.
-	std::string shaderCode;
-	std::ifstream shaderStream(shaderFilePath, std::ios::in);
-	if (shaderStream.is_open()) 
+// 64-bit FNV-1a
+static uint64_t HashBytes(const std::string& bytes)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : bytes)
 	{
-		std::string Line = "";
-		while (getline(shaderStream, Line))
-			shaderCode += "\n" + Line;
-		shaderStream.close();
+		hash ^= c;
+		hash *= 1099511628211ull;
 	}
-	else 
+	return hash;
+}
+
+// The shader's source with the defines after the #version line, and a
+// #line after them so compile errors still point at lines of the file.
+static bool ReadShaderSource(const char * shaderFilePath, const std::vector<std::string>& defines, std::string& shaderCode)
+{
+	std::ifstream shaderStream(shaderFilePath, std::ios::in | std::ios::binary);
+	if (!shaderStream.is_open())
 	{
 		std::cerr << "Impossible to open " << shaderFilePath << ". "
 			<< "Check to make sure the file exists and you passed in the "
 			<< "right filepath!"
 			<< std::endl;
-		return 0;
+		return false;
+	}
+	std::ostringstream contents;
+	contents << shaderStream.rdbuf();
+	shaderCode = contents.str();
+	if (defines.empty())
+		return true;
+
+	size_t lineStart = 0;
+	for (int lineNumber = 1; lineStart < shaderCode.size(); lineNumber++)
+	{
+		size_t lineEnd = std::min(shaderCode.find('\n', lineStart), shaderCode.size());
+		if (shaderCode.compare(lineStart, 8, "#version") == 0)
+		{
+			std::string inserted;
+			for (const std::string& define : defines)
+				inserted += "\n#define " + define;
+			inserted += "\n#line " + std::to_string(lineNumber + 1);
+			shaderCode.insert(lineEnd, inserted);
+			break;
+		}
+		lineStart = lineEnd + 1;
+	}
+	return true;
+}
+
+static void PrintShaderName(const char * shaderFilePath, const std::vector<std::string>& defines)
+{
+	std::cerr << shaderFilePath;
+	for (const std::string& define : defines)
+		std::cerr << " " << define;
+	std::cerr << std::endl;
+}
+
+// what a binary from glGetProgramBinary is only good for
+static const std::string& DriverString()
+{
+	static std::string driver;
+	if (driver.empty())
+	{
+		const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+		for (GLenum name : names)
+		{
+			const GLubyte* value = glGetString(name);
+			driver += value ? (const char*)value : "";
+			driver += "\n";
+		}
+	}
+	return driver;
+}
+
+// program binaries need GL 4.1 or ARB_get_program_binary, and a driver
+// that offers at least one format
+static bool BinariesSupported()
+{
+	static int supported = -1;
+	if (supported < 0)
+	{
+#ifdef __APPLE__
+		bool extension = true;
+#else
+		bool extension = GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary;
+#endif
+		GLint formats = 0;
+		if (extension)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0;
 	}
+	return supported != 0;
+}
 
+// with KHR_parallel_shader_compile (or the ARB version), let the driver
+// use as many threads as it likes; false if neither is there
+static bool ParallelCompile()
+{
+	static int parallel = -1;
+	if (parallel < 0)
+	{
+		parallel = 0;
+#ifndef __APPLE__
+		if (GLEW_KHR_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+			parallel = 1;
+		}
+		else if (GLEW_ARB_parallel_shader_compile)
+		{
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			parallel = 1;
+		}
+#endif
+	}
+	return parallel != 0;
+}
+
+// a linked program from the cache file, or 0 if there is none for the key
+// or the driver turns it down
+static GLuint LoadCachedProgram(const std::string& cacheFile, uint64_t key)
+{
+	std::ifstream cacheStream(cacheFile, std::ios::in | std::ios::binary);
+	if (!cacheStream.is_open())
+		return 0;
+	ProgramCacheHeader header;
+	if (!cacheStream.read((char*)&header, sizeof(header))
+		|| memcmp(header.magic, programCacheMagic, sizeof(header.magic)) != 0
+		|| header.version != programCacheVersion || header.key != key
+		|| header.length == 0 || header.length > (1u << 30))
+		return 0;
+	std::vector<char> binary(header.length);
+	if (!cacheStream.read(binary.data(), (std::streamsize)binary.size()))
+		return 0;
+	cacheStream.close();
+
+	GLuint programID = glCreateProgram();
+	glProgramBinary(programID, header.binaryFormat, binary.data(), (GLsizei)binary.size());
 	GLint Result = GL_FALSE;
-	int InfoLogLength;
+	glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE)
+	{
+		// e.g. built by another driver version; compiled again and replaced
+		glDeleteProgram(programID);
+		std::error_code error;
+		std::filesystem::remove(cacheFile, error);
+		loadCounts.rejected++;
+		return 0;
+	}
+	return programID;
+}
+
+// written under a temporary name and renamed, so no run reads half a file
+static void StoreCachedProgram(GLuint programID, const std::string& cacheFile, uint64_t key)
+{
+	GLint length = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(programID, length, &length, &binaryFormat, binary.data());
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, programCacheMagic, sizeof(header.magic));
+	header.version = programCacheVersion;
+	header.binaryFormat = binaryFormat;
+	header.key = key;
+	header.length = (uint64_t)length;
 
-	// Compile Shader.
-	std::cerr << "Compiling shader: " << shaderFilePath << std::endl;
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(cacheFile).parent_path(), error);
+	std::string tempFile = cacheFile + ".tmp";
+	std::ofstream cacheStream(tempFile, std::ios::binary | std::ios::trunc);
+	cacheStream.write((const char*)&header, sizeof(header));
+	cacheStream.write(binary.data(), length);
+	cacheStream.close();
+	if (cacheStream)
+		std::filesystem::rename(tempFile, cacheFile, error);
+	if (!cacheStream || error)
+	{
+		std::cerr << "Can't write the program cache " << cacheFile << std::endl;
+		std::filesystem::remove(tempFile, error);
+	}
+}
+
+// Start compiling; the status is not asked for, since that would wait for
+// the driver. FinishLoadShaders reports errors once the link is done.
+static GLuint CompileShader(const char * shaderFilePath, ShaderType type, const std::string& shaderCode,
+	const std::vector<std::string>& defines)
+{
+	GLuint shaderID = glCreateShader(type == vertex ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER);
+	std::cerr << "Compiling shader: ";
+	PrintShaderName(shaderFilePath, defines);
 	char const * sourcePointer = shaderCode.c_str();
 	glShaderSource(shaderID, 1, &sourcePointer, NULL);
 	glCompileShader(shaderID);
-	
-	// Check Shader.
+	return shaderID;
+}
+
+// the compile errors of a shader, if it failed
+static void PrintShaderErrors(GLuint shaderID, ShaderType type)
+{
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &Result);
 	glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) 
+	if (Result != GL_TRUE && InfoLogLength > 0)
 	{
 		std::vector<char> shaderErrorMessage(InfoLogLength + 1);
 		glGetShaderInfoLog(shaderID, InfoLogLength, NULL, shaderErrorMessage.data());
 		std::string msg(shaderErrorMessage.begin(), shaderErrorMessage.end());
-		std::cerr << msg << std::endl;
-		return 0;
+		std::cerr << (type == vertex ? "Vertex" : "Fragment") << " shader: " << msg << std::endl;
 	}
-	else 
+}
+
+bool BeginLoadShaders(const char * vertexFilePath, const char * fragmentFilePath, const std::vector<std::string>& defines,
+	PendingProgram& pending)
+{
+	pending = PendingProgram();
+	std::string vertexCode, fragmentCode;
+	if (!ReadShaderSource(vertexFilePath, defines, vertexCode) || !ReadShaderSource(fragmentFilePath, defines, fragmentCode))
+		return false;
+
+	if (!cacheDirectory.empty() && BinariesSupported())
 	{
-		if (type == vertex)
-			printf("Successfully compiled vertex shader!\n");
-		else if (type == fragment) 
-			printf("Successfully compiled fragment shader!\n");
+		pending.cacheKey = HashBytes(vertexCode + '\0' + fragmentCode + '\0' + DriverString());
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.progbin", (unsigned long long)pending.cacheKey);
+		pending.cacheFile = cacheDirectory + "/" + name;
+		pending.program = LoadCachedProgram(pending.cacheFile, pending.cacheKey);
+		if (pending.program)
+		{
+			pending.cached = true;
+			std::cerr << "Loaded cached program: " << vertexFilePath << " ";
+			PrintShaderName(fragmentFilePath, defines);
+			return true;
+		}
 	}
 
-	return shaderID;
+	ParallelCompile();
+	pending.vertexShader = CompileShader(vertexFilePath, vertex, vertexCode, defines);
+	pending.fragmentShader = CompileShader(fragmentFilePath, fragment, fragmentCode, defines);
+
+	pending.program = glCreateProgram();
+	if (!pending.cacheFile.empty())
+		glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glAttachShader(pending.program, pending.vertexShader);
+	glAttachShader(pending.program, pending.fragmentShader);
+	glLinkProgram(pending.program);
+	return true;
 }
 
-GLuint LoadShaders(const char * vertexFilePath, const char * fragmentFilePath) 
+bool ShadersReady(const PendingProgram& pending)
 {
-	// Create the vertex shader and fragment shader.
-	GLuint vertexShaderID = LoadSingleShader(vertexFilePath, vertex);
-	GLuint fragmentShaderID = LoadSingleShader(fragmentFilePath, fragment);
+	if (pending.cached || !ParallelCompile())
+		return true;
+#ifndef __APPLE__
+	GLint done = GL_FALSE;
+	glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+#else
+	return true;
+#endif
+}
 
-	// Check both shaders.
-	if (vertexShaderID == 0 || fragmentShaderID == 0) return 0;
+GLuint FinishLoadShaders(PendingProgram& pending)
+{
+	GLuint programID = pending.program;
+	if (pending.cached)
+	{
+		loadCounts.cached++;
+		pending = PendingProgram();
+		return programID;
+	}
 
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
-	// Link the program.
-	printf("Linking program\n");
-	GLuint programID = glCreateProgram();
-	glAttachShader(programID, vertexShaderID);
-	glAttachShader(programID, fragmentShaderID);
-	glLinkProgram(programID);
-
 	// Check the program.
 	glGetProgramiv(programID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) 
+	if (Result != GL_TRUE)
 	{
-		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-		glGetProgramInfoLog(programID, InfoLogLength, NULL, ProgramErrorMessage.data());
-		std::string msg(ProgramErrorMessage.begin(), ProgramErrorMessage.end());
-		std::cerr << msg << std::endl;
+		PrintShaderErrors(pending.vertexShader, vertex);
+		PrintShaderErrors(pending.fragmentShader, fragment);
+		glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if (InfoLogLength > 0)
+		{
+			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+			glGetProgramInfoLog(programID, InfoLogLength, NULL, ProgramErrorMessage.data());
+			std::string msg(ProgramErrorMessage.begin(), ProgramErrorMessage.end());
+			std::cerr << msg << std::endl;
+		}
+		glDeleteShader(pending.vertexShader);
+		glDeleteShader(pending.fragmentShader);
 		glDeleteProgram(programID);
+		pending = PendingProgram();
 		return 0;
 	}
-	else
-	{
-		printf("Successfully linked program!\n");
-	}
-
 	// Detach and delete the shaders as they are no longer needed.
-	glDetachShader(programID, vertexShaderID);
-	glDetachShader(programID, fragmentShaderID);
-	glDeleteShader(vertexShaderID);
-	glDeleteShader(fragmentShaderID);
+	glDetachShader(programID, pending.vertexShader);
+	glDetachShader(programID, pending.fragmentShader);
+	glDeleteShader(pending.vertexShader);
+	glDeleteShader(pending.fragmentShader);
 
+	if (!pending.cacheFile.empty())
+		StoreCachedProgram(programID, pending.cacheFile, pending.cacheKey);
+	loadCounts.compiled++;
+	pending = PendingProgram();
 	return programID;
 }
+
+GLuint LoadShaders(const char * vertexFilePath, const char * fragmentFilePath, const std::vector<std::string>& defines)
+{
+	PendingProgram pending;
+	if (!BeginLoadShaders(vertexFilePath, fragmentFilePath, defines, pending))
+		return 0;
+	return FinishLoadShaders(pending);
+}
+
+void SetShaderCacheDirectory(const std::string& directory)
+{
+	cacheDirectory = directory;
+}
+
+ShaderLoadCounts GetShaderLoadCounts()
+{
+	return loadCounts;
+}
@@ -8,12 +8,60 @@
 #endif
 
 #include <stdio.h>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 
-GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path);
+// Compile and link a program. Each entry of defines ("NAME" or "NAME value")
+// becomes a #define after the #version line of both shaders, to build
+// specialized variants of the same source.
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path,
+	const std::vector<std::string>& defines = std::vector<std::string>());
+
+// A program being built. With KHR_parallel_shader_compile the driver
+// compiles and links on its own threads after BeginLoadShaders returns, so
+// many programs can be started before the first is waited for.
+struct PendingProgram
+{
+	GLuint program = 0;
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+	// the program was restored from the binary cache, not compiled
+	bool cached = false;
+	// where its binary is stored once linked, and the hash it is stored
+	// under; empty without a cache
+	std::string cacheFile;
+	uint64_t cacheKey = 0;
+};
+
+// start building a program, from the binary cache if it holds it; false if
+// a source can't be read
+bool BeginLoadShaders(const char * vertex_file_path, const char * fragment_file_path,
+	const std::vector<std::string>& defines, PendingProgram& pending);
+// whether FinishLoadShaders would return without waiting for the driver
+bool ShadersReady(const PendingProgram& pending);
+// wait for the link, report errors, store the binary, and return the
+// program (0 if it failed)
+GLuint FinishLoadShaders(PendingProgram& pending);
+
+// Linked programs are kept between runs as driver binaries
+// (glGetProgramBinary) in this directory, keyed by a hash of both sources
+// with their defines and of the driver's vendor, renderer and version. A
+// binary the driver rejects is compiled from source again. Empty, the
+// default, compiles every program.
+void SetShaderCacheDirectory(const std::string& directory);
+
+// programs loaded so far, for the startup report
+struct ShaderLoadCounts
+{
+	int cached = 0;
+	int compiled = 0;
+	// cached binaries the driver refused
+	int rejected = 0;
+};
+ShaderLoadCounts GetShaderLoadCounts();
 
 #endif
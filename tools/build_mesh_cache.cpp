@@ -0,0 +1,83 @@
+// Offline .meshbin builder.
+//
+// Parses, welds, optimizes, normalizes and simplifies each OBJ file exactly as
+// Geometry does and writes the binary cache next to it, so the first launch already
+// starts warm. Run from the repository root:
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc tools/build_mesh_cache.cpp src/MeshLod.cpp src/Mesh.cpp src/MeshPreprocess.cpp src/VertexWeld.cpp src/MeshOptimizer.cpp src/MeshCache.cpp src/ObjReader.cpp src/MappedFile.cpp src/ThreadPool.cpp -o build_mesh_cache
+//   ./build_mesh_cache [--no-optimize] [--no-lods] [file.obj ...]     (defaults to the models the app loads)
+
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshLod.h"
+#include "MeshPreprocess.h"
+#include "VertexWeld.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files;
+	bool optimize = true;
+	bool lods = true;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--no-optimize") == 0) {
+			optimize = false;
+		}
+		else if (strcmp(argv[i], "--no-lods") == 0) {
+			lods = false;
+		}
+		else {
+			files.push_back(argv[i]);
+		}
+	}
+	if (files.empty()) {
+		files = { "bunny.obj", "SandalF20.obj", "bear.obj", "sphere.obj" };
+	}
+
+	ThreadPool pool;
+	int failures = 0;
+
+	for (const std::string& file : files) {
+		MeshData mesh;
+		WeldStats weld;
+		OptimizeStats optimized;
+		std::string cacheFilename = MeshCachePath(file);
+
+		bool loaded = LoadMesh(file, mesh, &pool, &weld);
+		// same typical view as Geometry: camera on +z
+		if (loaded && optimize) {
+			OptimizeMesh(mesh, glm::vec3(0.0f, 0.0f, 1.0f), &optimized);
+		}
+		if (loaded && lods) {
+			BuildMeshLods(mesh, &pool);
+		}
+		uint32_t flags = (optimize ? meshCacheOptimized : 0) | (lods ? meshCacheLods : 0);
+		// Geometry's default preprocessing
+		uint32_t preprocessKey = MeshPreprocessKey(MeshPreprocessOptions());
+		if (!loaded || !WriteMeshCache(cacheFilename, file, mesh, flags, preprocessKey)) {
+			fprintf(stderr, "%s: skipped\n", file.c_str());
+			failures++;
+			continue;
+		}
+
+		size_t triangles = mesh.lods.empty() ? mesh.faces.size() : (size_t)mesh.lods[0].faceCount;
+		printf("%s -> %s (%zu vertices, %zu triangles; welded from %zu corners, %.1f%%)\n", file.c_str(),
+			cacheFilename.c_str(), mesh.points.size(), triangles, weld.corners,
+			weld.corners ? 100.0 * weld.vertices / weld.corners : 0.0);
+		if (optimize) {
+			printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %zu overdraw clusters\n", optimized.before.acmr,
+				optimized.after.acmr, optimized.before.atvr, optimized.after.atvr, optimized.clusters);
+		}
+		for (size_t l = 1; l < mesh.lods.size(); l++) {
+			printf("  LOD %zu: %u triangles, error %.4f\n", l, mesh.lods[l].faceCount, mesh.lods[l].error);
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}